@@ -0,0 +1,20 @@
+#include "bench.h"
+
+int main(void) {
+    static long a[4096];
+    for (long i = 0; i <= 4095; i++) a[i] = i;
+    long sink = 0;
+    bench_t b;
+    bench_init(&b, "array_sum", 100);
+    while (bench_next(&b)) {
+        for (int r = 1; r <= 100; r++) {
+            long s = 0;
+            for (long i = 0; i <= 4095; i++) s += a[i];
+            sink += s;
+            __asm__ volatile("" : : "r"(a) : "memory");  /* one sum per round, like VYL */
+        }
+    }
+    bench_report(&b);
+    printf("%ld\n", sink);
+    return 0;
+}
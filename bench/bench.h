@@ -0,0 +1,80 @@
+/*
+ * C side of the VYL benchmark harness: the same protocol as the Bench,
+ * BenchNext and BenchReport builtins, so `vyl bench` can hold each kernel
+ * against its C baseline sample for sample.
+ *
+ *     bench_t b;
+ *     bench_init(&b, "fib", 1000);
+ *     while (bench_next(&b)) { ...1000 ops... }
+ *     bench_report(&b);
+ *
+ * VYL_BENCH_WARMUP and VYL_BENCH_SAMPLES override the sample counts.
+ */
+#ifndef VYL_BENCH_H
+#define VYL_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_WARMUP 3
+#define BENCH_DEFAULT_SAMPLES 30
+
+typedef struct {
+    const char *name;
+    long ops, warmup, wanted, taken, start;
+    long *samples;
+} bench_t;
+
+static long bench_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static long bench_env(const char *name, long fallback) {
+    const char *value = getenv(name);
+    long n = value ? strtol(value, NULL, 10) : -1;
+    return n < 0 ? fallback : n;
+}
+
+static void bench_init(bench_t *b, const char *name, long ops) {
+    b->name = name;
+    b->ops = ops > 0 ? ops : 1;
+    b->warmup = bench_env("VYL_BENCH_WARMUP", BENCH_DEFAULT_WARMUP);
+    b->wanted = bench_env("VYL_BENCH_SAMPLES", BENCH_DEFAULT_SAMPLES);
+    if (b->wanted == 0) b->wanted = 1;
+    b->taken = 0;
+    b->start = 0;
+    b->samples = calloc(b->wanted, sizeof(long));
+}
+
+static int bench_next(bench_t *b) {
+    long now = bench_ns();
+    if (b->start) {
+        if (b->warmup > 0) b->warmup--;
+        else b->samples[b->taken++] = now - b->start;
+    }
+    if (b->taken >= b->wanted) return 0;
+    b->start = bench_ns();
+    return 1;
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_report(bench_t *b) {
+    long n = b->taken;
+    if (n == 0) return;
+    qsort(b->samples, n, sizeof(long), bench_cmp);
+    long median = b->samples[n / 2];
+    long p99 = b->samples[(n * 99 + 99) / 100 - 1];
+    long rate = median ? (long)((unsigned __int128)b->ops * 1000000000u / median) : 0;
+    printf("{\"bench\":\"%s\",\"samples\":%ld,\"ops\":%ld,\"median_ns\":%ld,\"p99_ns\":%ld,\"min_ns\":%ld,\"ops_per_sec\":%ld}\n",
+           b->name, n, b->ops, median, p99, b->samples[0], rate);
+    free(b->samples);
+}
+
+#endif
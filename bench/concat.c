@@ -0,0 +1,33 @@
+#include <string.h>
+#include "bench.h"
+
+/* Immutable strings like VYL's: every + allocates the result */
+static char *concat(const char *a, size_t alen, const char *b, size_t blen) {
+    char *s = malloc(alen + blen + 1);
+    memcpy(s, a, alen);
+    memcpy(s + alen, b, blen + 1);
+    return s;
+}
+
+int main(void) {
+    long sink = 0;
+    bench_t b;
+    bench_init(&b, "concat", 100);
+    while (bench_next(&b)) {
+        for (int i = 1; i <= 100; i++) {
+            char *s = concat("", 0, "", 0);
+            size_t len = 0;
+            for (int j = 1; j <= 64; j++) {
+                char *next = concat(s, len, "abc", 3);
+                free(s);
+                s = next;
+                len += 3;
+            }
+            sink += (long)strlen(s);
+            free(s);
+        }
+    }
+    bench_report(&b);
+    printf("%ld\n", sink);
+    return 0;
+}
@@ -0,0 +1,24 @@
+#include "bench.h"
+
+static long fib_iter(long n) {
+    if (n <= 1) return n;
+    long a = 0, b = 1;
+    for (long i = 2; i <= n; i++) {
+        long t = a + b;
+        a = b;
+        b = t;
+    }
+    return b;
+}
+
+int main(void) {
+    long sink = 0;
+    bench_t b;
+    bench_init(&b, "fib", 1000);
+    while (bench_next(&b)) {
+        for (long i = 0; i <= 999; i++) sink += fib_iter(80 + i / 100);
+    }
+    bench_report(&b);
+    printf("%ld\n", sink);
+    return 0;
+}
@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include "bench.h"
+
+/* Open addressing with linear probing, the layout VYL's Map uses */
+#define CAPACITY 2048
+
+typedef struct { long key, value; int used; } Slot;
+static Slot table[CAPACITY];
+
+static size_t slot_of(long key) {
+    uint64_t h = (uint64_t)key * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 53);  /* top 11 bits: CAPACITY slots */
+}
+
+static void put(long key, long value) {
+    size_t i = slot_of(key);
+    while (table[i].used && table[i].key != key) i = (i + 1) & (CAPACITY - 1);
+    table[i].key = key;
+    table[i].value = value;
+    table[i].used = 1;
+}
+
+__attribute__((noinline)) static long get(long key) {
+    size_t i = slot_of(key);
+    while (table[i].used) {
+        if (table[i].key == key) return table[i].value;
+        i = (i + 1) & (CAPACITY - 1);
+    }
+    return 0;
+}
+
+int main(void) {
+    for (long i = 0; i <= 1023; i++) put(i * 7919, i);
+    long sink = 0;
+    bench_t b;
+    bench_init(&b, "hash_lookup", 1024);
+    while (bench_next(&b)) {
+        for (long i = 0; i <= 1023; i++) sink += get(i * 7919);
+    }
+    bench_report(&b);
+    printf("%ld\n", sink);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include "bench.h"
+
+/* The same fields as http_parse.vyl, read in place through pointers */
+__attribute__((noinline)) static long parse_request(const char *req, size_t len) {
+    const char *end = memmem(req, len, "\r\n", 2);
+    const char *sp = memchr(req, ' ', end - req);
+    size_t method = sp - req;
+    const char *path = sp + 1;
+    size_t path_len = (const char *)memchr(path, ' ', end - path) - path;
+    long headers = 0, length = 0;
+    const char *pos = end + 2, *stop = req + len;
+    for (;;) {
+        const char *eol = memmem(pos, stop - pos, "\r\n", 2);
+        if (!eol || eol == pos) break;
+        const char *colon = memmem(pos, eol - pos, ": ", 2);
+        if (colon && colon - pos == 14 && memcmp(pos, "Content-Length", 14) == 0) {
+            length = 0;
+            for (const char *c = colon + 2; c < eol; c++) length = length * 10 + (*c - '0');
+        }
+        headers++;
+        pos = eol + 2;
+    }
+    return (long)method + (long)path_len + headers + length;
+}
+
+int main(void) {
+    const char *req = "POST /api/v1/items?limit=20 HTTP/1.1\r\nHost: example.com\r\nUser-Agent: vyl-bench/1.0\r\n"
+                      "Accept: application/json\r\nContent-Type: application/json\r\nContent-Length: 1337\r\n"
+                      "Connection: keep-alive\r\n\r\n";
+    size_t len = strlen(req);
+    long sink = 0;
+    bench_t b;
+    bench_init(&b, "http_parse", 100);
+    while (bench_next(&b)) {
+        for (int i = 1; i <= 100; i++) {
+            __asm__ volatile("" : "+r"(req));  /* parse every time, like VYL */
+            sink += parse_request(req, len);
+        }
+    }
+    bench_report(&b);
+    printf("%ld\n", sink);
+    return 0;
+}
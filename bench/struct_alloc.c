@@ -0,0 +1,26 @@
+#include "bench.h"
+
+typedef struct { long x, y; } Point;
+
+__attribute__((noinline)) static Point *make_point(long x, long y) {
+    Point *p = malloc(sizeof(Point));
+    p->x = x;
+    p->y = y;
+    return p;
+}
+
+int main(void) {
+    long sink = 0;
+    bench_t b;
+    bench_init(&b, "struct_alloc", 1000);
+    while (bench_next(&b)) {
+        for (long i = 1; i <= 1000; i++) {
+            Point *p = make_point(i, i + 1);
+            sink += p->x + p->y;
+            free(p);
+        }
+    }
+    bench_report(&b);
+    printf("%ld\n", sink);
+    return 0;
+}
@@ -12,6 +12,6 @@ long fib_iter(long n) {
 }
 
 int main() {
-    printf("%ld\n", fib_iter(1000));
+    printf("%ld\n", fib_iter(40));
     return 0;
 }
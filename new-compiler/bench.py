@@ -0,0 +1,208 @@
+"""
+VYL Benchmarks - `vyl bench`: time kernels against their C baselines
+
+A kernel is a .vyl file, by default every one in the repository's bench/
+directory, with an optional C baseline of the same name next to it. Kernels
+time themselves through the Bench builtins (bench/bench.h for C) and print
+one JSON line per benchmark; a program that prints none, such as
+examples/benchmark.vyl, is timed as a whole process instead.
+
+    vyl bench                                  # bench/*.vyl against bench/*.c
+    vyl bench examples/benchmark.vyl           # one program, whole-process timing
+    vyl bench --json out.json                  # keep the results
+    vyl bench --max-slowdown 50                # fail if a kernel is >50% slower than C
+    vyl bench --baseline out.json              # fail if a kernel regressed >10% since
+
+Every run gets the same VYL_BENCH_WARMUP / VYL_BENCH_SAMPLES, so both sides
+of a comparison drop the same warmup samples and take the same number.
+"""
+
+import argparse
+import contextlib
+import io
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+from typing import Callable, Dict, List, Optional, Tuple
+
+try:
+    from .cache import default_cache_dir
+except ImportError:
+    from cache import default_cache_dir
+
+BENCH_DIR = Path(__file__).resolve().parent.parent / "bench"
+RESULTS_VERSION = 1
+RUN_TIMEOUT = 600
+C_FLAGS = ["-O2"]
+
+
+def discover(paths: List[str]) -> List[Tuple[Path, Optional[Path]]]:
+    """(kernel, C baseline or None) for each .vyl file named or found in a
+    named directory; bench/ when nothing is named."""
+    kernels = []
+    for path in map(Path, paths or [str(BENCH_DIR)]):
+        sources = sorted(path.glob("*.vyl")) if path.is_dir() else [path]
+        for source in sources:
+            baseline = source.with_suffix(".c")
+            kernels.append((source, baseline if baseline.is_file() else None))
+    return kernels
+
+
+def build_vyl(compile_vyl: Callable[..., bool], source: Path, output: Path, opt_level: int) -> bool:
+    log = io.StringIO()
+    with contextlib.redirect_stdout(log):
+        ok = compile_vyl(source.read_text(), str(output), source_path=str(source),
+                         opt_level=opt_level, cache_dir=str(default_cache_dir()))
+    if not ok:
+        print(log.getvalue(), end="")
+    return ok
+
+
+def build_c(source: Path, output: Path) -> bool:
+    cmd = ["gcc", *C_FLAGS, "-I", str(BENCH_DIR), str(source), "-o", str(output)]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr, end="")
+    return result.returncode == 0
+
+
+def summarize(name: str, samples: List[int], ops: int = 1) -> Dict:
+    """The record a BenchReport line carries, for samples timed out here."""
+    samples = sorted(samples)
+    n = len(samples)
+    median = samples[n // 2]
+    return {"bench": name, "samples": n, "ops": ops, "median_ns": median,
+            "p99_ns": samples[(n * 99 + 99) // 100 - 1], "min_ns": samples[0],
+            "ops_per_sec": ops * 1_000_000_000 // median if median else 0}
+
+
+def run(binary: Path, name: str, warmup: int, samples: int) -> List[Dict]:
+    """Every benchmark a binary reports, or one for the whole process when
+    it reports none."""
+    env = dict(os.environ, VYL_BENCH_WARMUP=str(warmup), VYL_BENCH_SAMPLES=str(samples))
+
+    def once() -> str:
+        result = subprocess.run([str(binary)], capture_output=True, text=True, env=env, timeout=RUN_TIMEOUT)
+        if result.returncode != 0:
+            raise RuntimeError(f"{binary.name} exited with {result.returncode}")
+        return result.stdout
+
+    records = []
+    for line in once().splitlines():
+        if line.startswith("{"):
+            try:
+                record = json.loads(line)
+            except ValueError:
+                continue
+            if "bench" in record:
+                records.append(record)
+    if records:
+        return records
+
+    # Whole-process timing; the run above was the first warmup
+    times = []
+    for _ in range(max(warmup - 1, 0) + max(samples, 1)):
+        start = time.perf_counter_ns()
+        once()
+        times.append(time.perf_counter_ns() - start)
+    return [summarize(name, times[max(warmup - 1, 0):])]
+
+
+def compare(results: List[Dict], max_slowdown: Optional[float], baseline: Optional[Dict],
+            max_regression: float) -> List[str]:
+    """The gate failures, one message each."""
+    failures = []
+    before = {r["bench"]: r for r in (baseline or {}).get("results", [])}
+    for r in results:
+        if max_slowdown is not None and r.get("ratio") is not None and r["ratio"] > 1 + max_slowdown / 100:
+            failures.append(f"{r['bench']}: {(r['ratio'] - 1) * 100:.0f}% slower than C (limit {max_slowdown:g}%)")
+        old = before.get(r["bench"])
+        if old and old["vyl"]["median_ns"]:
+            growth = r["vyl"]["median_ns"] / old["vyl"]["median_ns"] - 1
+            if growth > max_regression / 100:
+                failures.append(f"{r['bench']}: median {growth * 100:.0f}% above the baseline "
+                                f"(limit {max_regression:g}%)")
+    return failures
+
+
+def _ns(value: int) -> str:
+    for unit, scale in (("s", 1_000_000_000), ("ms", 1_000_000), ("us", 1_000)):
+        if value >= scale:
+            return f"{value / scale:.2f} {unit}"
+    return f"{value} ns"
+
+
+def report(results: List[Dict]) -> None:
+    print(f"{'benchmark':<16}{'median':>12}{'p99':>12}{'ops/s':>14}{'C median':>12}{'vs C':>8}")
+    for r in results:
+        vyl, c = r["vyl"], r.get("c")
+        line = f"{r['bench']:<16}{_ns(vyl['median_ns']):>12}{_ns(vyl['p99_ns']):>12}{vyl['ops_per_sec']:>14,}"
+        if c:
+            line += f"{_ns(c['median_ns']):>12}{r['ratio']:>7.2f}x"
+        print(line)
+
+
+def bench_main(argv: List[str], compile_vyl: Callable[..., bool]) -> int:
+    """`vyl bench`; main passes its compile_vyl in. Returns the exit status."""
+    parser = argparse.ArgumentParser(prog="vyl bench", description="Run VYL benchmarks against their C baselines")
+    parser.add_argument("paths", nargs="*", help=f"Kernels or directories of kernels (default: {BENCH_DIR})")
+    parser.add_argument("-O", dest="opt_level", type=int, choices=[0, 1, 2], default=2,
+                        help="Optimization level for the VYL kernels (default: 2)")
+    parser.add_argument("--warmup", type=int, default=3, help="Samples dropped before timing (default: 3)")
+    parser.add_argument("--samples", type=int, default=30, help="Samples timed per benchmark (default: 30)")
+    parser.add_argument("--no-c", action="store_true", help="Skip the C baselines")
+    parser.add_argument("--json", metavar="FILE", help="Write the results as JSON ('-' for stdout)")
+    parser.add_argument("--max-slowdown", type=float, metavar="PCT",
+                        help="Fail when a kernel's median is more than PCT%% above its C baseline")
+    parser.add_argument("--baseline", metavar="FILE", help="Results of an earlier --json run to check for regressions")
+    parser.add_argument("--max-regression", type=float, default=10.0, metavar="PCT",
+                        help="Fail when a median grew more than PCT%% over --baseline (default: 10)")
+    args = parser.parse_args(argv)
+
+    kernels = discover(args.paths)
+    if not kernels:
+        print("Error: no benchmarks found")
+        return 1
+    results = []
+    with tempfile.TemporaryDirectory(prefix="vyl-bench-") as tmp:
+        for source, baseline in kernels:
+            binary = Path(tmp) / source.stem
+            if not build_vyl(compile_vyl, source, binary, args.opt_level):
+                print(f"Error: {source} failed to compile")
+                return 1
+            c_records = {}
+            if baseline and not args.no_c:
+                c_binary = Path(tmp) / f"{source.stem}.c.out"
+                if not build_c(baseline, c_binary):
+                    print(f"Error: {baseline} failed to compile")
+                    return 1
+            try:
+                if baseline and not args.no_c:
+                    c_records = {r["bench"]: r for r in run(c_binary, source.stem, args.warmup, args.samples)}
+                records = run(binary, source.stem, args.warmup, args.samples)
+            except (RuntimeError, subprocess.TimeoutExpired) as e:
+                print(f"Error: {e}")
+                return 1
+            for record in records:
+                c = c_records.get(record["bench"])
+                results.append({"bench": record["bench"], "source": str(source), "vyl": record, "c": c,
+                                "ratio": record["median_ns"] / c["median_ns"] if c and c["median_ns"] else None})
+
+    report(results)
+    document = {"version": RESULTS_VERSION, "opt_level": args.opt_level, "warmup": args.warmup,
+                "samples": args.samples, "results": results}
+    if args.json == "-":
+        json.dump(document, sys.stdout, indent=2)
+        print()
+    elif args.json:
+        Path(args.json).write_text(json.dumps(document, indent=2) + "\n")
+
+    previous = json.loads(Path(args.baseline).read_text()) if args.baseline else None
+    failures = compare(results, args.max_slowdown, previous, args.max_regression)
+    for failure in failures:
+        print(f"FAIL {failure}")
+    return 1 if failures else 0
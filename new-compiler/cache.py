@@ -0,0 +1,112 @@
+"""
+VYL Build Cache - reuse front-end and codegen results across builds
+
+Every source file is its own compilation unit. Its AST is stored under the
+SHA-256 of the file's text; a program's assembly, or its per-module objects,
+under the hashes of all of its units plus the options that shape codegen.
+Every key also covers the compiler itself (a digest of its own sources, so a
+version bump or a local edit of any pass misses instead of reusing stale
+output); the runtime archive depends on nothing else.
+
+Layout, below ``~/.vyl/cache`` or ``$VYL_CACHE_DIR``:
+    ast/<key>     pickled Program of one module, as the parser produced it
+    asm/<key>     assembly text of one program
+    obj/<key>     object file of one module within one program
+    rt/<key>      libvylrt.a, the runtime, which only the compiler changes
+
+Entries are written to a temporary file and renamed into place, so parallel
+builds never see half an entry; anything unreadable counts as a miss.
+"""
+
+import hashlib
+import os
+import pickle
+import tempfile
+from functools import lru_cache
+from pathlib import Path
+from typing import Any, Optional
+
+COMPILER_DIR = Path(__file__).resolve().parent
+
+
+def default_cache_dir() -> Path:
+    """The cache root: $VYL_CACHE_DIR, else ~/.vyl/cache."""
+    override = os.environ.get("VYL_CACHE_DIR")
+    return Path(override) if override else Path.home() / ".vyl" / "cache"
+
+
+@lru_cache(maxsize=None)
+def compiler_fingerprint() -> str:
+    """Digest of the compiler's own sources, part of every cache key."""
+    digest = hashlib.sha256()
+    for path in sorted(COMPILER_DIR.glob("*.py")):
+        digest.update(path.name.encode())
+        digest.update(path.read_bytes())
+    return digest.hexdigest()
+
+
+def content_hash(text: str) -> str:
+    return hashlib.sha256(text.encode()).hexdigest()
+
+
+class BuildCache:
+    """Content-addressed store of ASTs and assembly under one directory."""
+
+    def __init__(self, root: Path):
+        self.root = Path(root)
+        self.hits = 0
+        self.misses = 0
+
+    def key(self, *parts: str) -> str:
+        digest = hashlib.sha256(compiler_fingerprint().encode())
+        for part in parts:
+            digest.update(b"\0")
+            digest.update(part.encode())
+        return digest.hexdigest()
+
+    def _path(self, kind: str, key: str) -> Path:
+        return self.root / kind / key
+
+    def path(self, kind: str, key: str) -> Optional[Path]:
+        """Where an entry lives, for tools that read files; None on a miss."""
+        path = self._path(kind, key)
+        if path.is_file():
+            self.hits += 1
+            return path
+        self.misses += 1
+        return None
+
+    def load(self, kind: str, key: str) -> Optional[Any]:
+        try:
+            data = self._path(kind, key).read_bytes()
+            if kind == "ast":
+                value = pickle.loads(data)
+            elif kind == "asm":
+                value = data.decode()
+            else:
+                value = data
+        except Exception:
+            self.misses += 1
+            return None
+        self.hits += 1
+        return value
+
+    def store(self, kind: str, key: str, value: Any) -> None:
+        """Best effort: a full disk or an unpicklable AST just skips the entry."""
+        path = self._path(kind, key)
+        tmp = None
+        try:
+            if kind == "ast":
+                data = pickle.dumps(value, pickle.HIGHEST_PROTOCOL)
+            elif kind == "asm":
+                data = value.encode()
+            else:
+                data = value
+            path.parent.mkdir(parents=True, exist_ok=True)
+            fd, tmp = tempfile.mkstemp(dir=path.parent, prefix=".tmp-")
+            with os.fdopen(fd, "wb") as f:
+                f.write(data)
+            os.replace(tmp, path)
+        except Exception:
+            if tmp and os.path.exists(tmp):
+                os.unlink(tmp)
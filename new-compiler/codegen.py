@@ -1,8 +1,9 @@
 """
 VYL Code Generator - Generates x86-64 assembly from AST
 """
+import struct
 from dataclasses import dataclass
-from typing import Dict, List, Optional, Tuple
+from typing import Dict, List, Optional, Set, Tuple
 
 try:
     from .parser import (
@@ -26,6 +27,7 @@ try:
         IndexExpr,
         NewExpr,
         ArrayLiteral,
+        ConstArray,
         EnumDef,
         EnumAccess,
         MethodDef,
@@ -33,13 +35,20 @@ try:
         SelfExpr,
         AddressOf,
         Dereference,
+        AwaitExpr,
+        SpawnExpr,
         NullLiteral,
         TupleLiteral,
         TupleUnpack,
         InterfaceDef,
         InterpString,
         TryExpr,
+        BoundsCheck,
+        ArrayClone,
     )
+    from .regalloc import CALLEE_SAVED_REGS, allocate_registers, is_call_node, parse_interp_parts
+    from .generics import chan_elem_type, map_key_kind, map_type_args, task_result_type
+    from .escape import EscapeAnalysis
 except ImportError:  # pragma: no cover - fallback for direct execution
     from parser import (
         Program,
@@ -62,6 +71,7 @@ except ImportError:  # pragma: no cover - fallback for direct execution
         IndexExpr,
         NewExpr,
         ArrayLiteral,
+        ConstArray,
         EnumDef,
         EnumAccess,
         MethodDef,
@@ -69,19 +79,171 @@ except ImportError:  # pragma: no cover - fallback for direct execution
         SelfExpr,
         AddressOf,
         Dereference,
+        AwaitExpr,
+        SpawnExpr,
         NullLiteral,
         TupleLiteral,
         TupleUnpack,
         InterfaceDef,
         InterpString,
         TryExpr,
+        BoundsCheck,
+        ArrayClone,
     )
+    from regalloc import CALLEE_SAVED_REGS, allocate_registers, is_call_node, parse_interp_parts
+    from generics import chan_elem_type, map_key_kind, map_type_args, task_result_type
+    from escape import EscapeAnalysis
 
 
 class CodegenError(Exception):
     """Raised when code generation fails."""
 
 
+def dec_bits(value) -> int:
+    """IEEE-754 double bit pattern of value, as a signed 64-bit integer."""
+    return struct.unpack("<q", struct.pack("<d", float(value)))[0]
+
+
+# Condition-code suffixes (for jcc/setcc) of the signed integer comparisons
+CONDITION_CODES = {"==": "e", "!=": "ne", "<": "l", ">": "g", "<=": "le", ">=": "ge"}
+INVERSE_CONDITION = {"e": "ne", "ne": "e", "l": "ge", "ge": "l", "g": "le", "le": "g",
+                     "a": "be", "be": "a", "ae": "b", "b": "ae"}
+# ucomisd sets the flags like an unsigned compare; < and <= swap the operands
+# so that an unordered (NaN) compare is false for every ordering operator
+DEC_CONDITION_CODES = {">": "a", ">=": "ae", "<": "a", "<=": "ae"}
+# System V passes the first eight floating-point arguments in SSE registers
+DEC_ARG_REGS = [f"%xmm{i}" for i in range(8)]
+
+# Marks an object as not needing an executable stack; without it ld warns
+# and falls back to one
+STACK_NOTE = '.section .note.GNU-stack,"",@progbits'
+
+# Builtins whose result is a string, so + concatenates and ==/!= compare bytes
+STRING_BUILTINS = frozenset({
+    "GetArg", "Read", "SHA256", "Input", "GetEnv", "StrConcat", "Substring",
+    "ReadDir", "TcpRecv", "TcpResolve", "TlsRecv", "HttpGet", "Build",
+    "MapFile", "ReadLine", "ReadChunk", "HttpRead",
+})
+# Initial StringBuilder buffer; Append doubles it as needed
+SB_MIN_CAPACITY = 32
+# Output buffer: [next writer, fd, bytes pending, FILE* or 0] then the data
+WRITER_HEADER_SIZE = 32
+WRITER_BUFFER_SIZE = 65536
+# CopyFile moves up to this much per copy_file_range/sendfile call and falls
+# back to read/write through a buffer of COPY_BUFFER_SIZE
+COPY_CHUNK_SIZE = 1 << 30
+COPY_BUFFER_SIZE = 1 << 20
+# RemoveAll reads directories with getdents64 into a buffer this large
+DENTS_BUFFER_SIZE = 32768
+# Unzip inflates each entry through an output buffer of this size
+UNZIP_BUFFER_SIZE = 1 << 18
+ZSTREAM_SIZE = 112
+# LineReader: [fd, start, end, line string, FILE*] then the read buffer
+READER_HEADER_SIZE = 48
+READER_BUFFER_SIZE = 65536
+# MapFile puts the string header on its own page just below the file bytes
+PAGE_SIZE = 4096
+# Resolved addresses are reused for this long: [next, expires, port, host,
+# family, socktype, protocol, addrlen] then room for a sockaddr_in6
+DNS_TTL_SECONDS = 60
+DNS_ADDR_SIZE = 32
+DNS_ENTRY_SIZE = 48 + DNS_ADDR_SIZE
+# HTTP connection: [next, host, tls, fd, SSL*, start, end, body mode, remaining,
+# keep-alive, status, done, chunk CRLF pending, body string, Location, reused]
+# then the receive buffer. Body modes: 0 until close, 1 Content-Length, 2 chunked.
+HTTP_CONN_HEADER_SIZE = 128
+HTTP_BUFFER_SIZE = 65536
+# Task record, at the top of the task's own stack: [saved rsp (0 while it
+# runs), done, detached, result, waiter, run-queue next, all-tasks next,
+# all-tasks prev, entry, 6 args, lock, I/O wait result]
+TASK_SIZE = 144
+TASK_STACK_SIZE = 1 << 18
+TASK_STACK_CACHE = 64          # finished stacks kept for the next spawn
+TASK_MMAP_FLAGS = 0x24022      # MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK
+# Scheduler worker, one per OS thread: [run-queue lock, head, tail, count,
+# pthread_t, its thread-local free lists, stack bounds it publishes for a
+# collection (rsp, top), index]. Spawn starts them on first use.
+WORKER_SIZE = 128
+SCHED_MAX_WORKERS = 256
+SCHED_STACK_SIZE = 1 << 16     # Main's scheduler context; workers use their own stack
+GC_STOP_SIGNAL = 23            # SIGURG: ignored by default, so a stray one is harmless
+# Channel: [capacity, mask, closed, lock, receivers head/tail, senders
+# head/tail], the send and receive positions on cache lines of their own, then
+# capacity cells of [sequence, value] (a bounded multi-producer queue)
+CHAN_HEADER_SIZE = 192
+CHAN_MIN_CAPACITY = 2
+TCP_LISTEN_BACKLOG = 4096
+# Bench: [name, ops per sample, warmup samples left, samples wanted, samples
+# taken, start of the running sample], then one nanosecond count per sample
+BENCH_HEADER_SIZE = 48
+BENCH_DEFAULT_WARMUP = 3
+BENCH_DEFAULT_SAMPLES = 30
+# --profile-alloc: every allocating call site gets a [allocs, bytes, name, 0]
+# record in this section; the linker's __start_/__stop_ symbols bound them all
+PROF_SITE_SECTION = "vyl_alloc_sites"
+PROF_SITE_SIZE = 32
+PROF_PAUSE_BUCKETS = 24        # GC pauses by power of two of 1024 ns, up to ~8.6 s
+# Call targets that may allocate on the caller's behalf, so get a site tag
+PROF_TAGGED_CALLS = ("vyl_", "__async_", "__spawn_")
+# --perf-map: a [start, size, name] record per function in this section, which
+# vyl_perf_map_write copies to /tmp/perf-<pid>.map for perf
+PERF_MAP_SECTION = "vyl_perf_map"
+PERF_MAP_RECORD_SIZE = 24
+PERF_MAP_PATH_SIZE = 64
+EPOLL_BATCH = 64               # readiness events taken per epoll_wait
+EPOLL_EVENT_SIZE = 12          # struct epoll_event is packed on x86-64
+# Arrays keep [capacity, length] just before their data; Push grows from here
+ARRAY_HEADER_SIZE = 16
+VEC_MIN_CAPACITY = 4
+# Map handle: [slots, capacity, count, used]; slots are flat [hash, key, value]
+# triples probed linearly. Hash 0 marks an empty slot and 1 a deleted one.
+MAP_HEADER_SIZE = 32
+MAP_SLOT_SIZE = 24
+MAP_MIN_CAPACITY = 8
+# Tuples of up to three words are returned in registers, not as heap objects
+TUPLE_RETURN_REGS = ("%rax", "%rdx", "%rcx")
+# vyl_cpu_features bits, filled from CPUID at startup
+CPU_SSE42 = 1
+CPU_AVX2 = 2
+# Array kernels: builtin -> (int[] routine, dec[] routine); see generate_simd_runtime
+ARRAY_KERNELS = {
+    "ArraySum": ("vyl_sum_i64", "vyl_sum_f64"),
+    "ArrayMin": ("vyl_min_i64", "vyl_min_f64"),
+    "ArrayMax": ("vyl_max_i64", "vyl_max_f64"),
+    "ArrayFind": ("vyl_find_i64", "vyl_find_i64"),
+    "ArrayFill": ("vyl_fill_i64", "vyl_fill_i64"),
+    "ArrayCopy": ("vyl_array_copy", "vyl_array_copy"),
+}
+# Packed (AVX, SSE2) instructions of the element-wise operators vectorized loops use
+VECTOR_INSTRUCTIONS = {
+    "int": {"+": ("vpaddq", "paddq"), "-": ("vpsubq", "psubq")},
+    "dec": {"+": ("vaddpd", "addpd"), "-": ("vsubpd", "subpd"),
+            "*": ("vmulpd", "mulpd"), "/": ("vdivpd", "divpd")},
+}
+
+# Managed heap layout. vyl_alloc carves 64 KiB pages out of one reserved
+# address range; every span (a small-object page or a multi-page large object)
+# starts with a header holding its slot size and the alloc/mark bitmaps, and a
+# page table maps any interior pointer back to that header in O(1).
+GC_PAGE_SHIFT = 16
+GC_PAGE_SIZE = 1 << GC_PAGE_SHIFT
+GC_RESERVE = 1 << 34           # address space reserved on first allocation
+GC_MIN_RESERVE = 1 << 28       # smallest reservation tried before giving up
+GC_ALLOC_BITS = 64             # header offset of the allocation bitmap
+GC_MARK_BITS = 576             # header offset of the mark bitmap
+GC_HEADER_SIZE = 1088          # header + two bitmaps (one bit per 16-byte granule)
+GC_SIZE_CLASSES = (
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024, 1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096,
+    5120, 6144, 7168, 8192,
+)
+GC_MMAP_FLAGS = 0x4022         # MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+
+# Region allocator: nested @arena scopes tracked exactly, then saturating
+ARENA_MAX_DEPTH = 256
+ARENA_MIN_CHUNK = 4096
+
+
 @dataclass
 class Symbol:
     name: str
@@ -94,11 +256,19 @@ class Symbol:
 
 
 class CodeGenerator:
-    def __init__(self):
+    def __init__(self, opt_level: int = 1, profile_alloc: bool = False, perf_map: bool = False,
+                 sources: Optional[List[str]] = None):
+        self.opt_level = opt_level
+        self.profile_alloc = profile_alloc
+        self.perf_map = perf_map
+        self.sources = sources or []  # source file of each unit, for .file/.loc
+        self.unchecked_depth = 0  # > 0 inside @unchecked functions and blocks
+        self.arena_depth = 0  # @arena blocks open in the current function
         self.output: List[str] = []
         self.label_counter = 0
         self.current_function: Optional[str] = None
         self.current_struct: Optional[StructDef] = None
+        self.return_type: Optional[str] = None
         self.current_function_end_label: Optional[str] = None  # For early returns (e.g., ? operator)
         self.locals: Dict[str, Symbol] = {}
         self.params: Dict[str, Symbol] = {}
@@ -108,16 +278,112 @@ class CodeGenerator:
         self.struct_layouts: Dict[str, dict] = {}
         self.enum_values: Dict[str, Dict[str, int]] = {}
         self.defer_stack: List[DeferStmt] = []  # Stack of deferred statements
+        self.escapes: Optional[EscapeAnalysis] = None
+        self.stack_objects: Dict[int, int] = {}  # id(allocation node) -> frame offset
+        self.tuple_return = 0  # words the current function returns in TUPLE_RETURN_REGS
+        self.tail_label: Optional[str] = None  # jump target of self tail calls
+        self.spawned: Set[str] = set()  # functions that need a __spawn_ entry
+        self.current_line = 0  # source line of the statement being generated
+        self.expr_kind: Optional[str] = None  # node type of the innermost expression
+        self.alloc_sites: Dict[Tuple[str, int, str, str], str] = {}  # --profile-alloc
+        self.current_file = 0  # .file number of the function being generated, 0 for none
+        self.loc_line = 0  # line of the last .loc, so a line gets only one
+        self.perf_symbols: List[Tuple[str, str]] = []  # (function, end label) for --perf-map
+        self.static_data: Dict[str, List[str]] = {}  # section -> compile-time values laid out there
 
     # ---------- helpers ----------
     def emit(self, line: str):
+        if self.profile_alloc and self.current_function and line.startswith("call ") \
+                and line[5:].startswith(PROF_TAGGED_CALLS):
+            # Charge whatever the callee allocates to this site; a store of an
+            # immediate, so no register changes, not even at safepoints
+            self.output.append(f"movq ${self._alloc_site(line[5:])}, {self.tls('vyl_prof_site')}")
         self.output.append(line)
 
+    def _alloc_site(self, callee: str) -> str:
+        key = (self.current_function, self.current_line, self.expr_kind or "statement", callee)
+        label = self.alloc_sites.get(key)
+        if label is None:
+            label = f".Lalloc_site{len(self.alloc_sites)}"
+            self.alloc_sites[key] = label
+        return label
+
+    def _emit_alloc_sites(self):
+        self.emit(f".section {PROF_SITE_SECTION},\"aw\"")
+        self.emit(".balign 8")
+        for label in self.alloc_sites.values():
+            self.emit(f"{label}: .quad 0, 0, {label}_name, 0")
+        self.emit(".section .rodata")
+        for (function, line, kind, callee), label in self.alloc_sites.items():
+            self.emit(f"{label}_name: .asciz \"{function}:{line} {kind} ({callee})\"")
+
+    def _emit_perf_map(self):
+        self.emit(f".section {PERF_MAP_SECTION},\"aw\"")
+        self.emit(".balign 8")
+        for name, end in self.perf_symbols:
+            self.emit(f".quad {name}, {end} - {name}, .Lperf_name_{name}")
+        self.emit(".section .rodata")
+        for name, _ in self.perf_symbols:
+            self.emit(f".Lperf_name_{name}: .asciz \"{name}\"")
+
+    def _emit_loc(self, line: int, column: int = 0):
+        """Line-table entry for the code that follows, when it starts a new
+        source line; gas turns these into .debug_line."""
+        if self.current_file and line and line != self.loc_line:
+            self.loc_line = line
+            self.emit(f".loc {self.current_file} {line} {column}")
+
     def get_label(self, prefix: str = ".L") -> str:
+        # Always assembler-local: a symbol would split its function in perf
+        # and debugger backtraces
+        if not prefix.startswith("."):
+            prefix = f".L{prefix}"
         lbl = f"{prefix}{self.label_counter}"
         self.label_counter += 1
         return lbl
 
+    @staticmethod
+    def tls(name: str) -> str:
+        """Operand for this thread's copy of a thread-local runtime variable."""
+        return f"%fs:{name}@tpoff"
+
+    def _emit_tls_address(self, name: str, reg: str):
+        self.emit(f"movq %fs:0, {reg}")
+        self.emit(f"leaq {name}@tpoff({reg}), {reg}")
+
+    def _emit_safepoint(self):
+        """Leave a no-collection region; stop here if a collection asked to."""
+        done = self.get_label(".Lsafe")
+        self.emit(f"decq {self.tls('vyl_gc_busy')}")
+        self.emit(f"jnz {done}")
+        self.emit(f"cmpq $0, {self.tls('vyl_gc_pending')}")
+        self.emit(f"je {done}")
+        self.emit("call vyl_gc_park")
+        self.emit(f"{done}:")
+
+    def _emit_spin_lock(self, lock: str):
+        """Take a runtime spinlock; clobbers rax. The holder cannot be stopped
+        for a collection until _emit_spin_unlock, so it never stalls one."""
+        retry = self.get_label(".Llock")
+        spin = self.get_label(".Llock")
+        held = self.get_label(".Llock")
+        self.emit(f"incq {self.tls('vyl_gc_busy')}")
+        self.emit(f"{retry}:")
+        self.emit("movl $1, %eax")
+        self.emit(f"xchgq %rax, {lock}")
+        self.emit("testq %rax, %rax")
+        self.emit(f"jz {held}")
+        self.emit(f"{spin}:")
+        self.emit("pause")
+        self.emit(f"cmpq $0, {lock}")
+        self.emit(f"jne {spin}")
+        self.emit(f"jmp {retry}")
+        self.emit(f"{held}:")
+
+    def _emit_spin_unlock(self, lock: str):
+        self.emit(f"movq $0, {lock}")
+        self._emit_safepoint()
+
     def escape_string(self, content: str) -> str:
         return (
             content.replace("\\", "\\\\")
@@ -145,8 +411,12 @@ class CodeGenerator:
         """Infer the type of an expression for variable declarations."""
         if isinstance(expr, Literal):
             return expr.literal_type  # 'int', 'string', 'bool', 'dec'
-        if isinstance(expr, FunctionCall):
-            if expr.name in ("GetArg", "Read", "SHA256", "Input", "GetEnv", "StrConcat", "Substring"):
+        if self._is_dec_operand(expr):
+            return "dec"
+        if self._is_async_call(expr) or isinstance(expr, SpawnExpr):
+            return f"Task<{self._awaited_type(expr) or 'int'}>"
+        if isinstance(expr, (FunctionCall, AwaitExpr)):
+            if self._is_string_operand(expr):
                 return "string"
             return "int"  # Default for function calls
         if isinstance(expr, BinaryExpr):
@@ -163,34 +433,249 @@ class CodeGenerator:
             return "int"
         return "int"  # Default fallback
 
-    def _expr_is_stringish(self, node) -> bool:
-        """Check if an expression evaluates to a string type."""
+    def _is_dec_operand(self, node) -> bool:
+        """Expressions whose value is a double (its bits travel in general registers)."""
+        if isinstance(node, Literal):
+            return node.literal_type == "dec"
+        if isinstance(node, Identifier):
+            sym = self.get_variable_symbol(node.name)
+            return bool(sym and sym.typ == "dec")
+        if isinstance(node, FieldAccess):
+            return self._field_type(node) == "dec"
+        if isinstance(node, IndexExpr):
+            return self._static_type(node.receiver) == "dec[]"
+        if isinstance(node, UnaryExpr):
+            return node.operator == "-" and self._is_dec_operand(node.operand)
+        if isinstance(node, BinaryExpr):
+            if node.operator not in ("+", "-", "*", "/") or self._is_string_operand(node):
+                return False
+            return self._is_dec_operand(node.left) or self._is_dec_operand(node.right)
+        if isinstance(node, FunctionCall):
+            if node.name == "ToDec":
+                return True
+            if node.name == "Sqrt":
+                return bool(node.arguments) and self._is_dec_operand(node.arguments[0])
+            if node.name == "Pop" and node.arguments:
+                return self._static_type(node.arguments[0]) == "dec[]"
+            if node.name == "MapGet" and node.arguments:
+                args = map_type_args(self._static_type(node.arguments[0]))
+                return bool(args and args[1] == "dec")
+            if node.name in ("ArraySum", "ArrayMin", "ArrayMax") and node.arguments:
+                return self._static_type(node.arguments[0]) == "dec[]"
+            if node.name == "ChanRecv" and node.arguments:
+                return chan_elem_type(self._static_type(node.arguments[0])) == "dec"
+            func_def = self.function_defs.get(node.name)
+            return bool(func_def and func_def.return_type == "dec")
+        if isinstance(node, MethodCall):
+            return self._method_return_type(node) == "dec"
+        if isinstance(node, TryExpr):
+            return self._is_dec_operand(node.operand)
+        return False
+
+    def _static_type(self, node) -> Optional[str]:
+        """Declared type of a variable or field expression, when known."""
+        if isinstance(node, Identifier):
+            sym = self.get_variable_symbol(node.name)
+            return sym.typ if sym else None
+        if isinstance(node, SelfExpr):
+            return self.current_struct.name if self.current_struct else None
+        if isinstance(node, FieldAccess):
+            return self._field_type(node)
+        return None
+
+    def _field_type(self, node: FieldAccess) -> Optional[str]:
+        layout = self.struct_layouts.get(self._static_type(node.receiver) or "")
+        field_info = layout["fields"].get(node.field) if layout else None
+        return field_info[0] if field_info else None
+
+    def _method_return_type(self, node: MethodCall) -> Optional[str]:
+        methods = self.method_table.get(self._receiver_struct(node.receiver) or "", {})
+        method = methods.get(node.method_name)
+        return method.return_type if method else None
+
+    def generate_converted(self, expr, target_type: Optional[str]):
+        """Evaluate expr into %rax, widening an int to dec for a dec destination."""
+        self.generate_expression(expr)
+        if target_type == "dec" and not self._is_dec_operand(expr):
+            self.emit("cvtsi2sdq %rax, %xmm0")
+            self.emit("movq %xmm0, %rax")
+
+    def _is_string_operand(self, node) -> bool:
+        """Operands that make ==/!= compare contents and + concatenate."""
         if isinstance(node, Literal) and node.literal_type == "string":
             return True
-        if isinstance(node, FunctionCall) and node.name in ("GetArg", "Read", "SHA256", "Input", "GetEnv", "StrConcat", "Substring"):
-            return True
+        if isinstance(node, FunctionCall):
+            if node.name in STRING_BUILTINS:
+                return True
+            func_def = self.function_defs.get(node.name)
+            if func_def and func_def.return_type == "string" and not func_def.is_async:
+                return True
+            if node.name == "MapGet" and node.arguments and isinstance(node.arguments[0], Identifier):
+                sym = self.get_variable_symbol(node.arguments[0].name)
+                args = map_type_args(sym.typ if sym else None)
+                return bool(args and args[1] == "string")
+            if node.name == "ChanRecv" and node.arguments:
+                return chan_elem_type(self._static_type(node.arguments[0])) == "string"
         if isinstance(node, Identifier):
             sym = self.get_variable_symbol(node.name)
             if sym and sym.typ == "string":
                 return True
+        if isinstance(node, InterpString):
+            return True
+        if isinstance(node, AwaitExpr):
+            return self._awaited_type(node.operand) == "string"
+        if isinstance(node, IndexExpr) or (isinstance(node, FunctionCall) and node.name == "Pop"):
+            receiver = node.receiver if isinstance(node, IndexExpr) else (node.arguments or [None])[0]
+            if isinstance(receiver, Identifier):
+                sym = self.get_variable_symbol(receiver.name)
+                return bool(sym and sym.typ == "string[]")
         if isinstance(node, BinaryExpr) and node.operator == "+":
-            # If either side is stringish, the result is stringish
-            return self._expr_is_stringish(node.left) or self._expr_is_stringish(node.right)
+            # Recursive check - if either side is stringish, result is stringish
+            return self._is_string_operand(node.left) or self._is_string_operand(node.right)
         return False
 
-    # ---------- entry ----------
-    def generate(self, program: Program) -> str:
+    def _map_key_kind(self, call: FunctionCall) -> str:
+        """Pick the int- or string-keyed runtime for a Map builtin call.
+
+        The declared Map<K, V> decides; an untyped Map() falls back to the key
+        expression itself.
+        """
+        target = call.arguments[0]
+        kind = None
+        if isinstance(target, Identifier):
+            sym = self.get_variable_symbol(target.name)
+            kind = map_key_kind(sym.typ if sym else None)
+        if kind is None:
+            kind = "str" if self._is_string_operand(call.arguments[1]) else "int"
+        return kind
+
+    def _emit_multiply(self, rhs: str, dest: str):
+        """Multiply dest by rhs; powers of two become shifts."""
+        if rhs.startswith("$"):
+            factor = int(rhs[1:])
+            if factor > 1 and factor & (factor - 1) == 0:
+                self.emit(f"shlq ${factor.bit_length() - 1}, {dest}")
+                return
+        self.emit(f"imulq {rhs}, {dest}")
+
+    def _simple_operand(self, node) -> Optional[str]:
+        """Return an operand string for leaf expressions that need no code."""
+        if isinstance(node, Literal) and node.literal_type in ("int", "bool", "dec"):
+            if node.literal_type == "dec":
+                value = dec_bits(node.value)
+            else:
+                value = int(node.value) if node.literal_type != "bool" else (1 if node.value else 0)
+            if -(2 ** 31) <= value < 2 ** 31:
+                return f"${value}"
+            return None
+        if isinstance(node, Identifier):
+            if node.name == "argc":
+                return "argc_store(%rip)"
+            if node.name == "argv":
+                return "argv_store(%rip)"
+            sym = self.get_variable_symbol(node.name)
+            if sym:
+                return self.get_variable_location(sym)
+        return None
+
+    def _concat_parts(self, node) -> List[Tuple[str, object]]:
+        """Flatten a string ``+`` chain or interpolation into ordered parts.
+
+        Parts are ("lit", text), ("str", expr), ("int", expr) or ("dec", expr).
+        Only operands that are themselves string-typed are flattened, so
+        ``1 + 2 + "a"`` still adds before converting.
+        """
+        if isinstance(node, BinaryExpr) and node.operator == "+" and self._is_string_operand(node):
+            return self._concat_parts(node.left) + self._concat_parts(node.right)
+        if isinstance(node, InterpString):
+            parts: List[Tuple[str, object]] = []
+            exprs = iter(parse_interp_parts(node))
+            for is_expr, value in node.parts:
+                parts.extend(self._concat_parts(next(exprs)) if is_expr else [("lit", value)])
+            return parts
+        if isinstance(node, Literal) and node.literal_type == "string":
+            return [("lit", node.value)]
+        if self._is_dec_operand(node):
+            return [("dec", node)]
+        return [("str" if self._is_string_operand(node) else "int", node)]
+
+    def generate_concat(self, node):
+        """Build a whole concatenation with one allocation.
+
+        Each part gets a (ptr, len) descriptor in a stack frame; numbers are
+        formatted by vyl_itoa / vyl_dtoa into scratch space behind the
+        descriptors and vyl_str_build sizes, allocates and copies everything once.
+        """
+        parts: List[Tuple[str, object]] = []
+        for kind, value in self._concat_parts(node):
+            if kind == "lit" and parts and parts[-1][0] == "lit":
+                parts[-1] = ("lit", parts[-1][1] + value)
+            elif kind != "lit" or value:
+                parts.append((kind, value))
+        if not parts:
+            parts = [("lit", "")]
+        if len(parts) == 1 and parts[0][0] not in ("int", "dec"):
+            kind, value = parts[0]
+            if kind == "lit":
+                label = self.get_label(".str")
+                self.string_literals.append((label, value))
+                self.emit(f"leaq {label}(%rip), %rax")
+            else:
+                self.generate_expression(value)
+            return
+
+        scratch = 16 * len(parts)
+        frame = scratch + 24 * sum(1 for kind, _ in parts if kind in ("int", "dec"))
+        frame = (frame + 15) & ~15
+        self.emit(f"subq ${frame}, %rsp")
+        for index, (kind, value) in enumerate(parts):
+            slot = 16 * index
+            if kind == "lit":
+                label = self.get_label(".str")
+                self.string_literals.append((label, value))
+                self.emit(f"leaq {label}(%rip), %rax")
+                self.emit(f"movq %rax, {slot}(%rsp)")
+                self.emit(f"movq ${len(value.encode('utf-8'))}, {slot + 8}(%rsp)")
+            elif kind == "str":
+                self.generate_expression(value)
+                self.emit(f"movq %rax, {slot}(%rsp)")
+                self.emit(f"movq $-1, {slot + 8}(%rsp)")  # length comes from the header
+            else:
+                self.generate_expression(value)
+                scratch += 24
+                self.emit("movq %rax, %rdi")
+                self.emit(f"leaq {scratch}(%rsp), %rsi")
+                self.emit("call vyl_dtoa" if kind == "dec" else "call vyl_itoa")
+                self.emit(f"movq %rax, {slot}(%rsp)")
+                self.emit(f"movq %rdx, {slot + 8}(%rsp)")
+        self.emit("movq %rsp, %rdi")
+        self.emit(f"movq ${len(parts)}, %rsi")
+        self.emit("call vyl_str_build")
+        self.emit(f"addq ${frame}, %rsp")
+
+    def generate(self, program: Program, unit: Optional[int] = None, root_unit: int = 0) -> str:
+        """Assemble the whole program with its runtime, or with `unit` set,
+        only the statements parsed from that module (see main.py). The root
+        unit also owns the globals, the main stub and anything the passes
+        created, such as generic instances; the runtime then comes from
+        generate_runtime."""
         self.output = []
         self.string_literals = []
         self.locals = {}
         self.params = {}
         self.globals = {}
         self.function_defs = {}
+        self.spawned = set()
+        self.perf_symbols = []
+        self.static_data = {}
         self.label_counter = 0
+        if unit is None:
+            root_unit = max(len(self.sources) - 1, 0)  # the root file comes last
 
         self.struct_layouts = self.build_struct_layouts(program)
         self.enum_values = self.build_enum_values(program)
         self.method_table: Dict[str, Dict[str, MethodDef]] = self.build_method_table(program)
+        self.escapes = EscapeAnalysis(program) if self.opt_level > 0 else None
 
         # Build function lookup table for default parameters
         for stmt in program.statements:
@@ -198,10 +683,15 @@ class CodeGenerator:
                 self.function_defs[stmt.name] = stmt
 
         self.emit(".section .text")
+        for number, source in enumerate(self.sources, 1):
+            self.emit(f".file {number} \"{self.escape_string(source)}\"")
+
+        def owned(stmt) -> bool:
+            return unit is None or getattr(stmt, "unit", root_unit) == unit
 
         for stmt in program.statements:
             if isinstance(stmt, VarDecl):
-                self.process_global_var(stmt)
+                self.process_global_var(stmt, emit=unit is None or unit == root_unit, export=unit is not None)
             elif isinstance(stmt, StructDef):
                 continue
             elif isinstance(stmt, EnumDef):
@@ -210,6 +700,10 @@ class CodeGenerator:
                 continue
 
         for stmt in program.statements:
+            if not owned(stmt):
+                continue
+            # Passes that create statements, like generics, leave .unit unset
+            self.current_file = getattr(stmt, "unit", root_unit) + 1 if self.sources else 0
             if isinstance(stmt, FunctionDef):
                 self.generate_function(stmt)
             elif isinstance(stmt, VarDecl):
@@ -225,25 +719,69 @@ class CodeGenerator:
             else:
                 self.generate_statement(stmt)
 
-        self.generate_main_stub()
-        self.generate_builtin_functions()
+        # A spawned call enters its function through a stub like __async_, but
+        # the first spawn also starts the worker threads
+        self.emit(".section .text")
+        for name in sorted(self.spawned):
+            self.emit(f"__spawn_{name}:")
+            self.emit(f"leaq {name}(%rip), %rax")
+            self.emit("jmp vyl_task_go")
+
+        self.current_file = 0
+        if unit is None:
+            self.generate_main_stub()
+            self.generate_builtin_functions()
+        elif unit == root_unit:
+            self.generate_main_stub()
+
+        if self.alloc_sites:
+            self._emit_alloc_sites()
+        if self.perf_symbols:
+            self._emit_perf_map()
+        for section, lines in self.static_data.items():
+            self.emit(f".section {section}")
+            for line in lines:
+                self.emit(line)
 
         if self.string_literals:
             self.emit(".section .data")
             for label, content in self.string_literals:
                 escaped = self.escape_string(content)
+                length = len(content.encode("utf-8"))
+                self.emit(".balign 8")
+                self.emit(f".quad {length}, {length}")  # capacity, length
                 self.emit(f"{label}: .asciz \"{escaped}\"")
 
-        # Add format string for int-to-string conversion
-        self.emit(".section .data")
-        self.emit(".int_fmt: .asciz \"%ld\"")
+        self.emit(STACK_NOTE)
+        return "\n".join(self.output) + "\n"
 
-        return "\n".join(self.output)
+    def generate_runtime(self) -> str:
+        """The runtime on its own, for libvylrt.a. It does not depend on the
+        program, and every label that is not assembler-local (.L, .fmt_...)
+        is made global so separately assembled modules can reach it."""
+        self.output = []
+        self.generate_builtin_functions()
+        labels = []
+        for line in self.output:
+            head = line.split(":", 1)[0] if ":" in line else ""
+            if head and not head.startswith(".") and head.replace("_", "a").isalnum():
+                labels.append(head)
+        self.output[:0] = [f".globl {label}" for label in labels]
+        self.emit(STACK_NOTE)
+        return "\n".join(self.output) + "\n"
 
     # ---------- globals ----------
-    def process_global_var(self, decl: VarDecl):
-        var_type = decl.var_type or "int"
-        self.emit(".section .data")
+    def process_global_var(self, decl: VarDecl, emit: bool = True, export: bool = False):
+        var_type = decl.var_type or (decl.value.literal_type if isinstance(decl.value, Literal) else "int")
+        if not emit:
+            # Defined by the root unit's object; only the symbol is needed here
+            self.globals[decl.name] = Symbol(decl.name, var_type, True, 0, size=8)
+            return
+        # A const is never written, so it and everything it points to is read-only
+        section = ".rodata" if decl.is_const else ".data"
+        self.emit(f".section {section}")
+        if export:
+            self.emit(f".globl {decl.name}")
         if var_type in self.struct_layouts:
             data_label = f"{decl.name}_data"
             size = self.struct_layouts[var_type]["size"]
@@ -253,114 +791,61 @@ class CodeGenerator:
             self.emit(f".quad {data_label}")
         else:
             self.emit(f"{decl.name}:")
-            if decl.value and isinstance(decl.value, Literal) and decl.value.literal_type != "string":
-                self.emit(f".quad {decl.value.value}")
+            if isinstance(decl.value, ConstArray):
+                word = self._static_word(decl.value.elements, f"{decl.value.element_type}[]", section)
+                self.emit(f".quad {word}")
+            elif decl.value and isinstance(decl.value, Literal) and var_type == "dec":
+                self.emit(f".quad {dec_bits(decl.value.value)}")
+            elif decl.value and isinstance(decl.value, Literal) and decl.value.literal_type == "string":
+                self.emit(f".quad {self._static_word(decl.value.value, 'string', section)}")
+            elif decl.value and isinstance(decl.value, Literal):
+                self.emit(f".quad {int(decl.value.value)}")
             else:
                 self.emit(".quad 0")
         self.emit(".section .text")
         self.globals[decl.name] = Symbol(decl.name, var_type, True, 0, size=8)
 
+    def _static_word(self, value, typ: str, section: str) -> str:
+        """Operand for one word of a value computed at compile time
+        (comptime.py): scalars inline, strings and arrays as objects with
+        their [capacity, length] header, laid out in section."""
+        if typ == "dec":
+            return str(dec_bits(value))
+        if isinstance(value, list):
+            elem = typ[:-2] if typ.endswith("[]") else "int"
+            words = [self._static_word(item, elem, section) for item in value]
+            length = len(value)
+            body = f" .quad {', '.join(words)}" if words else ""
+        elif isinstance(value, str):
+            length = len(value.encode("utf-8"))
+            body = f" .asciz \"{self.escape_string(value)}\""
+        else:
+            return str(int(value))
+        label = self.get_label(".Lconst")
+        self.static_data.setdefault(section, []).extend(
+            [".balign 8", f".quad {length}, {length}", f"{label}:{body}"])
+        return label
+
     # ---------- functions ----------
     def generate_function(self, func: FunctionDef):
         self.current_function = func.name
+        self.tuple_return = self._tuple_arity(func.return_type)
+        self.return_type = func.return_type
         self.locals = {}
         self.params = {}
         self.defer_stack = []  # Clear defer stack for new function
 
-        # Collect locals
-        decls = self.collect_var_decls(func.body) if func.body else []
-
-        arg_regs = ["%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"]
-        param_reg_pool = ["%r14", "%r15"]  # callee-saved to survive calls
-        reg_param_count = min(len(func.params), len(param_reg_pool))
-        saved_regs = param_reg_pool[:reg_param_count]
-
-        # Stack slots for non-register params + locals
-        total_slots = (len(func.params) - reg_param_count)
-        locals_size = sum(self.var_size(d.var_type or "int") for d in decls)
-        stack_bytes = total_slots * 8 + locals_size
-        
-        # Account for stack alignment: after push rbp + saved_regs pushes
-        # push rbp: rsp aligned (16)
-        # each saved_reg push: toggles alignment
-        # We need total frame to maintain 16-byte alignment before calls
-        # saved_regs_bytes + stack_bytes must be multiple of 16
-        saved_regs_bytes = len(saved_regs) * 8
-        total_frame = saved_regs_bytes + stack_bytes
-        if total_frame % 16 != 0:
-            stack_bytes += 8  # add padding to align
-        
-        offset = -stack_bytes if stack_bytes else 0
-
-        self.emit(f".globl {func.name}")
-        self.emit(f"{func.name}:")
-        self.emit("push %rbp")
-        self.emit("movq %rsp, %rbp")
-
-        for reg in saved_regs:
-            self.emit(f"push {reg}")
-
-        if stack_bytes:
-            self.emit(f"subq ${stack_bytes}, %rsp")
-
-        # Assign parameters (register-backed first, then stack-backed)
-        offset_cursor = offset
-        for idx, (pname, ptype, pdefault) in enumerate(func.params):
-            if idx < reg_param_count:
-                sym = Symbol(pname, ptype or "int", False, 0, is_param=True, reg=param_reg_pool[idx])
-                self.locals[pname] = sym
-                self.params[pname] = sym
-            else:
-                sym = Symbol(pname, ptype or "int", False, offset_cursor, is_param=True)
-                self.locals[pname] = sym
-                self.params[pname] = sym
-                offset_cursor += 8
-
-        # Move incoming parameter values to their homes
-        for idx, (pname, _, pdefault) in enumerate(func.params):
-            sym = self.params[pname]
-            if sym.reg:
-                if idx < len(arg_regs):
-                    self.emit(f"movq {arg_regs[idx]}, {sym.reg}")
-                else:
-                    src_offset = 16 + (idx - len(arg_regs)) * 8
-                    self.emit(f"movq {src_offset}(%rbp), {sym.reg}")
-            else:
-                if idx < len(arg_regs):
-                    self.emit(f"movq {arg_regs[idx]}, {self.get_variable_location(sym)}")
-                else:
-                    src_offset = 16 + (idx - len(arg_regs)) * 8
-                    self.emit(f"movq {src_offset}(%rbp), %rax")
-                    self.emit(f"movq %rax, {self.get_variable_location(sym)}")
-
-        # Assign locals after params
-        for d in decls:
-            # Infer type from initializer if not explicitly specified
-            if d.var_type:
-                var_type = d.var_type
-            elif d.value:
-                var_type = self._infer_type_from_expr(d.value)
-            else:
-                var_type = "int"
-            size = self.var_size(var_type)
-            sym = Symbol(d.name, var_type, False, offset_cursor, size=size)
-            self.locals[d.name] = sym
-            offset_cursor += size
+        params = [(pname, ptype) for pname, ptype, _ in func.params]
+        self.loc_line = 0
+        self._emit_loc(func.line, func.column)
+        stack_bytes, saved_regs = self._emit_frame_setup(func.name, params, func.body)
 
         end_lbl = self.get_label("ret")
         self.current_function_end_label = end_lbl
 
-        # Initialize struct locals so field access has storage
-        for d in decls:
-            var_type = d.var_type or "int"
-            if var_type in self.struct_layouts:
-                size = self.struct_layouts[var_type]["size"]
-                loc = self.get_variable_location(self.locals[d.name])
-                self.emit(f"movq ${size}, %rdi")
-                self.emit("call vyl_alloc")
-                self.emit(f"movq %rax, {loc}")
-
+        self.arena_depth = 0
         if func.body:
+            self.unchecked_depth = int(func.body.unchecked)
             for stmt in func.body.statements:
                 self.generate_statement(stmt, end_label=end_lbl)
 
@@ -368,90 +853,64 @@ class CodeGenerator:
             self.emit("movq $0, %rax")
         # Execute any remaining deferred statements for implicit return
         self._emit_deferred_statements()
-        self.emit(f"{end_lbl}:")
-        if stack_bytes:
-            self.emit(f"addq ${stack_bytes}, %rsp")
-        for reg in reversed(saved_regs):
-            self.emit(f"pop {reg}")
-        self.emit("leave")
-        self.emit("ret")
+        self._emit_frame_teardown(func.name, end_lbl, stack_bytes, saved_regs)
         self.current_function = None
+        if func.is_async:
+            # Callers land here with the arguments in registers and get a task
+            self.emit(f".globl __async_{func.name}")
+            self.emit(f"__async_{func.name}:")
+            self.emit(f"leaq {func.name}(%rip), %rax")
+            self.emit("jmp vyl_task_spawn")
 
     def generate_method(self, method: MethodDef, struct: StructDef):
         """Generate code for a struct method. 'self' is passed as implicit first argument."""
         method_name = f"{struct.name}_{method.name}"
         self.current_function = method_name
+        self.tuple_return = self._tuple_arity(method.return_type)
+        self.return_type = method.return_type
         self.current_struct = struct
         self.locals = {}
         self.params = {}
         self.defer_stack = []  # Clear defer stack for new method
 
-        # Collect locals
-        decls = self.collect_var_decls(method.body) if method.body else []
-
         # 'self' is the first argument (pointer to struct), then explicit params
-        all_params = [("self", struct.name)] + list(method.params)
-
-        arg_regs = ["%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"]
-        param_reg_pool = ["%r14", "%r15", "%r13"]  # callee-saved to survive calls
-        reg_param_count = min(len(all_params), len(param_reg_pool))
-        saved_regs = param_reg_pool[:reg_param_count]
-
-        # Stack slots for non-register params + locals
-        total_slots = (len(all_params) - reg_param_count)
-        locals_size = sum(self.var_size(d.var_type or "int") for d in decls)
-        stack_bytes = total_slots * 8 + locals_size
-
-        saved_regs_bytes = len(saved_regs) * 8
-        total_frame = saved_regs_bytes + stack_bytes
-        if total_frame % 16 != 0:
-            stack_bytes += 8
+        all_params = [("self", struct.name)] + [(p[0], p[1]) for p in method.params]
+        self.loc_line = 0
+        self._emit_loc(method.line, method.column)
+        stack_bytes, saved_regs = self._emit_frame_setup(method_name, all_params, method.body)
 
-        offset = -stack_bytes if stack_bytes else 0
+        end_lbl = self.get_label("ret")
+        self.current_function_end_label = end_lbl
 
-        self.emit(f".globl {method_name}")
-        self.emit(f"{method_name}:")
-        self.emit("push %rbp")
-        self.emit("movq %rsp, %rbp")
+        self.arena_depth = 0
+        if method.body:
+            self.unchecked_depth = int(method.body.unchecked)
+            for stmt in method.body.statements:
+                self.generate_statement(stmt, end_label=end_lbl)
 
-        for reg in saved_regs:
-            self.emit(f"push {reg}")
+        self._emit_frame_teardown(method_name, end_lbl, stack_bytes, saved_regs)
+        self.current_function = None
+        self.current_struct = None
+        self.locals = {}
+        self.params = {}
 
-        if stack_bytes:
-            self.emit(f"subq ${stack_bytes}, %rsp")
+    def _emit_frame_setup(self, label: str, params: List[Tuple[str, Optional[str]]],
+                          body: Optional[Block]) -> Tuple[int, List[str]]:
+        """Build symbols, run register allocation and emit the prologue.
 
-        # Assign parameters (register-backed first, then stack-backed)
-        offset_cursor = offset
-        for idx, (pname, ptype) in enumerate(all_params):
-            if idx < reg_param_count:
-                sym = Symbol(pname, ptype or "int", False, 0, is_param=True, reg=param_reg_pool[idx])
-                self.locals[pname] = sym
-                self.params[pname] = sym
-            else:
-                sym = Symbol(pname, ptype or "int", False, offset_cursor, is_param=True)
-                self.locals[pname] = sym
-                self.params[pname] = sym
-                offset_cursor += 8
-
-        # Move incoming parameter values to their homes
-        for idx, (pname, _) in enumerate(all_params):
-            sym = self.params[pname]
-            if sym.reg:
-                if idx < len(arg_regs):
-                    self.emit(f"movq {arg_regs[idx]}, {sym.reg}")
-                else:
-                    src_offset = 16 + (idx - len(arg_regs)) * 8
-                    self.emit(f"movq {src_offset}(%rbp), {sym.reg}")
-            else:
-                if idx < len(arg_regs):
-                    self.emit(f"movq {arg_regs[idx]}, {self.get_variable_location(sym)}")
-                else:
-                    src_offset = 16 + (idx - len(arg_regs)) * 8
-                    self.emit(f"movq {src_offset}(%rbp), %rax")
-                    self.emit(f"movq %rax, {self.get_variable_location(sym)}")
+        Frame layout below the saved %rbp: callee-saved registers used by the
+        allocator, then one 8-byte slot per spilled local or parameter.
+        Returns (stack_bytes, saved_regs) for the matching teardown.
+        """
+        decls = self.collect_var_decls(body) if body else []
 
-        # Assign locals after params
+        for pname, ptype in params:
+            sym = Symbol(pname, ptype or "int", False, 0, is_param=True)
+            self.locals[pname] = sym
+            self.params[pname] = sym
         for d in decls:
+            if d.name in self.params:
+                continue
             # Infer type from initializer if not explicitly specified
             if d.var_type:
                 var_type = d.var_type
@@ -459,61 +918,275 @@ class CodeGenerator:
                 var_type = self._infer_type_from_expr(d.value)
             else:
                 var_type = "int"
-            size = self.var_size(var_type)
-            sym = Symbol(d.name, var_type, False, offset_cursor, size=size)
-            self.locals[d.name] = sym
-            offset_cursor += size
+            self.locals[d.name] = Symbol(d.name, var_type, False, 0, size=self.var_size(var_type))
+
+        # Struct locals get zeroed storage at entry unless every declaration
+        # initialises them; storage that never escapes lives in the frame.
+        uninitialised = {d.name for d in decls if d.value is None}
+        struct_locals = [name for name, sym in self.locals.items()
+                         if not sym.is_param and sym.typ in self.struct_layouts and name in uninitialised]
+        self.stack_objects = {}
+        plan = None
+        if self.escapes is not None:
+            plan = self.escapes.plan([pname for pname, _ in params], body, struct_locals,
+                                     self._stack_object_size)
+        heap_struct_locals = [name for name in struct_locals if not plan or name not in plan.locals]
+        assignment = {}
+        if self.opt_level > 0:
+            assignment = allocate_registers(
+                [pname for pname, _ in params],
+                body,
+                set(self.locals),
+                lambda node: id(node) not in plan.sites and is_call_node(node, self._is_string_operand),
+                entry_calls=bool(heap_struct_locals),
+            )
+        saved_regs = [reg for reg in CALLEE_SAVED_REGS if reg in assignment.values()]
+
+        offset_cursor = -len(saved_regs) * 8
+        for name, sym in self.locals.items():
+            if name in assignment:
+                sym.reg = assignment[name]
+            else:
+                offset_cursor -= sym.size
+                sym.offset = offset_cursor
+        stack_locals: Dict[str, int] = {}
+        if plan:
+            for name in struct_locals:
+                if name in plan.locals:
+                    offset_cursor -= self.struct_layouts[self.locals[name].typ]["size"]
+                    stack_locals[name] = offset_cursor
+            for site, size in plan.sites.items():
+                offset_cursor -= size
+                self.stack_objects[site] = offset_cursor
+
+        # saved_regs_bytes + stack_bytes must be a multiple of 16 so calls
+        # made from the body see an aligned stack
+        stack_bytes = -offset_cursor - len(saved_regs) * 8
+        if (len(saved_regs) * 8 + stack_bytes) % 16 != 0:
+            stack_bytes += 8
 
-        end_lbl = self.get_label("ret")
-        self.current_function_end_label = end_lbl
+        self.emit(f".globl {label}")
+        self.emit(f"{label}:")
+        self._emit_frame_entry()
+        for slot, reg in enumerate(saved_regs, 3):
+            self.emit(f"push {reg}")
+            self.emit(f".cfi_offset {reg}, -{slot * 8}")
+        if stack_bytes:
+            self.emit(f"subq ${stack_bytes}, %rsp")
 
-        # Initialize struct locals
-        for d in decls:
-            var_type = d.var_type or "int"
-            if var_type in self.struct_layouts:
-                size = self.struct_layouts[var_type]["size"]
-                loc = self.get_variable_location(self.locals[d.name])
+        # Move incoming parameter values to their homes. When a home is one of
+        # the incoming argument registers, go through the stack so no argument
+        # is overwritten before it has been read.
+        arg_regs = ["%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"]
+        reg_args = min(len(params), len(arg_regs))
+        homes = [self.get_variable_location(self.params[pname]) for pname, _ in params]
+        types = [ptype for _, ptype in params]
+        if "dec" in types:
+            self._emit_dec_param_homing(types, homes)
+        elif any(home in arg_regs[:reg_args] for home in homes):
+            for idx in range(reg_args):
+                self.emit(f"push {arg_regs[idx]}")
+            for idx in reversed(range(reg_args)):
+                if homes[idx].startswith("%"):
+                    self.emit(f"pop {homes[idx]}")
+                else:
+                    self.emit("pop %rax")
+                    self.emit(f"movq %rax, {homes[idx]}")
+        else:
+            for idx in range(reg_args):
+                self.emit(f"movq {arg_regs[idx]}, {homes[idx]}")
+        stack_args = [idx for idx, loc in enumerate(self._arg_locations(types)) if loc == "stack"]
+        for slot, idx in enumerate(stack_args):
+            src_offset = 16 + slot * 8
+            if homes[idx].startswith("%"):
+                self.emit(f"movq {src_offset}(%rbp), {homes[idx]}")
+            else:
+                self.emit(f"movq {src_offset}(%rbp), %rax")
+                self.emit(f"movq %rax, {homes[idx]}")
+
+        # Self tail calls store the new arguments in the homes and jump here.
+        # Frame-resident objects would be recycled while still referenced.
+        self.tail_label = None
+        if self.opt_level > 0 and not self.stack_objects and not stack_locals and self._has_tail_call(body):
+            self.tail_label = self.get_label("tail")
+            self.emit(f"{self.tail_label}:")
+
+        # Initialize struct locals so field access has storage
+        for name in struct_locals:
+            sym = self.locals[name]
+            size = self.struct_layouts[sym.typ]["size"]
+            if name in stack_locals:
+                self._emit_frame_object(stack_locals[name], size)
+            else:
                 self.emit(f"movq ${size}, %rdi")
                 self.emit("call vyl_alloc")
-                self.emit(f"movq %rax, {loc}")
+            self.emit(f"movq %rax, {self.get_variable_location(sym)}")
 
-        if method.body:
-            for stmt in method.body.statements:
-                self.generate_statement(stmt, end_label=end_lbl)
+        return stack_bytes, saved_regs
+
+    def _arg_locations(self, types: List[Optional[str]]) -> List[str]:
+        """SysV home of each argument: an integer register, an SSE register
+        or "stack" (memory arguments keep their relative order)."""
+        int_regs = ["%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"]
+        sse_regs = list(DEC_ARG_REGS)
+        locations = []
+        for typ in types:
+            pool = sse_regs if typ == "dec" else int_regs
+            locations.append(pool.pop(0) if pool else "stack")
+        return locations
+
+    def _emit_dec_param_homing(self, types: List[Optional[str]], homes: List[str]):
+        """Home parameters passed in a mix of integer and SSE registers.
+
+        Integer registers are parked on the stack first, so an SSE argument
+        whose home is one of them cannot overwrite it before it is read.
+        """
+        locations = self._arg_locations(types)
+        int_args = [idx for idx, loc in enumerate(locations) if loc.startswith("%r")]
+        for idx in int_args:
+            self.emit(f"push {locations[idx]}")
+        for idx, loc in enumerate(locations):
+            if loc.startswith("%xmm"):
+                self.emit(f"movq {loc}, {homes[idx]}")
+        for idx in reversed(int_args):
+            if homes[idx].startswith("%"):
+                self.emit(f"pop {homes[idx]}")
+            else:
+                self.emit("pop %rax")
+                self.emit(f"movq %rax, {homes[idx]}")
+
+    def _emit_user_call(self, target: str, args: List, types: List[Optional[str]],
+                        return_type: Optional[str]):
+        """Call a VYL function or method, passing decs in SSE registers."""
+        arg_regs = ["%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"]
+        arg_count = len(args)
+        if "dec" not in types:
+            # Evaluate args right-to-left, push on stack
+            for arg in reversed(args):
+                self.generate_expression(arg)
+                self.emit("push %rax")
+            # Pop into registers in order
+            for idx in range(min(arg_count, len(arg_regs))):
+                self.emit(f"pop {arg_regs[idx]}")
+            # Arguments beyond 6 are already on the stack in SysV order
+            self.emit(f"call {target}")
+            if arg_count > len(arg_regs):
+                excess = arg_count - len(arg_regs)
+                self.emit(f"addq ${excess * 8}, %rsp")
+        else:
+            # Evaluate everything first, then load registers from the pushed
+            # values and copy the memory arguments below them
+            for arg, typ in reversed(list(zip(args, types))):
+                self.generate_converted(arg, typ)
+                self.emit("push %rax")
+            locations = self._arg_locations(types)
+            for idx, loc in enumerate(locations):
+                if loc != "stack":
+                    self.emit(f"movq {idx * 8}(%rsp), {loc}")
+            stack_args = [idx for idx, loc in enumerate(locations) if loc == "stack"]
+            pad = 8 * ((arg_count + len(stack_args)) % 2)
+            if pad:
+                self.emit("subq $8, %rsp")
+            for pushed, idx in enumerate(reversed(stack_args)):
+                self.emit(f"pushq {idx * 8 + pushed * 8 + pad}(%rsp)")
+            self.emit(f"call {target}")
+            self.emit(f"addq ${(arg_count + len(stack_args)) * 8 + pad}, %rsp")
+        if return_type == "dec":
+            self.emit("movq %xmm0, %rax")
+
+    def _stack_object_size(self, node) -> Optional[int]:
+        """Bytes an allocation needs in the frame, None if it must stay on the heap."""
+        if isinstance(node, NewExpr):
+            layout = self.struct_layouts.get(node.struct_name)
+            return layout["size"] if layout else None
+        if isinstance(node, ArrayLiteral):
+            return ARRAY_HEADER_SIZE + len(node.elements) * 8
+        if isinstance(node, TupleLiteral):
+            return len(node.elements) * 8
+        if isinstance(node, FunctionCall) and node.name == "Array":
+            length = int(node.arguments[0].value)
+            return ARRAY_HEADER_SIZE + length * 8 if length >= 0 else None
+        return None
+
+    def _emit_frame_object(self, offset: int, size: int):
+        """Zero a frame-resident object and leave its address in %rax."""
+        for word in range(0, size, 8):
+            self.emit(f"movq $0, {offset + word}(%rbp)")
+        self.emit(f"leaq {offset}(%rbp), %rax")
+
+    def _emit_frame_entry(self):
+        """Open a function's %rbp frame and its CFI. From here on the CFA is
+        %rbp + 16 whatever the body pushes, so both frame-pointer and DWARF
+        unwinders (perf record -g / --call-graph dwarf) walk through it."""
+        self.emit(".cfi_startproc")
+        self.emit("push %rbp")
+        self.emit(".cfi_def_cfa_offset 16")
+        self.emit(".cfi_offset %rbp, -16")
+        self.emit("movq %rsp, %rbp")
+        self.emit(".cfi_def_cfa_register %rbp")
+
+    def _emit_leave_ret(self):
+        """Return from a frame opened by _emit_frame_entry. The unwind state is
+        kept for code placed after the ret, such as other return paths."""
+        self.emit(".cfi_remember_state")
+        self.emit("leave")
+        self.emit(".cfi_def_cfa %rsp, 8")
+        self.emit("ret")
+        self.emit(".cfi_restore_state")
 
+    def _emit_frame_teardown(self, label: str, end_lbl: str, stack_bytes: int, saved_regs: List[str]):
         self.emit(f"{end_lbl}:")
-        if stack_bytes:
-            self.emit(f"addq ${stack_bytes}, %rsp")
+        if self.return_type == "dec":
+            self.emit("movq %rax, %xmm0")
+        if saved_regs:
+            self.emit(f"leaq -{len(saved_regs) * 8}(%rbp), %rsp")
         for reg in reversed(saved_regs):
             self.emit(f"pop {reg}")
-        self.emit("leave")
-        self.emit("ret")
-        self.current_function = None
-        self.current_struct = None
-        self.locals = {}
-        self.params = {}
+        self._emit_leave_ret()
+        self._emit_frame_exit(label)
+
+    def _emit_frame_exit(self, label: str):
+        self.emit(".cfi_endproc")
+        if self.perf_map:
+            end = f".L{label}_end"
+            self.emit(f"{end}:")
+            self.perf_symbols.append((label, end))
 
     def generate_main_stub(self):
         self.emit(".globl main")
         self.emit("main:")
-        self.emit("push %rbp")
-        self.emit("movq %rsp, %rbp")
+        self._emit_frame_entry()
         self.emit("movq %rdi, argc_store(%rip)")
         self.emit("movq %rsi, argv_store(%rip)")
         self.emit("movq %rbp, stack_base(%rip)")
         # After push rbp, rsp % 16 == 0. Keep aligned for calls.
         self.emit("subq $16, %rsp")
+        self.emit("call vyl_cpu_init")
+        self.emit("call vyl_io_init")
+        self.emit("call vyl_wrap_argv")
         # seed rand()
         self.emit("movq $0, %rdi")
         self.emit("call time")
         self.emit("movq %rax, %rdi")
         self.emit("call srand")
+        self.emit("call vyl_sched_boot")
+        if self.perf_map:
+            self.emit("call vyl_perf_map_write")
         self.emit("call Main")
-        self.emit("movq %rax, %rdi")
-        self.emit("movq $60, %rax")
+        # The raw exit skips libc teardown, so pending output goes out first
+        self.emit("movq %rax, (%rsp)")
+        self.emit("call vyl_flush_all")
+        if self.profile_alloc:
+            self.emit("call vyl_prof_dump")
+        self.emit("movq (%rsp), %rdi")
+        self.emit("movq $231, %rax")  # exit_group, not just this thread
         self.emit("syscall")
+        self._emit_frame_exit("main")
 
     def generate_statement(self, stmt, end_label: Optional[str] = None):
+        if stmt.line:
+            self.current_line = stmt.line
+            self._emit_loc(stmt.line, stmt.column)
         if isinstance(stmt, Assignment):
             self.generate_assignment(stmt)
         elif isinstance(stmt, VarDecl):
@@ -521,8 +1194,15 @@ class CodeGenerator:
             if not sym:
                 raise CodegenError(f"Undefined local declaration for '{stmt.name}'")
             if stmt.value:
-                self.generate_expression(stmt.value)
-                self.emit(f"movq %rax, {self.get_variable_location(sym)}")
+                self._emit_store(stmt.name, stmt.value, self.get_variable_location(sym))
+        elif isinstance(stmt, TupleUnpack) and self._tuple_call_arity(stmt.value) == len(stmt.names):
+            # The callee returns the elements in registers; take them directly
+            self._generate_call(stmt.value)
+            for reg, name in zip(TUPLE_RETURN_REGS, stmt.names):
+                sym = self.get_variable_symbol(name)
+                if not sym:
+                    raise CodegenError(f"Undefined local declaration for '{name}'")
+                self.emit(f"movq {reg}, {self.get_variable_location(sym)}")
         elif isinstance(stmt, TupleUnpack):
             # Generate the tuple expression - tuple values are laid out on stack
             self.generate_expression(stmt.value)
@@ -538,6 +1218,14 @@ class CodeGenerator:
                 self.emit(f"movq %rcx, {self.get_variable_location(sym)}")
         elif isinstance(stmt, FunctionCall):
             self.generate_function_call(stmt)
+            if self._is_async_call(stmt):
+                # Nobody can await a dropped handle, so the task frees itself
+                self.emit("movq %rax, %rdi")
+                self.emit("call vyl_task_detach")
+        elif isinstance(stmt, SpawnExpr):
+            self.generate_spawn(stmt.operand)
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_task_detach")
         elif isinstance(stmt, IfStmt):
             self.generate_if(stmt, end_label=end_label)
         elif isinstance(stmt, WhileStmt):
@@ -548,37 +1236,193 @@ class CodeGenerator:
             # Add defer to stack - will be executed when function returns
             self.defer_stack.append(stmt)
         elif isinstance(stmt, Block):
+            if stmt.arena is not None:
+                self.generate_expression(stmt.arena)
+                self.emit("movq %rax, %rdi")
+                self.emit("call vyl_arena_push")
+                self.arena_depth += 1
+            self.unchecked_depth += stmt.unchecked
             for s in stmt.statements:
                 self.generate_statement(s, end_label=end_label)
+            self.unchecked_depth -= stmt.unchecked
+            if stmt.arena is not None:
+                self.arena_depth -= 1
+                self._emit_arena_pop(1)
+        elif isinstance(stmt, BoundsCheck):
+            self.generate_bounds_check(stmt)
         elif isinstance(stmt, ReturnStmt):
-            if stmt.value:
-                self.generate_expression(stmt.value)
+            if (self.tail_label and not self.defer_stack and not self.arena_depth
+                    and self._is_self_call(stmt.value)):
+                self.generate_tail_call(stmt.value)
+                return
+            if stmt.value and self.tuple_return:
+                self.generate_tuple_return(stmt.value)
+            elif stmt.value:
+                self.generate_converted(stmt.value, self.return_type)
             else:
                 self.emit("movq $0, %rax")
+            self._emit_arena_pop(self.arena_depth)
             # Execute all deferred statements in LIFO order
             self._emit_deferred_statements()
             if end_label:
                 self.emit(f"jmp {end_label}")
             else:
-                self.emit("leave")
-                self.emit("ret")
+                if self.return_type == "dec":
+                    self.emit("movq %rax, %xmm0")
+                self._emit_leave_ret()
         elif isinstance(stmt, StructDef):
             return
         else:
             self.generate_expression(stmt)
 
+    def _is_self_call(self, node) -> bool:
+        """True for a call of the function or method being generated."""
+        if isinstance(node, FunctionCall):
+            return (not self.current_struct and node.name == self.current_function != "Main"
+                    and not self._is_async_call(node))
+        if isinstance(node, MethodCall) and self.current_struct:
+            return f"{self._receiver_struct(node.receiver)}_{node.method_name}" == self.current_function
+        return False
+
+    def _is_async_call(self, node) -> bool:
+        """True for a call that spawns a task instead of running the callee."""
+        func_def = self.function_defs.get(node.name) if isinstance(node, FunctionCall) else None
+        return bool(func_def and func_def.is_async)
+
+    def _awaited_type(self, node) -> Optional[str]:
+        """What awaiting node yields: an async call in place, or a kept Task<T>."""
+        if isinstance(node, SpawnExpr):
+            node = node.operand
+            return self.function_defs[node.name].return_type or "int"
+        if self._is_async_call(node):
+            return self.function_defs[node.name].return_type or "int"
+        return task_result_type(self._static_type(node))
+
+    def _has_tail_call(self, node) -> bool:
+        if isinstance(node, ReturnStmt):
+            return self._is_self_call(node.value)
+        if isinstance(node, Block):
+            return any(self._has_tail_call(stmt) for stmt in node.statements)
+        if isinstance(node, IfStmt):
+            return self._has_tail_call(node.then_block) or self._has_tail_call(node.else_block)
+        if isinstance(node, (WhileStmt, ForStmt)):
+            return self._has_tail_call(node.body)
+        return False
+
+    def generate_tail_call(self, call):
+        """Turn ``return f(args)`` inside f into a jump back to its start.
+
+        Arguments are evaluated right to left like a call, then popped into
+        the parameter homes, so the frame is reused instead of stacked.
+        """
+        if isinstance(call, MethodCall):
+            args = [call.receiver] + list(call.arguments)
+        else:
+            params = self.function_defs[call.name].params
+            args = list(call.arguments) + [default for _, _, default in params[len(call.arguments):]]
+        for arg, sym in reversed(list(zip(args, self.params.values()))):
+            self.generate_converted(arg, sym.typ)
+            self.emit("push %rax")
+        for sym in self.params.values():
+            self.emit(f"popq {self.get_variable_location(sym)}")
+        self.emit(f"jmp {self.tail_label}")
+
+    def generate_tuple_return(self, value):
+        """Leave a returned tuple's elements in TUPLE_RETURN_REGS."""
+        count = self.tuple_return
+        if isinstance(value, TupleLiteral) and len(value.elements) == count:
+            for elem in value.elements[:-1]:
+                self.generate_expression(elem)
+                self.emit("push %rax")
+            self.generate_expression(value.elements[-1])
+            self.emit(f"movq %rax, {TUPLE_RETURN_REGS[count - 1]}")
+            for reg in reversed(TUPLE_RETURN_REGS[:count - 1]):
+                self.emit(f"pop {reg}")
+            return
+        if self._tuple_call_arity(value) == count:
+            self._generate_call(value)  # already in registers
+            return
+        # A tuple held by pointer (e.g. a variable): load its words
+        self.generate_expression(value)
+        for index in reversed(range(count)):
+            self.emit(f"movq {index * 8}(%rax), {TUPLE_RETURN_REGS[index]}")
+
+    def _tuple_element_types(self, type_str: Optional[str]) -> List[str]:
+        """Split "(int, string)" into ["int", "string"]; [] for non-tuples."""
+        if not type_str or not type_str.startswith("("):
+            return []
+        types, depth, current = [], 0, ""
+        for ch in type_str[1:-1]:
+            if ch == "," and depth == 0:
+                types.append(current.strip())
+                current = ""
+                continue
+            depth += (ch in "(<") - (ch in ")>")
+            current += ch
+        return types + [current.strip()]
+
+    def _tuple_arity(self, type_str: Optional[str]) -> int:
+        """Element count of a tuple type returned in registers, else 0."""
+        count = len(self._tuple_element_types(type_str))
+        return count if count <= len(TUPLE_RETURN_REGS) else 0
+
+    def _tuple_call_arity(self, node) -> int:
+        """Register-tuple arity of a user function or method call, else 0."""
+        if isinstance(node, FunctionCall):
+            func_def = self.function_defs.get(node.name)
+            return self._tuple_arity(func_def.return_type) if func_def else 0
+        if isinstance(node, MethodCall):
+            methods = self.method_table.get(self._receiver_struct(node.receiver) or "", {})
+            method = methods.get(node.method_name)
+            return self._tuple_arity(method.return_type) if method else 0
+        return 0
+
+    def _generate_call(self, node):
+        if isinstance(node, MethodCall):
+            self.generate_method_call(node)
+        else:
+            self.generate_function_call(node)
+
+    def _emit_tuple_box(self, count: int):
+        """Store a register-returned tuple into a heap tuple left in %rax."""
+        self.emit("subq $32, %rsp")
+        for index, reg in enumerate(TUPLE_RETURN_REGS[:count]):
+            self.emit(f"movq {reg}, {index * 8}(%rsp)")
+        self.emit(f"movq ${count * 8}, %rdi")
+        self.emit("call vyl_alloc")
+        for index in range(count):
+            self.emit(f"movq {index * 8}(%rsp), %rcx")
+            self.emit(f"movq %rcx, {index * 8}(%rax)")
+        self.emit("addq $32, %rsp")
+
+    def _emit_arena_pop(self, count: int):
+        """Leave `count` @arena scopes; %rax, %rdx and %rcx (a return value) are preserved."""
+        if count:
+            self.emit(f"movq ${count}, %rdi")
+            self.emit("call vyl_arena_pop")
+
     def _emit_deferred_statements(self):
         """Emit all deferred statements in LIFO order, preserving return value."""
         if not self.defer_stack:
             return
-        # Save return value
-        self.emit("pushq %rax")
+        # Save the return value registers (padded so calls stay aligned)
+        saved = TUPLE_RETURN_REGS[:max(1, self.tuple_return)]
+        pad = 8 if len(saved) % 2 else 0
+        for reg in saved:
+            self.emit(f"pushq {reg}")
+        if pad:
+            self.emit(f"subq ${pad}, %rsp")
         # Execute deferred statements in reverse order
+        tuple_return, self.tuple_return = self.tuple_return, 0
         for defer_stmt in reversed(self.defer_stack):
             for stmt in defer_stmt.body.statements:
                 self.generate_statement(stmt)
+        self.tuple_return = tuple_return
         # Restore return value
-        self.emit("popq %rax")
+        if pad:
+            self.emit(f"addq ${pad}, %rsp")
+        for reg in reversed(saved):
+            self.emit(f"popq {reg}")
 
     def collect_var_decls(self, block: Block) -> List[VarDecl]:
         """Collect VarDecl nodes and synthesize VarDecl for TupleUnpack names."""
@@ -587,9 +1431,12 @@ class CodeGenerator:
             if isinstance(stmt, VarDecl):
                 decls.append(stmt)
             elif isinstance(stmt, TupleUnpack):
-                # Create synthetic VarDecl for each unpacked variable
+                # Create synthetic VarDecl for each unpacked variable; untyped
+                # names take the element type a called function declares
+                func_def = self.function_defs.get(stmt.value.name) if isinstance(stmt.value, FunctionCall) else None
+                returned = self._tuple_element_types(func_def.return_type) if func_def else []
                 for i, name in enumerate(stmt.names):
-                    var_type = stmt.types[i] if stmt.types[i] else "int"
+                    var_type = stmt.types[i] or (returned[i] if i < len(returned) else "int")
                     synthetic = VarDecl(name=name, var_type=var_type, is_mutable=True, value=None, 
                                        line=stmt.line, column=stmt.column)
                     decls.append(synthetic)
@@ -600,6 +1447,8 @@ class CodeGenerator:
             elif isinstance(stmt, WhileStmt):
                 decls.extend(self.collect_var_decls(stmt.body))
             elif isinstance(stmt, ForStmt):
+                decls.append(VarDecl(name=stmt.var_name, var_type="int", is_mutable=True, value=None,
+                                     line=stmt.line, column=stmt.column))
                 decls.extend(self.collect_var_decls(stmt.body))
         return decls
 
@@ -615,11 +1464,21 @@ class CodeGenerator:
 
     # ---------- expressions ----------
     def generate_expression(self, expr):
+        if not self.profile_alloc:
+            return self._generate_expression(expr)
+        outer = self.expr_kind
+        self.expr_kind = type(expr).__name__
+        try:
+            return self._generate_expression(expr)
+        finally:
+            self.expr_kind = outer
+
+    def _generate_expression(self, expr):
         if isinstance(expr, Literal):
             if expr.literal_type == "int":
                 self.emit(f"movq ${expr.value}, %rax")
             elif expr.literal_type == "dec":
-                self.emit(f"movq ${int(expr.value)}, %rax")
+                self.emit(f"movabsq ${dec_bits(expr.value)}, %rax")
             elif expr.literal_type == "string":
                 label = self.get_label(".str")
                 self.string_literals.append((label, expr.value))
@@ -656,31 +1515,13 @@ class CodeGenerator:
             return
 
         if isinstance(expr, IndexExpr):
-            # Save base while computing index; index expression may call functions
-            self.generate_expression(expr.receiver)
-            self.emit("push %rax")
-            self.generate_expression(expr.index)
-            self.emit("movq %rax, %rcx")
-            self.emit("pop %rbx")
-            bounds_fail = self.get_label("oob")
-            self.emit("cmpq $0, %rbx")
-            self.emit(f"je {bounds_fail}")
-            self.emit("cmpq $0, %rcx")
-            self.emit(f"jl {bounds_fail}")
-            self.emit("movq -8(%rbx), %rdx")
-            self.emit("cmpq %rdx, %rcx")
-            self.emit(f"jae {bounds_fail}")
-            self.emit("imulq $8, %rcx")
-            self.emit("addq %rcx, %rbx")
-            self.emit("movq (%rbx), %rax")
-            self.emit(f"jmp {bounds_fail}_done")
-            self.emit(f"{bounds_fail}:")
-            self.emit("call vyl_bounds_fail")
-            self.emit(f"{bounds_fail}_done:")
+            self._emit_element_access(expr, "movq (%rdx,%rcx,8), %rax")
             return
 
         if isinstance(expr, FunctionCall):
             self.generate_function_call(expr)
+            if self._tuple_call_arity(expr):
+                self._emit_tuple_box(self._tuple_call_arity(expr))
             return
 
         if isinstance(expr, NewExpr):
@@ -691,6 +1532,20 @@ class CodeGenerator:
             self.generate_array_literal(expr)
             return
 
+        if isinstance(expr, ConstArray):
+            # A local const: the array was laid out at compile time
+            label = self._static_word(expr.elements, f"{expr.element_type}[]", ".rodata")
+            self.emit(f"leaq {label}(%rip), %rax")
+            return
+
+        if isinstance(expr, ArrayClone):
+            # A const array handed to code that may keep or change it
+            self.generate_expression(expr.array)
+            self.emit("movq %rax, %rdi")
+            self.emit(f"movq ${expr.depth}, %rsi")
+            self.emit("call vyl_array_clone")
+            return
+
         if isinstance(expr, TupleLiteral):
             self.generate_tuple_literal(expr)
             return
@@ -705,7 +1560,9 @@ class CodeGenerator:
 
         if isinstance(expr, UnaryExpr):
             self.generate_expression(expr.operand)
-            if expr.operator == "-":
+            if expr.operator == "-" and self._is_dec_operand(expr.operand):
+                self.emit("btcq $63, %rax")  # flip the sign bit
+            elif expr.operator == "-":
                 self.emit("negq %rax")
             elif expr.operator in ("!", "NOT"):
                 self.emit("cmpq $0, %rax")
@@ -744,81 +1601,12 @@ class CodeGenerator:
                     self.emit(f"{end_lbl}:")
                 return
 
-            def _is_stringish(node):
-                if isinstance(node, Literal) and node.literal_type == "string":
-                    return True
-                if isinstance(node, FunctionCall) and node.name in ("GetArg", "Read", "SHA256"):
-                    return True
-                if isinstance(node, Identifier):
-                    sym = self.get_variable_symbol(node.name)
-                    if sym and sym.typ == "string":
-                        return True
-                if isinstance(node, BinaryExpr) and node.operator == "+":
-                    # Recursive check - if either side is stringish, result is stringish
-                    return _is_stringish(node.left) or _is_stringish(node.right)
-                return False
-
-            left_stringy = _is_stringish(expr.left)
-            right_stringy = _is_stringish(expr.right)
-            stringy = left_stringy or right_stringy
+            stringy = self._is_string_operand(expr.left) or self._is_string_operand(expr.right)
 
             if expr.operator == "+" and stringy:
-                # String concatenation with automatic int-to-string conversion
-                # Use callee-saved registers to preserve values across function calls
-                
-                # Helper to convert int in %rax to string, result in %rax
-                def emit_int_to_string():
-                    self.emit("movq %rax, %r14")  # save int value in callee-saved reg
-                    self.emit("movq $24, %rdi")
-                    self.emit("call vyl_alloc")
-                    self.emit("movq %rax, %r12")  # buffer in r12
-                    self.emit("movq %r12, %rdi")  # 1st arg: buffer
-                    self.emit("leaq .int_fmt(%rip), %rsi")  # 2nd arg: format
-                    self.emit("movq %r14, %rdx")  # 3rd arg: value
-                    self.emit("movq $0, %rax")  # no vector registers for sprintf
-                    self.emit("call sprintf")
-                    self.emit("movq %r12, %rax")  # result is buffer
-                
-                # Generate left, convert if needed
-                self.generate_expression(expr.left)
-                if not left_stringy:
-                    emit_int_to_string()
-                self.emit("movq %rax, %r15")  # save left string in r15 (callee-saved)
-                
-                # Generate right, convert if needed
-                self.generate_expression(expr.right)
-                if not right_stringy:
-                    emit_int_to_string()
-                self.emit("movq %rax, %rbx")  # right string in rbx
-                
-                # Now concatenate: left in r15, right in rbx
-                # Get strlen of left
-                self.emit("movq %r15, %rdi")
-                self.emit("call strlen")
-                self.emit("movq %rax, %r14")  # len_left in r14
-                
-                # Get strlen of right
-                self.emit("movq %rbx, %rdi")
-                self.emit("call strlen")
-                self.emit("addq %r14, %rax")  # total length
-                self.emit("incq %rax")  # +1 for null terminator
-                
-                # Allocate destination buffer
-                self.emit("movq %rax, %rdi")
-                self.emit("call vyl_alloc")
-                self.emit("movq %rax, %r13")  # dest buffer in r13
-                
-                # strcpy(dest, left)
-                self.emit("movq %r13, %rdi")
-                self.emit("movq %r15, %rsi")
-                self.emit("call strcpy")
-                
-                # strcat(dest, right)
-                self.emit("movq %r13, %rdi")
-                self.emit("movq %rbx, %rsi")
-                self.emit("call strcat")
-                
-                self.emit("movq %r13, %rax")  # return concatenated string
+                # String concatenation with automatic int-to-string conversion;
+                # the whole chain is built in one allocation.
+                self.generate_concat(expr)
                 return
 
             if expr.operator in ("==", "!=") and stringy:
@@ -827,34 +1615,48 @@ class CodeGenerator:
                 self.generate_expression(expr.right)
                 self.emit("movq %rax, %rsi")
                 self.emit("pop %rdi")
-                self.emit("call strcmp")
-                self.emit("cmpq $0, %rax")
-                self.emit("sete %al" if expr.operator == "==" else "setne %al")
-                self.emit("movzbq %al, %rax")
+                self.emit("call vyl_streq")
+                if expr.operator == "!=":
+                    self.emit("xorq $1, %rax")
                 return
 
+            if (expr.operator in ("+", "-", "*", "/") and self._is_dec_operand(expr)) or (
+                expr.operator in CONDITION_CODES
+                and (self._is_dec_operand(expr.left) or self._is_dec_operand(expr.right))
+            ):
+                self.generate_dec_binary(expr)
+                return
+
+            # Right operands that are registers, slots or small immediates are
+            # used in place; anything else goes through the stack.
             self.generate_expression(expr.left)
-            self.emit("push %rax")
-            self.generate_expression(expr.right)
-            self.emit("movq %rax, %rbx")
-            self.emit("pop %rax")
+            rhs = self._simple_operand(expr.right)
+            if rhs is None or expr.operator in ("/", "%"):
+                if rhs is None:
+                    self.emit("push %rax")
+                    self.generate_expression(expr.right)
+                    self.emit("movq %rax, %rcx")
+                    self.emit("pop %rax")
+                else:
+                    self.emit(f"movq {rhs}, %rcx")
+                rhs = "%rcx"
 
             op = expr.operator
             if op == "+":
-                self.emit("addq %rbx, %rax")
+                self.emit(f"addq {rhs}, %rax")
             elif op == "-":
-                self.emit("subq %rbx, %rax")
+                self.emit(f"subq {rhs}, %rax")
             elif op == "*":
-                self.emit("imulq %rbx, %rax")
+                self._emit_multiply(rhs, "%rax")
             elif op == "/":
                 self.emit("cqto")
-                self.emit("idivq %rbx")
+                self.emit("idivq %rcx")
             elif op == "%":
                 self.emit("cqto")
-                self.emit("idivq %rbx")
+                self.emit("idivq %rcx")
                 self.emit("movq %rdx, %rax")
             elif op in ("==", "!=", "<", ">", "<=", ">="):
-                self.emit("cmpq %rbx, %rax")
+                self.emit(f"cmpq {rhs}, %rax")
                 table = {
                     "==": "sete",
                     "!=": "setne",
@@ -892,6 +1694,17 @@ class CodeGenerator:
             self.emit("movq (%rax), %rax")
             return
 
+        if isinstance(expr, SpawnExpr):
+            self.generate_spawn(expr.operand)
+            return
+
+        if isinstance(expr, AwaitExpr):
+            # Run other tasks until this one has finished, then take its result
+            self.generate_expression(expr.operand)
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_task_await")
+            return
+
         if isinstance(expr, EnumAccess):
             # Enums are compile-time constants
             if expr.enum_name not in self.enum_values:
@@ -904,6 +1717,8 @@ class CodeGenerator:
 
         if isinstance(expr, MethodCall):
             self.generate_method_call(expr)
+            if self._tuple_call_arity(expr):
+                self._emit_tuple_box(self._tuple_call_arity(expr))
             return
 
         raise CodegenError(f"Unsupported expression type: {type(expr).__name__}")
@@ -951,28 +1766,75 @@ class CodeGenerator:
             return field_type
         if isinstance(expr, IndexExpr):
             # dest receives address of element
+            self._emit_element_access(expr, f"leaq (%rdx,%rcx,8), {dest}")
+            return "int"
+        raise CodegenError("Unsupported lvalue expression")
+
+    def _emit_element_access(self, expr: IndexExpr, access: str):
+        """Load base into %rdx and index into %rcx, bounds-check, then emit access."""
+        base = self._simple_operand(expr.receiver)
+        index = self._simple_operand(expr.index)
+        if base is not None and (index is not None or base.startswith("%")):
+            # Leaf operands: no stack traffic (a register base survives the index)
+            if index is None:
+                self.generate_expression(expr.index)
+                self.emit("movq %rax, %rcx")
+            else:
+                self.emit(f"movq {index}, %rcx")
+            self.emit(f"movq {base}, %rdx")
+        else:
+            # Save base while computing index; index expression may call functions
             self.generate_expression(expr.receiver)
             self.emit("push %rax")
             self.generate_expression(expr.index)
             self.emit("movq %rax, %rcx")
-            self.emit("pop %rbx")
-            bounds_fail = self.get_label("oob")
-            self.emit("cmpq $0, %rbx")
-            self.emit(f"je {bounds_fail}")
-            self.emit("cmpq $0, %rcx")
-            self.emit(f"jl {bounds_fail}")
-            self.emit("movq -8(%rbx), %rdx")
-            self.emit("cmpq %rdx, %rcx")
+            self.emit("pop %rdx")
+        if not expr.checked or self.unchecked_depth:
+            self.emit(access)
+            return
+        bounds_fail = self.get_label("oob")
+        self.emit("cmpq $0, %rdx")
+        self.emit(f"je {bounds_fail}")
+        self.emit("cmpq $0, %rcx")
+        self.emit(f"jl {bounds_fail}")
+        self.emit("cmpq -8(%rdx), %rcx")
+        self.emit(f"jae {bounds_fail}")
+        self.emit(access)
+        self.emit(f"jmp {bounds_fail}_done")
+        self.emit(f"{bounds_fail}:")
+        self.emit("call vyl_bounds_fail")
+        self.emit(f"{bounds_fail}_done:")
+
+    def generate_bounds_check(self, node: BoundsCheck, fail_lbl: Optional[str] = None):
+        """Check a whole index range once (hoisted out of a loop by the optimizer).
+
+        With fail_lbl, an out-of-bounds range jumps there instead of failing.
+        """
+        if self.unchecked_depth:
+            return
+        self.generate_expression(node.array)
+        self.emit("push %rax")
+        self.generate_expression(node.low)
+        self.emit("push %rax")
+        self.generate_expression(node.high)
+        self.emit("pop %rcx")
+        self.emit("pop %rdx")
+        bounds_fail = fail_lbl or self.get_label("oob")
+        done_lbl = self.get_label("oob_done") if fail_lbl else f"{bounds_fail}_done"
+        self.emit("cmpq %rax, %rcx")
+        self.emit(f"jg {done_lbl}")
+        self.emit("cmpq $0, %rdx")
+        self.emit(f"je {bounds_fail}")
+        self.emit("cmpq $0, %rcx")
+        self.emit(f"jl {bounds_fail}")
+        self.emit("cmpq -8(%rdx), %rax")
+        if fail_lbl:
             self.emit(f"jae {bounds_fail}")
-            self.emit("imulq $8, %rcx")
-            self.emit("addq %rcx, %rbx")
-            self.emit(f"movq %rbx, {dest}")
-            self.emit(f"jmp {bounds_fail}_done")
+        else:
+            self.emit(f"jb {done_lbl}")
             self.emit(f"{bounds_fail}:")
             self.emit("call vyl_bounds_fail")
-            self.emit(f"{bounds_fail}_done:")
-            return "int"
-        raise CodegenError("Unsupported lvalue expression")
+        self.emit(f"{done_lbl}:")
 
     def var_size(self, var_type: str) -> int:
         if var_type in self.struct_layouts:
@@ -1019,18 +1881,51 @@ class CodeGenerator:
 
     # ---------- assignments ----------
     def generate_assignment(self, assign: Assignment):
-        self.generate_expression(assign.value)
-        if assign.target:
-            self.emit("push %rax")
-            self.generate_address(assign.target, dest="%rcx")
-            self.emit("pop %rax")
-            self.emit("movq %rax, (%rcx)")
+        if not assign.target:
+            sym = self.get_variable_symbol(assign.name)
+            if not sym:
+                raise CodegenError(f"Undefined variable '{assign.name}'")
+            self._emit_store(assign.name, assign.value, self.get_variable_location(sym))
             return
-        sym = self.get_variable_symbol(assign.name)
-        if sym:
-            self.emit(f"movq %rax, {self.get_variable_location(sym)}")
-        else:
-            raise CodegenError(f"Undefined variable '{assign.name}'")
+        self.generate_converted(assign.value, "dec" if self._is_dec_operand(assign.target) else None)
+        self.emit("push %rax")
+        self.generate_address(assign.target, dest="%rcx")
+        self.emit("pop %rax")
+        self.emit("movq %rax, (%rcx)")
+
+    def _emit_store(self, name: str, value, loc: str):
+        """Store ``value`` into ``loc`` without bouncing through %rax when possible."""
+        sym = self.get_variable_symbol(name)
+        if sym and sym.typ == "dec" and not self._is_dec_operand(value):
+            self.generate_converted(value, "dec")
+            self.emit(f"movq %rax, {loc}")
+            return
+        in_reg = loc.startswith("%")
+        operand = self._simple_operand(value)
+        if operand is not None and (in_reg or operand.startswith("$") or operand.startswith("%")):
+            if operand != loc:
+                self.emit(f"movq {operand}, {loc}")
+            return
+        # In-place update: x = x op <simple>
+        if (
+            isinstance(value, BinaryExpr)
+            and value.operator in ("+", "-", "*")
+            and isinstance(value.left, Identifier)
+            and value.left.name == name
+            and not self._is_string_operand(value)
+            and not self._is_dec_operand(value)
+        ):
+            rhs = self._simple_operand(value.right)
+            if rhs is not None and (in_reg or rhs.startswith("$") or rhs.startswith("%")) and (value.operator != "*" or in_reg):
+                if rhs == "$1" and value.operator in ("+", "-"):
+                    self.emit(f"{'incq' if value.operator == '+' else 'decq'} {loc}")
+                elif value.operator == "*":
+                    self._emit_multiply(rhs, loc)
+                else:
+                    self.emit(f"{'addq' if value.operator == '+' else 'subq'} {rhs}, {loc}")
+                return
+        self.generate_expression(value)
+        self.emit(f"movq %rax, {loc}")
 
     # ---------- struct instantiation ----------
     def generate_new_expr(self, expr: NewExpr):
@@ -1039,55 +1934,63 @@ class CodeGenerator:
         if not layout:
             raise CodegenError(f"Unknown struct type '{expr.struct_name}'")
         size = layout["size"]
+
+        slot = self.stack_objects.get(id(expr))
+        if slot is not None:
+            # Non-escaping: build it in the frame (zeroed there)
+            self._emit_frame_object(slot, size)
+        else:
+            # Allocate memory for struct
+            self.emit(f"movq ${size}, %rdi")
+            self.emit("call vyl_alloc")
+
+            # Zero-initialize all fields
+            for i in range(size // 8):
+                self.emit(f"movq $0, {i * 8}(%rax)")
         
-        # Allocate memory for struct
-        self.emit(f"movq ${size}, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("movq %rax, %r12")  # save struct pointer
-        
-        # Zero-initialize all fields
-        for i in range(size // 8):
-            self.emit(f"movq $0, {i * 8}(%r12)")
-        
-        # Apply initializers
+        # Apply initializers; the struct pointer stays on the stack meanwhile
+        self.emit("push %rax")
         for field_name, value in expr.initializers:
             field_info = layout["fields"].get(field_name)
             if not field_info:
                 raise CodegenError(f"Unknown field '{field_name}' on struct '{expr.struct_name}'")
             field_type, offset = field_info
             
-            self.emit("push %r12")  # save struct pointer
-            self.generate_expression(value)
-            self.emit("pop %r12")  # restore struct pointer
-            self.emit(f"movq %rax, {offset}(%r12)")
+            self.generate_converted(value, field_type)
+            self.emit("movq (%rsp), %rcx")
+            self.emit(f"movq %rax, {offset}(%rcx)")
         
-        self.emit("movq %r12, %rax")  # return struct pointer
+        self.emit("pop %rax")  # return struct pointer
 
     # ---------- array literals ----------
     def generate_array_literal(self, expr: ArrayLiteral):
         """Generate code for [expr1, expr2, ...]"""
         num_elements = len(expr.elements)
         
-        # Allocate: 8 bytes for length + 8 bytes per element
-        total_size = 8 + (num_elements * 8)
-        self.emit(f"movq ${total_size}, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("movq %rax, %r12")  # save array pointer
-        
-        # Store length at offset 0
-        self.emit(f"movq ${num_elements}, (%r12)")
-        
-        # Evaluate and store each element
+        # Allocate: capacity and length header + 8 bytes per element
+        total_size = ARRAY_HEADER_SIZE + (num_elements * 8)
+        slot = self.stack_objects.get(id(expr))
+        if slot is not None:
+            self.emit(f"leaq {slot}(%rbp), %rax")  # every word is written below
+        else:
+            self.emit(f"movq ${total_size}, %rdi")
+            self.emit("call vyl_alloc")
+
+        # Capacity at offset 0, length at offset 8
+        self.emit(f"movq ${num_elements}, (%rax)")
+        self.emit(f"movq ${num_elements}, 8(%rax)")
+
+        # Evaluate and store each element; the array pointer stays on the stack
+        self.emit("push %rax")
         for i, elem in enumerate(expr.elements):
-            self.emit("push %r12")  # save array pointer
             self.generate_expression(elem)
-            self.emit("pop %r12")  # restore array pointer
-            offset = 8 + (i * 8)  # skip length field
-            self.emit(f"movq %rax, {offset}(%r12)")
-        
-        # Return pointer to first element (skip length)
-        self.emit("addq $8, %r12")
-        self.emit("movq %r12, %rax")
+            self.emit("movq (%rsp), %rcx")
+            offset = ARRAY_HEADER_SIZE + (i * 8)  # skip header
+            self.emit(f"movq %rax, {offset}(%rcx)")
+
+        # Return pointer to first element (skip header)
+        self.emit("pop %rax")
+        self.emit(f"addq ${ARRAY_HEADER_SIZE}, %rax")
 
     def generate_tuple_literal(self, expr: TupleLiteral):
         """Generate code for (expr1, expr2, ...)"""
@@ -1095,122 +1998,31 @@ class CodeGenerator:
         
         # Allocate: 8 bytes per element
         total_size = num_elements * 8
-        self.emit(f"movq ${total_size}, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("movq %rax, %r12")  # save tuple pointer
+        slot = self.stack_objects.get(id(expr))
+        if slot is not None:
+            self.emit(f"leaq {slot}(%rbp), %rax")  # every word is written below
+        else:
+            self.emit(f"movq ${total_size}, %rdi")
+            self.emit("call vyl_alloc")
         
-        # Evaluate and store each element
+        # Evaluate and store each element; the tuple pointer stays on the stack
+        self.emit("push %rax")
         for i, elem in enumerate(expr.elements):
-            self.emit("push %r12")  # save tuple pointer
             self.generate_expression(elem)
-            self.emit("pop %r12")  # restore tuple pointer
+            self.emit("movq (%rsp), %rcx")
             offset = i * 8
-            self.emit(f"movq %rax, {offset}(%r12)")
+            self.emit(f"movq %rax, {offset}(%rcx)")
         
         # Return pointer to tuple
-        self.emit("movq %r12, %rax")
+        self.emit("pop %rax")
 
     def generate_interp_string(self, expr: InterpString):
         """Generate code for interpolated string: "Hello {name}!"
-        
-        The approach is to build the string by:
-        1. For each part, generate either a string literal or convert expression to string
-        2. Concatenate all parts together using vyl_strconcat
+
+        Literal pieces and embedded expressions become parts of one
+        concatenation, so the result is sized and allocated once.
         """
-        # Import lexer and parser for parsing embedded expressions
-        try:
-            from .lexer import tokenize
-            from .parser import Parser
-        except ImportError:
-            from lexer import tokenize
-            from parser import Parser
-        
-        parts = expr.parts
-        
-        if not parts:
-            # Empty string
-            label = self.get_label(".str")
-            self.string_literals.append((label, ""))
-            self.emit(f"leaq {label}(%rip), %rax")
-            return
-        
-        # Helper to convert int in %rax to string, result in %rax
-        # Uses rbx (callee-saved) to preserve values across calls
-        def emit_int_to_string():
-            self.emit("push %rbx")  # save rbx
-            self.emit("movq %rax, %rbx")  # save int value
-            self.emit("subq $8, %rsp")  # align stack to 16 bytes
-            self.emit("movq $24, %rdi")
-            self.emit("call vyl_alloc")
-            self.emit("push %rax")  # save buffer pointer
-            self.emit("movq %rax, %rdi")  # 1st arg: buffer
-            self.emit("leaq .int_fmt(%rip), %rsi")  # 2nd arg: format
-            self.emit("movq %rbx, %rdx")  # 3rd arg: value
-            self.emit("movq $0, %rax")  # no vector registers for sprintf
-            self.emit("call sprintf")
-            self.emit("pop %rax")  # result is buffer
-            self.emit("addq $8, %rsp")  # remove alignment padding
-            self.emit("pop %rbx")  # restore rbx
-        
-        def is_stringish_expr(node):
-            """Check if expression result is a string."""
-            if isinstance(node, Literal) and node.literal_type == "string":
-                return True
-            if isinstance(node, FunctionCall) and node.name in ("GetArg", "Read", "SHA256", "Input", "GetEnv", "StrConcat", "Substring"):
-                return True
-            if isinstance(node, Identifier):
-                sym = self.get_variable_symbol(node.name)
-                if sym and sym.typ == "string":
-                    return True
-            if isinstance(node, InterpString):
-                return True
-            return False
-        
-        # Generate first part
-        is_expr, value = parts[0]
-        if is_expr:
-            # Parse and generate the expression
-            tokens = tokenize(value)
-            parser = Parser(tokens)
-            ast_expr = parser.parse_expression()
-            self.generate_expression(ast_expr)
-            if not is_stringish_expr(ast_expr):
-                emit_int_to_string()
-        else:
-            # String literal
-            label = self.get_label(".str")
-            self.string_literals.append((label, value))
-            self.emit(f"leaq {label}(%rip), %rax")
-        
-        # If only one part, we're done
-        if len(parts) == 1:
-            return
-        
-        # Save result and concatenate with remaining parts
-        self.emit("push %rax")  # Save accumulated string
-        
-        for is_expr, value in parts[1:]:
-            # Generate next part
-            if is_expr:
-                tokens = tokenize(value)
-                parser = Parser(tokens)
-                ast_expr = parser.parse_expression()
-                self.generate_expression(ast_expr)
-                if not is_stringish_expr(ast_expr):
-                    emit_int_to_string()
-            else:
-                label = self.get_label(".str")
-                self.string_literals.append((label, value))
-                self.emit(f"leaq {label}(%rip), %rax")
-            
-            # Concatenate: pop left, right is in rax
-            self.emit("movq %rax, %rsi")  # right
-            self.emit("pop %rdi")  # left
-            self.emit("call vyl_strconcat")
-            self.emit("push %rax")  # Save result for next iteration
-        
-        # Final result is on stack
-        self.emit("pop %rax")
+        self.generate_concat(expr)
 
     def generate_try_expr(self, expr: TryExpr):
         """Generate code for error propagation: expr?
@@ -1227,6 +2039,7 @@ class CodeGenerator:
         self.emit(f"jge {ok_label}")  # Jump if >= 0 (success)
         
         # Error path: execute deferred statements and jump to function epilogue
+        self._emit_arena_pop(self.arena_depth)
         self._emit_deferred_statements()
         
         # Jump to the function's return label which handles proper stack cleanup
@@ -1234,8 +2047,7 @@ class CodeGenerator:
             self.emit(f"jmp {self.current_function_end_label}")
         else:
             # Fallback: direct return (shouldn't happen in practice)
-            self.emit("leave")
-            self.emit("ret")
+            self._emit_leave_ret()
         
         # Success path: continue with the value
         self.emit(f"{ok_label}:")
@@ -1248,29 +2060,12 @@ class CodeGenerator:
             if call.arguments:
                 arg = call.arguments[0]
                 self.generate_expression(arg)
-                stringy = isinstance(arg, Literal) and arg.literal_type == "string"
-                if isinstance(arg, InterpString):
-                    stringy = True
-                if isinstance(arg, FunctionCall) and arg.name in ("GetArg", "Read", "SHA256", "Input", "GetEnv", "StrConcat", "Substring"):
-                    stringy = True
-                # Check if it's a variable reference of type string
-                if isinstance(arg, Identifier):
-                    sym = self.get_variable_symbol(arg.name)
-                    if sym and sym.typ == "string":
-                        stringy = True
-                # Check if it's indexing a string array
-                if isinstance(arg, IndexExpr):
-                    if isinstance(arg.receiver, Identifier):
-                        sym = self.get_variable_symbol(arg.receiver.name)
-                        if sym and sym.typ in ("string[]", "array"):
-                            # Check if it's a string array by inspecting element type
-                            if sym.typ == "string[]":
-                                stringy = True
-                # Check if it's a string concatenation expression
-                if isinstance(arg, BinaryExpr) and arg.operator == "+":
-                    stringy = self._expr_is_stringish(arg)
+                stringy = self._is_string_operand(arg)
                 self.emit("movq %rax, %rdi")
-                self.emit("call print_string" if stringy else "call print_int")
+                if self._is_dec_operand(arg):
+                    self.emit("call print_dec")
+                else:
+                    self.emit("call print_string" if stringy else "call print_int")
             return
 
         if name == "Len":
@@ -1299,7 +2094,7 @@ class CodeGenerator:
                 raise CodegenError("Sys expects (command)")
             self.generate_expression(call.arguments[0])
             self.emit("movq %rax, %rdi")
-            self.emit("call system")
+            self.emit("call vyl_system")
             return
 
         if name == "Input":
@@ -1362,14 +2157,66 @@ class CodeGenerator:
             self.emit("call vyl_collect")
             return
 
+        if name == "Yield":
+            self.emit("call vyl_task_yield")
+            return
+
+        if name in ("Chan", "ChanRecv", "ChanClose", "ChanLen"):
+            helper = {"Chan": "vyl_chan_new", "ChanRecv": "vyl_chan_recv",
+                      "ChanClose": "vyl_chan_close", "ChanLen": "vyl_chan_len"}[name]
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit(f"call {helper}")
+            return
+
+        if name == "ChanSend":
+            elem = chan_elem_type(self._static_type(call.arguments[0]))
+            self.generate_converted(call.arguments[1], elem)
+            self.emit("push %rax")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("pop %rsi")
+            self.emit("call vyl_chan_send")
+            return
+
+        if name in ("AtomicAdd", "AtomicLoad", "AtomicStore", "AtomicCas"):
+            # Lock-prefixed read-modify-write on one element, bounds-checked
+            # like a[i]; the values are evaluated first and wait on the stack
+            values = call.arguments[2:]
+            for value in reversed(values):
+                self.generate_expression(value)
+                self.emit("push %rax")
+            slot = IndexExpr(receiver=call.arguments[0], index=call.arguments[1])
+            self._emit_element_access(slot, "leaq (%rdx,%rcx,8), %rdx")
+            if name == "AtomicAdd":
+                self.emit("pop %rax")
+                self.emit("lock xaddq %rax, (%rdx)")  # %rax = the value before
+            elif name == "AtomicLoad":
+                self.emit("movq (%rdx), %rax")  # aligned loads are atomic on x86-64
+            elif name == "AtomicStore":
+                self.emit("pop %rax")
+                self.emit("xchgq %rax, (%rdx)")  # a store with a full fence
+            else:
+                self.emit("pop %rax")  # expected
+                self.emit("pop %rcx")  # replacement
+                self.emit("lock cmpxchgq %rcx, (%rdx)")
+                self.emit("sete %al")
+                self.emit("movzbq %al, %rax")
+            return
+
         if name == "ReadFilesize":
             if len(call.arguments) != 1:
                 raise CodegenError("ReadFilesize expects (path)")
             fail_lbl = self.get_label("rfs_fail")
             done_lbl = self.get_label("rfs_done")
             self.generate_expression(call.arguments[0])
+            self.emit("push %rbx")
+            self.emit("push %r12")
             self.emit("movq %rax, %rdi")
-            self.emit("leaq .mode_rb(%rip), %rsi")
+            # The mode string lives with this unit; runtime .labels are not exported
+            mode_lbl = self.get_label(".str")
+            self.string_literals.append((mode_lbl, "rb"))
+            self.emit(f"leaq {mode_lbl}(%rip), %rsi")
             self.emit("call fopen")
             self.emit("movq %rax, %rbx")
             self.emit(f"cmpq $0, %rbx")
@@ -1390,6 +2237,8 @@ class CodeGenerator:
             self.emit(f"{fail_lbl}:")
             self.emit("movq $0, %rax")
             self.emit(f"{done_lbl}:")
+            self.emit("pop %r12")
+            self.emit("pop %rbx")
             return
 
         if name == "Argc":
@@ -1399,16 +2248,15 @@ class CodeGenerator:
         if name == "GetArg":
             if len(call.arguments) == 1:
                 self.generate_expression(call.arguments[0])
-                self.emit("movq argv_store(%rip), %rbx")
-                self.emit("movq %rax, %rcx")
-                self.emit("movq (%rbx,%rcx,8), %rax")
+                self.emit("movq argv_store(%rip), %rdx")
+                self.emit("movq (%rdx,%rax,8), %rax")
                 return
             if len(call.arguments) == 2:
                 self.generate_expression(call.arguments[1])
-                self.emit("movq %rax, %rcx")
+                self.emit("push %rax")
                 self.generate_expression(call.arguments[0])
-                self.emit("movq %rax, %rbx")
-                self.emit("movq (%rbx,%rcx,8), %rax")
+                self.emit("pop %rcx")
+                self.emit("movq (%rax,%rcx,8), %rax")
                 return
             raise CodegenError("GetArg expects 1 or 2 arguments")
 
@@ -1417,7 +2265,7 @@ class CodeGenerator:
                 raise CodegenError("Exit expects (code)")
             self.generate_expression(call.arguments[0])
             self.emit("movq %rax, %rdi")
-            self.emit("call exit")
+            self.emit("call vyl_exit")
             self.emit("movq $0, %rax")
             return
 
@@ -1425,30 +2273,8 @@ class CodeGenerator:
             if len(call.arguments) != 1:
                 raise CodegenError("Sleep expects (ms)")
             self.generate_expression(call.arguments[0])
-            self.emit("push %rbp")
-            self.emit("movq %rsp, %rbp")
-            self.emit("push %rbx")
-            self.emit("push %r12")
-            # 208 bytes keeps rsp%16==8 after two pushes
-            self.emit("subq $208, %rsp")
-            self.emit("movq $1000, %rcx")
-            self.emit("xorq %rdx, %rdx")
-            self.emit("movq %rbx, %rax")
-            self.emit("divq %rcx")          # rax=sec, rdx=ms
-            self.emit("subq $16, %rsp")
-            self.emit("movq %rax, (%rsp)")  # tv_sec
-            self.emit("movq %rdx, %rax")
-            self.emit("movq $1000000, %rcx")
-            self.emit("imulq %rcx, %rax")   # ms->ns
-            self.emit("movq %rax, 8(%rsp)") # tv_nsec
-            self.emit("leaq (%rsp), %rdi")
-            self.emit("movq $0, %rsi")
-            self.emit("call nanosleep")
-            self.emit("addq $16, %rsp")
-            self.emit("pop %rdx")
-            self.emit("pop %rcx")
-            self.emit("pop %rbx")
-            self.emit("movq $0, %rax")
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_sleep_ms")
             return
 
         if name == "Now":
@@ -1460,17 +2286,41 @@ class CodeGenerator:
             self.emit("call clock_gettime")
             self.emit("movq (%rsp), %rax")    # sec
             self.emit("imulq $1000, %rax")    # sec -> ms
-            self.emit("movq %rax, %rbx")      # sec_ms
+            self.emit("movq %rax, %rsi")      # sec_ms
             self.emit("movq 8(%rsp), %rcx")   # nsec
             self.emit("movq $1000000, %r8")
             self.emit("xorq %rdx, %rdx")
             self.emit("movq %rcx, %rax")
             self.emit("divq %r8")             # (nsec / 1e6) quotient in rax
-            self.emit("addq %rax, %rbx")      # total ms
-            self.emit("movq %rbx, %rax")
+            self.emit("addq %rsi, %rax")      # total ms
             self.emit("addq $16, %rsp")
             return
 
+        if name == "NowNs":
+            if call.arguments:
+                raise CodegenError("NowNs expects ()")
+            self.emit("call vyl_clock_ns")
+            return
+
+        if name == "Bench":
+            if len(call.arguments) != 2:
+                raise CodegenError("Bench expects (name, ops)")
+            self.generate_expression(call.arguments[1])
+            self.emit("push %rax")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("pop %rsi")
+            self.emit("call vyl_bench_new")
+            return
+
+        if name in ("BenchNext", "BenchReport"):
+            if len(call.arguments) != 1:
+                raise CodegenError(f"{name} expects (bench)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_bench_next" if name == "BenchNext" else "call vyl_bench_report")
+            return
+
         if name == "RandInt":
             if call.arguments:
                 raise CodegenError("RandInt expects ()")
@@ -1551,24 +2401,97 @@ class CodeGenerator:
         if name == "Array":
             if len(call.arguments) != 1:
                 raise CodegenError("Array expects (length)")
+            slot = self.stack_objects.get(id(call))
+            if slot is not None:
+                length = int(call.arguments[0].value)
+                self._emit_frame_object(slot, ARRAY_HEADER_SIZE + length * 8)
+                self.emit(f"movq ${length}, (%rax)")      # capacity
+                self.emit(f"movq ${length}, 8(%rax)")     # length
+                self.emit(f"addq ${ARRAY_HEADER_SIZE}, %rax")
+                return
             fail_lbl = self.get_label("array_fail")
             done_lbl = self.get_label("array_done")
             self.generate_expression(call.arguments[0])
-            self.emit("movq %rax, %rbx")        # length
-            self.emit("movq %rax, %rdi")
-            self.emit("imulq $8, %rdi")         # bytes for elements
-            self.emit("addq $8, %rdi")          # + header for length
+            self.emit("push %rax")              # length
+            self.emit("subq $8, %rsp")
+            self.emit(f"leaq {ARRAY_HEADER_SIZE}(,%rax,8), %rdi")  # elements + capacity/length header
             self.emit("call vyl_alloc")
+            self.emit("addq $8, %rsp")
+            self.emit("pop %rcx")
             self.emit("cmpq $0, %rax")
             self.emit(f"je {fail_lbl}")
-            self.emit("movq %rbx, (%rax)")      # store length at header
-            self.emit("addq $8, %rax")          # return data pointer
+            self.emit("movq %rcx, (%rax)")      # capacity
+            self.emit("movq %rcx, 8(%rax)")     # length
+            self.emit(f"addq ${ARRAY_HEADER_SIZE}, %rax")  # return data pointer
             self.emit(f"jmp {done_lbl}")
             self.emit(f"{fail_lbl}:")
             self.emit("movq $0, %rax")
             self.emit(f"{done_lbl}:")
             return
 
+        if name == "Map":
+            if call.arguments:
+                raise CodegenError("Map expects no arguments")
+            self.emit("call vyl_map_new")
+            return
+
+        if name == "MapLen":
+            if len(call.arguments) != 1:
+                raise CodegenError("MapLen expects (map)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq 16(%rax), %rax")
+            return
+
+        if name == "MapKeys":
+            if len(call.arguments) != 1:
+                raise CodegenError("MapKeys expects (map)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_map_keys")
+            return
+
+        if name in ("MapSet", "MapGet", "MapHas", "MapDelete"):
+            arity = 3 if name == "MapSet" else 2
+            if len(call.arguments) != arity:
+                raise CodegenError(f"{name} expects (map, key{', value' if arity == 3 else ''})")
+            for arg in reversed(call.arguments[1:]):
+                self.generate_expression(arg)
+                self.emit("push %rax")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("pop %rsi")
+            if arity == 3:
+                self.emit("pop %rdx")
+            self.emit(f"call vyl_map_{name[3:].lower()}_{self._map_key_kind(call)}")
+            return
+
+        if name == "Vec":
+            if len(call.arguments) != 1:
+                raise CodegenError("Vec expects (capacity)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_vec_new")
+            return
+
+        if name == "Push":
+            if len(call.arguments) != 2:
+                raise CodegenError("Push expects (vec, value)")
+            self.generate_expression(call.arguments[1])
+            self.emit("push %rax")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("pop %rsi")
+            self.emit("call vyl_vec_push")
+            return
+
+        if name == "Pop":
+            if len(call.arguments) != 1:
+                raise CodegenError("Pop expects (vec)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_vec_pop")
+            return
+
         if name == "Length":
             if len(call.arguments) != 1:
                 raise CodegenError("Length expects (array)")
@@ -1578,10 +2501,30 @@ class CodeGenerator:
 
         if name == "Sqrt":
             if len(call.arguments) != 1:
-                raise CodegenError("Sqrt expects (int)")
+                raise CodegenError("Sqrt expects (int) or (dec)")
             self.generate_expression(call.arguments[0])
-            self.emit("movq %rax, %rdi")
-            self.emit("call vyl_isqrt")
+            if self._is_dec_operand(call.arguments[0]):
+                self.emit("movq %rax, %xmm0")
+                self.emit("sqrtsd %xmm0, %xmm0")
+                self.emit("movq %xmm0, %rax")
+            else:
+                self.emit("movq %rax, %rdi")
+                self.emit("call vyl_isqrt")
+            return
+
+        if name == "ToDec":
+            if len(call.arguments) != 1:
+                raise CodegenError("ToDec expects (int)")
+            self.generate_converted(call.arguments[0], "dec")
+            return
+
+        if name == "ToInt":
+            if len(call.arguments) != 1:
+                raise CodegenError("ToInt expects (dec)")
+            self.generate_expression(call.arguments[0])
+            if self._is_dec_operand(call.arguments[0]):
+                self.emit("movq %rax, %xmm0")
+                self.emit("cvttsd2siq %xmm0, %rax")  # truncates toward zero
             return
 
         if name == "Malloc":
@@ -1604,13 +2547,127 @@ class CodeGenerator:
             if len(call.arguments) != 1:
                 raise CodegenError("Free expects (ptr)")
             self.generate_expression(call.arguments[0])
-            # vyl_alloc returns ptr+24, so we need to subtract 24 to get original malloc ptr
-            self.emit("subq $24, %rax")
             self.emit("movq %rax, %rdi")
-            self.emit("call free")
+            self.emit("call vyl_free")
+            self.emit("movq $0, %rax")
+            return
+
+        if name == "ArenaNew":
+            if len(call.arguments) != 1:
+                raise CodegenError("ArenaNew expects (size)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_arena_new")
+            return
+
+        if name == "ArenaAlloc":
+            if len(call.arguments) != 2:
+                raise CodegenError("ArenaAlloc expects (arena, size)")
+            self.generate_expression(call.arguments[1])
+            self.emit("push %rax")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("pop %rsi")
+            self.emit("call vyl_arena_alloc")
+            return
+
+        if name in ("ArenaReset", "ArenaFree"):
+            if len(call.arguments) != 1:
+                raise CodegenError(f"{name} expects (arena)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_arena_reset" if name == "ArenaReset" else "call vyl_arena_free")
+            self.emit("movq $0, %rax")
+            return
+
+        if name == "Flush":
+            if len(call.arguments) > 1:
+                raise CodegenError("Flush expects () or (writer)")
+            if call.arguments:
+                self.generate_expression(call.arguments[0])
+                self.emit("movq %rax, %rdi")
+                self.emit("call vyl_buf_flush")
+            else:
+                self.emit("call vyl_flush_all")
+            self.emit("movq $0, %rax")
+            return
+
+        if name in ("BufferedWriter", "CloseWriter"):
+            if len(call.arguments) != 1:
+                raise CodegenError(f"{name} expects one argument")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_writer_new" if name == "BufferedWriter" else "call vyl_writer_close")
+            return
+
+        if name in ("MapFile", "UnmapFile", "LineReader", "ReadLine", "ReadChunk", "ReaderEof", "CloseReader"):
+            if len(call.arguments) != 1:
+                raise CodegenError(f"{name} expects one argument")
+            helper = {"MapFile": "vyl_map_file", "UnmapFile": "vyl_unmap_file",
+                      "LineReader": "vyl_reader_new", "ReadLine": "vyl_reader_line",
+                      "ReadChunk": "vyl_reader_chunk", "ReaderEof": "vyl_reader_eof",
+                      "CloseReader": "vyl_reader_close"}[name]
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit(f"call {helper}")
+            return
+
+        if name in ("BufWrite", "BufWriteInt"):
+            if len(call.arguments) != 2:
+                raise CodegenError(f"{name} expects (writer, value)")
+            self.generate_expression(call.arguments[1])
+            self.emit("push %rax")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("pop %rsi")
+            self.emit("call vyl_writer_write" if name == "BufWrite" else "call vyl_writer_write_int")
+            self.emit("movq $0, %rax")
+            return
+
+        if name == "StringBuilder":
+            if call.arguments:
+                raise CodegenError("StringBuilder expects no arguments")
+            self.emit("call vyl_sb_new")
+            return
+
+        if name in ("Append", "AppendInt", "Reserve"):
+            if len(call.arguments) != 2:
+                raise CodegenError(f"{name} expects (sb, value)")
+            helper = {"Append": "vyl_sb_append", "AppendInt": "vyl_sb_append_int",
+                      "Reserve": "vyl_sb_reserve"}[name]
+            self.generate_expression(call.arguments[1])
+            self.emit("push %rax")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("pop %rsi")
+            self.emit(f"call {helper}")
             self.emit("movq $0, %rax")
             return
 
+        if name == "Build":
+            if len(call.arguments) != 1:
+                raise CodegenError("Build expects (sb)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_sb_build")
+            return
+
+        if name in ARRAY_KERNELS:
+            expected = 2 if name in ("ArrayFind", "ArrayFill", "ArrayCopy") else 1
+            if len(call.arguments) != expected:
+                raise CodegenError(f"{name} expects {expected} argument(s)")
+            int_kernel, dec_kernel = ARRAY_KERNELS[name]
+            dec = self._static_type(call.arguments[0]) == "dec[]"
+            if expected == 2:
+                self.generate_converted(call.arguments[1], "dec" if dec and name != "ArrayCopy" else None)
+                self.emit("push %rax")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            if expected == 2:
+                self.emit("pop %rsi")
+            self.emit(f"call {dec_kernel if dec else int_kernel}")
+            return
+
         if name == "Memcpy":
             if len(call.arguments) != 3:
                 raise CodegenError("Memcpy expects (dst, src, n)")
@@ -1655,8 +2712,7 @@ class CodeGenerator:
             if len(call.arguments) != 1:
                 raise CodegenError("StrLen expects (str)")
             self.generate_expression(call.arguments[0])
-            self.emit("movq %rax, %rdi")
-            self.emit("call strlen")
+            self.emit("movq -8(%rax), %rax")  # length lives in the string header
             return
 
         if name == "StrFind":
@@ -1693,12 +2749,9 @@ class CodeGenerator:
             self.generate_expression(call.arguments[0])
             self.emit("movq %rax, %rdi")
             self.emit("call getenv")
-            # If NULL, return empty string
-            self.emit("cmpq $0, %rax")
-            lbl = self.get_label("getenv")
-            self.emit(f"jne {lbl}")
-            self.emit("leaq .empty_str(%rip), %rax")
-            self.emit(f"{lbl}:")
+            # A NULL result becomes the empty string
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_str_from_cstr")
             return
 
         if name == "Sys":
@@ -1707,7 +2760,7 @@ class CodeGenerator:
                 raise CodegenError("Sys expects (command)")
             self.generate_expression(call.arguments[0])
             self.emit("movq %rax, %rdi")
-            self.emit("call system")
+            self.emit("call vyl_system")
             return
 
         if name == "TcpConnect":
@@ -1751,6 +2804,22 @@ class CodeGenerator:
             self.emit("call close")
             return
 
+        if name == "TcpListen":
+            if len(call.arguments) != 1:
+                raise CodegenError("TcpListen expects (port)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_tcp_listen")
+            return
+
+        if name == "TcpAccept":
+            if len(call.arguments) != 1:
+                raise CodegenError("TcpAccept expects (listener)")
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit("call vyl_tcp_accept")
+            return
+
         if name == "TcpResolve":
             if len(call.arguments) != 1:
                 raise CodegenError("TcpResolve expects (host)")
@@ -1831,82 +2900,213 @@ class CodeGenerator:
             self.emit("call vyl_http_download")
             return
 
-        # generic call using SysV registers for first 6 args
-        arg_regs = ["%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"]
-        
-        # Build full argument list with defaults filled in
-        full_args: List = list(call.arguments)
-        if name in self.function_defs:
-            func_def = self.function_defs[name]
-            # Fill in missing arguments with defaults
-            for i in range(len(call.arguments), len(func_def.params)):
-                _, _, default = func_def.params[i]
-                if default is not None:
-                    full_args.append(default)
-        
-        arg_count = len(full_args)
-        # Evaluate args right-to-left, push on stack
-        for arg in reversed(full_args):
-            self.generate_expression(arg)
+        if name == "HttpOpen":
+            if len(call.arguments) != 3:
+                raise CodegenError("HttpOpen expects (host, path, use_tls)")
+            self.generate_expression(call.arguments[0])
             self.emit("push %rax")
-        # Pop into registers in order
-        for idx in range(min(arg_count, len(arg_regs))):
-            self.emit(f"pop {arg_regs[idx]}")
-        # Remove any remaining stack args beyond 6 (not currently emitted separately)
-        if arg_count > len(arg_regs):
-            excess = arg_count - len(arg_regs)
-            self.emit(f"addq ${excess * 8}, %rsp")
-        self.emit(f"call {name}")
+            self.generate_expression(call.arguments[1])
+            self.emit("push %rax")
+            self.generate_expression(call.arguments[2])
+            self.emit("movq %rax, %rdx")
+            self.emit("pop %rsi")
+            self.emit("pop %rdi")
+            self.emit("call vyl_http_open")
+            return
+
+        if name in ("HttpStatus", "HttpRead", "HttpClose"):
+            if len(call.arguments) != 1:
+                raise CodegenError(f"{name} expects (response)")
+            helper = {"HttpStatus": "vyl_http_status", "HttpRead": "vyl_http_read",
+                      "HttpClose": "vyl_http_finish"}[name]
+            self.generate_expression(call.arguments[0])
+            self.emit("movq %rax, %rdi")
+            self.emit(f"call {helper}")
+            return
+
+        # generic call using SysV registers for the first 6 integer and 8 dec args
+        # Build full argument list with defaults filled in
+        full_args: List = list(call.arguments)
+        types: List[Optional[str]] = [None] * len(full_args)
+        return_type = None
+        if name in self.function_defs:
+            func_def = self.function_defs[name]
+            # Fill in missing arguments with defaults
+            for i in range(len(call.arguments), len(func_def.params)):
+                _, _, default = func_def.params[i]
+                if default is not None:
+                    full_args.append(default)
+            types = [ptype for _, ptype, _ in func_def.params[:len(full_args)]]
+            types += [None] * (len(full_args) - len(types))
+            return_type = func_def.return_type
+            if func_def.is_async:
+                name, return_type = f"__async_{name}", None
+        self._emit_user_call(name, full_args, types, return_type)
+
+    def generate_spawn(self, call: FunctionCall):
+        """Queue call as a task any worker thread may run; %rax = its handle."""
+        func_def = self.function_defs[call.name]
+        full_args: List = list(call.arguments)
+        for _, _, default in func_def.params[len(full_args):]:
+            if default is not None:
+                full_args.append(default)
+        types = [ptype for _, ptype, _ in func_def.params[:len(full_args)]]
+        self.spawned.add(call.name)
+        self._emit_user_call(f"__spawn_{call.name}", full_args, types, None)
 
     def generate_method_call(self, call: MethodCall):
         """Generate code for a method call: receiver.method(args)
         The receiver becomes the implicit 'self' first argument."""
         # Determine struct name from receiver
         receiver = call.receiver
-        struct_name = None
+        struct_name = self._receiver_struct(receiver)
+
+        method_name = f"{struct_name}_{call.method_name}" if struct_name else call.method_name
+
+        # Total args = self + explicit args, under the SysV calling convention
+        all_args = [receiver] + list(call.arguments)
+        types: List[Optional[str]] = [struct_name] + [None] * len(call.arguments)
+        method = self.method_table.get(struct_name or "", {}).get(call.method_name)
+        if method:
+            types[1:] = [p[1] for p in method.params[:len(call.arguments)]]
+            types += [None] * (len(all_args) - len(types))
+        self._emit_user_call(method_name, all_args, types, method.return_type if method else None)
+
+    def _receiver_struct(self, receiver) -> Optional[str]:
+        """Struct type of a method receiver, when it is statically known."""
         if isinstance(receiver, Identifier):
             sym = self.get_variable_symbol(receiver.name)
             if sym:
-                struct_name = sym.typ
+                return sym.typ
         elif isinstance(receiver, SelfExpr):
             if self.current_struct:
-                struct_name = self.current_struct.name
-        elif isinstance(receiver, FieldAccess):
-            # Need to figure out type from field access - for now just try looking up method
-            pass
-
-        method_name = f"{struct_name}_{call.method_name}" if struct_name else call.method_name
-
-        # SysV calling convention: rdi, rsi, rdx, rcx, r8, r9
-        arg_regs = ["%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"]
-
-        # Total args = self + explicit args
-        all_args = [receiver] + list(call.arguments)
-        arg_count = len(all_args)
+                return self.current_struct.name
+        # Field receivers would need the field's type - the method is looked up by name
+        return None
+
+    def generate_dec_binary(self, expr: BinaryExpr):
+        """SSE2 arithmetic or comparison on doubles; an int operand is widened."""
+        op = expr.operator
+        if op in DEC_CONDITION_CODES:
+            self._emit_dec_compare(expr)
+            self.emit(f"set{DEC_CONDITION_CODES[op]} %al")
+            self.emit("movzbq %al, %rax")
+            return
+        self._emit_dec_operands(expr.left, expr.right)
+        if op in ("==", "!="):
+            # Unordered operands compare unequal: ZF and not PF
+            self.emit("ucomisd %xmm1, %xmm0")
+            if op == "==":
+                self.emit("sete %al")
+                self.emit("setnp %cl")
+                self.emit("andb %cl, %al")
+            else:
+                self.emit("setne %al")
+                self.emit("setp %cl")
+                self.emit("orb %cl, %al")
+            self.emit("movzbq %al, %rax")
+            return
+        instr = {"+": "addsd", "-": "subsd", "*": "mulsd", "/": "divsd"}[op]
+        self.emit(f"{instr} %xmm1, %xmm0")
+        self.emit("movq %xmm0, %rax")
 
-        # Evaluate args right-to-left, push on stack
-        for arg in reversed(all_args):
-            self.generate_expression(arg)
-            self.emit("push %rax")
+    def _emit_dec_operands(self, left, right):
+        """Leave left in %xmm0 and right in %xmm1 as doubles."""
+        self.generate_converted(left, "dec")
+        self.emit("push %rax")
+        self.generate_converted(right, "dec")
+        self.emit("movq %rax, %xmm1")
+        self.emit("pop %rax")
+        self.emit("movq %rax, %xmm0")
 
-        # Pop into registers in order
-        for idx in range(min(arg_count, len(arg_regs))):
-            self.emit(f"pop {arg_regs[idx]}")
+    def _emit_dec_compare(self, cond: BinaryExpr):
+        """ucomisd for an ordering comparison, flags as in DEC_CONDITION_CODES."""
+        self._emit_dec_operands(cond.left, cond.right)
+        if cond.operator in ("<", "<="):
+            self.emit("ucomisd %xmm0, %xmm1")
+        else:
+            self.emit("ucomisd %xmm1, %xmm0")
 
-        # Remove any remaining stack args beyond 6
-        if arg_count > len(arg_regs):
-            excess = arg_count - len(arg_regs)
-            self.emit(f"addq ${excess * 8}, %rsp")
+    # ---------- control flow ----------
+    def _emit_compare(self, cond) -> Optional[str]:
+        """Emit a flag-setting compare for an integer comparison.
 
-        self.emit(f"call {method_name}")
+        Returns the condition-code suffix that is true when ``cond`` holds, or
+        None (emitting nothing) when cond is not a plain integer comparison.
+        Ordering comparisons of decs compare in SSE registers.
+        """
+        if not (isinstance(cond, BinaryExpr) and cond.operator in CONDITION_CODES):
+            return None
+        if self._is_dec_operand(cond.left) or self._is_dec_operand(cond.right):
+            if cond.operator not in DEC_CONDITION_CODES:
+                return None  # equality needs the parity flag too
+            self._emit_dec_compare(cond)
+            return DEC_CONDITION_CODES[cond.operator]
+        if cond.operator in ("==", "!=") and (
+            self._is_string_operand(cond.left) or self._is_string_operand(cond.right)
+        ):
+            return None
+        left = self._simple_operand(cond.left)
+        right = self._simple_operand(cond.right)
+        if left is not None and left.startswith("%") and right is not None:
+            self.emit(f"cmpq {right}, {left}")
+        elif left is not None and left.startswith("%"):
+            # Register locals cannot be changed by evaluating the right side
+            self.generate_expression(cond.right)
+            self.emit(f"cmpq %rax, {left}")
+        else:
+            self.generate_expression(cond.left)
+            if right is None:
+                self.emit("push %rax")
+                self.generate_expression(cond.right)
+                self.emit("movq %rax, %rcx")
+                self.emit("pop %rax")
+                right = "%rcx"
+            self.emit(f"cmpq {right}, %rax")
+        return CONDITION_CODES[cond.operator]
+
+    def _emit_branch(self, cond, label: str, when: bool):
+        """Jump to label when cond evaluates to ``when``; fall through otherwise."""
+        if isinstance(cond, Literal) and cond.literal_type in ("int", "bool"):
+            if bool(cond.value) == when:
+                self.emit(f"jmp {label}")
+            return
+        if isinstance(cond, UnaryExpr) and cond.operator in ("!", "NOT"):
+            self._emit_branch(cond.operand, label, not when)
+            return
+        if isinstance(cond, BoundsCheck):
+            # The guard of a versioned loop: true when the whole range is in bounds
+            if when:
+                skip_lbl = self.get_label("cond_skip")
+                self.generate_bounds_check(cond, skip_lbl)
+                self.emit(f"jmp {label}")
+                self.emit(f"{skip_lbl}:")
+            else:
+                self.generate_bounds_check(cond, label)
+            return
+        if isinstance(cond, BinaryExpr) and cond.operator in ("&&", "||"):
+            # Jumping on the operator's own short-circuit value needs no extra label
+            short_circuit = cond.operator == "||"
+            if when == short_circuit:
+                self._emit_branch(cond.left, label, when)
+                self._emit_branch(cond.right, label, when)
+            else:
+                skip_lbl = self.get_label("cond_skip")
+                self._emit_branch(cond.left, skip_lbl, not when)
+                self._emit_branch(cond.right, label, when)
+                self.emit(f"{skip_lbl}:")
+            return
+        cc = self._emit_compare(cond)
+        if cc is None:
+            self.generate_expression(cond)
+            self.emit("cmpq $0, %rax")
+            cc = "ne"
+        self.emit(f"j{cc if when else INVERSE_CONDITION[cc]} {label}")
 
-    # ---------- control flow ----------
     def generate_if(self, node: IfStmt, end_label: Optional[str] = None):
         else_lbl = self.get_label("else")
         end_lbl = self.get_label("endif")
-        self.generate_expression(node.condition)
-        self.emit("cmpq $0, %rax")
-        self.emit(f"je {else_lbl}")
+        self._emit_branch(node.condition, else_lbl, False)
         self.generate_statement(node.then_block, end_label=end_label)
         self.emit(f"jmp {end_lbl}")
         self.emit(f"{else_lbl}:")
@@ -1915,107 +3115,16 @@ class CodeGenerator:
         self.emit(f"{end_lbl}:")
 
     def generate_while(self, node: WhileStmt, end_label: Optional[str] = None):
-        # Fast path: detect a simple counter loop of the form:
-        #   while (i < N) { i = i + 1; }
-        # or with <=/>/>= and step +/- literal. Keeps the counter in a
-        # register to avoid load/store on every iteration.
-        if self._try_generate_counter_while(node, end_label=end_label):
-            return
-
+        # Rotated loop: the condition is tested once on entry and again at the
+        # bottom, so each iteration costs one fused compare-and-branch.
         start_lbl = self.get_label("while")
         end_lbl = self.get_label("endwhile")
+        self._emit_branch(node.condition, end_lbl, False)
         self.emit(f"{start_lbl}:")
-        self.generate_expression(node.condition)
-        self.emit("cmpq $0, %rax")
-        self.emit(f"je {end_lbl}")
         self.generate_statement(node.body, end_label=end_label)
-        self.emit(f"jmp {start_lbl}")
-        self.emit(f"{end_lbl}:")
-
-    def _try_generate_counter_while(self, node: WhileStmt, end_label: Optional[str] = None) -> bool:
-        """Recognize and emit a register-based counter loop for simple patterns.
-
-        Pattern: while (<id> <op> <int>) { <id> = <id> (+|-) <int>; }
-        Supported ops: <, <=, >, >=. Step must be a literal. The loop variable
-        must resolve to a known symbol.
-        """
-        cond = node.condition
-        if not isinstance(cond, BinaryExpr):
-            return False
-
-        # Expect identifier on the left and integer literal on the right
-        if not (isinstance(cond.left, Identifier) and isinstance(cond.right, Literal)):
-            return False
-        if cond.right.literal_type != "int":
-            return False
-
-        var_name = cond.left.name
-        limit_val = cond.right.value
-        op = cond.operator
-        if op not in ("<", "<=", ">", ">="):
-            return False
-
-        # Body must be a block with a single assignment to the same var
-        if not isinstance(node.body, Block):
-            return False
-        if len(node.body.statements) != 1:
-            return False
-        body_stmt = node.body.statements[0]
-        if not isinstance(body_stmt, Assignment):
-            return False
-        if body_stmt.name != var_name:
-            return False
-
-        # Assignment value must be var +/- int
-        if not isinstance(body_stmt.value, BinaryExpr):
-            return False
-        step_expr = body_stmt.value
-        if step_expr.operator not in ("+", "-"):
-            return False
-        if not (isinstance(step_expr.left, Identifier) and step_expr.left.name == var_name):
-            return False
-        if not (isinstance(step_expr.right, Literal) and step_expr.right.literal_type == "int"):
-            return False
-
-        step_val = step_expr.right.value if step_expr.operator == "+" else -step_expr.right.value
-
-        sym = self.get_variable_symbol(var_name)
-        if not sym:
-            return False
-
-        start_lbl = self.get_label("while_fast")
-        end_lbl = self.get_label("endwhile_fast")
-
-        # Load counter and limit into registers
-        self.emit(f"movq {self.get_variable_location(sym)}, %rax")  # counter
-        self.emit(f"movq ${limit_val}, %rbx")                        # limit
-        self.emit(f"{start_lbl}:")
-
-        # Compare based on operator
-        self.emit("cmpq %rbx, %rax")
-        jmp_map = {
-            "<": "jge",
-            "<=": "jg",
-            ">": "jle",
-            ">=": "jl",
-        }
-        self.emit(f"{jmp_map[op]} {end_lbl}")
-
-        # Increment/decrement in register
-        if step_val == 1:
-            self.emit("incq %rax")
-        elif step_val == -1:
-            self.emit("decq %rax")
-        else:
-            self.emit(f"addq ${step_val}, %rax")
-
-        self.emit(f"jmp {start_lbl}")
+        self._emit_branch(node.condition, start_lbl, True)
         self.emit(f"{end_lbl}:")
 
-        # Store the final counter back to its home slot
-        self.emit(f"movq %rax, {self.get_variable_location(sym)}")
-        return True
-
     def generate_for(self, node: ForStmt, end_label: Optional[str] = None):
         start_lbl = self.get_label("for")
         end_lbl = self.get_label("endfor")
@@ -2024,318 +3133,670 @@ class CodeGenerator:
             offset = len(self.locals) * 8 + 8
             loop_var = Symbol(node.var_name, "int", False, -offset)
             self.locals[node.var_name] = loop_var
-        self.generate_expression(node.start)
-        self.emit(f"movq %rax, {self.get_variable_location(loop_var)}")
+        var_loc = self.get_variable_location(loop_var)
+        self._emit_store(node.var_name, node.start, var_loc)
+        if node.vectorize and self.opt_level > 0:
+            # Whole vectors first; the scalar loop below finishes the rest
+            self.generate_vector_loop(node, var_loc)
+        # The bound is compared in place when it is a literal or a variable
+        # (the optimizer hoists invariant bounds into one); anything else is
+        # re-evaluated on every iteration.
+        bound = Identifier(name=node.var_name, line=node.line, column=node.column)
+        condition = BinaryExpr(left=bound, operator="<=", right=node.end, line=node.line, column=node.column)
+        self._emit_branch(condition, end_lbl, False)
         self.emit(f"{start_lbl}:")
-        self.emit(f"movq {self.get_variable_location(loop_var)}, %rax")
-        self.emit("push %rax")
-        self.generate_expression(node.end)
-        self.emit("pop %rbx")
-        self.emit("cmpq %rax, %rbx")
-        self.emit(f"jg {end_lbl}")
         self.generate_statement(node.body, end_label=end_label)
-        self.emit(f"incq {self.get_variable_location(loop_var)}")
-        self.emit(f"jmp {start_lbl}")
+        self.emit(f"incq {var_loc}")
+        self._emit_branch(condition, start_lbl, True)
         self.emit(f"{end_lbl}:")
 
-    # ---------- built-ins ----------
-    def generate_builtin_functions(self):
-        # print_int
-        self.emit(".globl print_int")
-        self.emit("print_int:")
-        self.emit("push %rbp")
-        self.emit("movq %rsp, %rbp")
-        self.emit("movq %rdi, %rsi")
-        self.emit("leaq .fmt_int(%rip), %rdi")
-        self.emit("movq $0, %rax")
-        self.emit("call printf")
-        self.emit("leave")
-        self.emit("ret")
+    def generate_vector_loop(self, node: ForStmt, var_loc: str):
+        """Run ``c[i] = x op y`` four lanes at a time with AVX2, else two with SSE2.
 
-        # print_string
-        self.emit(".globl print_string")
-        self.emit("print_string:")
-        self.emit("push %rbp")
-        self.emit("movq %rsp, %rbp")
-        self.emit("movq %rdi, %rsi")
-        self.emit("leaq .fmt_string(%rip), %rdi")
-        self.emit("movq $0, %rax")
-        self.emit("call printf")
-        self.emit("leave")
-        self.emit("ret")
+        The optimizer only marks loops whose accesses are proven in bounds and
+        whose operands are c-typed arrays indexed by i or invariant scalars,
+        which are broadcast to %xmm2 / %xmm3 up front. Only %rax, %rcx and
+        %rdx are used, so values the allocator keeps in registers survive.
+        """
+        stmt = node.body.statements[0]
+        elem = node.vectorize
+        avx_op, sse_op = VECTOR_INSTRUCTIONS[elem][stmt.value.operator]
+        operands = [stmt.value.left, stmt.value.right]
+        for reg, operand in zip(("%xmm2", "%xmm3"), operands):
+            if not isinstance(operand, IndexExpr):
+                self.generate_converted(operand, elem)
+                self.emit(f"movq %rax, {reg}")
+                self.emit(f"punpcklqdq {reg}, {reg}")
+        self.generate_expression(node.end)
+        self.emit("movq %rax, %rdx")
+        self.emit(f"movq {var_loc}, %rcx")
+
+        def base(array):
+            self.emit(f"movq {self.get_variable_location(self.get_variable_symbol(array.receiver.name))}, %rax")
+
+        avx_lbl = self.get_label("vec_avx")
+        sse_lbl = self.get_label("vec_sse")
+        done_lbl = self.get_label("vec_done")
+        scalars = [None if isinstance(op, IndexExpr) else reg for op, reg in zip(operands, ("%ymm2", "%ymm3"))]
+        self.emit(f"testb ${CPU_AVX2}, vyl_cpu_features(%rip)")
+        self.emit(f"jz {sse_lbl}")
+        for reg in filter(None, scalars):
+            self.emit(f"vinsertf128 $1, %xmm{reg[-1]}, {reg}, {reg}")
+        self.emit(f"{avx_lbl}:")
+        self.emit("leaq 3(%rcx), %rax")
+        self.emit("cmpq %rdx, %rax")
+        self.emit(f"jg {avx_lbl}_end")
+        left, right = operands
+        if scalars[0]:
+            base(right)
+            self.emit("vmovdqu (%rax,%rcx,8), %ymm1")
+            self.emit(f"{avx_op} %ymm1, {scalars[0]}, %ymm0")
+        else:
+            base(left)
+            self.emit("vmovdqu (%rax,%rcx,8), %ymm0")
+            if scalars[1]:
+                self.emit(f"{avx_op} {scalars[1]}, %ymm0, %ymm0")
+            else:
+                base(right)
+                self.emit(f"{avx_op} (%rax,%rcx,8), %ymm0, %ymm0")
+        base(stmt.target)
+        self.emit("vmovdqu %ymm0, (%rax,%rcx,8)")
+        self.emit("addq $4, %rcx")
+        self.emit(f"jmp {avx_lbl}")
+        self.emit(f"{avx_lbl}_end:")
+        self.emit("vzeroupper")
+        self.emit(f"{sse_lbl}:")
+        self.emit("leaq 1(%rcx), %rax")
+        self.emit("cmpq %rdx, %rax")
+        self.emit(f"jg {done_lbl}")
+        if scalars[0]:
+            base(right)
+            self.emit("movdqu (%rax,%rcx,8), %xmm1")
+            self.emit("movdqa %xmm2, %xmm0")
+        else:
+            base(left)
+            self.emit("movdqu (%rax,%rcx,8), %xmm0")
+            if scalars[1]:
+                self.emit("movdqa %xmm3, %xmm1")
+            else:
+                base(right)
+                self.emit("movdqu (%rax,%rcx,8), %xmm1")
+        self.emit(f"{sse_op} %xmm1, %xmm0")
+        base(stmt.target)
+        self.emit("movdqu %xmm0, (%rax,%rcx,8)")
+        self.emit("addq $2, %rcx")
+        self.emit(f"jmp {sse_lbl}")
+        self.emit(f"{done_lbl}:")
+        self.emit(f"movq %rcx, {var_loc}")
 
-        # clock (stubbed)
-        self.emit(".globl clock")
-        self.emit("clock:")
-        self.emit("push %rbp")
-        self.emit("movq %rsp, %rbp")
-        self.emit("movq $2208988800, %rax")
-        self.emit("addq clock_counter(%rip), %rax")
-        self.emit("incq clock_counter(%rip)")
-        self.emit("leave")
-        self.emit("ret")
+    # ---------- built-ins ----------
+    def generate_gc_runtime(self):
+        """Emit the size-class heap: vyl_alloc, vyl_free and vyl_collect.
+
+        Each thread allocates from free lists of its own; pages with free
+        slots left by a collection wait on shared per-class lists until a
+        thread runs out. Page and span bookkeeping sits behind vyl_heap_lock.
+        A collection stops every other worker with GC_STOP_SIGNAL first: the
+        handler parks its thread at once, unless the thread is inside the
+        allocator or holds a runtime lock (vyl_gc_busy), in which case it
+        parks at the next safepoint on the way out.
+        """
+        page = GC_PAGE_SIZE
+        hdr = GC_HEADER_SIZE
+        alloc_bits = GC_ALLOC_BITS
+        mark_bits = GC_MARK_BITS
+        # The single object of a large span starts at granule hdr/16
+        large_bit = hdr >> 4
+        large_word = 8 * (large_bit // 64)
+        large_bit %= 64
+        table_limit = 64  # sizes up to 1 KiB use the direct lookup table
+        first_scan = next(i for i, size in enumerate(GC_SIZE_CLASSES) if size > table_limit * 16)
+        classes = len(GC_SIZE_CLASSES)
 
         self.emit(".section .data")
-        self.emit("clock_counter: .quad 1")
-        self.emit(".fmt_int: .asciz \"%ld\\n\"")
-        self.emit(".fmt_string: .asciz \"%s\"")
-        self.emit(".fmt_newline: .asciz \"\\n\"")
-        self.emit("argc_store: .quad 0")
-        self.emit("argv_store: .quad 0")
-        self.emit(".mode_rb: .asciz \"rb\"")
-        self.emit(".mode_wb: .asciz \"wb\"")
-        self.emit("vyl_head: .quad 0")
-        self.emit("stack_base: .quad 0")
+        self.emit("vyl_heap_ready: .quad 0")
+        self.emit("vyl_heap_lo: .quad 0")
+        self.emit("vyl_heap_hi: .quad 0")
+        self.emit("vyl_heap_next: .quad 0")
+        self.emit("vyl_page_map: .quad 0")
+        self.emit("vyl_gc_free_spans: .quad 0")
+        self.emit("vyl_gc_mark_base: .quad 0")
+        self.emit("vyl_gc_mark_cap: .quad 0")
+        self.emit("vyl_gc_mark_top: .quad 0")
+        self.emit(f"vyl_gc_partial: .zero {8 * classes}")
+        self.emit(".balign 64")
+        self.emit("vyl_heap_lock: .quad 0")
+        self.emit(".balign 64")
+        self.emit("vyl_gc_lock: .quad 0")
+        self.emit("vyl_gc_phase: .quad 0")  # odd while a collection stops the world
+        self.emit("vyl_gc_stopped: .quad 0")
+        self.emit(".balign 64")
+        self.emit("vyl_gc_class_sizes: .quad " + ", ".join(str(size) for size in GC_SIZE_CLASSES))
+        # vyl_gc_class_table[u] = smallest class holding 16*u bytes
+        table = [next(i for i, size in enumerate(GC_SIZE_CLASSES) if size >= 16 * units)
+                 for units in range(table_limit + 1)]
+        self.emit("vyl_gc_class_table: .byte " + ", ".join(str(index) for index in table))
+        self.emit(".section .tbss,\"awT\",@nobits")
+        self.emit(".balign 8")
+        self.emit(f"vyl_gc_free_lists: .zero {8 * classes}")
+        self.emit("vyl_gc_busy: .zero 8")
+        self.emit("vyl_gc_pending: .zero 8")
+        self.emit("vyl_gc_parked: .zero 8")  # phase this thread last stopped for
         self.emit(".section .text")
 
-        # SHA256 helper
-        self.emit(".globl vyl_sha256")
-        self.emit("vyl_sha256:")
+        # vyl_gc_init: reserve the heap range and its page table
+        self.emit("vyl_gc_init:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
-        self.emit("push %r12")
-        # 2 pushes, rsp % 16 == 0. Keep aligned.
-        self.emit("subq $16, %rsp")
-        self.emit("movq %rdi, %rbx")
-        self.emit("movq %rbx, %rdi")
-        self.emit("call strlen")
-        self.emit("movq %rax, %r12")
-        self.emit("leaq sha256_buf(%rip), %rdi")
-        self.emit("movq %rdi, %rdx")
-        self.emit("movq %rbx, %rdi")
-        self.emit("movq %r12, %rsi")
-        self.emit("call SHA256")
-        self.emit("leaq sha256_buf(%rip), %rsi")
-        self.emit("leaq sha256_hex(%rip), %rdi")
-        self.emit("leaq hex_table(%rip), %r8")
-        self.emit("movq $0, %rcx")
-        self.emit("sha256_hex_loop:")
-        self.emit("cmpq $32, %rcx")
-        self.emit("jge sha256_hex_done")
-        self.emit("movzbl (%rsi,%rcx,1), %eax")
-        self.emit("movq %rax, %rbx")
-        self.emit("shrq $4, %rbx")
-        self.emit("andq $0xF, %rbx")
-        self.emit("movzbl (%r8,%rbx,1), %ebx")
-        self.emit("movb %bl, (%rdi,%rcx,2)")
-        self.emit("movzbl %al, %ebx")
-        self.emit("andq $0xF, %rbx")
-        self.emit("movzbl (%r8,%rbx,1), %ebx")
-        self.emit("movb %bl, 1(%rdi,%rcx,2)")
-        self.emit("incq %rcx")
-        self.emit("jmp sha256_hex_loop")
-        self.emit("sha256_hex_done:")
-        self.emit("movb $0, 64(%rdi)")
-        self.emit("leaq sha256_hex(%rip), %rax")
-        self.emit("addq $16, %rsp")
-        self.emit("pop %r12")
-        self.emit("pop %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit(f"movq ${GC_RESERVE}, %rbx")
+        self.emit("vyl_gc_init_retry:")
+        self.emit("xorl %edi, %edi")
+        self.emit("movq %rbx, %rsi")
+        self.emit("movl $3, %edx")  # PROT_READ | PROT_WRITE
+        self.emit(f"movl ${GC_MMAP_FLAGS}, %ecx")
+        self.emit("movq $-1, %r8")
+        self.emit("xorl %r9d, %r9d")
+        self.emit("call mmap")
+        self.emit("cmpq $-1, %rax")
+        self.emit("jne vyl_gc_init_map")
+        self.emit("shrq $1, %rbx")
+        self.emit(f"cmpq ${GC_MIN_RESERVE}, %rbx")
+        self.emit("jae vyl_gc_init_retry")
+        self.emit("jmp vyl_gc_init_done")
+        self.emit("vyl_gc_init_map:")
+        # heap_hi stays at heap_lo (no pages to hand out) until the page table exists
+        self.emit("movq %rax, vyl_heap_lo(%rip)")
+        self.emit("movq %rax, vyl_heap_hi(%rip)")
+        self.emit("movq %rax, vyl_heap_next(%rip)")
+        self.emit("xorl %edi, %edi")
+        self.emit("movq %rbx, %rsi")
+        self.emit(f"shrq ${GC_PAGE_SHIFT - 3}, %rsi")  # one qword per page
+        self.emit("movl $3, %edx")
+        self.emit(f"movl ${GC_MMAP_FLAGS}, %ecx")
+        self.emit("movq $-1, %r8")
+        self.emit("xorl %r9d, %r9d")
+        self.emit("call mmap")
+        self.emit("cmpq $-1, %rax")
+        self.emit("je vyl_gc_init_done")
+        self.emit("movq %rax, vyl_page_map(%rip)")
+        self.emit("addq %rbx, vyl_heap_hi(%rip)")
+        self.emit("vyl_gc_init_done:")
+        self.emit("movq $1, vyl_heap_ready(%rip)")
+        self.emit("movq -8(%rbp), %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # input_line -> returns malloc'd string or 0 on EOF/error
-        self.emit(".globl vyl_input")
-        self.emit("vyl_input:")
+        # vyl_gc_take_pages(rdi=npages) -> span header (zeroed) or 0
+        self.emit("vyl_gc_take_pages:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
-        self.emit("movq $4096, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("movq %rax, %r12")
-        self.emit("cmpq $0, %r12")
-        self.emit("je vyl_input_fail")
-        self.emit("movq %r12, %rdi")
-        self.emit("movq $4096, %rsi")
-        self.emit("movq stdin(%rip), %rdx")
-        self.emit("call fgets")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_input_fail")
-        # strip trailing newline if present
+        self.emit("movq %rdi, %r12")
+        self._emit_spin_lock("vyl_heap_lock(%rip)")
+        # first fit over the free spans; rcx holds the link to patch
+        self.emit("leaq vyl_gc_free_spans(%rip), %rcx")
+        self.emit("vyl_gc_take_scan:")
+        self.emit("movq (%rcx), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_gc_take_bump")
+        self.emit("movq 40(%rax), %rdx")
+        self.emit("cmpq %r12, %rdx")
+        self.emit("jae vyl_gc_take_fit")
+        self.emit("leaq 32(%rax), %rcx")
+        self.emit("jmp vyl_gc_take_scan")
+        self.emit("vyl_gc_take_fit:")
+        self.emit("movq 32(%rax), %rsi")
+        self.emit("cmpq %r12, %rdx")
+        self.emit("je vyl_gc_take_exact")
+        # split: the tail of the span stays free
         self.emit("movq %r12, %rdi")
-        self.emit("call strlen")
+        self.emit(f"shlq ${GC_PAGE_SHIFT}, %rdi")
+        self.emit("addq %rax, %rdi")
+        self.emit("subq %r12, %rdx")
+        self.emit("movq %rdx, 40(%rdi)")
+        self.emit("movq %rsi, 32(%rdi)")
+        self.emit("movq %rdi, (%rcx)")
+        self.emit("jmp vyl_gc_take_got")
+        self.emit("vyl_gc_take_exact:")
+        self.emit("movq %rsi, (%rcx)")
+        self.emit("jmp vyl_gc_take_got")
+        self.emit("vyl_gc_take_bump:")
+        self.emit("movq vyl_heap_next(%rip), %rax")
+        self.emit("movq %r12, %rdx")
+        self.emit(f"shlq ${GC_PAGE_SHIFT}, %rdx")
+        self.emit("addq %rax, %rdx")
+        self.emit("cmpq vyl_heap_hi(%rip), %rdx")
+        self.emit("ja vyl_gc_take_fail")
+        self.emit("movq %rdx, vyl_heap_next(%rip)")
+        self.emit("vyl_gc_take_got:")
         self.emit("movq %rax, %rbx")
-        self.emit("cmpq $0, %rbx")
-        self.emit("je vyl_input_done")
-        self.emit("decq %rbx")
-        self.emit("cmpb $10, (%r12,%rbx,1)")
-        self.emit("jne vyl_input_done")
-        self.emit("movb $0, (%r12,%rbx,1)")
-        self.emit("vyl_input_done:")
-        self.emit("movq %r12, %rax")
+        self.emit("movq %rax, %rdi")
+        self.emit(f"movl ${hdr // 8}, %ecx")
+        self.emit("xorl %eax, %eax")
+        self.emit("rep stosq")
+        self.emit("movq %r12, 40(%rbx)")
+        # point every page of the span at its header
+        self.emit("movq %rbx, %rdx")
+        self.emit("subq vyl_heap_lo(%rip), %rdx")
+        self.emit(f"shrq ${GC_PAGE_SHIFT}, %rdx")
+        self.emit("movq vyl_page_map(%rip), %rdi")
+        self.emit("leaq (%rdi,%rdx,8), %rdi")
+        self.emit("movq %r12, %rcx")
+        self.emit("movq %rbx, %rax")
+        self.emit("rep stosq")
+        self.emit("movq %rbx, %rax")
+        self._emit_spin_unlock("vyl_heap_lock(%rip)")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
-        self.emit("vyl_input_fail:")
-        self.emit("movq $0, %rax")
+        self.emit("vyl_gc_take_fail:")
+        self._emit_spin_unlock("vyl_heap_lock(%rip)")
+        self.emit("xorl %eax, %eax")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # read_all
-        self.emit(".globl vyl_read_all")
-        self.emit("vyl_read_all:")
+        # vyl_gc_release(rdi=span): unmap from the page table, return to the free spans
+        self.emit("vyl_gc_release:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
-        self.emit("push %r13")
         self.emit("push %r12")
         self.emit("movq %rdi, %rbx")
+        self.emit("movq 40(%rdi), %r12")
+        self.emit("movq %rbx, %rdx")
+        self.emit("subq vyl_heap_lo(%rip), %rdx")
+        self.emit(f"shrq ${GC_PAGE_SHIFT}, %rdx")
+        self.emit("movq vyl_page_map(%rip), %rdi")
+        self.emit("leaq (%rdi,%rdx,8), %rdi")
+        self.emit("movq %r12, %rcx")
+        self.emit("xorl %eax, %eax")
+        self.emit("rep stosq")
+        # give the memory back to the kernel; it reads as zero when reused
         self.emit("movq %rbx, %rdi")
-        self.emit("movq $0, %rsi")
-        self.emit("movq $2, %rdx")
-        self.emit("call fseek")
-        self.emit("movq %rbx, %rdi")
-        self.emit("call ftell")
-        self.emit("movq %rax, %r12")
-        self.emit("movq %rbx, %rdi")
-        self.emit("call rewind")
-        self.emit("cmpq $0, %r12")
-        self.emit("jle vyl_read_all_zero")
-        self.emit("movq %r12, %rdi")
-        self.emit("incq %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("movq %rax, %r13")
-        self.emit("movq %r13, %rdi")
-        self.emit("movq $1, %rsi")
-        self.emit("movq %r12, %rdx")
-        self.emit("movq %rbx, %rcx")
-        self.emit("call fread")
-        self.emit("movb $0, (%r13,%r12,1)")
-        self.emit("movq %r13, %rax")
-        self.emit("jmp vyl_read_all_done")
-        self.emit("vyl_read_all_zero:")
-        self.emit("movq $0, %rax")
-        self.emit("vyl_read_all_done:")
-        self.emit("pop %r13")
+        self.emit("movq %r12, %rsi")
+        self.emit(f"shlq ${GC_PAGE_SHIFT}, %rsi")
+        self.emit("movl $4, %edx")  # MADV_DONTNEED
+        self.emit("call madvise")
+        self.emit("movq %r12, 40(%rbx)")
+        self._emit_spin_lock("vyl_heap_lock(%rip)")
+        self.emit("movq vyl_gc_free_spans(%rip), %rax")
+        self.emit("movq %rax, 32(%rbx)")
+        self.emit("movq %rbx, vyl_gc_free_spans(%rip)")
+        self._emit_spin_unlock("vyl_heap_lock(%rip)")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # write_all
-        self.emit(".globl vyl_write_all")
-        self.emit("vyl_write_all:")
+        # vyl_gc_new_page(rdi=class): refill this thread's class free list from
+        # a page a collection left slots on, else thread a fresh page onto it
+        self.emit("vyl_gc_new_page:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
-        self.emit("movq %rdi, %rbx")
-        self.emit("movq %rsi, %r8")
-        self.emit("movq %r8, %rdi")
-        self.emit("call strlen")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %r12")
+        self._emit_spin_lock("vyl_heap_lock(%rip)")
+        self.emit("leaq vyl_gc_partial(%rip), %rcx")
+        self.emit("movq (%rcx,%r12,8), %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_gc_new_page_fresh")
+        self.emit("movq 56(%rbx), %rax")
+        self.emit("movq %rax, (%rcx,%r12,8)")
+        self._emit_spin_unlock("vyl_heap_lock(%rip)")
+        self._emit_tls_address("vyl_gc_free_lists", "%rdi")
+        self.emit("movq 32(%rbx), %rax")
+        self.emit("movq %rax, (%rdi,%r12,8)")
+        self.emit("movq $0, 32(%rbx)")
+        self.emit("movl $1, %eax")
+        self.emit("jmp vyl_gc_new_page_done")
+        self.emit("vyl_gc_new_page_fresh:")
+        self._emit_spin_unlock("vyl_heap_lock(%rip)")
+        self.emit("movq $1, %rdi")
+        self.emit("call vyl_gc_take_pages")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_gc_new_page_done")
+        self.emit("movq %rax, %rbx")
+        self.emit("leaq vyl_gc_class_sizes(%rip), %rcx")
+        self.emit("movq (%rcx,%r12,8), %rsi")
+        self.emit("movq %rsi, 0(%rbx)")  # slot size
+        self.emit(f"movq ${page - hdr}, %rax")
+        self.emit("xorl %edx, %edx")
+        self.emit("divq %rsi")
+        self.emit("movq %rax, 8(%rbx)")  # slot count
+        self.emit("movq $1, 16(%rbx)")  # kind: small
+        self.emit("movq %r12, 24(%rbx)")  # class
+        # 48(hdr) = ceil(2^32 / size): offset * magic >> 32 == offset / size for offsets < 64 KiB
+        self.emit("leaq -1(%rsi), %rax")
+        self.emit("btsq $32, %rax")
+        self.emit("xorl %edx, %edx")
+        self.emit("divq %rsi")
+        self.emit("movq %rax, 48(%rbx)")
+        self.emit("movq 8(%rbx), %rcx")
+        self.emit("leaq -1(%rcx), %rax")
+        self.emit("imulq %rsi, %rax")
+        self.emit(f"leaq {hdr}(%rbx,%rax), %rax")  # last slot
+        self._emit_tls_address("vyl_gc_free_lists", "%rdi")
+        self.emit("movq (%rdi,%r12,8), %rdx")
+        self.emit("vyl_gc_new_page_thread:")
+        self.emit("movq %rdx, (%rax)")
         self.emit("movq %rax, %rdx")
-        self.emit("movq %r8, %rdi")
-        self.emit("movq $1, %rsi")
-        self.emit("movq %rdx, %rdx")
-        self.emit("movq %rbx, %rcx")
-        self.emit("call fwrite")
-        self.emit("movq %rax, %rax")
+        self.emit("subq %rsi, %rax")
+        self.emit("decq %rcx")
+        self.emit("jnz vyl_gc_new_page_thread")
+        self.emit("movq %rdx, (%rdi,%r12,8)")
+        self.emit("movl $1, %eax")
+        self.emit("vyl_gc_new_page_done:")
+        self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_isqrt (integer floor sqrt)
-        self.emit(".globl vyl_isqrt")
-        self.emit("vyl_isqrt:")
+        # vyl_gc_alloc_large(rdi=size): one object in a span of its own
+        self.emit("vyl_gc_alloc_large:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
-        self.emit("cmpq $0, %rdi")
-        self.emit("jle vyl_isqrt_zero")
-        self.emit("xorq %rbx, %rbx")
-        self.emit("vyl_isqrt_loop:")
-        self.emit("movq %rbx, %rax")
-        self.emit("imulq %rbx, %rax")
-        self.emit("cmpq %rax, %rdi")
-        self.emit("jl vyl_isqrt_done")
-        self.emit("incq %rbx")
-        self.emit("jmp vyl_isqrt_loop")
-        self.emit("vyl_isqrt_done:")
-        self.emit("decq %rbx")
-        self.emit("movq %rbx, %rax")
-        self.emit("pop %rbx")
-        self.emit("leave")
-        self.emit("ret")
-        self.emit("vyl_isqrt_zero:")
-        self.emit("movq $0, %rax")
+        self.emit("push %r12")
+        self.emit("leaq 15(%rdi), %rbx")
+        self.emit("andq $-16, %rbx")
+        self.emit(f"leaq {hdr + page - 1}(%rbx), %rdi")
+        self.emit(f"shrq ${GC_PAGE_SHIFT}, %rdi")
+        self.emit("call vyl_gc_take_pages")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_gc_alloc_large_done")
+        self.emit("movq %rax, %r12")
+        self.emit("movq %rbx, 0(%r12)")
+        self.emit("movq $1, 8(%r12)")
+        self.emit("movq $2, 16(%r12)")  # kind: large
+        self.emit("movq $-1, 24(%r12)")
+        self.emit(f"btsq ${large_bit}, {alloc_bits + large_word}(%r12)")
+        self.emit(f"leaq {hdr}(%r12), %rdi")
+        self.emit("movq %rbx, %rcx")
+        self.emit("shrq $3, %rcx")
+        self.emit("xorl %eax, %eax")
+        self.emit("rep stosq")
+        self.emit(f"leaq {hdr}(%r12), %rax")
+        self.emit("vyl_gc_alloc_large_done:")
+        self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_alloc (tracked malloc)
+        # vyl_alloc(rdi=size) -> zeroed object, or 0 when the heap is exhausted
         self.emit(".globl vyl_alloc")
         self.emit("vyl_alloc:")
+        if self.profile_alloc:
+            self.emit("call vyl_prof_alloc")
+        # inside an @arena scope every allocation bumps the current arena
+        self.emit(f"movq {self.tls('vyl_arena_current')}, %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_alloc_arena")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit(f"incq {self.tls('vyl_gc_busy')}")
         self.emit("movq %rdi, %rbx")  # size
-        self.emit("addq $24, %rdi")
-        self.emit("call malloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_alloc_fail")
-        self.emit("movq vyl_head(%rip), %rcx")
-        self.emit("movq %rcx, (%rax)")      # next
-        self.emit("movq %rbx, 8(%rax)")      # size
-        self.emit("movq $0, 16(%rax)")       # mark
-        self.emit("movq %rax, vyl_head(%rip)")
-        self.emit("addq $24, %rax")          # return data ptr
-        self.emit("pop %rbx")
-        self.emit("leave")
-        self.emit("ret")
-
-        # vyl_bounds_fail: abort on null/OO.B
-        self.emit(".globl vyl_bounds_fail")
-        self.emit("vyl_bounds_fail:")
-        self.emit("movq $1, %rdi")
-        self.emit("movq $60, %rax")
-        self.emit("syscall")
+        self.emit("cmpq $0, vyl_heap_ready(%rip)")
+        self.emit("jne vyl_alloc_ready")
+        self.emit("call vyl_gc_init")
+        self.emit("vyl_alloc_ready:")
+        self.emit(f"cmpq ${GC_SIZE_CLASSES[-1]}, %rbx")
+        self.emit("ja vyl_alloc_large")
+        self.emit("leaq 15(%rbx), %rax")
+        self.emit("shrq $4, %rax")
+        self.emit(f"cmpq ${table_limit}, %rax")
+        self.emit("ja vyl_alloc_scan")
+        self.emit("leaq vyl_gc_class_table(%rip), %rcx")
+        self.emit("movzbl (%rcx,%rax), %r12d")
+        self.emit("jmp vyl_alloc_class")
+        self.emit("vyl_alloc_scan:")
+        self.emit(f"movq ${first_scan}, %r12")
+        self.emit("leaq vyl_gc_class_sizes(%rip), %rcx")
+        self.emit("vyl_alloc_scan_loop:")
+        self.emit("cmpq (%rcx,%r12,8), %rbx")
+        self.emit("jbe vyl_alloc_class")
+        self.emit("incq %r12")
+        self.emit("jmp vyl_alloc_scan_loop")
+        self.emit("vyl_alloc_class:")
+        self._emit_tls_address("vyl_gc_free_lists", "%rcx")
+        self.emit("movq (%rcx,%r12,8), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_alloc_pop")
+        self.emit("movq %r12, %rdi")
+        self.emit("call vyl_gc_new_page")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_alloc_fail")
+        self._emit_tls_address("vyl_gc_free_lists", "%rcx")
+        self.emit("movq (%rcx,%r12,8), %rax")
+        self.emit("vyl_alloc_pop:")
+        self.emit("movq (%rax), %rdx")
+        self.emit("movq %rdx, (%rcx,%r12,8)")
+        # small pages are page aligned relative to heap_lo: no table lookup needed
+        self.emit("movq %rax, %rdx")
+        self.emit("subq vyl_heap_lo(%rip), %rdx")
+        self.emit(f"andq ${-page}, %rdx")
+        self.emit("addq vyl_heap_lo(%rip), %rdx")
+        self.emit("movq %rax, %rcx")
+        self.emit("subq %rdx, %rcx")
+        self.emit("shrq $4, %rcx")
+        # other threads free into and allocate from the same page
+        self.emit(f"lock btsq %rcx, {alloc_bits}(%rdx)")
+        self.emit("movq 0(%rdx), %rcx")
+        self.emit("shrq $3, %rcx")
+        self.emit("movq %rax, %rdi")
+        self.emit("movq %rax, %rdx")
+        self.emit("xorl %eax, %eax")
+        self.emit("rep stosq")
+        self.emit("movq %rdx, %rax")
+        self.emit("jmp vyl_alloc_ret")
+        self.emit("vyl_alloc_large:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_gc_alloc_large")
+        self.emit("jmp vyl_alloc_ret")
+        self.emit("vyl_alloc_arena:")
+        self.emit("movq %rdi, %rsi")
+        self.emit("movq %rax, %rdi")
+        self.emit("jmp vyl_arena_alloc")
         self.emit("vyl_alloc_fail:")
-        self.emit("movq $0, %rax")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_alloc_ret:")
+        self._emit_safepoint()
+        self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_mark_ptr(rdi=ptr)
-        self.emit(".globl vyl_mark_ptr")
-        self.emit("vyl_mark_ptr:")
+        # vyl_gc_find(rdi=ptr) -> rax=object start (0 if not a live object), rdx=span
+        # Leaf routine; clobbers only rax, rcx and rdx.
+        self.emit("vyl_gc_find:")
+        self.emit("movq %rdi, %rcx")
+        self.emit("subq vyl_heap_lo(%rip), %rcx")
+        self.emit("jb vyl_gc_find_none")
+        self.emit("cmpq vyl_heap_next(%rip), %rdi")
+        self.emit("jae vyl_gc_find_none")
+        self.emit(f"shrq ${GC_PAGE_SHIFT}, %rcx")
+        self.emit("movq vyl_page_map(%rip), %rdx")
+        self.emit("movq (%rdx,%rcx,8), %rdx")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jz vyl_gc_find_none")
+        self.emit("movq %rdi, %rcx")
+        self.emit("subq %rdx, %rcx")
+        self.emit(f"subq ${hdr}, %rcx")
+        self.emit("jb vyl_gc_find_none")
+        self.emit("cmpq $2, 16(%rdx)")
+        self.emit("je vyl_gc_find_large")
+        self.emit("movq %rcx, %rax")
+        self.emit("imulq 48(%rdx), %rax")
+        self.emit("shrq $32, %rax")  # slot index
+        self.emit("cmpq 8(%rdx), %rax")
+        self.emit("jae vyl_gc_find_none")
+        self.emit("imulq 0(%rdx), %rax")
+        self.emit(f"leaq {hdr}(%rdx,%rax), %rax")
+        self.emit("jmp vyl_gc_find_live")
+        self.emit("vyl_gc_find_large:")
+        self.emit("cmpq 0(%rdx), %rcx")
+        self.emit("jae vyl_gc_find_none")
+        self.emit(f"leaq {hdr}(%rdx), %rax")
+        self.emit("vyl_gc_find_live:")
+        self.emit("movq %rax, %rcx")
+        self.emit("subq %rdx, %rcx")
+        self.emit("shrq $4, %rcx")
+        self.emit(f"btq %rcx, {alloc_bits}(%rdx)")
+        self.emit("jnc vyl_gc_find_none")
+        self.emit("ret")
+        self.emit("vyl_gc_find_none:")
+        self.emit("xorl %eax, %eax")
+        self.emit("ret")
+
+        # vyl_free(rdi=ptr): release a managed object; anything else came from Malloc
+        self.emit(".globl vyl_free")
+        self.emit("vyl_free:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
-        self.emit("push %rbx")
-        self.emit("cmpq $0, %rdi")
-        self.emit("je vyl_mark_done")
-        self.emit("movq vyl_head(%rip), %rbx")
-        self.emit("vyl_mark_loop:")
-        self.emit("cmpq $0, %rbx")
-        self.emit("je vyl_mark_done")
-        self.emit("leaq 24(%rbx), %rax")
-        self.emit("cmpq %rax, %rdi")
-        self.emit("jb vyl_mark_next")
-        self.emit("movq 8(%rbx), %rcx")
-        self.emit("leaq (%rax,%rcx,1), %rdx")
-        self.emit("cmpq %rdi, %rdx")
-        self.emit("jae vyl_mark_next")
-        self.emit("movq $1, 16(%rbx)")
-        self.emit("jmp vyl_mark_done")
-        self.emit("vyl_mark_next:")
-        self.emit("movq (%rbx), %rbx")
-        self.emit("jmp vyl_mark_loop")
-        self.emit("vyl_mark_done:")
-        self.emit("pop %rbx")
+        self.emit(f"incq {self.tls('vyl_gc_busy')}")
+        self.emit("call vyl_gc_find")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_free_managed")
+        self.emit("call free")
+        self.emit("jmp vyl_free_ret")
+        self.emit("vyl_free_managed:")
+        self.emit("cmpq $2, 16(%rdx)")
+        self.emit("jne vyl_free_small")
+        self.emit("movq %rdx, %rdi")
+        self.emit("call vyl_gc_release")
+        self.emit("jmp vyl_free_ret")
+        self.emit("vyl_free_small:")
+        self.emit("movq %rax, %rcx")
+        self.emit("subq %rdx, %rcx")
+        self.emit("shrq $4, %rcx")
+        self.emit(f"lock btrq %rcx, {alloc_bits}(%rdx)")
+        self.emit("movq 24(%rdx), %rcx")
+        self._emit_tls_address("vyl_gc_free_lists", "%rdx")
+        self.emit("movq (%rdx,%rcx,8), %rsi")
+        self.emit("movq %rsi, (%rax)")
+        self.emit("movq %rax, (%rdx,%rcx,8)")
+        self.emit("vyl_free_ret:")
+        self._emit_safepoint()
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_collect (mark-sweep)
+        # vyl_mark_ptr(rdi=word): mark the object it points into and queue it for tracing
+        self.emit(".globl vyl_mark_ptr")
+        self.emit("vyl_mark_ptr:")
+        self.emit("call vyl_gc_find")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_mark_done")
+        self.emit("movq %rax, %rcx")
+        self.emit("subq %rdx, %rcx")
+        self.emit("shrq $4, %rcx")
+        self.emit(f"btsq %rcx, {mark_bits}(%rdx)")
+        self.emit("jc vyl_mark_done")
+        # every object is queued at most once, so the mark stack never overflows
+        self.emit("movq vyl_gc_mark_top(%rip), %rcx")
+        self.emit("movq %rax, (%rcx)")
+        self.emit("addq $8, %rcx")
+        self.emit("movq %rcx, vyl_gc_mark_top(%rip)")
+        self.emit("vyl_mark_done:")
+        self.emit("ret")
+
+        # vyl_collect: conservative mark-sweep over stack, data and the heap itself
         self.emit(".globl vyl_collect")
         self.emit("vyl_collect:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
+        # Spill every callee-saved register first: register-allocated locals
+        # are GC roots and must be visible to the stack scan below.
         self.emit("push %rbx")
         self.emit("push %r12")
         self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("push %r15")
+        self.emit("subq $8, %rsp")
+        # One collection at a time; wait for the lock unmarked, so a
+        # collection that is already running can stop this thread
+        self.emit("vyl_collect_lock:")
+        self.emit("movl $1, %eax")
+        self.emit("xchgq %rax, vyl_gc_lock(%rip)")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_collect_stop")
+        self.emit("pause")
+        self.emit("jmp vyl_collect_lock")
+        # stop every other worker and wait until each has published its stack
+        self.emit("vyl_collect_stop:")
+        if self.profile_alloc:
+            self.emit("call vyl_clock_ns")
+            self.emit("movq %rax, vyl_prof_gc_start(%rip)")
+        self.emit("movq vyl_nworkers(%rip), %r15")
+        self.emit("cmpq $1, %r15")
+        self.emit("jbe vyl_collect_sized")
+        self.emit("movq $0, vyl_gc_stopped(%rip)")
+        self.emit("lock incq vyl_gc_phase(%rip)")
+        self.emit("xorl %r14d, %r14d")
+        self.emit("vyl_collect_signal:")
+        self.emit("movq %r14, %r13")
+        self.emit(f"imulq ${WORKER_SIZE}, %r13")
+        self.emit("leaq vyl_workers(%rip), %rax")
+        self.emit("addq %rax, %r13")
+        self.emit(f"cmpq {self.tls('vyl_worker_self')}, %r13")
+        self.emit("je vyl_collect_signal_next")
+        self.emit("movq 32(%r13), %rdi")
+        self.emit(f"movl ${GC_STOP_SIGNAL}, %esi")
+        self.emit("call pthread_kill")
+        self.emit("vyl_collect_signal_next:")
+        self.emit("incq %r14")
+        self.emit("cmpq %r15, %r14")
+        self.emit("jb vyl_collect_signal")
+        self.emit("decq %r15")
+        self.emit("vyl_collect_wait:")
+        self.emit("cmpq %r15, vyl_gc_stopped(%rip)")
+        self.emit("jae vyl_collect_sized")
+        self.emit("call sched_yield")
+        self.emit("jmp vyl_collect_wait")
+        # The mark stack holds at most one entry per 16 heap bytes
+        self.emit("vyl_collect_sized:")
+        self.emit("movq vyl_heap_next(%rip), %rbx")
+        self.emit("subq vyl_heap_lo(%rip), %rbx")
+        self.emit("jz vyl_collect_done")
+        self.emit("shrq $1, %rbx")
+        self.emit("cmpq vyl_gc_mark_cap(%rip), %rbx")
+        self.emit("jbe vyl_collect_roots")
+        self.emit("movq vyl_gc_mark_base(%rip), %rdi")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_collect_map")
+        self.emit("movq vyl_gc_mark_cap(%rip), %rsi")
+        self.emit("call munmap")
+        self.emit("movq $0, vyl_gc_mark_base(%rip)")
+        self.emit("movq $0, vyl_gc_mark_cap(%rip)")
+        self.emit("vyl_collect_map:")
+        self.emit("xorl %edi, %edi")
+        self.emit("movq %rbx, %rsi")
+        self.emit("movl $3, %edx")
+        self.emit(f"movl ${GC_MMAP_FLAGS}, %ecx")
+        self.emit("movq $-1, %r8")
+        self.emit("xorl %r9d, %r9d")
+        self.emit("call mmap")
+        self.emit("cmpq $-1, %rax")
+        self.emit("je vyl_collect_done")
+        self.emit("movq %rax, vyl_gc_mark_base(%rip)")
+        self.emit("movq %rbx, vyl_gc_mark_cap(%rip)")
+        self.emit("vyl_collect_roots:")
+        self.emit("movq vyl_gc_mark_base(%rip), %rax")
+        self.emit("movq %rax, vyl_gc_mark_top(%rip)")
         self.emit("movq stack_base(%rip), %r12")
+        self.emit(f"movq {self.tls('vyl_task_current')}, %rax")
+        self.emit("leaq vyl_task_root(%rip), %rcx")
+        self.emit("cmpq %rcx, %rax")
+        self.emit("je vyl_mark_scan_stack")
+        self.emit(f"leaq {TASK_SIZE}(%rax), %r12")  # a task's stack ends with its record
+        self.emit("vyl_mark_scan_stack:")
         self.emit("movq %rsp, %r13")
         self.emit("vyl_mark_scan:")
         self.emit("cmpq %r12, %r13")
@@ -2345,1147 +3806,6410 @@ class CodeGenerator:
         self.emit("addq $8, %r13")
         self.emit("jmp vyl_mark_scan")
         self.emit("vyl_mark_done_scan:")
-        self.emit("movq vyl_head(%rip), %rbx")
-        self.emit("xor %rdi, %rdi")  # prev = 0
-        self.emit("vyl_sweep_loop:")
-        self.emit("cmpq $0, %rbx")
-        self.emit("je vyl_sweep_done")
-        self.emit("movq 16(%rbx), %rax")
-        self.emit("cmpq $0, %rax")
-        self.emit("jne vyl_keep")
-        self.emit("movq (%rbx), %rcx")   # next
-        self.emit("cmpq $0, %rdi")
-        self.emit("je vyl_sweep_update_head")
-        self.emit("movq %rcx, (%rdi)")
-        self.emit("jmp vyl_sweep_free")
-        self.emit("vyl_sweep_update_head:")
-        self.emit("movq %rcx, vyl_head(%rip)")
-        self.emit("vyl_sweep_free:")
+        # globals live in .data/.bss
+        self.emit("leaq __data_start(%rip), %r13")
+        self.emit("andq $-8, %r13")
+        self.emit("leaq _end(%rip), %r12")
+        self.emit("vyl_mark_scan_data:")
+        self.emit("cmpq %r12, %r13")
+        self.emit("jae vyl_mark_workers")
+        self.emit("movq (%r13), %rdi")
+        self.emit("call vyl_mark_ptr")
+        self.emit("addq $8, %r13")
+        self.emit("jmp vyl_mark_scan_data")
+        # the stacks other workers stopped on, from the registers they pushed up
+        self.emit("vyl_mark_workers:")
+        self.emit("xorl %r14d, %r14d")
+        self.emit("vyl_mark_worker:")
+        self.emit("cmpq vyl_nworkers(%rip), %r14")
+        self.emit("jae vyl_mark_tasks")
+        self.emit("movq %r14, %r15")
+        self.emit(f"imulq ${WORKER_SIZE}, %r15")
+        self.emit("leaq vyl_workers(%rip), %rax")
+        self.emit("addq %rax, %r15")
+        self.emit("incq %r14")
+        self.emit(f"cmpq {self.tls('vyl_worker_self')}, %r15")
+        self.emit("je vyl_mark_worker")
+        self.emit("movq 56(%r15), %r12")
+        self.emit("testq %r12, %r12")
+        self.emit("jz vyl_mark_worker")  # stopped in its scheduler: no task stack
+        self.emit("movq 48(%r15), %r13")
+        self.emit("vyl_mark_worker_words:")
+        self.emit("cmpq %r12, %r13")
+        self.emit("jae vyl_mark_worker")
+        self.emit("movq (%r13), %rdi")
+        self.emit("call vyl_mark_ptr")
+        self.emit("addq $8, %r13")
+        self.emit("jmp vyl_mark_worker_words")
+        # parked tasks, from their saved registers up; Main's stack while a task
+        # runs. A zero saved rsp marks a running task, scanned above.
+        self.emit("vyl_mark_tasks:")
+        self.emit("movq vyl_task_all(%rip), %r14")
+        self.emit("leaq vyl_task_root(%rip), %r15")
+        self.emit("movq stack_base(%rip), %r12")
+        self.emit("jmp vyl_mark_task_parked")
+        self.emit("vyl_mark_task:")
+        self.emit("testq %r14, %r14")
+        self.emit("jz vyl_mark_arenas")
+        self.emit("movq %r14, %r15")
+        self.emit("movq 48(%r14), %r14")
+        self.emit(f"leaq {TASK_SIZE}(%r15), %r12")
+        self.emit("vyl_mark_task_parked:")
+        self.emit("movq (%r15), %r13")
+        self.emit("cmpq $0, 8(%r15)")
+        self.emit("jne vyl_mark_task_done")
+        self.emit("testq %r13, %r13")
+        self.emit("jz vyl_mark_task")
+        self.emit("jmp vyl_mark_task_words")
+        self.emit("vyl_mark_task_done:")
+        self.emit("leaq 24(%r15), %r13")  # finished: only the result is left
+        self.emit("vyl_mark_task_words:")
+        self.emit("cmpq %r12, %r13")
+        self.emit("jae vyl_mark_task")
+        self.emit("movq (%r13), %rdi")
+        self.emit("call vyl_mark_ptr")
+        self.emit("addq $8, %r13")
+        self.emit("jmp vyl_mark_task_words")
+        # arena chunks, each up to its used end
+        self.emit("vyl_mark_arenas:")
+        self.emit("movq vyl_arena_list(%rip), %r14")
+        self.emit("vyl_mark_arena:")
+        self.emit("testq %r14, %r14")
+        self.emit("jz vyl_mark_trace")
+        self.emit("movq 0(%r14), %r15")
+        self.emit("movq 8(%r14), %r12")
+        self.emit("vyl_mark_arena_chunk:")
+        self.emit("leaq 32(%r15), %r13")
+        self.emit("vyl_mark_arena_words:")
+        self.emit("cmpq %r12, %r13")
+        self.emit("jae vyl_mark_arena_next_chunk")
+        self.emit("movq (%r13), %rdi")
+        self.emit("call vyl_mark_ptr")
+        self.emit("addq $8, %r13")
+        self.emit("jmp vyl_mark_arena_words")
+        self.emit("vyl_mark_arena_next_chunk:")
+        self.emit("movq (%r15), %r15")
+        self.emit("testq %r15, %r15")
+        self.emit("jz vyl_mark_arena_next")
+        self.emit("movq 16(%r15), %r12")
+        self.emit("jmp vyl_mark_arena_chunk")
+        self.emit("vyl_mark_arena_next:")
+        self.emit("movq 32(%r14), %r14")
+        self.emit("jmp vyl_mark_arena")
+        # drain the mark stack, scanning each object for heap-to-heap references
+        self.emit("vyl_mark_trace:")
+        self.emit("movq vyl_gc_mark_top(%rip), %rax")
+        self.emit("cmpq vyl_gc_mark_base(%rip), %rax")
+        self.emit("je vyl_sweep")
+        self.emit("subq $8, %rax")
+        self.emit("movq %rax, vyl_gc_mark_top(%rip)")
+        self.emit("movq (%rax), %r13")
+        self.emit("movq %r13, %rdx")
+        self.emit("subq vyl_heap_lo(%rip), %rdx")
+        self.emit(f"shrq ${GC_PAGE_SHIFT}, %rdx")
+        self.emit("movq vyl_page_map(%rip), %rcx")
+        self.emit("movq (%rcx,%rdx,8), %rcx")
+        self.emit("movq 0(%rcx), %r12")
+        self.emit("addq %r13, %r12")
+        self.emit("vyl_mark_trace_words:")
+        self.emit("cmpq %r12, %r13")
+        self.emit("jae vyl_mark_trace")
+        self.emit("movq (%r13), %rdi")
+        self.emit("call vyl_mark_ptr")
+        self.emit("addq $8, %r13")
+        self.emit("jmp vyl_mark_trace_words")
+        # sweep span by span; each page's free slots form a chain in its header
+        # (32) and pages with any free slot queue on vyl_gc_partial through 56
+        self.emit("vyl_sweep:")
+        if self.profile_alloc:
+            self.emit("movq $0, vyl_prof_swept(%rip)")
+        self.emit("leaq vyl_gc_partial(%rip), %rdi")
+        self.emit(f"movl ${classes}, %ecx")
+        self.emit("xorl %eax, %eax")
+        self.emit("rep stosq")
+        self.emit("xorl %r14d, %r14d")
+        self.emit("vyl_sweep_lists:")  # every thread's free lists start empty
+        self.emit("cmpq vyl_nworkers(%rip), %r14")
+        self.emit("jae vyl_sweep_start")
+        self.emit("movq %r14, %rdx")
+        self.emit(f"imulq ${WORKER_SIZE}, %rdx")
+        self.emit("leaq vyl_workers(%rip), %rax")
+        self.emit("movq 40(%rax,%rdx), %rdi")
+        self.emit("incq %r14")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_sweep_lists")
+        self.emit(f"movl ${classes}, %ecx")
+        self.emit("xorl %eax, %eax")
+        self.emit("rep stosq")
+        self.emit("jmp vyl_sweep_lists")
+        self.emit("vyl_sweep_start:")
+        self.emit("movq vyl_heap_lo(%rip), %rbx")
+        self.emit("vyl_sweep_span:")
+        self.emit("cmpq vyl_heap_next(%rip), %rbx")
+        self.emit("jae vyl_collect_done")
+        self.emit("movq 40(%rbx), %r14")
+        self.emit(f"shlq ${GC_PAGE_SHIFT}, %r14")
+        self.emit("addq %rbx, %r14")  # next span
+        self.emit("movq %rbx, %rdx")
+        self.emit("subq vyl_heap_lo(%rip), %rdx")
+        self.emit(f"shrq ${GC_PAGE_SHIFT}, %rdx")
+        self.emit("movq vyl_page_map(%rip), %rcx")
+        self.emit("cmpq $0, (%rcx,%rdx,8)")
+        self.emit("je vyl_sweep_next")  # already free
+        self.emit("cmpq $2, 16(%rbx)")
+        self.emit("je vyl_sweep_large")
+        # small page: allocated &= marked, then clear the marks
+        self.emit("xorl %eax, %eax")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("vyl_sweep_bits:")
+        self.emit(f"movq {alloc_bits}(%rbx,%rcx,8), %rdx")
+        self.emit(f"andq {mark_bits}(%rbx,%rcx,8), %rdx")
+        self.emit(f"movq %rdx, {alloc_bits}(%rbx,%rcx,8)")
+        self.emit(f"movq $0, {mark_bits}(%rbx,%rcx,8)")
+        self.emit("orq %rdx, %rax")
+        if self.profile_alloc:
+            # one allocation bit per object: survivors times the slot size
+            self.emit("popcntq %rdx, %r9")
+            self.emit("imulq 0(%rbx), %r9")
+            self.emit("addq %r9, vyl_prof_swept(%rip)")
+        self.emit("incq %rcx")
+        self.emit(f"cmpq ${(mark_bits - alloc_bits) // 8}, %rcx")
+        self.emit("jb vyl_sweep_bits")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_sweep_thread")
         self.emit("movq %rbx, %rdi")
-        self.emit("call free")
-        self.emit("movq %rcx, %rbx")
-        self.emit("jmp vyl_sweep_loop")
-        self.emit("vyl_keep:")
-        self.emit("movq $0, 16(%rbx)")
+        self.emit("call vyl_gc_release")
+        self.emit("jmp vyl_sweep_next")
+        self.emit("vyl_sweep_thread:")
+        self.emit("movq 0(%rbx), %rsi")
+        self.emit("movq 8(%rbx), %rcx")
+        self.emit("leaq 32(%rbx), %r8")
+        self.emit("movq $0, (%r8)")
+        self.emit("leaq -1(%rcx), %rax")
+        self.emit("imulq %rsi, %rax")
+        self.emit(f"leaq {hdr}(%rbx,%rax), %rax")  # last slot
+        self.emit("vyl_sweep_slot:")
+        self.emit("movq %rax, %rdx")
+        self.emit("subq %rbx, %rdx")
+        self.emit("shrq $4, %rdx")
+        self.emit(f"btq %rdx, {alloc_bits}(%rbx)")
+        self.emit("jc vyl_sweep_slot_next")
+        self.emit("movq (%r8), %rdx")
+        self.emit("movq %rdx, (%rax)")
+        self.emit("movq %rax, (%r8)")
+        self.emit("vyl_sweep_slot_next:")
+        self.emit("subq %rsi, %rax")
+        self.emit("decq %rcx")
+        self.emit("jnz vyl_sweep_slot")
+        self.emit("cmpq $0, 32(%rbx)")
+        self.emit("je vyl_sweep_next")
+        self.emit("movq 24(%rbx), %rdx")
+        self.emit("leaq vyl_gc_partial(%rip), %rcx")
+        self.emit("movq (%rcx,%rdx,8), %rax")
+        self.emit("movq %rax, 56(%rbx)")
+        self.emit("movq %rbx, (%rcx,%rdx,8)")
+        self.emit("jmp vyl_sweep_next")
+        self.emit("vyl_sweep_large:")
+        self.emit(f"btrq ${large_bit}, {mark_bits + large_word}(%rbx)")
+        if self.profile_alloc:
+            self.emit("jnc vyl_sweep_large_free")
+            self.emit("movq 40(%rbx), %rdx")
+            self.emit(f"shlq ${GC_PAGE_SHIFT}, %rdx")
+            self.emit("addq %rdx, vyl_prof_swept(%rip)")
+            self.emit("jmp vyl_sweep_next")
+            self.emit("vyl_sweep_large_free:")
+        else:
+            self.emit("jc vyl_sweep_next")
         self.emit("movq %rbx, %rdi")
-        self.emit("movq (%rbx), %rbx")
-        self.emit("jmp vyl_sweep_loop")
-        self.emit("vyl_sweep_done:")
+        self.emit("call vyl_gc_release")
+        self.emit("vyl_sweep_next:")
+        self.emit("movq %r14, %rbx")
+        self.emit("jmp vyl_sweep_span")
+        # restart the world
+        self.emit("vyl_collect_done:")
+        self.emit("cmpq $1, vyl_nworkers(%rip)")
+        self.emit("jbe vyl_collect_unlock")
+        self.emit("lock incq vyl_gc_phase(%rip)")
+        self.emit("movl $202, %eax")  # futex
+        self.emit("leaq vyl_gc_phase(%rip), %rdi")
+        self.emit("movl $129, %esi")  # FUTEX_WAKE_PRIVATE
+        self.emit("movl $0x7fffffff, %edx")
+        self.emit("syscall")
+        self.emit("vyl_collect_unlock:")
+        if self.profile_alloc:
+            self.emit("call vyl_prof_gc_done")
+        self.emit("movq $0, vyl_gc_lock(%rip)")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r15")
+        self.emit("pop %r14")
         self.emit("pop %r13")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # data
-        self.emit(".section .data")
-        self.emit("sha256_buf: .space 32")
-        self.emit("sha256_hex: .space 65")
-        self.emit("hex_table: .asciz \"0123456789abcdef\"")
-        self.emit("tls_ctx: .quad 0")
+        # vyl_gc_signal: GC_STOP_SIGNAL handler. A thread that is allocating or
+        # holds a runtime lock only notes the request; vyl_gc_park runs at its
+        # next safepoint instead.
+        self.emit("vyl_gc_signal:")
+        self.emit(f"cmpq $0, {self.tls('vyl_gc_busy')}")
+        self.emit("je vyl_gc_park")
+        self.emit(f"movq $1, {self.tls('vyl_gc_pending')}")
+        self.emit("ret")
 
-        # File/dir helper strings
-        self.emit(".fmt_mkdirp: .asciz \"mkdir -p %s\"")
-        self.emit(".fmt_rmrf: .asciz \"rm -rf %s\"")
-        self.emit(".fmt_unzip: .asciz \"unzip -o -q %s -d %s\"")
+        # vyl_gc_park: publish this thread's stack to the collector and sleep
+        # until the collection ends. Preserves every register, so safepoints
+        # can call it anywhere; the pushed registers are scanned as roots.
+        self.emit(".globl vyl_gc_park")
+        self.emit("vyl_gc_park:")
+        regs = ("%rax", "%rbx", "%rcx", "%rdx", "%rsi", "%rdi", "%rbp",
+                "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15")
+        for reg in regs:
+            self.emit(f"push {reg}")
+        self.emit(f"incq {self.tls('vyl_gc_busy')}")  # a second signal only sets pending
+        self.emit(f"movq $0, {self.tls('vyl_gc_pending')}")
+        self.emit("movq vyl_gc_phase(%rip), %r12")
+        self.emit("testq $1, %r12")
+        self.emit("jz vyl_gc_park_ret")  # no collection is stopping the world
+        self.emit(f"cmpq {self.tls('vyl_gc_parked')}, %r12")
+        self.emit("je vyl_gc_park_ret")  # already counted for this one
+        self.emit(f"movq %r12, {self.tls('vyl_gc_parked')}")
+        self.emit(f"movq {self.tls('vyl_worker_self')}, %rbx")
+        self.emit("movq %rsp, 48(%rbx)")
+        self.emit(f"movq {self.tls('vyl_task_current')}, %rax")
+        self.emit("xorl %ecx, %ecx")
+        self._emit_tls_address("vyl_sched_ctx", "%rdx")
+        self.emit("cmpq %rdx, %rax")
+        self.emit("je vyl_gc_park_top")
+        self.emit("movq stack_base(%rip), %rcx")
+        self.emit("leaq vyl_task_root(%rip), %rdx")
+        self.emit("cmpq %rdx, %rax")
+        self.emit("je vyl_gc_park_top")
+        self.emit(f"leaq {TASK_SIZE}(%rax), %rcx")
+        self.emit("vyl_gc_park_top:")
+        self.emit("movq %rcx, 56(%rbx)")
+        self.emit("lock incq vyl_gc_stopped(%rip)")
+        self.emit("vyl_gc_park_wait:")
+        self.emit("movl $202, %eax")  # futex
+        self.emit("leaq vyl_gc_phase(%rip), %rdi")
+        self.emit("movl $128, %esi")  # FUTEX_WAIT_PRIVATE
+        self.emit("movl %r12d, %edx")
+        self.emit("xorl %r10d, %r10d")
+        self.emit("syscall")
+        self.emit("cmpq %r12, vyl_gc_phase(%rip)")
+        self.emit("je vyl_gc_park_wait")
+        self.emit("vyl_gc_park_ret:")
+        self.emit(f"decq {self.tls('vyl_gc_busy')}")
+        for reg in reversed(regs):
+            self.emit(f"pop {reg}")
+        self.emit("ret")
 
-        # Switch back to text for networking helpers
+    def generate_arena_runtime(self):
+        """Emit the region allocator behind ArenaNew/ArenaAlloc and @arena blocks.
+
+        An arena is a 48-byte header [chunk, cur, end, chunk_size, next_arena]
+        over a list of malloc'd chunks [next, end, top] (newest first).
+        Allocation bumps cur; ArenaReset keeps only the first chunk. The
+        @arena scopes in effect belong to the OS thread that entered them.
+        """
+        current = self.tls("vyl_arena_current")
+        depth = self.tls("vyl_arena_depth")
+        self.emit(".section .data")
+        self.emit("vyl_arena_list: .quad 0")
+        self.emit("vyl_arena_lock: .quad 0")
+        self.emit(".section .tbss,\"awT\",@nobits")
+        self.emit(".balign 8")
+        self.emit("vyl_arena_current: .zero 8")
+        self.emit("vyl_arena_depth: .zero 8")
+        self.emit(f"vyl_arena_stack: .zero {8 * ARENA_MAX_DEPTH}")
         self.emit(".section .text")
 
-        # Networking helpers
-        self.emit(".globl vyl_tcp_connect")
-        self.emit("vyl_tcp_connect:")
+        # vyl_arena_push(rdi=arena): route vyl_alloc into arena; clobbers rcx, rdx
+        self.emit(".globl vyl_arena_push")
+        self.emit("vyl_arena_push:")
+        self.emit(f"movq {depth}, %rcx")
+        self.emit(f"cmpq ${ARENA_MAX_DEPTH}, %rcx")
+        self.emit("jae vyl_arena_push_deep")
+        self._emit_tls_address("vyl_arena_stack", "%rdx")
+        self.emit(f"pushq {current}")
+        self.emit("popq (%rdx,%rcx,8)")
+        self.emit("vyl_arena_push_deep:")
+        self.emit(f"incq {depth}")
+        self.emit(f"movq %rdi, {current}")
+        self.emit("ret")
+
+        # vyl_arena_pop(rdi=count): leave count scopes; clobbers only rdi/rsi so
+        # a return value in rax (or a tuple in rax/rdx/rcx) survives
+        self.emit(".globl vyl_arena_pop")
+        self.emit("vyl_arena_pop:")
+        self.emit(f"movq {depth}, %rsi")
+        self.emit("subq %rdi, %rsi")
+        self.emit(f"movq %rsi, {depth}")
+        self.emit(f"cmpq ${ARENA_MAX_DEPTH}, %rsi")
+        self.emit("jae vyl_arena_pop_done")
+        self._emit_tls_address("vyl_arena_stack", "%rdi")
+        self.emit("movq (%rdi,%rsi,8), %rdi")
+        self.emit(f"movq %rdi, {current}")
+        self.emit("vyl_arena_pop_done:")
+        self.emit("ret")
+
+        # vyl_arena_new(rdi=first chunk bytes) -> arena or 0
+        self.emit(".globl vyl_arena_new")
+        self.emit("vyl_arena_new:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
-        # 2 pushes = 16 bytes, rsp % 16 == 0 after these pushes
-        # Need subq that keeps rsp % 16 == 0. 208 works (0 - 208 = -208, 208 % 16 = 0)
-        self.emit("subq $208, %rsp")
-        self.emit("movq %rdi, -24(%rbp)")  # host ptr
-        self.emit("movq %rsi, -32(%rbp)")  # port int
-        # build port string at -80..-65
-        self.emit("leaq -80(%rbp), %rdi")
-        self.emit("movq $16, %rsi")
-        self.emit("leaq .fmt_port(%rip), %rdx")
-        self.emit("movq -32(%rbp), %rcx")
-        self.emit("movq $0, %rax")
-        self.emit("call snprintf")
-        # zero hints at -208..-96 (14 qwords)
-        self.emit("leaq -216(%rbp), %rdi")
-        self.emit("movq $0, %rax")
-        self.emit("movq $0, %rcx")
-        self.emit("movq $14, %rdx")
-        self.emit("vyl_tcp_zero_hints:")
-        self.emit("movq $0, (%rdi,%rcx,8)")
-        self.emit("incq %rcx")
-        self.emit("cmpq %rdx, %rcx")
-        self.emit("jl vyl_tcp_zero_hints")
-        # hints.ai_socktype = SOCK_STREAM(1)
-        self.emit("movl $1, -208(%rbp)")
-        # res pointer storage at -40
-        self.emit("leaq -40(%rbp), %r9")
-        self.emit("movq $0, -40(%rbp)")
-        # call getaddrinfo(host, portstr, &hints, &res)
-        self.emit("movq -24(%rbp), %rdi")
-        self.emit("leaq -80(%rbp), %rsi")
-        self.emit("leaq -216(%rbp), %rdx")
-        self.emit("movq %r9, %rcx")
-        self.emit("call getaddrinfo")
-        self.emit("cmpq $0, %rax")
-        self.emit("jne vyl_tcp_fail")
-        self.emit("movq -40(%rbp), %rbx")
-        self.emit("cmpq $0, %rbx")
-        self.emit("je vyl_tcp_fail")
-        # socket(res->ai_family, ai_socktype, ai_protocol)
-        self.emit("movl 4(%rbx), %edi")
-        self.emit("movl 8(%rbx), %esi")
-        self.emit("movl 12(%rbx), %edx")
-        self.emit("call socket")
+        self.emit("movq %rdi, %rbx")
+        self.emit(f"cmpq ${ARENA_MIN_CHUNK}, %rbx")
+        self.emit("jge vyl_arena_new_sized")
+        self.emit(f"movq ${ARENA_MIN_CHUNK}, %rbx")
+        self.emit("vyl_arena_new_sized:")
+        self.emit("addq $15, %rbx")
+        self.emit("andq $-16, %rbx")
+        self.emit("movl $48, %edi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_arena_new_fail")
         self.emit("movq %rax, %r12")
-        self.emit("cmpq $0, %r12")
-        self.emit("jl vyl_tcp_cleanup_fail")
-        # connect(fd, res->ai_addr, res->ai_addrlen)
-        self.emit("movq %r12, %rdi")
-        self.emit("movq 24(%rbx), %rsi")
-        self.emit("movl 16(%rbx), %edx")
-        self.emit("call connect")
-        self.emit("cmpq $0, %rax")
-        self.emit("jne vyl_tcp_cleanup_fail")
-        self.emit("movq -40(%rbp), %rdi")
-        self.emit("call freeaddrinfo")
+        self.emit("movq %rbx, 24(%r12)")
+        self.emit("leaq 32(%rbx), %rdi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_arena_new_release")
+        self.emit("movq $0, (%rax)")
+        self.emit("leaq 32(%rax,%rbx), %rdx")
+        self.emit("movq %rdx, 8(%rax)")
+        self.emit("movq $0, 16(%rax)")
+        self.emit("movq %rax, 0(%r12)")
+        self.emit("leaq 32(%rax), %rcx")
+        self.emit("movq %rcx, 8(%r12)")
+        self.emit("movq %rdx, 16(%r12)")
+        # register with the collector: arena memory may hold references into the heap
+        self._emit_spin_lock("vyl_arena_lock(%rip)")
+        self.emit("movq vyl_arena_list(%rip), %rax")
+        self.emit("movq %rax, 32(%r12)")
+        self.emit("movq %r12, vyl_arena_list(%rip)")
+        self._emit_spin_unlock("vyl_arena_lock(%rip)")
         self.emit("movq %r12, %rax")
-        self.emit("addq $208, %rsp")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
-        self.emit("vyl_tcp_cleanup_fail:")
+        self.emit("vyl_arena_new_release:")
         self.emit("movq %r12, %rdi")
-        self.emit("call close")
-        self.emit("vyl_tcp_fail:")
-        self.emit("movq -40(%rbp), %rdi")
-        self.emit("cmpq $0, %rdi")
-        self.emit("je vyl_tcp_fail_ret")
-        self.emit("call freeaddrinfo")
-        self.emit("vyl_tcp_fail_ret:")
-        self.emit("movq $0, %rax")
-        self.emit("addq $208, %rsp")
+        self.emit("call free")
+        self.emit("vyl_arena_new_fail:")
+        self.emit("xorl %eax, %eax")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_tcp_send(fd, data)
-        self.emit(".globl vyl_tcp_send")
-        self.emit("vyl_tcp_send:")
+        # vyl_arena_alloc(rdi=arena, rsi=size) -> zeroed memory or 0
+        self.emit(".globl vyl_arena_alloc")
+        self.emit("vyl_arena_alloc:")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jnz vyl_arena_alloc_start")
+        self.emit("movq %rsi, %rdi")
+        self.emit("jmp vyl_alloc")
+        self.emit("vyl_arena_alloc_start:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
-        # 2 pushes, rsp % 16 == 0. Need to keep aligned for calls.
-        self.emit("subq $16, %rsp")
-        self.emit("movq %rdi, %rbx")       # fd
-        self.emit("movq %rsi, %r12")       # buf ptr
-        self.emit("movq %rsi, %rdi")       # strlen(buf)
-        self.emit("call strlen")
-        self.emit("movq %rax, %rdx")       # length
-        self.emit("movq %rbx, %rdi")       # send(fd, buf, len, 0)
-        self.emit("movq %r12, %rsi")
-        self.emit("movq $0, %rcx")
-        self.emit("call send")
-        self.emit("addq $16, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("leaq 15(%rsi), %r12")
+        self.emit("andq $-16, %r12")
+        self.emit("vyl_arena_alloc_bump:")
+        self.emit("movq 8(%rbx), %rax")
+        self.emit("leaq (%rax,%r12), %rdx")
+        self.emit("cmpq 16(%rbx), %rdx")
+        self.emit("ja vyl_arena_alloc_grow")
+        self.emit("movq %rdx, 8(%rbx)")
+        self.emit("movq %rax, %rdi")
+        self.emit("movq %r12, %rcx")
+        self.emit("shrq $3, %rcx")
+        self.emit("movq %rax, %rdx")
+        self.emit("xorl %eax, %eax")
+        self.emit("rep stosq")
+        self.emit("movq %rdx, %rax")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+        self.emit("vyl_arena_alloc_grow:")
+        # retire the current chunk, then chain a new one of max(chunk_size, size)
+        self.emit("movq 0(%rbx), %rcx")
+        self.emit("movq 8(%rbx), %rdx")
+        self.emit("movq %rdx, 16(%rcx)")
+        self.emit("movq 24(%rbx), %rdi")
+        self.emit("cmpq %r12, %rdi")
+        self.emit("jae vyl_arena_alloc_chunk")
+        self.emit("movq %r12, %rdi")
+        self.emit("vyl_arena_alloc_chunk:")
+        self.emit("push %rdi")
+        self.emit("push %rdi")
+        self.emit("addq $32, %rdi")
+        self.emit("call malloc")
+        self.emit("pop %rdi")
+        self.emit("pop %rcx")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_arena_alloc_fail")
+        self.emit("movq 0(%rbx), %rcx")
+        self.emit("movq %rcx, (%rax)")
+        self.emit("leaq 32(%rax,%rdi), %rdx")
+        self.emit("movq %rdx, 8(%rax)")
+        self.emit("movq $0, 16(%rax)")
+        self.emit("movq %rax, 0(%rbx)")
+        self.emit("leaq 32(%rax), %rcx")
+        self.emit("movq %rcx, 8(%rbx)")
+        self.emit("movq %rdx, 16(%rbx)")
+        self.emit("jmp vyl_arena_alloc_bump")
+        self.emit("vyl_arena_alloc_fail:")
+        self.emit("xorl %eax, %eax")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_tcp_recv(fd, max)
-        self.emit(".globl vyl_tcp_recv")
-        self.emit("vyl_tcp_recv:")
+        # vyl_arena_reset(rdi=arena): free every chunk but the first, rewind
+        self.emit(".globl vyl_arena_reset")
+        self.emit("vyl_arena_reset:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
-        self.emit("push %r13")
-        self.emit("subq $8, %rsp")
-        self.emit("movq %rdi, %rbx")       # fd
-        self.emit("movq %rsi, %r12")       # max size
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_arena_reset_done")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq 0(%rbx), %r12")
+        self.emit("vyl_arena_reset_loop:")
+        self.emit("cmpq $0, (%r12)")
+        self.emit("je vyl_arena_reset_first")
         self.emit("movq %r12, %rdi")
-        self.emit("incq %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_tcp_recv_fail")
-        self.emit("movq %rax, %r13")       # buf ptr
-        self.emit("movq %rbx, %rdi")
-        self.emit("movq %r13, %rsi")
-        self.emit("movq %r12, %rdx")
-        self.emit("movq $0, %rcx")
-        self.emit("call recv")
-        self.emit("cmpq $0, %rax")
-        self.emit("jle vyl_tcp_recv_fail")
-        self.emit("movq %rax, %rdx")
-        self.emit("movb $0, (%r13,%rdx,1)")
-        self.emit("movq %r13, %rax")
-        self.emit("addq $8, %rsp")
-        self.emit("pop %r13")
-        self.emit("pop %r12")
-        self.emit("pop %rbx")
-        self.emit("leave")
-        self.emit("ret")
-        self.emit("vyl_tcp_recv_fail:")
-        self.emit("movq $0, %rax")
-        self.emit("addq $8, %rsp")
-        self.emit("pop %r13")
+        self.emit("movq (%r12), %r12")
+        self.emit("call free")
+        self.emit("jmp vyl_arena_reset_loop")
+        self.emit("vyl_arena_reset_first:")
+        self.emit("movq %r12, 0(%rbx)")
+        self.emit("leaq 32(%r12), %rax")
+        self.emit("movq %rax, 8(%rbx)")
+        self.emit("movq 8(%r12), %rax")
+        self.emit("movq %rax, 16(%rbx)")
+        self.emit("vyl_arena_reset_done:")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_tcp_resolve(host) -> string IPv4
-        self.emit(".globl vyl_tcp_resolve")
-        self.emit("vyl_tcp_resolve:")
+        # vyl_arena_free(rdi=arena): unregister and release all of its memory
+        self.emit(".globl vyl_arena_free")
+        self.emit("vyl_arena_free:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
-        # 2 pushes = 16 bytes, rsp % 16 == 0. Need subq that keeps aligned.
-        # 112 works (0 - 112 = -112, 112 % 16 = 0)
-        self.emit("subq $112, %rsp")
-        self.emit("movq %rdi, -24(%rbp)")  # host
-        # zero hints at -104..-24 (10 qwords)
-        self.emit("leaq -104(%rbp), %rdi")
-        self.emit("movq $0, %rax")
-        self.emit("movq $10, %rcx")
-        self.emit("vyl_tcp_resolve_zero:")
-        self.emit("movq $0, (%rdi,%rax,8)")
-        self.emit("incq %rax")
-        self.emit("cmpq %rcx, %rax")
-        self.emit("jl vyl_tcp_resolve_zero")
-        # hints.family = AF_INET(2)
-        self.emit("movl $2, -96(%rbp)")
-        # res storage at -32
-        self.emit("movq $0, -32(%rbp)")
-        self.emit("movq -24(%rbp), %rdi")
-        self.emit("movq $0, %rsi")
-        self.emit("leaq -104(%rbp), %rdx")
-        self.emit("leaq -32(%rbp), %rcx")
-        self.emit("call getaddrinfo")
-        self.emit("cmpq $0, %rax")
-        self.emit("jne vyl_tcp_resolve_fail")
-        self.emit("movq -32(%rbp), %rbx")
-        self.emit("cmpq $0, %rbx")
-        self.emit("je vyl_tcp_resolve_fail")
-        # sockaddr_in starts at ai_addr
-        self.emit("movq 24(%rbx), %rsi")
-        self.emit("addq $4, %rsi")  # skip sin_family+port
-        self.emit("movq $64, %rdx")
-        self.emit("leaq -88(%rbp), %rdi")  # buffer for IP string
-        self.emit("movl $2, %edi")         # AF_INET
-        self.emit("call inet_ntop")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_tcp_resolve_fail")
-        self.emit("movq %rax, %rdi")
-        self.emit("call strlen")
-        self.emit("incq %rax")
-        self.emit("movq %rax, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_tcp_resolve_fail")
-        self.emit("movq %rax, %r12")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_arena_free_done")
+        self.emit("movq %rdi, %rbx")
+        self._emit_spin_lock("vyl_arena_lock(%rip)")
+        self.emit("leaq vyl_arena_list(%rip), %rcx")
+        self.emit("vyl_arena_free_find:")
+        self.emit("movq (%rcx), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_arena_free_chunks")
+        self.emit("cmpq %rbx, %rax")
+        self.emit("je vyl_arena_free_unlink")
+        self.emit("leaq 32(%rax), %rcx")
+        self.emit("jmp vyl_arena_free_find")
+        self.emit("vyl_arena_free_unlink:")
+        self.emit("movq 32(%rbx), %rax")
+        self.emit("movq %rax, (%rcx)")
+        self.emit("vyl_arena_free_chunks:")
+        self._emit_spin_unlock("vyl_arena_lock(%rip)")
+        self.emit(f"cmpq {current}, %rbx")
+        self.emit("jne vyl_arena_free_walk")
+        self.emit(f"movq $0, {current}")
+        self.emit("vyl_arena_free_walk:")
+        self.emit("movq 0(%rbx), %r12")
+        self.emit("vyl_arena_free_loop:")
+        self.emit("testq %r12, %r12")
+        self.emit("jz vyl_arena_free_header")
         self.emit("movq %r12, %rdi")
-        self.emit("leaq -88(%rbp), %rsi")
-        self.emit("call strcpy")
-        self.emit("movq -32(%rbp), %rdi")
-        self.emit("call freeaddrinfo")
-        self.emit("movq %r12, %rax")
-        self.emit("addq $112, %rsp")
-        self.emit("pop %r12")
-        self.emit("pop %rbx")
-        self.emit("leave")
-        self.emit("ret")
-        self.emit("vyl_tcp_resolve_fail:")
-        self.emit("movq -32(%rbp), %rdi")
-        self.emit("cmpq $0, %rdi")
-        self.emit("je vyl_tcp_resolve_ret")
-        self.emit("call freeaddrinfo")
-        self.emit("vyl_tcp_resolve_ret:")
-        self.emit("movq $0, %rax")
-        self.emit("addq $112, %rsp")
+        self.emit("movq (%r12), %r12")
+        self.emit("call free")
+        self.emit("jmp vyl_arena_free_loop")
+        self.emit("vyl_arena_free_header:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call free")
+        self.emit("vyl_arena_free_done:")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        self.emit(".section .rodata")
-        self.emit(".fmt_port: .asciz \"%d\"")
-        self.emit(".empty_str: .asciz \"\"")
-        self.emit(".section .text")
+    def generate_builtin_functions(self):
+        self.generate_io_runtime()
+        self.generate_reader_runtime()
 
-        # TLS helpers (OpenSSL)
-        self.emit(".globl vyl_tls_ensure_ctx")
-        self.emit("vyl_tls_ensure_ctx:")
+        # print_int: digits plus newline straight into the stdout buffer
+        self.emit(".globl print_int")
+        self.emit("print_int:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
-        # After push rbp, rsp % 16 == 0. Need to keep it that way for calls.
-        # Subtracting 0 or 16 works. Use 16 for a bit of scratch.
-        self.emit("subq $16, %rsp")
-        self.emit("cmpq $0, tls_ctx(%rip)")
-        self.emit("jne vyl_tls_ctx_done")
-        self.emit("movq $0, %rdi")
-        self.emit("movq $0, %rsi")
-        self.emit("call OPENSSL_init_ssl")
-        self.emit("call TLS_client_method")
-        self.emit("movq %rax, %rdi")
-        self.emit("call SSL_CTX_new")
-        self.emit("movq %rax, tls_ctx(%rip)")
-        self.emit("vyl_tls_ctx_done:")
-        self.emit("addq $16, %rsp")
+        self.emit("subq $32, %rsp")
+        self.emit("leaq -8(%rbp), %rsi")
+        self.emit("call vyl_itoa")
+        self.emit("movb $10, -8(%rbp)")
+        self.emit("movq %rax, %rsi")
+        self.emit("incq %rdx")
+        self.emit("call vyl_print_bytes")
         self.emit("leave")
         self.emit("ret")
 
-        self.emit(".globl vyl_tls_connect")
-        self.emit("vyl_tls_connect:")
+        # print_dec(rdi=double bits)
+        self.emit(".globl print_dec")
+        self.emit("print_dec:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("subq $32, %rsp")
+        self.emit("movq %rdi, %xmm0")
+        self.emit("movq %rsp, %rdi")
+        self.emit("movq $32, %rsi")
+        self.emit("leaq .fmt_dec(%rip), %rdx")
+        self.emit("movl $1, %eax")  # one vector register argument
+        self.emit("call snprintf")
+        self.emit("movq %rsp, %rsi")
+        self.emit("movslq %eax, %rdx")
+        self.emit("call vyl_print_bytes")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_dtoa(rdi=double bits, rsi=end of a 24-byte buffer) -> rax=text, rdx=length
+        self.emit(".globl vyl_dtoa")
+        self.emit("vyl_dtoa:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("leaq -24(%rsi), %rbx")
+        self.emit("movq %rdi, %xmm0")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movq $24, %rsi")
+        self.emit("leaq .fmt_dec_text(%rip), %rdx")
+        self.emit("movl $1, %eax")
+        self.emit("call snprintf")
+        self.emit("movq %rax, %rdx")
+        self.emit("movq %rbx, %rax")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # print_string - the header already knows the length
+        self.emit(".globl print_string")
+        self.emit("print_string:")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz print_string_null")
+        self.emit("movq %rdi, %rsi")
+        self.emit("movq -8(%rdi), %rdx")
+        self.emit("jmp vyl_print_bytes")
+        self.emit("print_string_null:")
+        self.emit("leaq .str_null(%rip), %rsi")
+        self.emit("movq $6, %rdx")
+        self.emit("jmp vyl_print_bytes")
+
+        # vyl_wrap_argv: give every argv entry a string header. The copies
+        # come from malloc because argv sits above the stack range the
+        # collector scans.
+        self.emit(".globl vyl_wrap_argv")
+        self.emit("vyl_wrap_argv:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
         self.emit("push %r13")
-        # 3 pushes = 24 bytes below rbp. rsp % 16 == 8.
-        # Need subq $40 (24+40=64, still 8 mod 16) -> subq $40 gives 8-40%16=8-8=0 ✓
-        self.emit("subq $40, %rsp")
-        self.emit("movq %rdi, -32(%rbp)")   # host
-        self.emit("movq %rsi, -40(%rbp)")   # port
-        self.emit("call vyl_tls_ensure_ctx")
-        self.emit("movq -32(%rbp), %rdi")
-        self.emit("movq -40(%rbp), %rsi")
-        self.emit("call vyl_tcp_connect")
-        self.emit("movq %rax, %rbx")
-        self.emit("cmpq $0, %rbx")
-        self.emit("je vyl_tls_conn_fail")
-        self.emit("movq tls_ctx(%rip), %rdi")
-        self.emit("call SSL_new")
-        self.emit("movq %rax, %r12")
-        self.emit("cmpq $0, %r12")
-        self.emit("je vyl_tls_conn_fail_close")
-        self.emit("movq %r12, %rdi")
-        self.emit("movq %rbx, %rsi")
-        self.emit("call SSL_set_fd")
-        self.emit("cmpq $0, %rax")
-        self.emit("jle vyl_tls_conn_fail_ssl")
-        # Set SNI hostname: SSL_ctrl(ssl, SSL_CTRL_SET_TLSEXT_HOSTNAME=55, TLSEXT_NAMETYPE_host_name=0, hostname)
-        self.emit("movq %r12, %rdi")
-        self.emit("movq $55, %rsi")         # SSL_CTRL_SET_TLSEXT_HOSTNAME
-        self.emit("movq $0, %rdx")          # TLSEXT_NAMETYPE_host_name
-        self.emit("movq -32(%rbp), %rcx")   # hostname
-        self.emit("call SSL_ctrl")
-        self.emit("movq %r12, %rdi")
-        self.emit("call SSL_connect")
-        self.emit("cmpq $0, %rax")
-        self.emit("jle vyl_tls_conn_fail_ssl")
-        self.emit("movq %r12, %rax")
-        self.emit("addq $40, %rsp")
+        self.emit("push %r14")
+        self.emit("movq argv_store(%rip), %r12")
+        self.emit("xorq %rbx, %rbx")
+        self.emit("vyl_wrap_argv_loop:")
+        self.emit("cmpq argc_store(%rip), %rbx")
+        self.emit("jge vyl_wrap_argv_done")
+        self.emit("movq (%r12,%rbx,8), %r13")
+        self.emit("movq %r13, %rdi")
+        self.emit("call strlen")
+        self.emit("movq %rax, %r14")
+        self.emit("leaq 17(%rax), %rdi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_wrap_argv_done")
+        self.emit("movq %r14, (%rax)")
+        self.emit("movq %r14, 8(%rax)")
+        self.emit("leaq 16(%rax), %rdi")
+        self.emit("movq %rdi, (%r12,%rbx,8)")
+        self.emit("movq %r13, %rsi")
+        self.emit("leaq 1(%r14), %rdx")
+        self.emit("call memcpy")
+        self.emit("incq %rbx")
+        self.emit("jmp vyl_wrap_argv_loop")
+        self.emit("vyl_wrap_argv_done:")
+        self.emit("pop %r14")
         self.emit("pop %r13")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
-        self.emit("vyl_tls_conn_fail_ssl:")
-        self.emit("movq %r12, %rdi")
-        self.emit("call SSL_free")
-        self.emit("vyl_tls_conn_fail_close:")
-        self.emit("movq %rbx, %rdi")
-        self.emit("call close")
-        self.emit("vyl_tls_conn_fail:")
-        self.emit("movq $0, %rax")
-        self.emit("addq $40, %rsp")
-        self.emit("pop %r13")
-        self.emit("pop %r12")
-        self.emit("pop %rbx")
+
+        # clock (stubbed)
+        self.emit(".globl clock")
+        self.emit("clock:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("movl $1, %eax")
+        self.emit("lock xaddq %rax, clock_counter(%rip)")
+        self.emit("movq $2208988800, %rcx")
+        self.emit("addq %rcx, %rax")
         self.emit("leave")
         self.emit("ret")
 
-        self.emit(".globl vyl_tls_send")
-        self.emit("vyl_tls_send:")
+        self.emit(".section .data")
+        self.emit("clock_counter: .quad 1")
+        # 15 significant digits: exact for decimal input, no 0.1 + 0.2 noise
+        self.emit(".fmt_dec: .asciz \"%.15g\\n\"")
+        self.emit(".fmt_dec_text: .asciz \"%.15g\"")
+        self.emit(".str_null: .ascii \"(null)\"")
+        self.emit(".fmt_newline: .asciz \"\\n\"")
+        self.emit("argc_store: .quad 0")
+        self.emit("argv_store: .quad 0")
+        self.emit(".mode_wb: .asciz \"wb\"")
+        self.emit("stack_base: .quad 0")
+        self.emit(".section .text")
+
+        # SHA256 helper
+        self.emit(".globl vyl_sha256")
+        self.emit("vyl_sha256:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
         # 2 pushes, rsp % 16 == 0. Keep aligned.
         self.emit("subq $16, %rsp")
-        self.emit("movq %rdi, %rbx")       # ssl_ctx
-        self.emit("movq %rsi, %r12")       # buf ptr
-        self.emit("movq %rsi, %rdi")       # strlen(buf)
-        self.emit("call strlen")
-        self.emit("movq %rax, %rdx")       # length
-        self.emit("movq %rbx, %rdi")       # SSL_write(ssl, buf, len)
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq -8(%rdi), %r12")  # input length from the header
+        self.emit("leaq sha256_buf(%rip), %rdi")
+        self.emit("movq %rdi, %rdx")
+        self.emit("movq %rbx, %rdi")
         self.emit("movq %r12, %rsi")
-        self.emit("call SSL_write")
+        self.emit("call SHA256")
+        self.emit("leaq sha256_buf(%rip), %rsi")
+        self.emit("leaq sha256_hex(%rip), %rdi")
+        self.emit("leaq hex_table(%rip), %r8")
+        self.emit("movq $0, %rcx")
+        self.emit("sha256_hex_loop:")
+        self.emit("cmpq $32, %rcx")
+        self.emit("jge sha256_hex_done")
+        self.emit("movzbl (%rsi,%rcx,1), %eax")
+        self.emit("movq %rax, %rbx")
+        self.emit("shrq $4, %rbx")
+        self.emit("andq $0xF, %rbx")
+        self.emit("movzbl (%r8,%rbx,1), %ebx")
+        self.emit("movb %bl, (%rdi,%rcx,2)")
+        self.emit("movzbl %al, %ebx")
+        self.emit("andq $0xF, %rbx")
+        self.emit("movzbl (%r8,%rbx,1), %ebx")
+        self.emit("movb %bl, 1(%rdi,%rcx,2)")
+        self.emit("incq %rcx")
+        self.emit("jmp sha256_hex_loop")
+        self.emit("sha256_hex_done:")
+        self.emit("movb $0, 64(%rdi)")
+        self.emit("leaq sha256_hex(%rip), %rax")
         self.emit("addq $16, %rsp")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        self.emit(".globl vyl_tls_recv")
-        self.emit("vyl_tls_recv:")
+        # input_line -> returns malloc'd string or 0 on EOF/error
+        self.emit(".globl vyl_input")
+        self.emit("vyl_input:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
-        self.emit("push %r13")
-        # 3 pushes, rsp % 16 == 8. Need subq $8 to align.
-        self.emit("subq $8, %rsp")
-        self.emit("movq %rdi, %rbx")
-        self.emit("movq %rsi, %r12")
+        # Show anything printed so far, typically a prompt, before blocking
+        self._emit_spin_lock("vyl_stdout_lock(%rip)")
+        self.emit("leaq vyl_stdout(%rip), %rdi")
+        self.emit("call vyl_buf_flush")
+        self._emit_spin_unlock("vyl_stdout_lock(%rip)")
+        self.emit("movq $4095, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("movq %rax, %r12")
+        self.emit("cmpq $0, %r12")
+        self.emit("je vyl_input_fail")
         self.emit("movq %r12, %rdi")
-        self.emit("incq %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_tls_recv_fail")
-        self.emit("movq %rax, %r13")
-        self.emit("movq %rbx, %rdi")
-        self.emit("movq %r13, %rsi")
-        self.emit("movq %r12, %rdx")
-        self.emit("call SSL_read")
+        self.emit("movq $4096, %rsi")
+        self.emit("movq stdin(%rip), %rdx")
+        self.emit("call fgets")
         self.emit("cmpq $0, %rax")
-        self.emit("jle vyl_tls_recv_fail")
-        self.emit("movq %rax, %rdx")
-        self.emit("movb $0, (%r13,%rdx,1)")
-        self.emit("movq %r13, %rax")
-        self.emit("addq $8, %rsp")
-        self.emit("pop %r13")
+        self.emit("je vyl_input_fail")
+        # strip trailing newline if present
+        self.emit("movq %r12, %rdi")
+        self.emit("call strlen")
+        self.emit("movq %rax, %rbx")
+        self.emit("cmpq $0, %rbx")
+        self.emit("je vyl_input_done")
+        self.emit("cmpb $10, -1(%r12,%rbx,1)")
+        self.emit("jne vyl_input_done")
+        self.emit("decq %rbx")
+        self.emit("movb $0, (%r12,%rbx,1)")
+        self.emit("vyl_input_done:")
+        self.emit("movq %rbx, -8(%r12)")
+        self.emit("movq %r12, %rax")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
-        self.emit("vyl_tls_recv_fail:")
+        self.emit("vyl_input_fail:")
         self.emit("movq $0, %rax")
-        self.emit("addq $8, %rsp")
-        self.emit("pop %r13")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        self.emit(".globl vyl_tls_close")
-        self.emit("vyl_tls_close:")
+        # read_all
+        self.emit(".globl vyl_read_all")
+        self.emit("vyl_read_all:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
-        self.emit("subq $8, %rsp")
-        self.emit("movq %rdi, %rbx")       # save ssl ptr
+        self.emit("push %r13")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
         self.emit("movq %rbx, %rdi")
-        self.emit("call SSL_get_fd")
-        self.emit("movq %rax, %rdi")
-        self.emit("call close")
+        self.emit("movq $0, %rsi")
+        self.emit("movq $2, %rdx")
+        self.emit("call fseek")
         self.emit("movq %rbx, %rdi")
-        self.emit("call SSL_free")
+        self.emit("call ftell")
+        self.emit("movq %rax, %r12")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call rewind")
+        self.emit("cmpq $0, %r12")
+        self.emit("jle vyl_read_all_zero")
+        self.emit("movq %r12, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("movq %rax, %r13")
+        self.emit("movq %r13, %rdi")
+        self.emit("movq $1, %rsi")
+        self.emit("movq %r12, %rdx")
+        self.emit("movq %rbx, %rcx")
+        self.emit("call fread")
+        self.emit("movq %rax, -8(%r13)")  # short reads shrink the length
+        self.emit("movb $0, (%r13,%rax,1)")
+        self.emit("movq %r13, %rax")
+        self.emit("jmp vyl_read_all_done")
+        self.emit("vyl_read_all_zero:")
         self.emit("movq $0, %rax")
-        self.emit("addq $8, %rsp")
+        self.emit("vyl_read_all_done:")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_http_get(host, path, use_tls:int) -> string (body) or 0
-        self.emit(".globl vyl_http_get")
-        self.emit("vyl_http_get:")
+        # write_all
+        self.emit(".globl vyl_write_all")
+        self.emit("vyl_write_all:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
-        self.emit("push %rbx")
-        self.emit("push %r12")
-        self.emit("push %r13")
-        # 3 pushes = 24 bytes. Locals at -32 and below. Need 128-byte buffer + 24 for vars + alignment
-        self.emit("subq $168, %rsp")
-        self.emit("movq %rdi, -32(%rbp)")   # host
-        self.emit("movq %rsi, -40(%rbp)")   # path
-        self.emit("movq %rdx, -48(%rbp)")   # use_tls
-
-        # Build request into stack buffer (-176 to -49) and then heap copy
-        self.emit("leaq -176(%rbp), %rdi")
-        self.emit("movq $128, %rsi")
-        self.emit("leaq .fmt_http_get(%rip), %rdx")
-        self.emit("movq -40(%rbp), %rcx")
-        self.emit("movq -32(%rbp), %r8")
-        self.emit("movq $0, %rax")
-        self.emit("call snprintf")
-        self.emit("movq %rax, %r12")
-        self.emit("incq %r12")
-        self.emit("movq %r12, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_fail")
-        self.emit("movq %rax, %r13")
-        self.emit("movq %r13, %rdi")
-        self.emit("leaq -176(%rbp), %rsi")
-        self.emit("call strcpy")
-
-        # Connect
-        self.emit("movq -32(%rbp), %rdi")
-        self.emit("movq $80, %rsi")
-        self.emit("movq -48(%rbp), %rax")
-        self.emit("cmpq $0, %rax")
-        self.emit("jne vyl_http_tls_conn")
-        self.emit("call vyl_tcp_connect")
-        self.emit("jmp vyl_http_conn_done")
-        self.emit("vyl_http_tls_conn:")
-        self.emit("movq -32(%rbp), %rdi")   # host
-        self.emit("movq $443, %rsi")        # port
-        self.emit("call vyl_tls_connect")
-        self.emit("vyl_http_conn_done:")
+        self.emit("movq %rdi, %rcx")
+        self.emit("movq %rsi, %rdi")
+        self.emit("movq -8(%rsi), %rdx")
+        self.emit("movq $1, %rsi")
+        self.emit("call fwrite")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_isqrt(rdi=n) -> floor(sqrt(n)): sqrtsd, then fix the rounding
+        # of large n with at most a step or two either way
+        self.emit(".globl vyl_isqrt")
+        self.emit("vyl_isqrt:")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jle vyl_isqrt_ret")
+        self.emit("cvtsi2sdq %rdi, %xmm0")
+        self.emit("sqrtsd %xmm0, %xmm0")
+        self.emit("cvttsd2siq %xmm0, %rax")
+        self.emit("vyl_isqrt_down:")  # while r * r > n: r--
+        self.emit("movq %rax, %rcx")
+        self.emit("imulq %rcx, %rcx")
+        self.emit("jo vyl_isqrt_dec")
+        self.emit("cmpq %rdi, %rcx")
+        self.emit("jle vyl_isqrt_up")
+        self.emit("vyl_isqrt_dec:")
+        self.emit("decq %rax")
+        self.emit("jmp vyl_isqrt_down")
+        self.emit("vyl_isqrt_up:")  # while (r + 1) * (r + 1) <= n: r++
+        self.emit("leaq 1(%rax), %rcx")
+        self.emit("imulq %rcx, %rcx")
+        self.emit("jo vyl_isqrt_ret")
+        self.emit("cmpq %rdi, %rcx")
+        self.emit("jg vyl_isqrt_ret")
+        self.emit("incq %rax")
+        self.emit("jmp vyl_isqrt_up")
+        self.emit("vyl_isqrt_ret:")
+        self.emit("ret")
+
+        # vyl_sleep_ms(rdi=ms) -> 0; negative sleeps nothing, signals resume it
+        self.emit(".globl vyl_sleep_ms")
+        self.emit("vyl_sleep_ms:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("subq $16, %rsp")
+        self.emit("movq %rdi, %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jns vyl_sleep_ms_split")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_sleep_ms_split:")
+        self.emit("xorl %edx, %edx")
+        self.emit("movl $1000, %ecx")
+        self.emit("divq %rcx")
+        self.emit("movq %rax, (%rsp)")  # tv_sec
+        self.emit("imulq $1000000, %rdx, %rdx")
+        self.emit("movq %rdx, 8(%rsp)")  # tv_nsec
+        self.emit("vyl_sleep_ms_wait:")
+        self.emit("movq %rsp, %rdi")
+        self.emit("movq %rsp, %rsi")  # an interrupted sleep leaves the rest here
+        self.emit("call nanosleep")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_sleep_ms_wait")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_bounds_fail: abort on null/OO.B
+        self.emit(".globl vyl_bounds_fail")
+        self.emit("vyl_bounds_fail:")
+        self.emit("andq $-16, %rsp")
+        self.emit("call vyl_flush_all")
+        self.emit("movq $1, %rdi")
+        self.emit("movq $231, %rax")  # exit_group: every worker thread goes too
+        self.emit("syscall")
+
+        self.generate_gc_runtime()
+        self.generate_arena_runtime()
+        self.generate_task_runtime()
+        self.generate_chan_runtime()
+        self.generate_bench_runtime()
+        self.generate_perf_map_runtime()
+        if self.profile_alloc:
+            self.generate_alloc_profile_runtime()
+
+        # data
+        self.emit(".section .data")
+        self.emit("sha256_buf: .space 32")
+        self.emit(".balign 8")
+        self.emit(".quad 64, 64")
+        self.emit("sha256_hex: .space 65")
+        self.emit("hex_table: .asciz \"0123456789abcdef\"")
+        self.emit("tls_ctx: .quad 0")
+        self.emit("vyl_dns_cache: .quad 0")
+        self.emit("vyl_tls_sessions: .quad 0")
+        self.emit("vyl_net_lock: .quad 0")  # DNS cache, TLS context and sessions, HTTP pool
+
+        # File/dir helper strings
+
+        # Switch back to text for networking helpers
+        self.emit(".section .text")
+
+        # Networking helpers
+        # vyl_dns_lookup(rdi=host, rsi=port) -> cache entry with a usable address,
+        # or 0. Answers are kept for DNS_TTL_SECONDS, so reconnecting to the same
+        # endpoint does not go through getaddrinfo again.
+        self.emit(".globl vyl_dns_lookup")
+        self.emit("vyl_dns_lookup:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        # (%rsp) timespec, 16 port string, 32 hints, 80 result list
+        self.emit("subq $96, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movl $1, %edi")  # CLOCK_MONOTONIC
+        self.emit("movq %rsp, %rsi")
+        self.emit("call clock_gettime")
+        self.emit("movq (%rsp), %r13")  # now, in seconds
+        self._emit_spin_lock("vyl_net_lock(%rip)")
+        self.emit("movq vyl_dns_cache(%rip), %r14")
+        self.emit("vyl_dns_lookup_scan:")
+        self.emit("testq %r14, %r14")
+        self.emit("jz vyl_dns_lookup_new")
+        self.emit("cmpq %r12, 16(%r14)")
+        self.emit("jne vyl_dns_lookup_next")
+        self.emit("movq 24(%r14), %rdi")
+        self.emit("movq %rbx, %rsi")
+        self.emit("call strcmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_dns_lookup_next")
+        self.emit("cmpq %r13, 8(%r14)")
+        self.emit("jg vyl_dns_lookup_hit")
+        self.emit("jmp vyl_dns_lookup_resolve")  # expired: refresh in place
+        self.emit("vyl_dns_lookup_next:")
+        self.emit("movq (%r14), %r14")
+        self.emit("jmp vyl_dns_lookup_scan")
+        self.emit("vyl_dns_lookup_new:")
+        self.emit(f"movl ${DNS_ENTRY_SIZE}, %edi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_dns_lookup_ret")
+        self.emit("movq %rax, %r14")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call strdup")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_dns_lookup_drop")
+        self.emit("movq %rax, 24(%r14)")
+        self.emit("movq %r12, 16(%r14)")
+        self.emit("movq $0, 8(%r14)")
+        self.emit("movq vyl_dns_cache(%rip), %rax")
+        self.emit("movq %rax, (%r14)")
+        self.emit("movq %r14, vyl_dns_cache(%rip)")
+        self.emit("vyl_dns_lookup_resolve:")
+        self.emit("leaq 16(%rsp), %rdi")
+        self.emit("movl $16, %esi")
+        self.emit("leaq .fmt_port(%rip), %rdx")
+        self.emit("movq %r12, %rcx")
+        self.emit("xorl %eax, %eax")
+        self.emit("call snprintf")
+        self.emit("leaq 32(%rsp), %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit("movl $48, %edx")
+        self.emit("call memset")
+        self.emit("movl $1, 40(%rsp)")  # hints.ai_socktype = SOCK_STREAM
+        self.emit("movq $0, 80(%rsp)")
+        self.emit("movq %rbx, %rdi")
+        self.emit("leaq 16(%rsp), %rsi")
+        self.emit("leaq 32(%rsp), %rdx")
+        self.emit("leaq 80(%rsp), %rcx")
+        self.emit("call getaddrinfo")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_dns_lookup_fail")
+        self.emit("movq 80(%rsp), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_dns_lookup_fail")
+        self.emit("movl 16(%rax), %edx")  # ai_addrlen
+        self.emit(f"cmpl ${DNS_ADDR_SIZE}, %edx")
+        self.emit("ja vyl_dns_lookup_free")
+        self.emit("movl %edx, 44(%r14)")
+        self.emit("movl 4(%rax), %ecx")  # family, socktype, protocol
+        self.emit("movl %ecx, 32(%r14)")
+        self.emit("movl 8(%rax), %ecx")
+        self.emit("movl %ecx, 36(%r14)")
+        self.emit("movl 12(%rax), %ecx")
+        self.emit("movl %ecx, 40(%r14)")
+        self.emit("leaq 48(%r14), %rdi")
+        self.emit("movq 24(%rax), %rsi")
+        self.emit("call memcpy")
+        self.emit("movq 80(%rsp), %rdi")
+        self.emit("call freeaddrinfo")
+        self.emit(f"leaq {DNS_TTL_SECONDS}(%r13), %rax")
+        self.emit("movq %rax, 8(%r14)")
+        self.emit("vyl_dns_lookup_hit:")
+        self.emit("movq %r14, %rax")
+        self.emit("jmp vyl_dns_lookup_ret")
+        self.emit("vyl_dns_lookup_drop:")
+        self.emit("movq %r14, %rdi")
+        self.emit("call free")
+        self.emit("xorl %eax, %eax")
+        self.emit("jmp vyl_dns_lookup_ret")
+        self.emit("vyl_dns_lookup_free:")
+        self.emit("movq 80(%rsp), %rdi")
+        self.emit("call freeaddrinfo")
+        self.emit("vyl_dns_lookup_fail:")
+        self.emit("movq $0, 8(%r14)")  # stays expired; the next lookup retries
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_dns_lookup_ret:")
+        self._emit_spin_unlock("vyl_net_lock(%rip)")
+        self.emit("addq $96, %rsp")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_tcp_connect(host, port) -> fd, or 0 on failure.
+        # vyl_tcp_connect_fast is for protocols where the client speaks first:
+        # with a Fast Open cookie the first write rides on the SYN.
+        self.emit(".globl vyl_tcp_connect")
+        self.emit("vyl_tcp_connect:")
+        self.emit("xorl %edx, %edx")
+        self.emit("jmp vyl_tcp_open")
+        self.emit(".globl vyl_tcp_connect_fast")
+        self.emit("vyl_tcp_connect_fast:")
+        self.emit("movl $1, %edx")
+        self.emit("vyl_tcp_open:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")  # (%rsp) setsockopt value
+        self.emit("movq %rdx, %r13")
+        self.emit("call vyl_dns_lookup")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_tcp_fail")
+        self.emit("movq %rax, %rbx")
+        self.emit("movl 32(%rbx), %edi")
+        self.emit("movl 36(%rbx), %esi")
+        self.emit("orl $0x800, %esi")  # SOCK_NONBLOCK: waits go through the task loop
+        self.emit("movl 40(%rbx), %edx")
+        self.emit("call socket")
+        self.emit("movslq %eax, %r12")
+        self.emit("testq %r12, %r12")
+        self.emit("js vyl_tcp_fail")
+        # Small request writes must not wait behind a delayed ACK
+        self.emit("movl $1, (%rsp)")
+        self.emit("movl %r12d, %edi")
+        self.emit("movl $6, %esi")  # IPPROTO_TCP
+        self.emit("movl $1, %edx")  # TCP_NODELAY
+        self.emit("movq %rsp, %rcx")
+        self.emit("movl $4, %r8d")
+        self.emit("call setsockopt")
+        self.emit("testq %r13, %r13")
+        self.emit("jz vyl_tcp_connect_now")
+        self.emit("movl %r12d, %edi")
+        self.emit("movl $6, %esi")
+        self.emit("movl $30, %edx")  # TCP_FASTOPEN_CONNECT; ignored where unsupported
+        self.emit("movq %rsp, %rcx")
+        self.emit("movl $4, %r8d")
+        self.emit("call setsockopt")
+        self.emit("vyl_tcp_connect_now:")
+        self.emit("movl %r12d, %edi")
+        self.emit("leaq 48(%rbx), %rsi")
+        self.emit("movl 44(%rbx), %edx")
+        self.emit("call connect")
+        self.emit("testl %eax, %eax")
+        self.emit("jz vyl_tcp_connected")
+        self.emit("call __errno_location")
+        self.emit("cmpl $115, (%rax)")  # EINPROGRESS
+        self.emit("jne vyl_tcp_cleanup_fail")
+        self.emit("movl %r12d, %edi")
+        self.emit("movl $4, %esi")  # EPOLLOUT
+        self.emit("call vyl_io_wait")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_tcp_cleanup_fail")
+        self.emit("movl $4, 4(%rsp)")
+        self.emit("movl %r12d, %edi")
+        self.emit("movl $1, %esi")  # SOL_SOCKET
+        self.emit("movl $4, %edx")  # SO_ERROR
+        self.emit("movq %rsp, %rcx")
+        self.emit("leaq 4(%rsp), %r8")
+        self.emit("call getsockopt")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_tcp_cleanup_fail")
+        self.emit("cmpl $0, (%rsp)")
+        self.emit("jne vyl_tcp_cleanup_fail")
+        self.emit("vyl_tcp_connected:")
+        self.emit("movq %r12, %rax")
+        self.emit("jmp vyl_tcp_ret")
+        self.emit("vyl_tcp_cleanup_fail:")
+        self.emit("movq $0, 8(%rbx)")  # the address may have moved; resolve again next time
+        self.emit("movl %r12d, %edi")
+        self.emit("call close")
+        self.emit("vyl_tcp_fail:")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_tcp_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_tcp_send(fd, data) -> bytes sent, all of them unless the peer is gone (-1)
+        self.emit(".globl vyl_tcp_send")
+        self.emit("vyl_tcp_send:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("movq %rdi, %rbx")       # fd
+        self.emit("movq %rsi, %r12")       # buf ptr
+        self.emit("movq -8(%rsi), %r13")   # length from the string header
+        self.emit("xorl %r14d, %r14d")     # sent so far
+        self.emit("vyl_tcp_send_loop:")
+        self.emit("cmpq %r13, %r14")
+        self.emit("jae vyl_tcp_send_done")
+        self.emit("movq %rbx, %rdi")
+        self.emit("leaq (%r12,%r14), %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("subq %r14, %rdx")
+        self.emit("movl $0x4000, %ecx")    # MSG_NOSIGNAL: a closed peer is an error, not a signal
+        self.emit("call vyl_sock_send")
+        self.emit("testq %rax, %rax")
+        self.emit("js vyl_tcp_send_ret")
+        self.emit("addq %rax, %r14")
+        self.emit("jmp vyl_tcp_send_loop")
+        self.emit("vyl_tcp_send_done:")
+        self.emit("movq %r14, %rax")
+        self.emit("vyl_tcp_send_ret:")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_tcp_recv(fd, max)
+        self.emit(".globl vyl_tcp_recv")
+        self.emit("vyl_tcp_recv:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")       # fd
+        self.emit("movq %rsi, %r12")       # max size
+        self.emit("movq %r12, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("cmpq $0, %rax")
+        self.emit("je vyl_tcp_recv_fail")
+        self.emit("movq %rax, %r13")       # buf ptr
+        self.emit("movq %rbx, %rdi")
+        self.emit("movq %r13, %rsi")
+        self.emit("movq %r12, %rdx")
+        self.emit("movq $0, %rcx")
+        self.emit("call vyl_sock_recv")
+        self.emit("cmpq $0, %rax")
+        self.emit("jle vyl_tcp_recv_fail")
+        self.emit("movq %rax, %rdx")
+        self.emit("movq %rdx, -8(%r13)")
+        self.emit("movb $0, (%r13,%rdx,1)")
+        self.emit("movq %r13, %rax")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+        self.emit("vyl_tcp_recv_fail:")
+        self.emit("leaq .empty_str(%rip), %rax")  # the peer closed, or the read failed
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_tcp_listen(port) -> listening fd on every IPv4 address, or 0
+        self.emit(".globl vyl_tcp_listen")
+        self.emit("vyl_tcp_listen:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("subq $16, %rsp")        # (%rsp) sockaddr_in, then the option value
+        self.emit("movq %rdi, %r12")
+        self.emit("call vyl_loop_init")
+        self.emit("movl $2, %edi")         # AF_INET
+        self.emit("movl $0x801, %esi")     # SOCK_STREAM | SOCK_NONBLOCK
+        self.emit("xorl %edx, %edx")
+        self.emit("call socket")
+        self.emit("movslq %eax, %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jle vyl_tcp_listen_fail")
+        self.emit("movl $1, 8(%rsp)")
+        self.emit("movl %ebx, %edi")
+        self.emit("movl $1, %esi")         # SOL_SOCKET
+        self.emit("movl $2, %edx")         # SO_REUSEADDR
+        self.emit("leaq 8(%rsp), %rcx")
+        self.emit("movl $4, %r8d")
+        self.emit("call setsockopt")
+        self.emit("movq $0, (%rsp)")
+        self.emit("movq $0, 8(%rsp)")
+        self.emit("movw $2, (%rsp)")
+        self.emit("movl %r12d, %eax")
+        self.emit("xchgb %al, %ah")        # htons
+        self.emit("movw %ax, 2(%rsp)")
+        self.emit("movl %ebx, %edi")
+        self.emit("movq %rsp, %rsi")
+        self.emit("movl $16, %edx")
+        self.emit("call bind")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_tcp_listen_close")
+        self.emit("movl %ebx, %edi")
+        self.emit(f"movl ${TCP_LISTEN_BACKLOG}, %esi")
+        self.emit("call listen")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_tcp_listen_close")
+        self.emit("movq %rbx, %rax")
+        self.emit("jmp vyl_tcp_listen_ret")
+        self.emit("vyl_tcp_listen_close:")
+        self.emit("movl %ebx, %edi")
+        self.emit("call close")
+        self.emit("vyl_tcp_listen_fail:")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_tcp_listen_ret:")
+        self.emit("addq $16, %rsp")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_tcp_accept(listener) -> connected fd, or 0; waits for a client
+        self.emit(".globl vyl_tcp_accept")
+        self.emit("vyl_tcp_accept:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("xorl %esi, %esi")
+        self.emit("xorl %edx, %edx")
+        self.emit("movl $0x800, %ecx")     # SOCK_NONBLOCK
+        self.emit("call vyl_sock_accept")
         self.emit("movq %rax, %rbx")
+        self.emit("testq %rax, %rax")
+        self.emit("jg vyl_tcp_accept_nodelay")
+        self.emit("xorl %eax, %eax")
+        self.emit("jmp vyl_tcp_accept_ret")
+        self.emit("vyl_tcp_accept_nodelay:")
+        self.emit("movl $1, (%rsp)")
+        self.emit("movl %ebx, %edi")
+        self.emit("movl $6, %esi")         # IPPROTO_TCP
+        self.emit("movl $1, %edx")         # TCP_NODELAY
+        self.emit("movq %rsp, %rcx")
+        self.emit("movl $4, %r8d")
+        self.emit("call setsockopt")
+        self.emit("movq %rbx, %rax")
+        self.emit("vyl_tcp_accept_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_tcp_resolve(host) -> string IPv4
+        self.emit(".globl vyl_tcp_resolve")
+        self.emit("vyl_tcp_resolve:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        # 2 pushes = 16 bytes, rsp % 16 == 0. Need subq that keeps aligned.
+        # 112 works (0 - 112 = -112, 112 % 16 = 0)
+        self.emit("subq $112, %rsp")
+        self.emit("movq %rdi, -24(%rbp)")  # host
+        # zero hints at -104..-24 (10 qwords)
+        self.emit("leaq -104(%rbp), %rdi")
+        self.emit("movq $0, %rax")
+        self.emit("movq $10, %rcx")
+        self.emit("vyl_tcp_resolve_zero:")
+        self.emit("movq $0, (%rdi,%rax,8)")
+        self.emit("incq %rax")
+        self.emit("cmpq %rcx, %rax")
+        self.emit("jl vyl_tcp_resolve_zero")
+        # hints.family = AF_INET(2)
+        self.emit("movl $2, -96(%rbp)")
+        # res storage at -32
+        self.emit("movq $0, -32(%rbp)")
+        self.emit("movq -24(%rbp), %rdi")
+        self.emit("movq $0, %rsi")
+        self.emit("leaq -104(%rbp), %rdx")
+        self.emit("leaq -32(%rbp), %rcx")
+        self.emit("call getaddrinfo")
+        self.emit("cmpq $0, %rax")
+        self.emit("jne vyl_tcp_resolve_fail")
+        self.emit("movq -32(%rbp), %rbx")
         self.emit("cmpq $0, %rbx")
-        self.emit("je vyl_http_fail")
+        self.emit("je vyl_tcp_resolve_fail")
+        # sockaddr_in starts at ai_addr
+        self.emit("movq 24(%rbx), %rsi")
+        self.emit("addq $4, %rsi")  # skip sin_family+port
+        self.emit("leaq -88(%rbp), %rdx")  # buffer for IP string
+        self.emit("movq $64, %rcx")
+        self.emit("movl $2, %edi")         # AF_INET
+        self.emit("call inet_ntop")
+        self.emit("cmpq $0, %rax")
+        self.emit("je vyl_tcp_resolve_fail")
+        self.emit("leaq -88(%rbp), %rdi")
+        self.emit("call vyl_str_from_cstr")
+        self.emit("movq %rax, %r12")
+        self.emit("movq -32(%rbp), %rdi")
+        self.emit("call freeaddrinfo")
+        self.emit("movq %r12, %rax")
+        self.emit("addq $112, %rsp")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+        self.emit("vyl_tcp_resolve_fail:")
+        self.emit("movq -32(%rbp), %rdi")
+        self.emit("cmpq $0, %rdi")
+        self.emit("je vyl_tcp_resolve_ret")
+        self.emit("call freeaddrinfo")
+        self.emit("vyl_tcp_resolve_ret:")
+        self.emit("movq $0, %rax")
+        self.emit("addq $112, %rsp")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit(".section .rodata")
+        self.emit(".fmt_port: .asciz \"%d\"")
+        self.emit(".balign 8")
+        self.emit(".quad 0, 0")
+        self.emit(".empty_str: .asciz \"\"")
+        self.emit(".section .text")
+
+        # TLS helpers (OpenSSL)
+        self.emit(".globl vyl_tls_ensure_ctx")
+        self.emit("vyl_tls_ensure_ctx:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        # After push rbp, rsp % 16 == 0. Need to keep it that way for calls.
+        # Subtracting 0 or 16 works. Use 16 for a bit of scratch.
+        self.emit("subq $16, %rsp")
+        self._emit_spin_lock("vyl_net_lock(%rip)")
+        self.emit("cmpq $0, tls_ctx(%rip)")
+        self.emit("jne vyl_tls_ctx_done")
+        self.emit("movq $0, %rdi")
+        self.emit("movq $0, %rsi")
+        self.emit("call OPENSSL_init_ssl")
+        self.emit("call TLS_client_method")
+        self.emit("movq %rax, %rdi")
+        self.emit("call SSL_CTX_new")
+        self.emit("movq %rax, tls_ctx(%rip)")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_tls_ctx_done")
+        # Keep client sessions out of OpenSSL's internal store and hand every
+        # new ticket to vyl_tls_new_session, which files it under the host name
+        self.emit("movq %rax, %rdi")
+        self.emit("movl $44, %esi")  # SSL_CTRL_SET_SESS_CACHE_MODE
+        self.emit("movl $0x201, %edx")  # SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE
+        self.emit("xorl %ecx, %ecx")
+        self.emit("call SSL_CTX_ctrl")
+        self.emit("movq tls_ctx(%rip), %rdi")
+        self.emit("leaq vyl_tls_new_session(%rip), %rsi")
+        self.emit("call SSL_CTX_sess_set_new_cb")
+        self.emit("movq tls_ctx(%rip), %rdi")
+        self.emit("movl $123, %esi")  # SSL_CTRL_SET_MIN_PROTO_VERSION
+        self.emit("movl $0x303, %edx")  # TLS 1.2
+        self.emit("xorl %ecx, %ecx")
+        self.emit("call SSL_CTX_ctrl")
+        self.emit("vyl_tls_ctx_done:")
+        self._emit_spin_unlock("vyl_net_lock(%rip)")
+        self.emit("addq $16, %rsp")
+        self.emit("leave")
+        self.emit("ret")
+
+        # TLS session cache: a list of [next, host, SSL_SESSION*]
+        # vyl_tls_find_session(rdi=host) -> a copy of its session (the caller
+        # frees it), or 0. Copied under the lock: a new ticket may replace it.
+        self.emit(".globl vyl_tls_find_session")
+        self.emit("vyl_tls_find_session:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %r12")
+        self._emit_spin_lock("vyl_net_lock(%rip)")
+        self.emit("movq vyl_tls_sessions(%rip), %rbx")
+        self.emit("vyl_tls_find_session_scan:")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_tls_find_session_ret")
+        self.emit("movq 8(%rbx), %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("call strcmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jz vyl_tls_find_session_hit")
+        self.emit("movq (%rbx), %rbx")
+        self.emit("jmp vyl_tls_find_session_scan")
+        self.emit("vyl_tls_find_session_hit:")
+        self.emit("movq 16(%rbx), %rdi")
+        self.emit("call SSL_SESSION_dup")
+        self.emit("vyl_tls_find_session_ret:")
+        self._emit_spin_unlock("vyl_net_lock(%rip)")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_tls_new_session(rdi=ssl, rsi=session) -> 0. OpenSSL calls this for
+        # every ticket the server sends. A copy is filed because OpenSSL marks
+        # the original unresumable when the peer closes without close_notify.
+        self.emit(".globl vyl_tls_new_session")
+        self.emit("vyl_tls_new_session:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rsi, %r12")
+        self.emit("xorl %esi, %esi")  # TLSEXT_NAMETYPE_host_name
+        self.emit("call SSL_get_servername")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_tls_new_session_ret")
+        self.emit("movq %rax, %rbx")
+        self.emit("movq %r12, %rdi")
+        self.emit("call SSL_SESSION_dup")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_tls_new_session_ret")
+        self.emit("movq %rax, %r12")
+        self._emit_spin_lock("vyl_net_lock(%rip)")
+        self.emit("movq vyl_tls_sessions(%rip), %r13")
+        self.emit("vyl_tls_new_session_scan:")
+        self.emit("testq %r13, %r13")
+        self.emit("jz vyl_tls_new_session_add")
+        self.emit("movq 8(%r13), %rdi")
+        self.emit("movq %rbx, %rsi")
+        self.emit("call strcmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jz vyl_tls_new_session_replace")
+        self.emit("movq (%r13), %r13")
+        self.emit("jmp vyl_tls_new_session_scan")
+        self.emit("vyl_tls_new_session_replace:")
+        self.emit("movq 16(%r13), %rdi")
+        self.emit("call SSL_SESSION_free")
+        self.emit("movq %r12, 16(%r13)")
+        self.emit("jmp vyl_tls_new_session_done")
+        self.emit("vyl_tls_new_session_add:")
+        self.emit("movl $24, %edi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_tls_new_session_decline")
+        self.emit("movq %rax, %r13")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call strdup")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_tls_new_session_drop")
+        self.emit("movq %rax, 8(%r13)")
+        self.emit("movq %r12, 16(%r13)")
+        self.emit("movq vyl_tls_sessions(%rip), %rax")
+        self.emit("movq %rax, (%r13)")
+        self.emit("movq %r13, vyl_tls_sessions(%rip)")
+        self.emit("jmp vyl_tls_new_session_done")
+        self.emit("vyl_tls_new_session_drop:")
+        self.emit("movq %r13, %rdi")
+        self.emit("call free")
+        self.emit("vyl_tls_new_session_decline:")
+        self.emit("movq %r12, %rdi")
+        self.emit("call SSL_SESSION_free")
+        self.emit("vyl_tls_new_session_done:")
+        self._emit_spin_unlock("vyl_net_lock(%rip)")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_tls_new_session_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit(".globl vyl_tls_connect")
+        self.emit("vyl_tls_connect:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        # 3 pushes = 24 bytes below rbp. rsp % 16 == 8.
+        # Need subq $40 (24+40=64, still 8 mod 16) -> subq $40 gives 8-40%16=8-8=0 ✓
+        self.emit("subq $40, %rsp")
+        self.emit("movq %rdi, -32(%rbp)")   # host
+        self.emit("movq %rsi, -40(%rbp)")   # port
+        self.emit("call vyl_tls_ensure_ctx")
+        self.emit("movq -32(%rbp), %rdi")
+        self.emit("movq -40(%rbp), %rsi")
+        self.emit("call vyl_tcp_connect_fast")
+        self.emit("movq %rax, %rbx")
+        self.emit("cmpq $0, %rbx")
+        self.emit("je vyl_tls_conn_fail")
+        self.emit("movq tls_ctx(%rip), %rdi")
+        self.emit("call SSL_new")
+        self.emit("movq %rax, %r12")
+        self.emit("cmpq $0, %r12")
+        self.emit("je vyl_tls_conn_fail_close")
+        self.emit("movq %r12, %rdi")
+        self.emit("movq %rbx, %rsi")
+        self.emit("call SSL_set_fd")
+        self.emit("cmpq $0, %rax")
+        self.emit("jle vyl_tls_conn_fail_ssl")
+        # Set SNI hostname: SSL_ctrl(ssl, SSL_CTRL_SET_TLSEXT_HOSTNAME=55, TLSEXT_NAMETYPE_host_name=0, hostname)
+        self.emit("movq %r12, %rdi")
+        self.emit("movq $55, %rsi")         # SSL_CTRL_SET_TLSEXT_HOSTNAME
+        self.emit("movq $0, %rdx")          # TLSEXT_NAMETYPE_host_name
+        self.emit("movq -32(%rbp), %rcx")   # hostname
+        self.emit("call SSL_ctrl")
+        # Offer a copy of the last ticket from this host: an abbreviated
+        # handshake, and the cached one survives however this connection ends
+        self.emit("movq -32(%rbp), %rdi")
+        self.emit("call vyl_tls_find_session")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_tls_conn_handshake")
+        self.emit("movq %rax, -48(%rbp)")
+        self.emit("movq %r12, %rdi")
+        self.emit("movq %rax, %rsi")
+        self.emit("call SSL_set_session")
+        self.emit("movq -48(%rbp), %rdi")
+        self.emit("call SSL_SESSION_free")
+        self.emit("vyl_tls_conn_handshake:")
+        self.emit("movq %r12, %rdi")
+        self.emit("call vyl_ssl_handshake")
+        self.emit("cmpq $0, %rax")
+        self.emit("jle vyl_tls_conn_fail_ssl")
+        self.emit("movq %r12, %rax")
+        self.emit("addq $40, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+        self.emit("vyl_tls_conn_fail_ssl:")
+        self.emit("movq %r12, %rdi")
+        self.emit("call SSL_free")
+        self.emit("vyl_tls_conn_fail_close:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call close")
+        self.emit("vyl_tls_conn_fail:")
+        self.emit("movq $0, %rax")
+        self.emit("addq $40, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit(".globl vyl_tls_send")
+        self.emit("vyl_tls_send:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        # 2 pushes, rsp % 16 == 0. Keep aligned.
+        self.emit("subq $16, %rsp")
+        self.emit("movq %rdi, %rbx")       # ssl_ctx
+        self.emit("movq %rsi, %r12")       # buf ptr
+        self.emit("movq -8(%rsi), %rdx")   # length from the string header
+        self.emit("movq %rbx, %rdi")       # SSL_write(ssl, buf, len)
+        self.emit("movq %r12, %rsi")
+        self.emit("call vyl_ssl_write")
+        self.emit("addq $16, %rsp")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit(".globl vyl_tls_recv")
+        self.emit("vyl_tls_recv:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        # 3 pushes, rsp % 16 == 8. Need subq $8 to align.
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %r12, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("cmpq $0, %rax")
+        self.emit("je vyl_tls_recv_fail")
+        self.emit("movq %rax, %r13")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movq %r13, %rsi")
+        self.emit("movq %r12, %rdx")
+        self.emit("call vyl_ssl_read")
+        self.emit("cmpq $0, %rax")
+        self.emit("jle vyl_tls_recv_fail")
+        self.emit("movq %rax, %rdx")
+        self.emit("movq %rdx, -8(%r13)")
+        self.emit("movb $0, (%r13,%rdx,1)")
+        self.emit("movq %r13, %rax")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+        self.emit("vyl_tls_recv_fail:")
+        self.emit("leaq .empty_str(%rip), %rax")  # the peer closed, or the read failed
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit(".globl vyl_tls_close")
+        self.emit("vyl_tls_close:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")       # save ssl ptr
+        self.emit("movq %rbx, %rdi")
+        self.emit("call SSL_get_fd")
+        self.emit("movq %rax, %rdi")
+        self.emit("call close")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call SSL_free")
+        self.emit("movq $0, %rax")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.generate_http_runtime()
+
+        # vyl_readdir(dir) -> string (entry name, or empty string if done)
+        # Returns d_name field from struct dirent
+        self.emit(".globl vyl_readdir")
+        self.emit("vyl_readdir:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")  # Maintain 16-byte alignment (8 + 8 = 16)
+        self.emit("movq %rdi, %rbx")  # Save dir handle
+        self.emit("call readdir")     # Returns struct dirent*
+        self.emit("cmpq $0, %rax")
+        self.emit("je vyl_readdir_done")
+        # struct dirent has d_name at offset 19 (on x86-64 Linux)
+        self.emit("addq $19, %rax")   # Point to d_name
+        # Skip "." and ".." entries
+        self.emit("movb (%rax), %cl")
+        self.emit("cmpb $'.', %cl")
+        self.emit("jne vyl_readdir_ret")
+        self.emit("movb 1(%rax), %cl")
+        self.emit("cmpb $0, %cl")
+        self.emit("je vyl_readdir_next")  # "." entry
+        self.emit("cmpb $'.', %cl")
+        self.emit("jne vyl_readdir_ret")
+        self.emit("movb 2(%rax), %cl")
+        self.emit("cmpb $0, %cl")
+        self.emit("jne vyl_readdir_ret")  # Not ".."
+        self.emit("vyl_readdir_next:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call readdir")
+        self.emit("cmpq $0, %rax")
+        self.emit("je vyl_readdir_done")
+        self.emit("addq $19, %rax")
+        self.emit("jmp vyl_readdir_ret")
+        self.emit("vyl_readdir_done:")
+        self.emit("leaq .empty_str(%rip), %rax")
+        self.emit("jmp vyl_readdir_out")
+        self.emit("vyl_readdir_ret:")
+        self.emit("movq %rax, %rdi")  # d_name is overwritten by the next readdir
+        self.emit("call vyl_str_from_cstr")
+        self.emit("vyl_readdir_out:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.generate_fs_runtime()
+
+        # Strings carry a two-word header in front of their bytes: -16(p) is the
+        # capacity and -8(p) the length, so p itself stays a valid C string.
+        # vyl_str_alloc(rdi=len) -> zeroed string with room for len bytes
+        self.emit(".globl vyl_str_alloc")
+        self.emit("vyl_str_alloc:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("leaq 17(%rdi), %rdi")
+        self.emit("call vyl_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_str_alloc_ret")
+        self.emit("movq %rbx, (%rax)")   # capacity
+        self.emit("movq %rbx, 8(%rax)")  # length
+        self.emit("addq $16, %rax")
+        self.emit("movb $0, (%rax,%rbx,1)")
+        self.emit("vyl_str_alloc_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_str_from_cstr(rdi=cstr) -> copy of a NUL-terminated libc string
+        self.emit(".globl vyl_str_from_cstr")
+        self.emit("vyl_str_from_cstr:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_str_from_cstr_empty")
+        self.emit("movq %rdi, %r12")
+        self.emit("call strlen")
+        self.emit("movq %rax, %rbx")
+        self.emit("movq %rax, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_str_from_cstr_ret")
+        self.emit("movq %rax, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %rbx, %rdx")
+        self.emit("call memcpy")
+        self.emit("jmp vyl_str_from_cstr_ret")
+        self.emit("vyl_str_from_cstr_empty:")
+        self.emit("leaq .empty_str(%rip), %rax")
+        self.emit("vyl_str_from_cstr_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_streq(a, b) -> 1 when both strings hold the same bytes
+        self.emit(".globl vyl_streq")
+        self.emit("vyl_streq:")
+        self.emit("cmpq %rsi, %rdi")
+        self.emit("je vyl_streq_yes")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_streq_no")
+        self.emit("testq %rsi, %rsi")
+        self.emit("jz vyl_streq_no")
+        self.emit("movq -8(%rdi), %rdx")
+        self.emit("cmpq -8(%rsi), %rdx")
+        self.emit("jne vyl_streq_no")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("call memcmp")
+        self.emit("leave")
+        self.emit("testl %eax, %eax")
+        self.emit("sete %al")
+        self.emit("movzbq %al, %rax")
+        self.emit("ret")
+        self.emit("vyl_streq_yes:")
+        self.emit("movq $1, %rax")
+        self.emit("ret")
+        self.emit("vyl_streq_no:")
+        self.emit("xorl %eax, %eax")
+        self.emit("ret")
+
+        # vyl_itoa(rdi=value, rsi=buffer end) -> rax=first digit, rdx=length.
+        # Digits are written backwards ending at rsi; clobbers rcx, r8, r9.
+        self.emit(".globl vyl_itoa")
+        self.emit("vyl_itoa:")
+        self.emit("movq %rsi, %r9")
+        self.emit("movq %rdi, %r8")
+        self.emit("movq %rdi, %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jns vyl_itoa_loop")
+        self.emit("negq %rax")
+        self.emit("vyl_itoa_loop:")
+        self.emit("movq %rax, %rcx")
+        self.emit("movabsq $0xCCCCCCCCCCCCCCCD, %rdx")  # divide by 10 via reciprocal
+        self.emit("mulq %rdx")
+        self.emit("shrq $3, %rdx")
+        self.emit("leaq (%rdx,%rdx,4), %rax")
+        self.emit("addq %rax, %rax")
+        self.emit("subq %rax, %rcx")
+        self.emit("addb $48, %cl")
+        self.emit("decq %rsi")
+        self.emit("movb %cl, (%rsi)")
+        self.emit("movq %rdx, %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_itoa_loop")
+        self.emit("testq %r8, %r8")
+        self.emit("jns vyl_itoa_done")
+        self.emit("decq %rsi")
+        self.emit("movb $45, (%rsi)")
+        self.emit("vyl_itoa_done:")
+        self.emit("movq %rsi, %rax")
+        self.emit("movq %r9, %rdx")
+        self.emit("subq %rsi, %rdx")
+        self.emit("ret")
+
+        # vyl_str_build(rdi=parts, rsi=count) -> one string holding every part.
+        # parts is an array of (ptr, len) pairs; len < 0 means "read the header".
+        self.emit(".globl vyl_str_build")
+        self.emit("vyl_str_build:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("movq %rdi, %r12")
+        self.emit("movq %rsi, %r13")
+        self.emit("xorq %r14, %r14")  # total length
+        self.emit("xorq %rcx, %rcx")
+        self.emit("vyl_str_build_measure:")
+        self.emit("cmpq %r13, %rcx")
+        self.emit("jae vyl_str_build_alloc")
+        self.emit("movq %rcx, %rax")
+        self.emit("shlq $4, %rax")
+        self.emit("addq %r12, %rax")
+        self.emit("movq 8(%rax), %rdx")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jns vyl_str_build_sized")
+        self.emit("xorq %rdx, %rdx")
+        self.emit("movq (%rax), %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_str_build_store")  # a null string reads as ""
+        self.emit("movq -8(%rbx), %rdx")
+        self.emit("vyl_str_build_store:")
+        self.emit("movq %rdx, 8(%rax)")
+        self.emit("vyl_str_build_sized:")
+        self.emit("addq %rdx, %r14")
+        self.emit("incq %rcx")
+        self.emit("jmp vyl_str_build_measure")
+        self.emit("vyl_str_build_alloc:")
+        self.emit("movq %r14, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_str_build_ret")
+        self.emit("movq %rax, %rbx")
+        self.emit("movq %rax, %r14")  # write cursor
+        self.emit("vyl_str_build_copy:")
+        self.emit("testq %r13, %r13")
+        self.emit("jz vyl_str_build_done")
+        self.emit("movq 8(%r12), %rdx")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jz vyl_str_build_next")
+        self.emit("movq %r14, %rdi")
+        self.emit("movq (%r12), %rsi")
+        self.emit("addq %rdx, %r14")
+        self.emit("call memcpy")
+        self.emit("vyl_str_build_next:")
+        self.emit("addq $16, %r12")
+        self.emit("decq %r13")
+        self.emit("jmp vyl_str_build_copy")
+        self.emit("vyl_str_build_done:")
+        self.emit("movq %rbx, %rax")
+        self.emit("vyl_str_build_ret:")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_strconcat(s1, s2) -> new string s1+s2; a null operand reads as ""
+        self.emit(".globl vyl_strconcat")
+        self.emit("vyl_strconcat:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("leaq .empty_str(%rip), %rax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("cmovzq %rax, %rdi")
+        self.emit("testq %rsi, %rsi")
+        self.emit("cmovzq %rax, %rsi")
+        self.emit("movq %rdi, %r12")  # s1
+        self.emit("movq %rsi, %r13")  # s2
+        self.emit("movq -8(%rdi), %r14")  # len1
+        self.emit("movq -8(%rsi), %rdi")
+        self.emit("addq %r14, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_strconcat_ret")
+        self.emit("movq %rax, %rbx")  # save result
+        self.emit("movq %rax, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r14, %rdx")
+        self.emit("call memcpy")
+        self.emit("leaq (%rbx,%r14,1), %rdi")
+        self.emit("movq %r13, %rsi")
+        self.emit("movq -8(%r13), %rdx")
+        self.emit("call memcpy")
+        self.emit("movq %rbx, %rax")
+        self.emit("vyl_strconcat_ret:")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_strfind(haystack, needle) -> index or -1
+        self.emit(".globl vyl_strfind")
+        self.emit("vyl_strfind:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")  # save haystack
+        # memmem(haystack, len, needle, len)
+        self.emit("movq %rsi, %rdx")
+        self.emit("movq -8(%rsi), %rcx")
+        self.emit("movq -8(%rdi), %rsi")
+        self.emit("call memmem")
+        self.emit("cmpq $0, %rax")
+        self.emit("je vyl_strfind_notfound")
+        # found: return offset = result - haystack
+        self.emit("subq %rbx, %rax")
+        self.emit("jmp vyl_strfind_ret")
+        self.emit("vyl_strfind_notfound:")
+        self.emit("movq $-1, %rax")
+        self.emit("vyl_strfind_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_substring(str, start, len) -> new string; start and len are
+        # clamped to the length in str's header, so nothing past it is copied
+        self.emit(".globl vyl_substring")
+        self.emit("vyl_substring:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_substring_len")
+        self.emit("movq -8(%rdi), %rax")  # source length
+        self.emit("vyl_substring_len:")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("testq %rsi, %rsi")
+        self.emit("cmovsq %rcx, %rsi")  # start = max(start, 0)
+        self.emit("cmpq %rax, %rsi")
+        self.emit("cmovgq %rax, %rsi")  # start = min(start, srclen)
+        self.emit("subq %rsi, %rax")
+        self.emit("testq %rdx, %rdx")
+        self.emit("cmovsq %rcx, %rdx")  # len = max(len, 0)
+        self.emit("cmpq %rax, %rdx")
+        self.emit("cmovgq %rax, %rdx")  # len = min(len, srclen - start)
+        self.emit("movq %rdi, %r12")  # str
+        self.emit("movq %rsi, %r13")  # start
+        self.emit("movq %rdx, %rbx")  # len
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("cmpq $0, %rax")
+        self.emit("je vyl_substring_ret")
+        self.emit("movq %rax, %rdi")  # dest
+        # src = str + start
+        self.emit("leaq (%r12,%r13,1), %rsi")
+        self.emit("movq %rbx, %rdx")  # n
+        self.emit("call memcpy")
+        self.emit("vyl_substring_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.generate_string_builder_runtime()
+        self.generate_vector_runtime()
+        self.generate_map_runtime()
+        self.generate_simd_runtime()
+
+    def generate_io_runtime(self):
+        """Emit the buffered writers behind Print, BufferedWriter and Flush.
+
+        Stdout and every BufferedWriter collect output in a 64 KiB buffer that
+        goes to its fd with write(2) when full, on Flush and at exit; writers
+        are chained from vyl_writers so one pass flushes them all. When stdout
+        is a terminal each Print is flushed right away so output stays
+        interactive.
+        """
+        data = WRITER_HEADER_SIZE
+
+        # vyl_io_init: point stdout's buffer at fd 1 and note whether it is a tty
+        self.emit(".globl vyl_io_init")
+        self.emit("vyl_io_init:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("leaq vyl_stdout(%rip), %rax")
+        self.emit("movq $1, 8(%rax)")
+        self.emit("movq %rax, vyl_writers(%rip)")
+        self.emit("movl $1, %edi")
+        self.emit("call isatty")
+        self.emit("movslq %eax, %rax")
+        self.emit("movq %rax, vyl_stdout_tty(%rip)")
+        # A crash still shows what was printed: flush on SIGSEGV/SIGBUS, then
+        # the handler resets and the faulting instruction kills the process
+        self.emit("subq $160, %rsp")  # struct sigaction
+        self.emit("movq %rsp, %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit("movq $160, %rdx")
+        self.emit("call memset")
+        self.emit("leaq vyl_flush_writers(%rip), %rax")
+        self.emit("movq %rax, (%rsp)")
+        self.emit("movl $0xC0000000, 136(%rsp)")  # SA_RESETHAND | SA_NODEFER
+        self.emit("movl $11, %edi")
+        self.emit("movq %rsp, %rsi")
+        self.emit("xorl %edx, %edx")
+        self.emit("call sigaction")
+        self.emit("movl $7, %edi")
+        self.emit("movq %rsp, %rsi")
+        self.emit("xorl %edx, %edx")
+        self.emit("call sigaction")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_write_fd(rdi=fd, rsi=ptr, rdx=len) -> bytes not written: write(2)
+        # until it is all out
+        self.emit(".globl vyl_write_fd")
+        self.emit("vyl_write_fd:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("vyl_write_fd_loop:")
+        self.emit("testq %r13, %r13")
+        self.emit("jle vyl_write_fd_done")
+        self.emit("movl %ebx, %edi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("call write")
+        self.emit("testq %rax, %rax")
+        self.emit("jg vyl_write_fd_advance")
+        self.emit("call __errno_location")
+        self.emit("cmpl $4, (%rax)")  # EINTR: try again, anything else drops the rest
+        self.emit("je vyl_write_fd_loop")
+        self.emit("jmp vyl_write_fd_done")
+        self.emit("vyl_write_fd_advance:")
+        self.emit("addq %rax, %r12")
+        self.emit("subq %rax, %r13")
+        self.emit("jmp vyl_write_fd_loop")
+        self.emit("vyl_write_fd_done:")
+        self.emit("movq %r13, %rax")  # bytes left unwritten, 0 on success
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_buf_flush(rdi=writer): hand the pending bytes to the fd
+        self.emit(".globl vyl_buf_flush")
+        self.emit("vyl_buf_flush:")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_buf_flush_ret")
+        self.emit("movq 16(%rdi), %rdx")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jz vyl_buf_flush_ret")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("movq $0, 16(%rdi)")
+        self.emit(f"leaq {data}(%rdi), %rsi")
+        self.emit("movq 8(%rdi), %rdi")
+        self.emit("call vyl_write_fd")
+        self.emit("leave")
+        self.emit("vyl_buf_flush_ret:")
+        self.emit("ret")
+
+        # vyl_buf_write(rdi=writer, rsi=ptr, rdx=len): copy into the buffer,
+        # flushing first when it would overflow; big chunks skip the copy
+        self.emit(".globl vyl_buf_write")
+        self.emit("vyl_buf_write:")
+        self.emit("movq 16(%rdi), %rax")
+        self.emit("leaq (%rax,%rdx), %rcx")
+        self.emit(f"cmpq ${WRITER_BUFFER_SIZE}, %rcx")
+        self.emit("ja vyl_buf_write_full")
+        self.emit("movq %rcx, 16(%rdi)")
+        self.emit(f"leaq {data}(%rdi,%rax), %rdi")
+        self.emit("jmp memcpy")
+        self.emit("vyl_buf_write_full:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("call vyl_buf_flush")
+        self.emit(f"cmpq ${WRITER_BUFFER_SIZE}, %r13")
+        self.emit("jb vyl_buf_write_copy")
+        self.emit("movq 8(%rbx), %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("call vyl_write_fd")
+        self.emit("jmp vyl_buf_write_done")
+        self.emit("vyl_buf_write_copy:")
+        self.emit("movq %r13, 16(%rbx)")
+        self.emit(f"leaq {data}(%rbx), %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("call memcpy")
+        self.emit("vyl_buf_write_done:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_print_bytes(rsi=ptr, rdx=len): append to stdout; threads take
+        # turns, so every Print lands in one piece
+        self.emit(".globl vyl_print_bytes")
+        self.emit("vyl_print_bytes:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self._emit_spin_lock("vyl_stdout_lock(%rip)")
+        self.emit("leaq vyl_stdout(%rip), %rdi")
+        self.emit("call vyl_buf_write")
+        self.emit("cmpq $0, vyl_stdout_tty(%rip)")
+        self.emit("je vyl_print_bytes_ret")
+        self.emit("leaq vyl_stdout(%rip), %rdi")
+        self.emit("call vyl_buf_flush")
+        self.emit("vyl_print_bytes_ret:")
+        self._emit_spin_unlock("vyl_stdout_lock(%rip)")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_flush_writers: every writer; only uses write(2), so it doubles
+        # as the crash signal handler
+        self.emit(".globl vyl_flush_writers")
+        self.emit("vyl_flush_writers:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("movq vyl_writers(%rip), %rbx")
+        self.emit("vyl_flush_writers_loop:")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_flush_writers_done")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_buf_flush")
+        self.emit("movq (%rbx), %rbx")
+        self.emit("jmp vyl_flush_writers_loop")
+        self.emit("vyl_flush_writers_done:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_flush_all: every writer, then libc's own FILE buffers
+        self.emit(".globl vyl_flush_all")
+        self.emit("vyl_flush_all:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self._emit_spin_lock("vyl_stdout_lock(%rip)")
+        self.emit("call vyl_flush_writers")
+        self._emit_spin_unlock("vyl_stdout_lock(%rip)")
+        self.emit("xorl %edi, %edi")
+        self.emit("call fflush")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_exit(rdi=code): Exit() flushes before leaving
+        self.emit(".globl vyl_exit")
+        self.emit("vyl_exit:")
+        self.emit("movq %rdi, %rbx")
+        self.emit("andq $-16, %rsp")
+        self.emit("call vyl_flush_all")
+        if self.profile_alloc:
+            self.emit("call vyl_prof_dump")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call exit")
+
+        # vyl_system(rdi=command): the child must not overtake buffered output
+        self.emit(".globl vyl_system")
+        self.emit("vyl_system:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("call vyl_flush_all")
+        self.emit("movq %rbx, %rdi")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("jmp system")
+
+        # vyl_writer_new(rdi=FILE*) -> writer on the same fd, or 0
+        self.emit(".globl vyl_writer_new")
+        self.emit("vyl_writer_new:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_writer_new_ret")
+        self.emit("movq %rdi, %rbx")
+        self.emit("call fflush")  # earlier Write() calls land first
+        self.emit("movq %rbx, %rdi")
+        self.emit("call fileno")
+        self.emit("movslq %eax, %r12")
+        self.emit(f"movq ${WRITER_HEADER_SIZE + WRITER_BUFFER_SIZE}, %rdi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_writer_new_ret")
+        self.emit("movq vyl_writers(%rip), %rcx")
+        self.emit("movq %rcx, (%rax)")
+        self.emit("movq %r12, 8(%rax)")
+        self.emit("movq $0, 16(%rax)")
+        self.emit("movq %rbx, 24(%rax)")
+        self.emit("movq %rax, vyl_writers(%rip)")
+        self.emit("vyl_writer_new_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_writer_write(rdi=writer, rsi=str); a null writer or string is a no-op
+        self.emit(".globl vyl_writer_write")
+        self.emit("vyl_writer_write:")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_writer_write_ret")
+        self.emit("testq %rsi, %rsi")
+        self.emit("jz vyl_writer_write_ret")
+        self.emit("movq -8(%rsi), %rdx")
+        self.emit("jmp vyl_buf_write")
+        self.emit("vyl_writer_write_ret:")
+        self.emit("ret")
+
+        # vyl_writer_write_int(rdi=writer, rsi=n): digits only, no newline
+        self.emit(".globl vyl_writer_write_int")
+        self.emit("vyl_writer_write_int:")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_writer_write_ret")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $40, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %rdi")
+        self.emit("leaq -8(%rbp), %rsi")
+        self.emit("call vyl_itoa")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movq %rax, %rsi")
+        self.emit("call vyl_buf_write")
+        self.emit("movq -8(%rbp), %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_writer_close(rdi=writer): flush, unchain, close the file, free
+        self.emit(".globl vyl_writer_close")
+        self.emit("vyl_writer_close:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_writer_close_ret")
+        self.emit("movq %rdi, %rbx")
+        self.emit("call vyl_buf_flush")
+        self.emit("leaq vyl_writers(%rip), %rax")  # next is at offset 0, so a node is its own link
+        self.emit("vyl_writer_close_find:")
+        self.emit("movq (%rax), %rcx")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jz vyl_writer_close_file")
+        self.emit("cmpq %rcx, %rbx")
+        self.emit("je vyl_writer_close_unlink")
+        self.emit("movq %rcx, %rax")
+        self.emit("jmp vyl_writer_close_find")
+        self.emit("vyl_writer_close_unlink:")
+        self.emit("movq (%rbx), %rcx")
+        self.emit("movq %rcx, (%rax)")
+        self.emit("vyl_writer_close_file:")
+        self.emit("movq 24(%rbx), %rdi")
+        self.emit("call fclose")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call free")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_writer_close_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit(".section .data")
+        self.emit("vyl_writers: .quad 0")
+        self.emit("vyl_stdout_tty: .quad 0")
+        self.emit("vyl_stdout_lock: .quad 0")
+        self.emit(".section .bss")
+        self.emit(".balign 16")
+        self.emit(f"vyl_stdout: .zero {WRITER_HEADER_SIZE + WRITER_BUFFER_SIZE}")
+        self.emit(".section .text")
+
+    def generate_fs_runtime(self):
+        """Emit CopyFile, MkdirP, RemoveAll and Unzip without a shell.
+
+        CopyFile lets the kernel move the bytes (copy_file_range, then
+        sendfile) and only falls back to a read/write loop for files neither
+        supports. MkdirP and RemoveAll walk the path with mkdir, openat,
+        getdents64 and unlinkat, and Unzip maps the archive, walks its
+        central directory and inflates each entry with zlib.
+        """
+        page = PAGE_SIZE
+
+        # vyl_copy_file(src, dst) -> int (1 success, 0 fail); dst gets src's mode bits
+        self.emit(".globl vyl_copy_file")
+        self.emit("vyl_copy_file:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("subq $144, %rsp")  # struct stat
+        self.emit("movq %rsi, %r13")
+        self.emit("xorl %esi, %esi")  # O_RDONLY
+        self.emit("call open")
+        self.emit("movslq %eax, %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("js vyl_copy_fail")
+        self.emit("movl %ebx, %edi")
+        self.emit("movq %rsp, %rsi")
+        self.emit("call fstat")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_copy_close_src")
+        self.emit("movl 24(%rsp), %edx")  # st_mode
+        self.emit("andl $0777, %edx")
+        self.emit("movq %r13, %rdi")
+        self.emit("movl $0x241, %esi")  # O_WRONLY | O_CREAT | O_TRUNC
+        self.emit("call open")
+        self.emit("movslq %eax, %r12")
+        self.emit("testq %r12, %r12")
+        self.emit("js vyl_copy_close_src")
+        self.emit("vyl_copy_range:")
+        self.emit("movl %ebx, %edi")
+        self.emit("xorl %esi, %esi")
+        self.emit("movl %r12d, %edx")
+        self.emit("xorl %ecx, %ecx")
+        self.emit(f"movl ${COPY_CHUNK_SIZE}, %r8d")
+        self.emit("xorl %r9d, %r9d")
+        self.emit("call copy_file_range")
+        self.emit("testq %rax, %rax")
+        self.emit("jg vyl_copy_range")
+        self.emit("jz vyl_copy_done")
+        # Refused (older kernel, cross-filesystem, ...): both calls advance the
+        # file offsets, so sendfile carries on from wherever it stopped
+        self.emit("vyl_copy_sendfile:")
+        self.emit("movl %r12d, %edi")
+        self.emit("movl %ebx, %esi")
+        self.emit("xorl %edx, %edx")
+        self.emit(f"movl ${COPY_CHUNK_SIZE}, %ecx")
+        self.emit("call sendfile")
+        self.emit("testq %rax, %rax")
+        self.emit("jg vyl_copy_sendfile")
+        self.emit("jz vyl_copy_done")
+        self.emit(f"movl ${COPY_BUFFER_SIZE}, %edi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_copy_close_dst")
+        self.emit("movq %rax, %r14")
+        self.emit("vyl_copy_rw:")
+        self.emit("movl %ebx, %edi")
+        self.emit("movq %r14, %rsi")
+        self.emit(f"movl ${COPY_BUFFER_SIZE}, %edx")
+        self.emit("call read")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_copy_rw_done")
+        self.emit("js vyl_copy_rw_fail")
+        self.emit("movl %r12d, %edi")
+        self.emit("movq %r14, %rsi")
+        self.emit("movq %rax, %rdx")
+        self.emit("call vyl_write_fd")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_copy_rw")
+        self.emit("vyl_copy_rw_fail:")
+        self.emit("movq %r14, %rdi")
+        self.emit("call free")
+        self.emit("jmp vyl_copy_close_dst")
+        self.emit("vyl_copy_rw_done:")
+        self.emit("movq %r14, %rdi")
+        self.emit("call free")
+        self.emit("vyl_copy_done:")
+        self.emit("movl %r12d, %edi")
+        self.emit("call close")
+        self.emit("movl %ebx, %edi")
+        self.emit("call close")
+        self.emit("movl $1, %eax")
+        self.emit("jmp vyl_copy_ret")
+        self.emit("vyl_copy_close_dst:")
+        self.emit("movl %r12d, %edi")
+        self.emit("call close")
+        self.emit("vyl_copy_close_src:")
+        self.emit("movl %ebx, %edi")
+        self.emit("call close")
+        self.emit("vyl_copy_fail:")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_copy_ret:")
+        self.emit("addq $144, %rsp")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_mkdir_p(path) -> int (1 success, 0 fail): mkdir every prefix
+        # ending in '/', then the path; an existing directory counts as made
+        self.emit(".globl vyl_mkdir_p")
+        self.emit("vyl_mkdir_p:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit(f"subq ${page}, %rsp")  # PATH_MAX copy we can cut up
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_mkdir_p_ret")
+        self.emit("movq %rdi, %rbx")
+        self.emit("call strlen")
+        self.emit(f"cmpq ${page - 1}, %rax")
+        self.emit("ja vyl_mkdir_p_fail")
+        self.emit("movq %rsp, %rdi")
+        self.emit("movq %rbx, %rsi")
+        self.emit("leaq 1(%rax), %rdx")
+        self.emit("call memcpy")
+        self.emit("leaq 1(%rsp), %r12")  # a leading '/' is the root, not a prefix
+        self.emit("vyl_mkdir_p_scan:")
+        self.emit("movzbl (%r12), %eax")
+        self.emit("testb %al, %al")
+        self.emit("jz vyl_mkdir_p_last")
+        self.emit("cmpb $47, %al")
+        self.emit("jne vyl_mkdir_p_next")
+        self.emit("movb $0, (%r12)")
+        self.emit("movq %rsp, %rdi")
+        self.emit("movl $0777, %esi")
+        self.emit("call mkdir")
+        self.emit("movb $47, (%r12)")
+        self.emit("vyl_mkdir_p_next:")
+        self.emit("incq %r12")
+        self.emit("jmp vyl_mkdir_p_scan")
+        self.emit("vyl_mkdir_p_last:")
+        self.emit("movq %rsp, %rdi")
+        self.emit("movl $0777, %esi")
+        self.emit("call mkdir")
+        self.emit("testl %eax, %eax")
+        self.emit("jz vyl_mkdir_p_ok")
+        self.emit("movq %rsp, %rdi")
+        self.emit("movl $0x10000, %esi")  # O_RDONLY | O_DIRECTORY: is it one already?
+        self.emit("call open")
+        self.emit("testl %eax, %eax")
+        self.emit("js vyl_mkdir_p_fail")
+        self.emit("movl %eax, %edi")
+        self.emit("call close")
+        self.emit("vyl_mkdir_p_ok:")
+        self.emit("movl $1, %eax")
+        self.emit("jmp vyl_mkdir_p_ret")
+        self.emit("vyl_mkdir_p_fail:")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_mkdir_p_ret:")
+        self.emit(f"addq ${page}, %rsp")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_mkdir_parent(path) -> int: MkdirP of everything before the last '/'
+        self.emit(".globl vyl_mkdir_parent")
+        self.emit("vyl_mkdir_parent:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movl $47, %esi")
+        self.emit("call strrchr")
+        self.emit("movq %rax, %r12")
+        self.emit("movl $1, %eax")
+        self.emit("testq %r12, %r12")
+        self.emit("jz vyl_mkdir_parent_ret")
+        self.emit("cmpq %rbx, %r12")
+        self.emit("je vyl_mkdir_parent_ret")
+        self.emit("movb $0, (%r12)")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_mkdir_p")
+        self.emit("movb $47, (%r12)")
+        self.emit("vyl_mkdir_parent_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_remove_all(path) -> int (1 success, 0 fail); a missing path is success
+        self.emit(".globl vyl_remove_all")
+        self.emit("vyl_remove_all:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("movq %rdi, %rsi")
+        self.emit("movl $-100, %edi")  # AT_FDCWD
+        self.emit("call vyl_remove_at")
+        self.emit("testq %rax, %rax")
+        self.emit("sete %al")
+        self.emit("movzbq %al, %rax")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_remove_at(rdi=dirfd, rsi=name) -> 0, or -1 if something stayed.
+        # Unlink it; if it is a directory, empty it entry by entry and rmdir.
+        # Each pass rescans from the start until one finds nothing left, so
+        # entries the listing shifted while we deleted are not missed.
+        self.emit(".globl vyl_remove_at")
+        self.emit("vyl_remove_at:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("push %r15")
+        self.emit("subq $24, %rsp")  # removed this pass, failures, batch size
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movl %ebx, %edi")
+        self.emit("movq %r12, %rsi")
+        self.emit("xorl %edx, %edx")
+        self.emit("call unlinkat")
+        self.emit("testl %eax, %eax")
+        self.emit("jz vyl_remove_at_ok")
+        self.emit("call __errno_location")
+        self.emit("movl (%rax), %eax")
+        self.emit("cmpl $2, %eax")  # ENOENT
+        self.emit("je vyl_remove_at_ok")
+        self.emit("cmpl $21, %eax")  # EISDIR
+        self.emit("je vyl_remove_at_dir")
+        self.emit("cmpl $1, %eax")  # EPERM, what some filesystems say for directories
+        self.emit("jne vyl_remove_at_fail")
+        self.emit("vyl_remove_at_dir:")
+        self.emit("movl %ebx, %edi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movl $0xB0000, %edx")  # O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC
+        self.emit("xorl %ecx, %ecx")
+        self.emit("call openat")
+        self.emit("testl %eax, %eax")
+        self.emit("js vyl_remove_at_fail")
+        self.emit("movslq %eax, %r13")
+        self.emit(f"movl ${DENTS_BUFFER_SIZE}, %edi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_remove_at_close")
+        self.emit("movq %rax, %r14")
+        self.emit("vyl_remove_at_pass:")
+        self.emit("movq $0, (%rsp)")
+        self.emit("movq $0, 8(%rsp)")
+        self.emit("movl %r13d, %edi")
+        self.emit("xorl %esi, %esi")
+        self.emit("xorl %edx, %edx")  # SEEK_SET
+        self.emit("call lseek")
+        self.emit("vyl_remove_at_batch:")
+        self.emit("movl $217, %eax")  # getdents64
+        self.emit("movq %r13, %rdi")
+        self.emit("movq %r14, %rsi")
+        self.emit(f"movl ${DENTS_BUFFER_SIZE}, %edx")
+        self.emit("syscall")
+        self.emit("testq %rax, %rax")
+        self.emit("jle vyl_remove_at_listed")
+        self.emit("movq %rax, 16(%rsp)")
+        self.emit("xorl %r15d, %r15d")
+        self.emit("vyl_remove_at_entry:")
+        self.emit("cmpq 16(%rsp), %r15")
+        self.emit("jae vyl_remove_at_batch")
+        self.emit("leaq 19(%r14,%r15), %rsi")  # d_name
+        self.emit("movzwl 16(%r14,%r15), %eax")  # d_reclen
+        self.emit("addq %rax, %r15")
+        self.emit("cmpb $46, (%rsi)")  # skip "." and ".."
+        self.emit("jne vyl_remove_at_child")
+        self.emit("cmpb $0, 1(%rsi)")
+        self.emit("je vyl_remove_at_entry")
+        self.emit("cmpb $46, 1(%rsi)")
+        self.emit("jne vyl_remove_at_child")
+        self.emit("cmpb $0, 2(%rsi)")
+        self.emit("je vyl_remove_at_entry")
+        self.emit("vyl_remove_at_child:")
+        self.emit("incq (%rsp)")
+        self.emit("movq %r13, %rdi")
+        self.emit("call vyl_remove_at")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_remove_at_entry")
+        self.emit("movq $1, 8(%rsp)")
+        self.emit("jmp vyl_remove_at_entry")
+        self.emit("vyl_remove_at_listed:")
+        self.emit("cmpq $0, 8(%rsp)")
+        self.emit("jne vyl_remove_at_emptied")
+        self.emit("cmpq $0, (%rsp)")
+        self.emit("jne vyl_remove_at_pass")
+        self.emit("vyl_remove_at_emptied:")
+        self.emit("movq %r14, %rdi")
+        self.emit("call free")
+        self.emit("movl %r13d, %edi")
+        self.emit("call close")
+        self.emit("movl %ebx, %edi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movl $0x200, %edx")  # AT_REMOVEDIR
+        self.emit("call unlinkat")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_remove_at_fail")
+        self.emit("vyl_remove_at_ok:")
+        self.emit("xorl %eax, %eax")
+        self.emit("jmp vyl_remove_at_ret")
+        self.emit("vyl_remove_at_close:")
+        self.emit("movl %r13d, %edi")
+        self.emit("call close")
+        self.emit("vyl_remove_at_fail:")
+        self.emit("movq $-1, %rax")
+        self.emit("vyl_remove_at_ret:")
+        self.emit("addq $24, %rsp")
+        self.emit("pop %r15")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_zip_path(rdi=buffer, rsi=destDir, rdx=name, rcx=name length) -> 1,
+        # or 0 when "destDir/name" is too long or name could leave destDir
+        # (absolute, or a ".." component)
+        self.emit(".globl vyl_zip_path")
+        self.emit("vyl_zip_path:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r14")
+        self.emit("movq %rdx, %r12")
+        self.emit("movq %rcx, %r13")
+        self.emit("testq %r13, %r13")
+        self.emit("jz vyl_zip_path_build")
+        self.emit("cmpb $47, (%r12)")
+        self.emit("je vyl_zip_path_fail")
+        self.emit("xorl %ecx, %ecx")  # index
+        self.emit("xorl %edx, %edx")  # start of the current component
+        self.emit("vyl_zip_path_scan:")
+        self.emit("cmpq %r13, %rcx")
+        self.emit("je vyl_zip_path_component")
+        self.emit("cmpb $47, (%r12,%rcx)")
+        self.emit("jne vyl_zip_path_step")
+        self.emit("vyl_zip_path_component:")
+        self.emit("movq %rcx, %rax")
+        self.emit("subq %rdx, %rax")
+        self.emit("cmpq $2, %rax")
+        self.emit("jne vyl_zip_path_safe")
+        self.emit("cmpw $0x2e2e, (%r12,%rdx)")
+        self.emit("je vyl_zip_path_fail")
+        self.emit("vyl_zip_path_safe:")
+        self.emit("cmpq %r13, %rcx")
+        self.emit("je vyl_zip_path_build")
+        self.emit("leaq 1(%rcx), %rdx")
+        self.emit("vyl_zip_path_step:")
+        self.emit("incq %rcx")
+        self.emit("jmp vyl_zip_path_scan")
+        self.emit("vyl_zip_path_build:")
+        self.emit("movq %r14, %rdi")
+        self.emit("call strlen")
+        self.emit("leaq 2(%rax,%r13), %rcx")  # '/' and the terminator
+        self.emit(f"cmpq ${page}, %rcx")
+        self.emit("ja vyl_zip_path_fail")
+        self.emit("movq %rax, %rdx")
+        self.emit("movq %r14, %rsi")
+        self.emit("leaq (%rbx,%rax), %r14")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call memcpy")
+        self.emit("movb $47, (%r14)")
+        self.emit("leaq 1(%r14), %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("call memcpy")
+        self.emit("movb $0, 1(%r14,%r13)")
+        self.emit("movl $1, %eax")
+        self.emit("jmp vyl_zip_path_ret")
+        self.emit("vyl_zip_path_fail:")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_zip_path_ret:")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_zip_inflate(rdi=fd, rsi=data, rdx=compressed size, rcx=out buffer,
+        # r8=z_stream space) -> 1 when a raw deflate stream decoded completely
+        self.emit(".globl vyl_zip_inflate")
+        self.emit("vyl_zip_inflate:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("movq %r8, %rbx")
+        self.emit("movq %rdi, %r12")
+        self.emit("movq %rcx, %r13")
+        self.emit("push %rsi")
+        self.emit("push %rdx")
+        self.emit("movq %rbx, %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit(f"movl ${ZSTREAM_SIZE}, %edx")
+        self.emit("call memset")  # default allocators
+        self.emit("pop %rdx")
+        self.emit("pop %rsi")
+        self.emit("movq %rsi, (%rbx)")  # next_in
+        self.emit("movl %edx, 8(%rbx)")  # avail_in
+        self.emit("movq %rbx, %rdi")
+        self.emit("movl $-15, %esi")  # raw deflate, 32 KiB window
+        self.emit("leaq .zlib_version(%rip), %rdx")
+        self.emit(f"movl ${ZSTREAM_SIZE}, %ecx")
+        self.emit("call inflateInit2_")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_zip_inflate_fail")
+        self.emit("vyl_zip_inflate_loop:")
+        self.emit("movq %r13, 24(%rbx)")  # next_out
+        self.emit(f"movl ${UNZIP_BUFFER_SIZE}, 32(%rbx)")  # avail_out
+        self.emit("movq %rbx, %rdi")
+        self.emit("xorl %esi, %esi")  # Z_NO_FLUSH
+        self.emit("call inflate")
+        self.emit("movslq %eax, %r14")
+        self.emit(f"movl ${UNZIP_BUFFER_SIZE}, %edx")
+        self.emit("subl 32(%rbx), %edx")
+        self.emit("jz vyl_zip_inflate_check")
+        self.emit("movq %r12, %rdi")
+        self.emit("movq %r13, %rsi")
+        self.emit("call vyl_write_fd")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_zip_inflate_bad")
+        self.emit("vyl_zip_inflate_check:")
+        self.emit("cmpq $1, %r14")  # Z_STREAM_END
+        self.emit("je vyl_zip_inflate_good")
+        self.emit("testq %r14, %r14")  # anything but Z_OK: corrupt or truncated
+        self.emit("jz vyl_zip_inflate_loop")
+        self.emit("vyl_zip_inflate_bad:")
+        self.emit("xorl %r14d, %r14d")
+        self.emit("jmp vyl_zip_inflate_end")
+        self.emit("vyl_zip_inflate_good:")
+        self.emit("movl $1, %r14d")
+        self.emit("vyl_zip_inflate_end:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call inflateEnd")
+        self.emit("movq %r14, %rax")
+        self.emit("jmp vyl_zip_inflate_ret")
+        self.emit("vyl_zip_inflate_fail:")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_zip_inflate_ret:")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_unzip(zipPath, destDir) -> int (1 success, 0 fail). Stored and
+        # deflated entries are supported; zip64 and encryption are not.
+        path_slot, stream_slot = 0, page
+        out_slot = stream_slot + ZSTREAM_SIZE
+        fd_slot = out_slot + 8
+        frame = fd_slot + 16  # 5 pushes leave rsp 8 off, so the frame is too
+        self.emit(".globl vyl_unzip")
+        self.emit("vyl_unzip:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("push %r15")
+        self.emit(f"subq ${frame}, %rsp")
+        self.emit("movq %rsi, %r12")  # destDir
+        self.emit(f"movq $0, {out_slot}(%rsp)")
+        self.emit("call vyl_map_file")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_unzip_ret")
+        self.emit("movq %rax, %rbx")  # archive bytes
+        self.emit("xorl %r13d, %r13d")
+        self.emit("movq %r12, %rdi")
+        self.emit("call vyl_mkdir_p")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_unzip_fail")
+        self.emit("movq -8(%rbx), %r15")
+        self.emit("cmpq $22, %r15")
+        self.emit("jb vyl_unzip_fail")
+        self.emit("addq %rbx, %r15")  # end of archive
+        # The end-of-central-directory record sits in the last 22 + 64 KiB
+        self.emit("leaq -22(%r15), %r13")
+        self.emit("leaq -65557(%r15), %r14")
+        self.emit("cmpq %rbx, %r14")
+        self.emit("cmovbq %rbx, %r14")
+        self.emit("vyl_unzip_eocd:")
+        self.emit("cmpl $0x06054b50, (%r13)")
+        self.emit("je vyl_unzip_eocd_found")
+        self.emit("decq %r13")
+        self.emit("cmpq %r14, %r13")
+        self.emit("jae vyl_unzip_eocd")
+        self.emit("jmp vyl_unzip_fail")
+        self.emit("vyl_unzip_eocd_found:")
+        self.emit("movzwl 10(%r13), %r14d")  # entries
+        self.emit("movl 16(%r13), %eax")  # central directory offset
+        self.emit("leaq (%rbx,%rax), %r13")
+        self.emit(f"movl ${UNZIP_BUFFER_SIZE}, %edi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_unzip_fail")
+        self.emit(f"movq %rax, {out_slot}(%rsp)")
+        self.emit("vyl_unzip_entry:")
+        self.emit("testq %r14, %r14")
+        self.emit("jz vyl_unzip_done")
+        self.emit("leaq 46(%r13), %rax")
+        self.emit("cmpq %r15, %rax")
+        self.emit("ja vyl_unzip_fail")
+        self.emit("cmpl $0x02014b50, (%r13)")
+        self.emit("jne vyl_unzip_fail")
+        self.emit("movzwl 28(%r13), %ecx")  # name length
+        self.emit("leaq 46(%r13,%rcx), %rax")
+        self.emit("cmpq %r15, %rax")
+        self.emit("ja vyl_unzip_fail")
+        self.emit(f"leaq {path_slot}(%rsp), %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("leaq 46(%r13), %rdx")
+        self.emit("call vyl_zip_path")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_unzip_fail")
+        self.emit("movzwl 28(%r13), %ecx")
+        self.emit("testl %ecx, %ecx")
+        self.emit("jz vyl_unzip_next")
+        self.emit("cmpb $47, 45(%r13,%rcx)")  # "dir/" entries only create the directory
+        self.emit("jne vyl_unzip_file")
+        self.emit(f"leaq {path_slot}(%rsp), %rdi")
+        self.emit("call vyl_mkdir_p")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_unzip_fail")
+        self.emit("jmp vyl_unzip_next")
+        self.emit("vyl_unzip_file:")
+        self.emit("movl 42(%r13), %eax")  # local header offset
+        self.emit("leaq (%rbx,%rax), %rsi")
+        self.emit("leaq 30(%rsi), %rax")
+        self.emit("cmpq %r15, %rax")
+        self.emit("ja vyl_unzip_fail")
+        self.emit("cmpl $0x04034b50, (%rsi)")
+        self.emit("jne vyl_unzip_fail")
+        self.emit("movzwl 26(%rsi), %eax")
+        self.emit("movzwl 28(%rsi), %ecx")
+        self.emit("addq %rcx, %rax")
+        self.emit("leaq 30(%rsi,%rax), %rsi")  # entry data
+        self.emit("movl 20(%r13), %eax")  # compressed size
+        self.emit("leaq (%rsi,%rax), %rax")
+        self.emit("cmpq %r15, %rax")
+        self.emit("ja vyl_unzip_fail")
+        self.emit("push %rsi")
+        self.emit("subq $8, %rsp")
+        self.emit(f"leaq {path_slot + 16}(%rsp), %rdi")
+        self.emit("call vyl_mkdir_parent")
+        self.emit(f"leaq {path_slot + 16}(%rsp), %rdi")
+        self.emit("movl $0x241, %esi")  # O_WRONLY | O_CREAT | O_TRUNC
+        self.emit("movl $0644, %edx")
+        self.emit("call open")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rsi")
+        self.emit("testl %eax, %eax")
+        self.emit("js vyl_unzip_fail")
+        self.emit(f"movl %eax, {fd_slot}(%rsp)")
+        self.emit("movl 20(%r13), %edx")
+        self.emit("movzwl 10(%r13), %eax")  # method
+        self.emit("testl %eax, %eax")
+        self.emit("jz vyl_unzip_stored")
+        self.emit("cmpl $8, %eax")
+        self.emit("jne vyl_unzip_entry_fail")
+        self.emit(f"movslq {fd_slot}(%rsp), %rdi")
+        self.emit(f"movq {out_slot}(%rsp), %rcx")
+        self.emit(f"leaq {stream_slot}(%rsp), %r8")
+        self.emit("call vyl_zip_inflate")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_unzip_entry_fail")
+        self.emit("jmp vyl_unzip_close")
+        self.emit("vyl_unzip_stored:")
+        self.emit(f"movslq {fd_slot}(%rsp), %rdi")
+        self.emit("call vyl_write_fd")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_unzip_entry_fail")
+        self.emit("vyl_unzip_close:")
+        self.emit(f"movl {fd_slot}(%rsp), %edi")
+        self.emit("call close")
+        self.emit("vyl_unzip_next:")
+        self.emit("movzwl 28(%r13), %eax")
+        self.emit("movzwl 30(%r13), %ecx")
+        self.emit("addq %rcx, %rax")
+        self.emit("movzwl 32(%r13), %ecx")
+        self.emit("addq %rcx, %rax")
+        self.emit("leaq 46(%r13,%rax), %r13")
+        self.emit("decq %r14")
+        self.emit("jmp vyl_unzip_entry")
+        self.emit("vyl_unzip_entry_fail:")
+        self.emit(f"movl {fd_slot}(%rsp), %edi")
+        self.emit("call close")
+        self.emit("vyl_unzip_fail:")
+        self.emit("xorl %r13d, %r13d")
+        self.emit("jmp vyl_unzip_cleanup")
+        self.emit("vyl_unzip_done:")
+        self.emit("movl $1, %r13d")
+        self.emit("vyl_unzip_cleanup:")
+        self.emit(f"movq {out_slot}(%rsp), %rdi")
+        self.emit("call free")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_unmap_file")
+        self.emit("movq %r13, %rax")
+        self.emit("vyl_unzip_ret:")
+        self.emit(f"addq ${frame}, %rsp")
+        self.emit("pop %r15")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit(".section .data")
+        self.emit(".zlib_version: .asciz \"1.2.11\"")  # inflateInit2_ checks the major version
+        self.emit(".section .text")
+
+    def generate_http_runtime(self):
+        """Emit the HTTP/1.1 client behind HttpGet, HttpDownload and HttpOpen.
+
+        A connection carries its own 64 KiB receive buffer and the state of the
+        response being read. Bodies are consumed in place as Content-Length,
+        chunked or read-until-close pieces; once a keep-alive response has been
+        read to the end the connection goes back to a per-host idle pool, so
+        repeated requests to one host reuse the TCP (and TLS) session.
+        """
+        data = HTTP_CONN_HEADER_SIZE
+        cap = HTTP_BUFFER_SIZE
+
+        self.emit(".section .data")
+        self.emit("vyl_http_pool: .quad 0")
+        self.emit(".section .rodata")
+        self.emit(".http_req_get: .asciz \"GET \"")
+        self.emit(".http_req_host: .asciz \" HTTP/1.1\\r\\nHost: \"")
+        self.emit(".http_req_tail: .asciz \"\\r\\nUser-Agent: vyl/0.1\\r\\nAccept-Encoding: identity\\r\\n\\r\\n\"")
+        self.emit(".http_root: .asciz \"/\"")
+        self.emit(".http_prefix: .asciz \"http://\"")
+        self.emit(".https_prefix: .asciz \"https://\"")
+        self.emit(".http_hdr_length: .asciz \"content-length:\"")
+        self.emit(".http_hdr_encoding: .asciz \"transfer-encoding:\"")
+        self.emit(".http_hdr_connection: .asciz \"connection:\"")
+        self.emit(".http_hdr_location: .asciz \"location:\"")
+        self.emit(".http_chunked: .asciz \"chunked\"")
+        self.emit(".http_close: .asciz \"close\"")
+        self.emit(".section .text")
+
+        # vyl_http_connect(rdi=host, rsi=use_tls, rdx=fresh) -> connection or 0.
+        # Unless fresh is set an idle pooled connection to the same host wins.
+        self.emit(".globl vyl_http_connect")
+        self.emit("vyl_http_connect:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jnz vyl_http_connect_new")
+        self._emit_spin_lock("vyl_net_lock(%rip)")
+        self.emit("leaq vyl_http_pool(%rip), %r13")  # link that points at the candidate
+        self.emit("vyl_http_connect_scan:")
+        self.emit("movq (%r13), %r14")
+        self.emit("testq %r14, %r14")
+        self.emit("jz vyl_http_connect_miss")
+        self.emit("cmpq %r12, 16(%r14)")
+        self.emit("jne vyl_http_connect_next")
+        self.emit("movq 8(%r14), %rdi")
+        self.emit("movq %rbx, %rsi")
+        self.emit("call strcmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jz vyl_http_connect_hit")
+        self.emit("vyl_http_connect_next:")
+        self.emit("movq %r14, %r13")  # next is the first field
+        self.emit("jmp vyl_http_connect_scan")
+        self.emit("vyl_http_connect_hit:")
+        self.emit("movq (%r14), %rax")
+        self.emit("movq %rax, (%r13)")
+        self.emit("movq $0, (%r14)")
+        self.emit("movq $1, 120(%r14)")  # reused: the server may have dropped it
+        self._emit_spin_unlock("vyl_net_lock(%rip)")
+        self.emit("movq %r14, %rax")
+        self.emit("jmp vyl_http_connect_ret")
+        self.emit("vyl_http_connect_miss:")
+        self._emit_spin_unlock("vyl_net_lock(%rip)")
+        self.emit("vyl_http_connect_new:")
+        # A peer that closed an idle connection must fail the write, not kill us
+        self.emit("movl $13, %edi")  # SIGPIPE
+        self.emit("movl $1, %esi")  # SIG_IGN
+        self.emit("call signal")
+        self.emit(f"movq ${data + cap}, %rdi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_connect_ret")
+        self.emit("movq %rax, %r14")
+        self.emit("movq %rax, %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit(f"movl ${data}, %edx")
+        self.emit("call memset")
+        self.emit("movq %r12, 16(%r14)")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call strdup")
+        self.emit("movq %rax, 8(%r14)")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_connect_fail")
+        self.emit("movq %rbx, %rdi")
+        self.emit("testq %r12, %r12")
+        self.emit("jnz vyl_http_connect_tls")
+        self.emit("movl $80, %esi")
+        self.emit("call vyl_tcp_connect_fast")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_connect_fail")
+        self.emit("movq %rax, 24(%r14)")
+        self.emit("movq %r14, %rax")
+        self.emit("jmp vyl_http_connect_ret")
+        self.emit("vyl_http_connect_tls:")
+        self.emit("movl $443, %esi")
+        self.emit("call vyl_tls_connect")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_connect_fail")
+        self.emit("movq %rax, 32(%r14)")
+        self.emit("movq %rax, %rdi")
+        self.emit("call SSL_get_fd")
+        self.emit("movslq %eax, %rax")
+        self.emit("movq %rax, 24(%r14)")
+        self.emit("movq %r14, %rax")
+        self.emit("jmp vyl_http_connect_ret")
+        self.emit("vyl_http_connect_fail:")
+        self.emit("movq 8(%r14), %rdi")
+        self.emit("call free")
+        self.emit("movq %r14, %rdi")
+        self.emit("call free")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_http_connect_ret:")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_discard(rdi=conn): close the socket and free everything
+        self.emit(".globl vyl_http_discard")
+        self.emit("vyl_http_discard:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_http_discard_ret")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq 32(%rbx), %rdi")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_http_discard_plain")
+        self.emit("call vyl_tls_close")
+        self.emit("jmp vyl_http_discard_free")
+        self.emit("vyl_http_discard_plain:")
+        self.emit("movl 24(%rbx), %edi")
+        self.emit("call close")
+        self.emit("vyl_http_discard_free:")
+        self.emit("movq 8(%rbx), %rdi")
+        self.emit("call free")
+        self.emit("movq 112(%rbx), %rdi")
+        self.emit("call free")
+        self.emit("movq 104(%rbx), %rdi")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_http_discard_conn")
+        self.emit("subq $16, %rdi")
+        self.emit("call free")
+        self.emit("vyl_http_discard_conn:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call free")
+        self.emit("vyl_http_discard_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_fill(rdi=conn) -> bytes received, 0 on EOF, error or full buffer.
+        # Unconsumed bytes move to the front first.
+        self.emit(".globl vyl_http_fill")
+        self.emit("vyl_http_fill:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq 40(%rbx), %rsi")
+        self.emit("testq %rsi, %rsi")
+        self.emit("jz vyl_http_fill_read")
+        self.emit("movq 48(%rbx), %r12")
+        self.emit("subq %rsi, %r12")
+        self.emit(f"leaq {data}(%rbx), %rdi")
+        self.emit(f"leaq {data}(%rbx,%rsi), %rsi")
+        self.emit("movq %r12, %rdx")
+        self.emit("call memmove")
+        self.emit("movq $0, 40(%rbx)")
+        self.emit("movq %r12, 48(%rbx)")
+        self.emit("vyl_http_fill_read:")
+        self.emit(f"movl ${cap}, %edx")
+        self.emit("subq 48(%rbx), %rdx")
+        self.emit("jz vyl_http_fill_none")
+        self.emit("movq 48(%rbx), %rsi")
+        self.emit(f"leaq {data}(%rbx,%rsi), %rsi")
+        self.emit("movq 32(%rbx), %rdi")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_http_fill_plain")
+        self.emit("call vyl_ssl_read")
+        self.emit("jmp vyl_http_fill_got")
+        self.emit("vyl_http_fill_plain:")
+        self.emit("movl 24(%rbx), %edi")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("call vyl_sock_recv")
+        self.emit("vyl_http_fill_got:")
+        self.emit("testq %rax, %rax")
+        self.emit("jle vyl_http_fill_none")
+        self.emit("addq %rax, 48(%rbx)")
+        self.emit("jmp vyl_http_fill_ret")
+        self.emit("vyl_http_fill_none:")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_http_fill_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_send(rdi=conn, rsi=ptr, rdx=len) -> 0, or -1 once the peer is gone
+        self.emit(".globl vyl_http_send")
+        self.emit("vyl_http_send:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("vyl_http_send_loop:")
+        self.emit("testq %r13, %r13")
+        self.emit("jle vyl_http_send_done")
+        self.emit("movq 32(%rbx), %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_http_send_plain")
+        self.emit("movl %r13d, %edx")  # requests never reach 2 GiB
+        self.emit("call vyl_ssl_write")
+        self.emit("jmp vyl_http_send_got")
+        self.emit("vyl_http_send_plain:")
+        self.emit("movl 24(%rbx), %edi")
+        self.emit("movq %r13, %rdx")
+        self.emit("movl $0x4000, %ecx")  # MSG_NOSIGNAL
+        self.emit("call vyl_sock_send")
+        self.emit("vyl_http_send_got:")
+        self.emit("testq %rax, %rax")
+        self.emit("jle vyl_http_send_fail")
+        self.emit("addq %rax, %r12")
+        self.emit("subq %rax, %r13")
+        self.emit("jmp vyl_http_send_loop")
+        self.emit("vyl_http_send_done:")
+        self.emit("xorl %eax, %eax")
+        self.emit("jmp vyl_http_send_ret")
+        self.emit("vyl_http_send_fail:")
+        self.emit("movq $-1, %rax")
+        self.emit("vyl_http_send_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_line(rdi=conn) -> rax=line start in the buffer (0 on EOF),
+        # rdx=length without the CRLF. The line is consumed.
+        self.emit(".globl vyl_http_line")
+        self.emit("vyl_http_line:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
+        self.emit("vyl_http_line_scan:")
+        self.emit("movq 40(%rbx), %rax")
+        self.emit(f"leaq {data}(%rbx,%rax), %r12")
+        self.emit("movq 48(%rbx), %rdx")
+        self.emit("subq %rax, %rdx")
+        self.emit("movq %r12, %rdi")
+        self.emit("movl $10, %esi")
+        self.emit("call memchr")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_http_line_found")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_fill")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_http_line_scan")
+        self.emit("jmp vyl_http_line_ret")
+        self.emit("vyl_http_line_found:")
+        self.emit(f"leaq {1 - data}(%rax), %rcx")
+        self.emit("subq %rbx, %rcx")
+        self.emit("movq %rcx, 40(%rbx)")
+        self.emit("movq %rax, %rdx")
+        self.emit("subq %r12, %rdx")
+        self.emit("jz vyl_http_line_done")
+        self.emit("cmpb $13, -1(%rax)")
+        self.emit("jne vyl_http_line_done")
+        self.emit("decq %rdx")
+        self.emit("vyl_http_line_done:")
+        self.emit("movq %r12, %rax")
+        self.emit("vyl_http_line_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_request(rdi=conn, rsi=path) -> 0 once the GET is on the wire.
+        # The request is assembled in the (empty) receive buffer.
+        self.emit(".globl vyl_http_request")
+        self.emit("vyl_http_request:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("cmpb $0, (%r12)")
+        self.emit("jne vyl_http_request_sized")
+        self.emit("leaq .http_root(%rip), %r12")
+        self.emit("vyl_http_request_sized:")
+        self.emit("movq %r12, %rdi")
+        self.emit("call strlen")
+        self.emit("movq %rax, %r13")
+        self.emit("movq 8(%rbx), %rdi")
+        self.emit("call strlen")
+        self.emit("addq %rax, %r13")
+        self.emit(f"cmpq ${cap - 256}, %r13")  # room for the fixed header lines
+        self.emit("ja vyl_http_request_fail")
+        self.emit(f"leaq {data}(%rbx), %rdi")
+        self.emit("leaq .http_req_get(%rip), %rsi")
+        self.emit("call stpcpy")
+        self.emit("movq %rax, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("call stpcpy")
+        self.emit("movq %rax, %rdi")
+        self.emit("leaq .http_req_host(%rip), %rsi")
+        self.emit("call stpcpy")
+        self.emit("movq %rax, %rdi")
+        self.emit("movq 8(%rbx), %rsi")
+        self.emit("call stpcpy")
+        self.emit("movq %rax, %rdi")
+        self.emit("leaq .http_req_tail(%rip), %rsi")
+        self.emit("call stpcpy")
+        self.emit(f"leaq {data}(%rbx), %rsi")
+        self.emit("movq %rax, %rdx")
+        self.emit("subq %rsi, %rdx")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_send")
+        self.emit("movq $0, 40(%rbx)")
+        self.emit("movq $0, 48(%rbx)")
+        self.emit("jmp vyl_http_request_ret")
+        self.emit("vyl_http_request_fail:")
+        self.emit("movq $-1, %rax")
+        self.emit("vyl_http_request_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_headers(rdi=conn) -> 0 after the status line and headers.
+        # Picks the body framing and whether the connection can be kept.
+        self.emit(".globl vyl_http_headers")
+        self.emit("vyl_http_headers:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("push %r15")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("vyl_http_headers_status:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_line")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_headers_fail")
+        self.emit("cmpq $12, %rdx")
+        self.emit("jb vyl_http_headers_fail")
+        self.emit("cmpl $0x50545448, (%rax)")  # "HTTP"
+        self.emit("jne vyl_http_headers_fail")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("cmpb $'1', 7(%rax)")  # HTTP/1.1 keeps the connection by default
+        self.emit("sete %cl")
+        self.emit("movq %rcx, 72(%rbx)")
+        self.emit("movzbl 9(%rax), %ecx")
+        self.emit("subl $'0', %ecx")
+        self.emit("imull $100, %ecx, %ecx")
+        self.emit("movzbl 10(%rax), %edx")
+        self.emit("subl $'0', %edx")
+        self.emit("imull $10, %edx, %edx")
+        self.emit("addl %edx, %ecx")
+        self.emit("movzbl 11(%rax), %edx")
+        self.emit("subl $'0', %edx")
+        self.emit("addl %edx, %ecx")
+        self.emit("movslq %ecx, %rcx")
+        self.emit("movq %rcx, 80(%rbx)")
+        self.emit("movq $-1, %r13")  # Content-Length
+        self.emit("xorl %r14d, %r14d")  # chunked
+        self.emit("vyl_http_headers_next:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_line")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_headers_fail")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jz vyl_http_headers_end")
+        self.emit("movq %rax, %r12")
+        self.emit("movq %rdx, %r15")
+        # Lines are not NUL-terminated, but every compare stops at the CRLF
+        self.emit("movq %r12, %rdi")
+        self.emit("leaq .http_hdr_length(%rip), %rsi")
+        self.emit("movl $15, %edx")
+        self.emit("call strncasecmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_http_headers_encoding")
+        self.emit("leaq 15(%r12), %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit("movl $10, %edx")
+        self.emit("call strtol")
+        self.emit("movq %rax, %r13")
+        self.emit("jmp vyl_http_headers_next")
+        self.emit("vyl_http_headers_encoding:")
+        self.emit("movq %r12, %rdi")
+        self.emit("leaq .http_hdr_encoding(%rip), %rsi")
+        self.emit("movl $18, %edx")
+        self.emit("call strncasecmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_http_headers_connection")
+        self.emit("movq %r12, %rdi")
+        self.emit("movq %r15, %rsi")
+        self.emit("leaq .http_chunked(%rip), %rdx")
+        self.emit("movl $7, %ecx")
+        self.emit("call memmem")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_headers_next")
+        self.emit("movl $1, %r14d")
+        self.emit("jmp vyl_http_headers_next")
+        self.emit("vyl_http_headers_connection:")
+        self.emit("movq %r12, %rdi")
+        self.emit("leaq .http_hdr_connection(%rip), %rsi")
+        self.emit("movl $11, %edx")
+        self.emit("call strncasecmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_http_headers_location")
+        self.emit("movq %r12, %rdi")
+        self.emit("movq %r15, %rsi")
+        self.emit("leaq .http_close(%rip), %rdx")
+        self.emit("movl $5, %ecx")
+        self.emit("call memmem")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_headers_next")
+        self.emit("movq $0, 72(%rbx)")
+        self.emit("jmp vyl_http_headers_next")
+        self.emit("vyl_http_headers_location:")
+        self.emit("movq %r12, %rdi")
+        self.emit("leaq .http_hdr_location(%rip), %rsi")
+        self.emit("movl $9, %edx")
+        self.emit("call strncasecmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_http_headers_next")
+        self.emit("leaq 9(%r12), %rdi")
+        self.emit("leaq -9(%r15), %rsi")
+        self.emit("vyl_http_headers_trim:")
+        self.emit("testq %rsi, %rsi")
+        self.emit("jz vyl_http_headers_keep")
+        self.emit("cmpb $' ', (%rdi)")
+        self.emit("jne vyl_http_headers_keep")
+        self.emit("incq %rdi")
+        self.emit("decq %rsi")
+        self.emit("jmp vyl_http_headers_trim")
+        self.emit("vyl_http_headers_keep:")
+        self.emit("call strndup")
+        self.emit("movq %rax, %r12")
+        self.emit("movq 112(%rbx), %rdi")
+        self.emit("call free")
+        self.emit("movq %r12, 112(%rbx)")
+        self.emit("jmp vyl_http_headers_next")
+        self.emit("vyl_http_headers_end:")
+        self.emit("movq 80(%rbx), %rax")
+        self.emit("cmpq $100, %rax")
+        self.emit("jb vyl_http_headers_fail")
+        self.emit("cmpq $200, %rax")
+        self.emit("jb vyl_http_headers_status")  # interim 1xx; the real response follows
+        self.emit("movq $0, 88(%rbx)")
+        self.emit("movq $0, 96(%rbx)")
+        self.emit("movq $0, 64(%rbx)")
+        self.emit("movq $1, 56(%rbx)")
+        self.emit("cmpq $204, %rax")
+        self.emit("je vyl_http_headers_ok")
+        self.emit("cmpq $304, %rax")
+        self.emit("je vyl_http_headers_ok")
+        self.emit("movq $2, 56(%rbx)")
+        self.emit("testq %r14, %r14")
+        self.emit("jnz vyl_http_headers_ok")
+        self.emit("movq $1, 56(%rbx)")
+        self.emit("movq %r13, 64(%rbx)")
+        self.emit("testq %r13, %r13")
+        self.emit("jns vyl_http_headers_ok")
+        self.emit("movq $0, 56(%rbx)")  # no length: the body ends with the connection
+        self.emit("movq $0, 64(%rbx)")
+        self.emit("movq $0, 72(%rbx)")
+        self.emit("vyl_http_headers_ok:")
+        self.emit("xorl %eax, %eax")
+        self.emit("jmp vyl_http_headers_ret")
+        self.emit("vyl_http_headers_fail:")
+        self.emit("movq $-1, %rax")
+        self.emit("vyl_http_headers_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r15")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_open(rdi=host, rsi=path, rdx=use_tls) -> connection positioned
+        # at the start of the body, or 0. A pooled connection that turns out to
+        # be dead is retried once on a fresh one.
+        self.emit(".globl vyl_http_open")
+        self.emit("vyl_http_open:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("andq $-16, %rsp")  # builtins may be called mid-expression
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("push %r15")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("xorl %r14d, %r14d")  # fresh
+        self.emit("vyl_http_open_try:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movq %r13, %rsi")
+        self.emit("movq %r14, %rdx")
+        self.emit("call vyl_http_connect")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_open_ret")
+        self.emit("movq %rax, %r15")
+        self.emit("movq %rax, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("call vyl_http_request")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_http_open_retry")
+        self.emit("movq %r15, %rdi")
+        self.emit("call vyl_http_headers")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_http_open_retry")
+        self.emit("movq %r15, %rax")
+        self.emit("jmp vyl_http_open_ret")
+        self.emit("vyl_http_open_retry:")
+        self.emit("movq 120(%r15), %rax")
+        self.emit("movq %rax, (%rsp)")
+        self.emit("movq %r15, %rdi")
+        self.emit("call vyl_http_discard")
+        self.emit("xorl %eax, %eax")
+        self.emit("cmpq $0, (%rsp)")
+        self.emit("je vyl_http_open_ret")
+        self.emit("testq %r14, %r14")
+        self.emit("jnz vyl_http_open_ret")
+        self.emit("movl $1, %r14d")
+        self.emit("jmp vyl_http_open_try")
+        self.emit("vyl_http_open_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r15")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_next(rdi=conn) -> rax=next body bytes in the buffer, rdx=count;
+        # rdx=0 at the end. Sets done to 1 on a complete body, -1 on a cut one.
+        self.emit(".globl vyl_http_next")
+        self.emit("vyl_http_next:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("vyl_http_next_again:")
+        self.emit("cmpq $0, 88(%rbx)")
+        self.emit("jne vyl_http_next_end")
+        self.emit("cmpq $2, 56(%rbx)")
+        self.emit("jne vyl_http_next_length")
+        self.emit("cmpq $0, 64(%rbx)")
+        self.emit("jne vyl_http_next_buffered")
+        # Between chunks: the CRLF closing the last one, then the next size line
+        self.emit("cmpq $0, 96(%rbx)")
+        self.emit("je vyl_http_next_size")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_line")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_next_broken")
+        self.emit("movq $0, 96(%rbx)")
+        self.emit("vyl_http_next_size:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_line")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_next_broken")
+        self.emit("movq %rax, %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit("movl $16, %edx")
+        self.emit("call strtol")  # stops at a chunk extension or the CR
+        self.emit("testq %rax, %rax")
+        self.emit("js vyl_http_next_broken")
+        self.emit("jz vyl_http_next_trailer")
+        self.emit("movq %rax, 64(%rbx)")
+        self.emit("jmp vyl_http_next_buffered")
+        self.emit("vyl_http_next_trailer:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_line")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_next_broken")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jnz vyl_http_next_trailer")
+        self.emit("movq $1, 88(%rbx)")
+        self.emit("jmp vyl_http_next_end")
+        self.emit("vyl_http_next_length:")
+        self.emit("cmpq $1, 56(%rbx)")
+        self.emit("jne vyl_http_next_buffered")
+        self.emit("cmpq $0, 64(%rbx)")
+        self.emit("jne vyl_http_next_buffered")
+        self.emit("movq $1, 88(%rbx)")
+        self.emit("jmp vyl_http_next_end")
+        self.emit("vyl_http_next_buffered:")
+        self.emit("movq 48(%rbx), %rdx")
+        self.emit("subq 40(%rbx), %rdx")
+        self.emit("jnz vyl_http_next_take")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_fill")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_http_next_again")
+        self.emit("cmpq $0, 56(%rbx)")  # only a close-delimited body may end here
+        self.emit("jne vyl_http_next_broken")
+        self.emit("movq $1, 88(%rbx)")
+        self.emit("jmp vyl_http_next_end")
+        self.emit("vyl_http_next_take:")
+        self.emit("cmpq $0, 56(%rbx)")
+        self.emit("je vyl_http_next_slice")
+        self.emit("cmpq 64(%rbx), %rdx")
+        self.emit("cmovaq 64(%rbx), %rdx")
+        self.emit("subq %rdx, 64(%rbx)")
+        self.emit("cmpq $2, 56(%rbx)")
+        self.emit("jne vyl_http_next_slice")
+        self.emit("cmpq $0, 64(%rbx)")
+        self.emit("jne vyl_http_next_slice")
+        self.emit("movq $1, 96(%rbx)")  # chunk data is followed by a CRLF
+        self.emit("vyl_http_next_slice:")
+        self.emit("movq 40(%rbx), %rax")
+        self.emit("addq %rdx, 40(%rbx)")
+        self.emit(f"leaq {data}(%rbx,%rax), %rax")
+        self.emit("jmp vyl_http_next_ret")
+        self.emit("vyl_http_next_broken:")
+        self.emit("movq $-1, 88(%rbx)")
+        self.emit("movq $0, 72(%rbx)")
+        self.emit("vyl_http_next_end:")
+        self.emit("xorl %eax, %eax")
+        self.emit("xorl %edx, %edx")
+        self.emit("vyl_http_next_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_finish(rdi=conn) -> 1 when the body was read completely.
+        # A short unread remainder is drained so the connection can be pooled;
+        # anything else closes it.
+        self.emit(".globl vyl_http_finish")
+        self.emit("vyl_http_finish:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("andq $-16, %rsp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_http_finish_ret")
+        self.emit("movq %rdi, %rbx")
+        self.emit("cmpq $0, 72(%rbx)")
+        self.emit("je vyl_http_finish_close")
+        self.emit("cmpq $0, 88(%rbx)")
+        self.emit("jne vyl_http_finish_drained")
+        self.emit("cmpq $1, 56(%rbx)")
+        self.emit("jne vyl_http_finish_drain")
+        self.emit(f"cmpq ${cap}, 64(%rbx)")  # a big unread body is cheaper to drop
+        self.emit("ja vyl_http_finish_close")
+        self.emit("vyl_http_finish_drain:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_next")
+        self.emit("cmpq $0, 88(%rbx)")
+        self.emit("je vyl_http_finish_drain")
+        self.emit("vyl_http_finish_drained:")
+        self.emit("cmpq $1, 88(%rbx)")
+        self.emit("jne vyl_http_finish_close")
+        self.emit("movq 40(%rbx), %rax")
+        self.emit("cmpq 48(%rbx), %rax")
+        self.emit("jne vyl_http_finish_close")  # the server sent more than it framed
+        self.emit("movq $0, 40(%rbx)")
+        self.emit("movq $0, 48(%rbx)")
+        self.emit("movq 112(%rbx), %rdi")
+        self.emit("call free")
+        self.emit("movq $0, 112(%rbx)")
+        self._emit_spin_lock("vyl_net_lock(%rip)")
+        self.emit("movq vyl_http_pool(%rip), %rax")
+        self.emit("movq %rax, (%rbx)")
+        self.emit("movq %rbx, vyl_http_pool(%rip)")
+        self._emit_spin_unlock("vyl_net_lock(%rip)")
+        self.emit("movl $1, %eax")
+        self.emit("jmp vyl_http_finish_ret")
+        self.emit("vyl_http_finish_close:")
+        self.emit("movq 88(%rbx), %r12")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_discard")
+        self.emit("xorl %eax, %eax")
+        self.emit("cmpq $1, %r12")
+        self.emit("sete %al")
+        self.emit("vyl_http_finish_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_status(rdi=conn) -> status code, 0 for a failed HttpOpen
+        self.emit(".globl vyl_http_status")
+        self.emit("vyl_http_status:")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_http_status_ret")
+        self.emit("movq 80(%rdi), %rax")
+        self.emit("vyl_http_status_ret:")
+        self.emit("ret")
+
+        # vyl_http_read(rdi=conn) -> next piece of the body in one reused
+        # string; "" once the body is over
+        self.emit(".globl vyl_http_read")
+        self.emit("vyl_http_read:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("andq $-16, %rsp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("leaq .empty_str(%rip), %rax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_http_read_ret")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq 104(%rbx), %r12")
+        self.emit("testq %r12, %r12")
+        self.emit("jnz vyl_http_read_next")
+        self.emit(f"movl ${cap + 17}, %edi")
+        self.emit("call malloc")
+        self.emit("movq %rax, %rcx")
+        self.emit("leaq .empty_str(%rip), %rax")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jz vyl_http_read_ret")
+        self.emit(f"movq ${cap}, (%rcx)")
+        self.emit("leaq 16(%rcx), %r12")
+        self.emit("movq %r12, 104(%rbx)")
+        self.emit("vyl_http_read_next:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_next")
+        self.emit("movq %rdx, -8(%r12)")
+        self.emit("movb $0, (%r12,%rdx)")
+        self.emit("movq %r12, %rdi")
+        self.emit("movq %rax, %rsi")
+        self.emit("call memcpy")
+        self.emit("movq %r12, %rax")
+        self.emit("vyl_http_read_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_get(rdi=host, rsi=path, rdx=use_tls) -> body string or 0
+        self.emit(".globl vyl_http_get")
+        self.emit("vyl_http_get:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("andq $-16, %rsp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("call vyl_http_open")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_get_ret")
+        self.emit("movq %rax, %rbx")
+        self.emit("call vyl_sb_new")
+        self.emit("movq %rax, %r12")
+        self.emit("vyl_http_get_loop:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_next")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jz vyl_http_get_done")
+        self.emit("movq %r12, %rdi")
+        self.emit("movq %rax, %rsi")
+        self.emit("call vyl_sb_append_bytes")
+        self.emit("jmp vyl_http_get_loop")
+        self.emit("vyl_http_get_done:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_http_finish")
+        self.emit("movq %r12, %rdi")
+        self.emit("call vyl_sb_build")
+        self.emit("vyl_http_get_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_http_download(rdi=host, rsi=path, rdx=use_tls, rcx=dest) -> 1 on
+        # success. Follows up to five redirects, fails on 4xx/5xx and streams the
+        # body straight to the file.
+        self.emit(".globl vyl_http_download")
+        self.emit("vyl_http_download:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("andq $-16, %rsp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("push %r15")
+        # (%rsp) owned host, 8 owned path, 16 redirects, 24 result, 32 scratch
+        self.emit("subq $40, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("movq $0, (%rsp)")
+        self.emit("movq $0, 8(%rsp)")
+        self.emit("movq $0, 16(%rsp)")
+        self.emit("movq $0, 24(%rsp)")
+        self.emit("movq %rcx, %rdi")
+        self.emit("movl $0x241, %esi")  # O_WRONLY | O_CREAT | O_TRUNC
+        self.emit("movl $0644, %edx")
+        self.emit("call open")
+        self.emit("movslq %eax, %r14")
+        self.emit("testq %r14, %r14")
+        self.emit("js vyl_http_dl_free")
+        self.emit("vyl_http_dl_request:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("call vyl_http_open")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_dl_close")
+        self.emit("movq %rax, %r15")
+        self.emit("movq 80(%r15), %rax")
+        self.emit("cmpq $400, %rax")
+        self.emit("jae vyl_http_dl_abort")
+        self.emit("cmpq $300, %rax")
+        self.emit("jb vyl_http_dl_body")
+        self.emit("cmpq $0, 112(%r15)")
+        self.emit("je vyl_http_dl_body")  # a 3xx without Location is saved as is
+        self.emit("cmpq $5, 16(%rsp)")
+        self.emit("jae vyl_http_dl_abort")
+        self.emit("incq 16(%rsp)")
+        self.emit("movq 112(%r15), %rdi")
+        self.emit("leaq .https_prefix(%rip), %rsi")
+        self.emit("movl $8, %edx")
+        self.emit("call strncmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_http_dl_plain")
+        self.emit("movl $1, %r13d")
+        self.emit("movq 112(%r15), %rdi")
+        self.emit("addq $8, %rdi")
+        self.emit("jmp vyl_http_dl_absolute")
+        self.emit("vyl_http_dl_plain:")
+        self.emit("movq 112(%r15), %rdi")
+        self.emit("leaq .http_prefix(%rip), %rsi")
+        self.emit("movl $7, %edx")
+        self.emit("call strncmp")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_http_dl_relative")
+        self.emit("xorl %r13d, %r13d")
+        self.emit("movq 112(%r15), %rdi")
+        self.emit("addq $7, %rdi")
+        self.emit("vyl_http_dl_absolute:")
+        self.emit("movq %rdi, 32(%rsp)")
+        self.emit("movl $'/', %esi")
+        self.emit("call strchr")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_http_dl_split")
+        self.emit("movq 32(%rsp), %rdi")
+        self.emit("call strdup")
+        self.emit("leaq .http_root(%rip), %rdi")
+        self.emit("jmp vyl_http_dl_host")
+        self.emit("vyl_http_dl_split:")
+        self.emit("movq 32(%rsp), %rdi")
+        self.emit("movq %rax, 32(%rsp)")
+        self.emit("movq %rax, %rsi")
+        self.emit("subq %rdi, %rsi")
+        self.emit("call strndup")
+        self.emit("movq 32(%rsp), %rdi")
+        self.emit("vyl_http_dl_host:")
+        self.emit("movq %rdi, 32(%rsp)")  # path still to copy
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_dl_abort")
+        self.emit("movq (%rsp), %rdi")
+        self.emit("movq %rax, (%rsp)")
+        self.emit("movq %rax, %rbx")
+        self.emit("call free")
+        self.emit("movq 32(%rsp), %rdi")
+        self.emit("jmp vyl_http_dl_path")
+        self.emit("vyl_http_dl_relative:")
+        self.emit("movq 112(%r15), %rdi")
+        self.emit("vyl_http_dl_path:")
+        self.emit("call strdup")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_dl_abort")
+        self.emit("movq 8(%rsp), %rdi")
+        self.emit("movq %rax, 8(%rsp)")
+        self.emit("movq %rax, %r12")
+        self.emit("call free")
+        self.emit("movq %r15, %rdi")
+        self.emit("call vyl_http_finish")
+        self.emit("jmp vyl_http_dl_request")
+        self.emit("vyl_http_dl_body:")
+        self.emit("movq %r15, %rdi")
+        self.emit("call vyl_http_next")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jz vyl_http_dl_done")
+        self.emit("movl %r14d, %edi")
+        self.emit("movq %rax, %rsi")
+        self.emit("call vyl_write_fd")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_http_dl_body")
+        self.emit("jmp vyl_http_dl_abort")
+        self.emit("vyl_http_dl_done:")
+        self.emit("xorl %eax, %eax")
+        self.emit("cmpq $1, 88(%r15)")
+        self.emit("sete %al")
+        self.emit("movq %rax, 24(%rsp)")
+        self.emit("movq %r15, %rdi")
+        self.emit("call vyl_http_finish")
+        self.emit("jmp vyl_http_dl_close")
+        self.emit("vyl_http_dl_abort:")
+        self.emit("movq $0, 72(%r15)")  # never pool a half-read response
+        self.emit("movq %r15, %rdi")
+        self.emit("call vyl_http_finish")
+        self.emit("vyl_http_dl_close:")
+        self.emit("movl %r14d, %edi")
+        self.emit("call close")
+        self.emit("vyl_http_dl_free:")
+        self.emit("movq (%rsp), %rdi")
+        self.emit("call free")
+        self.emit("movq 8(%rsp), %rdi")
+        self.emit("call free")
+        self.emit("movq 24(%rsp), %rax")
+        self.emit("addq $40, %rsp")
+        self.emit("pop %r15")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+    def generate_task_runtime(self):
+        """Emit the M:N scheduler behind async/await and spawn.
+
+        Every task gets its own stack (an mmap with a guard page below, the
+        TASK_SIZE record on top). Each OS thread is a worker with its own run
+        queue and a scheduler context (vyl_sched_ctx) that a task switches to
+        when it waits: for another task, a channel, a socket, or in Yield. The
+        scheduler finishes whatever the task asked for on the way out (release
+        a lock, requeue it, arm its socket) once the task is off its stack,
+        then runs the next task from its own queue, steals half of another
+        worker's queue, polls the shared epoll fd, or sleeps on a futex. Main
+        runs on the process stack as the root task; the other workers only
+        start with the first spawn, so async/await alone stays on one thread.
+        """
+        cache = TASK_STACK_CACHE
+        below = TASK_STACK_SIZE - TASK_SIZE  # stack base to record
+        current = self.tls("vyl_task_current")
+        worker = self.tls("vyl_worker_self")
+        busy = self.tls("vyl_gc_busy")
+
+        self.emit(".section .data")
+        self.emit("vyl_epoll_fd: .quad -1")
+        self.emit("vyl_nworkers: .quad 1")
+        self.emit("vyl_runnable: .quad 1")  # tasks queued or running; Main runs
+        self.emit(".section .bss")
+        self.emit(".balign 64")
+        self.emit(f"vyl_workers: .zero {WORKER_SIZE * SCHED_MAX_WORKERS}")
+        self.emit(f"vyl_task_root: .zero {TASK_SIZE}")
+        self.emit("vyl_task_all: .zero 8")
+        self.emit("vyl_task_free: .zero 8")
+        self.emit("vyl_task_cached: .zero 8")
+        self.emit("vyl_task_lock: .zero 8")  # the two lists above
+        self.emit("vyl_sched_started: .zero 8")
+        self.emit("vyl_workers_ready: .zero 8")
+        self.emit(".balign 64")
+        self.emit("vyl_idle: .zero 8")  # workers asleep or about to be
+        self.emit("vyl_idle_seq: .zero 8")  # futex they sleep on
+        self.emit("vyl_io_waiting: .zero 8")
+        self.emit("vyl_poll_owner: .zero 8")  # the one worker in epoll_wait
+        self.emit(f"vyl_epoll_events: .zero {EPOLL_BATCH * EPOLL_EVENT_SIZE}")
+        self.emit(".section .tdata,\"awT\",@progbits")
+        self.emit(".balign 8")
+        self.emit("vyl_task_current: .quad vyl_task_root")
+        self.emit("vyl_worker_self: .quad vyl_workers")
+        self.emit(".section .tbss,\"awT\",@nobits")
+        self.emit(".balign 8")
+        self.emit("vyl_sched_ctx: .zero 8")  # saved rsp of this thread's scheduler
+        # what the scheduler does for the task that just switched to it
+        self.emit("vyl_park_task: .zero 8")
+        self.emit("vyl_park_unlock: .zero 8")
+        self.emit("vyl_park_requeue: .zero 8")
+        self.emit("vyl_park_fd: .zero 8")
+        self.emit("vyl_park_events: .zero 8")
+        self.emit("vyl_park_zombie: .zero 8")
+        deadlock = "vyl: deadlock, every task is waiting\n"
+        nomem = "vyl: out of memory for task stacks\n"
+        self.emit(".section .rodata")
+        self.emit(f".task_deadlock: .ascii \"{self.escape_string(deadlock)}\"")
+        self.emit(f".task_nomem: .ascii \"{self.escape_string(nomem)}\"")
+        self.emit(".task_threads_env: .asciz \"VYL_THREADS\"")
+        self.emit(".section .text")
+
+        # vyl_sched_boot: Main's thread is worker 0
+        self.emit(".globl vyl_sched_boot")
+        self.emit("vyl_sched_boot:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self._emit_tls_address("vyl_gc_free_lists", "%rax")
+        self.emit("movq %rax, vyl_workers+40(%rip)")
+        self.emit("call pthread_self")
+        self.emit("movq %rax, vyl_workers+32(%rip)")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_task_go(rdi..r9=args, rax=entry) -> task: spawn, starting the
+        # workers the first time
+        self.emit(".globl vyl_task_go")
+        self.emit("vyl_task_go:")
+        self.emit("cmpq $0, vyl_sched_started(%rip)")
+        self.emit("jne vyl_task_spawn")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        for reg in ("%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9", "%rax"):
+            self.emit(f"push {reg}")
+        self.emit("subq $8, %rsp")
+        self.emit("call vyl_sched_start")
+        self.emit("addq $8, %rsp")
+        for reg in ("%rax", "%r9", "%r8", "%rcx", "%rdx", "%rsi", "%rdi"):
+            self.emit(f"pop {reg}")
+        self.emit("leave")
+        self.emit("jmp vyl_task_spawn")
+
+        # vyl_sched_start: one worker per CPU (or VYL_THREADS). Holds the
+        # collector lock, so no collection runs while the set changes.
+        self.emit("vyl_sched_start:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $168, %rsp")  # struct sigaction
+        self.emit("vyl_sched_start_lock:")
+        self.emit("movl $1, %eax")
+        self.emit("xchgq %rax, vyl_gc_lock(%rip)")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_sched_start_locked")
+        self.emit("pause")
+        self.emit("jmp vyl_sched_start_lock")
+        self.emit("vyl_sched_start_locked:")
+        self.emit("cmpq $0, vyl_sched_started(%rip)")
+        self.emit("jne vyl_sched_start_done")
+        self.emit("cmpq $0, vyl_heap_ready(%rip)")
+        self.emit("jne vyl_sched_start_count")
+        self.emit("call vyl_gc_init")
+        self.emit("vyl_sched_start_count:")
+        self.emit("leaq .task_threads_env(%rip), %rdi")
+        self.emit("call getenv")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_sched_start_cpus")
+        self.emit("movq %rax, %rdi")
+        self.emit("call atol")
+        self.emit("movq %rax, %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jg vyl_sched_start_clamp")
+        self.emit("vyl_sched_start_cpus:")
+        self.emit("movl $84, %edi")  # _SC_NPROCESSORS_ONLN
+        self.emit("call sysconf")
+        self.emit("movq %rax, %rbx")
+        self.emit("vyl_sched_start_clamp:")
+        self.emit("cmpq $1, %rbx")
+        self.emit("jge vyl_sched_start_max")
+        self.emit("movl $1, %ebx")
+        self.emit("vyl_sched_start_max:")
+        self.emit(f"cmpq ${SCHED_MAX_WORKERS}, %rbx")
+        self.emit("jle vyl_sched_start_signal")
+        self.emit(f"movl ${SCHED_MAX_WORKERS}, %ebx")
+        self.emit("vyl_sched_start_signal:")
+        self.emit("movq %rsp, %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit("movl $160, %edx")
+        self.emit("call memset")
+        self.emit("leaq vyl_gc_signal(%rip), %rax")
+        self.emit("movq %rax, (%rsp)")
+        self.emit("movl $0x10000000, 136(%rsp)")  # SA_RESTART
+        self.emit(f"movl ${GC_STOP_SIGNAL}, %edi")
+        self.emit("movq %rsp, %rsi")
+        self.emit("xorl %edx, %edx")
+        self.emit("call sigaction")
+        self.emit("movl $1, %r12d")
+        self.emit("vyl_sched_start_thread:")
+        self.emit("cmpq %rbx, %r12")
+        self.emit("jae vyl_sched_start_wait")
+        self.emit("movq %r12, %r13")
+        self.emit(f"imulq ${WORKER_SIZE}, %r13")
+        self.emit("leaq vyl_workers(%rip), %rax")
+        self.emit("addq %rax, %r13")
+        self.emit("movq %r12, 64(%r13)")
+        self.emit("leaq 32(%r13), %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit("leaq vyl_worker_main(%rip), %rdx")
+        self.emit("movq %r13, %rcx")
+        self.emit("call pthread_create")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_sched_start_short")
+        self.emit("incq %r12")
+        self.emit("jmp vyl_sched_start_thread")
+        self.emit("vyl_sched_start_short:")
+        self.emit("movq %r12, %rbx")  # run with the threads we got
+        self.emit("vyl_sched_start_wait:")
+        self.emit("leaq -1(%rbx), %rax")
+        self.emit("cmpq %rax, vyl_workers_ready(%rip)")
+        self.emit("jae vyl_sched_start_publish")
+        self.emit("call sched_yield")
+        self.emit("jmp vyl_sched_start_wait")
+        self.emit("vyl_sched_start_publish:")
+        self.emit("movq %rbx, vyl_nworkers(%rip)")
+        self.emit("movq $1, vyl_sched_started(%rip)")
+        self.emit("vyl_sched_start_done:")
+        self.emit("movq $0, vyl_gc_lock(%rip)")
+        self.emit("addq $168, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_worker_main(rdi=worker): a new thread goes straight to scheduling
+        self.emit("vyl_worker_main:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit(f"movq %rdi, {worker}")
+        self._emit_tls_address("vyl_sched_ctx", "%rax")
+        self.emit(f"movq %rax, {current}")
+        self._emit_tls_address("vyl_gc_free_lists", "%rax")
+        self.emit("movq %rax, 40(%rdi)")
+        self.emit("lock incq vyl_workers_ready(%rip)")
+        self.emit(f"incq {busy}")  # as if a task had just switched here
+        self.emit("jmp vyl_sched_loop")
+
+        # vyl_task_spawn(rdi..r9=args, rax=entry) -> task; queued, not yet running
+        self.emit(".globl vyl_task_spawn")
+        self.emit("vyl_task_spawn:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        for reg in ("%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9", "%rax", "%rbx"):
+            self.emit(f"push {reg}")
+        self.emit("andq $-16, %rsp")
+        self._emit_spin_lock("vyl_task_lock(%rip)")
+        self.emit("movq vyl_task_free(%rip), %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_task_spawn_map")
+        self.emit("movq 40(%rbx), %rax")
+        self.emit("movq %rax, vyl_task_free(%rip)")
+        self.emit("decq vyl_task_cached(%rip)")
+        self._emit_spin_unlock("vyl_task_lock(%rip)")
+        self.emit("movq %rbx, %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit(f"movl ${TASK_SIZE}, %edx")
+        self.emit("call memset")
+        self.emit("jmp vyl_task_spawn_init")
+        self.emit("vyl_task_spawn_map:")
+        self._emit_spin_unlock("vyl_task_lock(%rip)")
+        self.emit("xorl %edi, %edi")
+        self.emit(f"movl ${TASK_STACK_SIZE}, %esi")
+        self.emit("movl $3, %edx")  # PROT_READ | PROT_WRITE
+        self.emit(f"movl ${TASK_MMAP_FLAGS}, %ecx")
+        self.emit("movq $-1, %r8")
+        self.emit("xorl %r9d, %r9d")
+        self.emit("call mmap")
+        self.emit("cmpq $-1, %rax")
+        self.emit("je vyl_task_nomem")
+        self.emit("movq %rax, %rbx")
+        self.emit("movq %rax, %rdi")
+        self.emit(f"movl ${PAGE_SIZE}, %esi")
+        self.emit("xorl %edx, %edx")  # an overflow faults instead of corrupting memory
+        self.emit("call mprotect")
+        self.emit(f"addq ${below}, %rbx")
+        self.emit("vyl_task_spawn_init:")
+        self.emit("movq -56(%rbp), %rax")
+        self.emit("movq %rax, 64(%rbx)")
+        for index in range(6):
+            self.emit(f"movq {-8 - index * 8}(%rbp), %rax")
+            self.emit(f"movq %rax, {72 + index * 8}(%rbx)")
+        # The first switch pops six zeroed registers and returns into the entry
+        for offset in range(-64, -16, 8):
+            self.emit(f"movq $0, {offset}(%rbx)")
+        self.emit("leaq vyl_task_entry(%rip), %rax")
+        self.emit("movq %rax, -16(%rbx)")
+        self.emit("leaq -64(%rbx), %rax")
+        self.emit("movq %rax, (%rbx)")
+        self._emit_spin_lock("vyl_task_lock(%rip)")
+        self.emit("movq vyl_task_all(%rip), %rax")
+        self.emit("movq %rax, 48(%rbx)")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_task_spawn_link")
+        self.emit("movq %rbx, 56(%rax)")
+        self.emit("vyl_task_spawn_link:")
+        self.emit("movq %rbx, vyl_task_all(%rip)")
+        self._emit_spin_unlock("vyl_task_lock(%rip)")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_task_ready")
+        self.emit("movq %rbx, %rax")
+        self.emit("movq -64(%rbp), %rbx")
+        self.emit("leave")
+        self.emit("ret")
+        self.emit("vyl_task_nomem:")
+        self.emit("leaq .task_nomem(%rip), %rsi")
+        self.emit(f"movl ${len(nomem)}, %edx")
+        self.emit("jmp vyl_task_die")
+
+        # vyl_task_entry: first code on a new stack; runs the function, then
+        # parks for good. The scheduler releases the record lock only once
+        # this stack is idle, so an awaiter never frees it from under us.
+        self.emit("vyl_task_entry:")
+        self._emit_safepoint()  # the switch here happened inside a busy region
+        self.emit("subq $8, %rsp")
+        self.emit(f"movq {current}, %rax")
+        self.emit("movq 72(%rax), %rdi")
+        self.emit("movq 80(%rax), %rsi")
+        self.emit("movq 88(%rax), %rdx")
+        self.emit("movq 96(%rax), %rcx")
+        self.emit("movq 104(%rax), %r8")
+        self.emit("movq 112(%rax), %r9")
+        self.emit("call *64(%rax)")
+        self.emit(f"movq {current}, %rbx")
+        self.emit("movq %rax, 24(%rbx)")
+        self._emit_spin_lock("120(%rbx)")
+        self.emit("movq $1, 8(%rbx)")
+        self.emit("movq 32(%rbx), %rdi")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_task_entry_done")
+        self.emit("call vyl_task_ready")
+        self.emit("vyl_task_entry_done:")
+        self.emit("cmpq $0, 16(%rbx)")
+        self.emit("je vyl_task_entry_park")
+        self.emit(f"movq %rbx, {self.tls('vyl_park_zombie')}")  # nobody awaits it: free it
+        self.emit("vyl_task_entry_park:")
+        self.emit("leaq 120(%rbx), %rax")
+        self.emit(f"movq %rax, {self.tls('vyl_park_unlock')}")
+        self.emit("call vyl_task_park")
+        self.emit("ud2")
+
+        # vyl_task_ready(rdi=task): append to this worker's run queue
+        self.emit(".globl vyl_task_ready")
+        self.emit("vyl_task_ready:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("lock incq vyl_runnable(%rip)")
+        self.emit("movq $0, 40(%rdi)")
+        self.emit(f"movq {worker}, %rbx")
+        self._emit_spin_lock("(%rbx)")
+        self.emit("movq 16(%rbx), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_task_ready_first")
+        self.emit("movq %rdi, 40(%rax)")
+        self.emit("jmp vyl_task_ready_tail")
+        self.emit("vyl_task_ready_first:")
+        self.emit("movq %rdi, 8(%rbx)")
+        self.emit("vyl_task_ready_tail:")
+        self.emit("movq %rdi, 16(%rbx)")
+        self.emit("incq 24(%rbx)")
+        self._emit_spin_unlock("(%rbx)")
+        self.emit("call vyl_sched_notify")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_sched_notify: wake one sleeping worker, if any, to look for work
+        self.emit("vyl_sched_notify:")
+        self.emit("mfence")  # order the new work before the idle check
+        self.emit("cmpq $0, vyl_idle(%rip)")
+        self.emit("je vyl_sched_notify_ret")
+        self.emit("lock incq vyl_idle_seq(%rip)")
+        self.emit("movl $202, %eax")  # futex
+        self.emit("leaq vyl_idle_seq(%rip), %rdi")
+        self.emit("movl $129, %esi")  # FUTEX_WAKE_PRIVATE
+        self.emit("movl $1, %edx")
+        self.emit("syscall")
+        self.emit("vyl_sched_notify_ret:")
+        self.emit("ret")
+
+        # vyl_task_switch(rdi=from, rsi=to): save the callee-saved registers on
+        # this stack, then resume the other context where it last switched
+        # away. A saved rsp of 0 marks the context that is running.
+        self.emit("vyl_task_switch:")
+        for reg in ("%rbp", "%rbx", "%r12", "%r13", "%r14", "%r15"):
+            self.emit(f"push {reg}")
+        self.emit("movq %rsp, (%rdi)")
+        self.emit(f"movq %rsi, {current}")
+        self.emit("movq (%rsi), %rsp")
+        self.emit("movq $0, (%rsi)")
+        for reg in ("%r15", "%r14", "%r13", "%r12", "%rbx", "%rbp"):
+            self.emit(f"pop {reg}")
+        self.emit("ret")
+
+        # vyl_task_park: switch to this thread's scheduler; returns once some
+        # worker resumes the task. The vyl_park_* requests are set beforehand.
+        self.emit(".globl vyl_task_park")
+        self.emit("vyl_task_park:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit(f"movq {current}, %rdi")
+        self.emit(f"movq %rdi, {self.tls('vyl_park_task')}")
+        self._emit_tls_address("vyl_sched_ctx", "%rsi")
+        self.emit("cmpq $0, (%rsi)")
+        self.emit("jne vyl_task_park_switch")
+        self.emit("call vyl_sched_stack")  # Main's thread, first time
+        self.emit(f"movq {current}, %rdi")
+        self._emit_tls_address("vyl_sched_ctx", "%rsi")
+        self.emit("vyl_task_park_switch:")
+        self.emit(f"incq {busy}")
+        self.emit("call vyl_task_switch")
+        self._emit_safepoint()
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_sched_stack: give Main's thread a scheduler context of its own
+        self.emit("vyl_sched_stack:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("xorl %edi, %edi")
+        self.emit(f"movl ${SCHED_STACK_SIZE}, %esi")
+        self.emit("movl $3, %edx")
+        self.emit(f"movl ${TASK_MMAP_FLAGS}, %ecx")
+        self.emit("movq $-1, %r8")
+        self.emit("xorl %r9d, %r9d")
+        self.emit("call mmap")
+        self.emit("cmpq $-1, %rax")
+        self.emit("je vyl_task_nomem")
+        self.emit(f"addq ${SCHED_STACK_SIZE - 64}, %rax")
+        for offset in range(0, 48, 8):
+            self.emit(f"movq $0, {offset}(%rax)")
+        self.emit("leaq vyl_sched_entry(%rip), %rcx")
+        self.emit("movq %rcx, 48(%rax)")
+        self.emit(f"movq %rax, {self.tls('vyl_sched_ctx')}")
+        self.emit("leave")
+        self.emit("ret")
+        self.emit("vyl_sched_entry:")
+        self.emit("subq $8, %rsp")  # as in vyl_task_entry
+
+        # vyl_sched_loop: the scheduler context of a worker, never returns
+        self.emit("vyl_sched_loop:")
+        self.emit("call vyl_sched_after")
+        self._emit_safepoint()
+        self.emit("call vyl_sched_find")
+        self.emit(f"incq {busy}")
+        self._emit_tls_address("vyl_sched_ctx", "%rdi")
+        self.emit("movq %rax, %rsi")
+        self.emit("call vyl_task_switch")
+        self.emit("jmp vyl_sched_loop")
+
+        # vyl_sched_after: carry out the parked task's requests
+        self.emit("vyl_sched_after:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit(f"movq {self.tls('vyl_park_task')}, %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_sched_after_ret")
+        self.emit(f"movq $0, {self.tls('vyl_park_task')}")
+        self.emit(f"movq {self.tls('vyl_park_unlock')}, %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_sched_after_requeue")
+        self.emit(f"movq $0, {self.tls('vyl_park_unlock')}")
+        self.emit("movq $0, (%rax)")
+        self.emit(f"decq {busy}")  # the lock's region; the loop's safepoint follows
+        self.emit("vyl_sched_after_requeue:")
+        self.emit(f"movq {self.tls('vyl_park_requeue')}, %rdi")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_sched_after_io")
+        self.emit(f"movq $0, {self.tls('vyl_park_requeue')}")
+        self.emit("call vyl_task_ready")
+        self.emit("vyl_sched_after_io:")
+        self.emit(f"movq {self.tls('vyl_park_events')}, %rsi")
+        self.emit("testq %rsi, %rsi")
+        self.emit("jz vyl_sched_after_zombie")
+        self.emit(f"movq $0, {self.tls('vyl_park_events')}")
+        self.emit(f"movq {self.tls('vyl_park_fd')}, %rdi")
+        self.emit("movq %rbx, %rdx")
+        self.emit("call vyl_io_arm")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_sched_after_zombie")
+        self.emit("movq $-1, 128(%rbx)")  # cannot be polled: resume it with the error
+        self.emit("lock decq vyl_io_waiting(%rip)")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_task_ready")
+        self.emit("vyl_sched_after_zombie:")
+        self.emit(f"movq {self.tls('vyl_park_zombie')}, %rdi")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_sched_after_count")
+        self.emit(f"movq $0, {self.tls('vyl_park_zombie')}")
+        self.emit("call vyl_task_release")
+        self.emit("vyl_sched_after_count:")
+        self.emit("lock decq vyl_runnable(%rip)")
+        self.emit("vyl_sched_after_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_sched_find -> the next task to run: this worker's queue, then
+        # the others', then sockets; sleeps until one of those has something
+        self.emit("vyl_sched_find:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("vyl_sched_find_again:")
+        self.emit("call vyl_sched_take")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_sched_find_ret")
+        self.emit("cmpq $0, vyl_io_waiting(%rip)")
+        self.emit("je vyl_sched_find_sleep")
+        self.emit("movl $1, %eax")
+        self.emit("xchgq %rax, vyl_poll_owner(%rip)")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_sched_find_sleep")
+        self.emit("movl vyl_epoll_fd(%rip), %edi")
+        self.emit("leaq vyl_epoll_events(%rip), %rsi")
+        self.emit(f"movl ${EPOLL_BATCH}, %edx")
+        self.emit("movl $-1, %ecx")
+        self.emit("call epoll_wait")
+        self.emit("movl %eax, %ebx")
+        self.emit("leaq vyl_epoll_events(%rip), %r12")
+        self.emit("vyl_sched_find_event:")
+        self.emit("testl %ebx, %ebx")
+        self.emit("jle vyl_sched_find_polled")  # none left, or EINTR
+        self.emit("movq 4(%r12), %rdi")  # epoll_data: the waiting task
+        self.emit("call vyl_task_ready")
+        self.emit("lock decq vyl_io_waiting(%rip)")
+        self.emit(f"addq ${EPOLL_EVENT_SIZE}, %r12")
+        self.emit("decl %ebx")
+        self.emit("jmp vyl_sched_find_event")
+        self.emit("vyl_sched_find_polled:")
+        self.emit("movq $0, vyl_poll_owner(%rip)")
+        self.emit("jmp vyl_sched_find_again")
+        # Sleep. Announce it first and look again, so a task readied in
+        # between either is found here or wakes us (vyl_sched_notify).
+        self.emit("vyl_sched_find_sleep:")
+        self.emit("movl vyl_idle_seq(%rip), %r12d")
+        self.emit("lock incq vyl_idle(%rip)")
+        self.emit("call vyl_sched_take")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_sched_find_woken")
+        self.emit("cmpq $0, vyl_runnable(%rip)")
+        self.emit("jne vyl_sched_find_wait")
+        self.emit("cmpq $0, vyl_io_waiting(%rip)")
+        self.emit("je vyl_task_deadlock")
+        self.emit("vyl_sched_find_wait:")
+        self.emit("cmpq $0, vyl_io_waiting(%rip)")
+        self.emit("je vyl_sched_find_futex")
+        self.emit("cmpq $0, vyl_poll_owner(%rip)")
+        self.emit("je vyl_sched_find_woken")  # nobody polls: take it over
+        self.emit("vyl_sched_find_futex:")
+        self.emit("movl $202, %eax")  # futex
+        self.emit("leaq vyl_idle_seq(%rip), %rdi")
+        self.emit("movl $128, %esi")  # FUTEX_WAIT_PRIVATE
+        self.emit("movl %r12d, %edx")
+        self.emit("xorl %r10d, %r10d")
+        self.emit("syscall")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_sched_find_woken:")
+        self.emit("lock decq vyl_idle(%rip)")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_sched_find_again")
+        self.emit("vyl_sched_find_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_sched_take -> a task from this worker's queue, else half of the
+        # first non-empty queue after it (the rest go on this one), else 0
+        self.emit("vyl_sched_take:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit(f"movq {worker}, %rbx")
+        self.emit("cmpq $0, 24(%rbx)")
+        self.emit("je vyl_sched_take_steal")
+        self._emit_spin_lock("(%rbx)")
+        self.emit("movq 8(%rbx), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_sched_take_empty")
+        self.emit("movq 40(%rax), %rcx")
+        self.emit("movq %rcx, 8(%rbx)")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jnz vyl_sched_take_count")
+        self.emit("movq $0, 16(%rbx)")
+        self.emit("vyl_sched_take_count:")
+        self.emit("decq 24(%rbx)")
+        self._emit_spin_unlock("(%rbx)")
+        self.emit("jmp vyl_sched_take_ret")
+        self.emit("vyl_sched_take_empty:")
+        self._emit_spin_unlock("(%rbx)")
+        self.emit("vyl_sched_take_steal:")
+        self.emit("movl $1, %r13d")
+        self.emit("vyl_sched_take_victim:")
+        self.emit("xorl %eax, %eax")
+        self.emit("cmpq vyl_nworkers(%rip), %r13")
+        self.emit("jae vyl_sched_take_ret")
+        self.emit("movq 64(%rbx), %r14")
+        self.emit("addq %r13, %r14")
+        self.emit("incq %r13")
+        self.emit("cmpq vyl_nworkers(%rip), %r14")
+        self.emit("jb vyl_sched_take_index")
+        self.emit("subq vyl_nworkers(%rip), %r14")
+        self.emit("vyl_sched_take_index:")
+        self.emit(f"imulq ${WORKER_SIZE}, %r14")
+        self.emit("leaq vyl_workers(%rip), %rax")
+        self.emit("addq %rax, %r14")
+        self.emit("cmpq $0, 24(%r14)")
+        self.emit("je vyl_sched_take_victim")
+        self._emit_spin_lock("(%r14)")
+        self.emit("movq 24(%r14), %r12")
+        self.emit("testq %r12, %r12")
+        self.emit("jz vyl_sched_take_missed")
+        self.emit("incq %r12")
+        self.emit("shrq $1, %r12")  # take the older half, rounded up
+        self.emit("subq %r12, 24(%r14)")
+        self.emit("movq 8(%r14), %rax")
+        self.emit("movq %rax, %rdx")
+        self.emit("movq %r12, %rcx")
+        self.emit("vyl_sched_take_walk:")
+        self.emit("decq %rcx")
+        self.emit("jz vyl_sched_take_cut")
+        self.emit("movq 40(%rdx), %rdx")
+        self.emit("jmp vyl_sched_take_walk")
+        self.emit("vyl_sched_take_cut:")
+        self.emit("movq 40(%rdx), %rcx")
+        self.emit("movq %rcx, 8(%r14)")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jnz vyl_sched_take_split")
+        self.emit("movq $0, 16(%r14)")
+        self.emit("vyl_sched_take_split:")
+        self.emit("movq $0, 40(%rdx)")
+        self._emit_spin_unlock("(%r14)")
+        # the first one runs now; only this worker fills its own queue, so
+        # it is still empty for the rest
+        self.emit("decq %r12")
+        self.emit("jz vyl_sched_take_ret")
+        self.emit("movq %rax, %r13")
+        self._emit_spin_lock("(%rbx)")
+        self.emit("movq 40(%r13), %rcx")
+        self.emit("movq %rcx, 8(%rbx)")
+        self.emit("movq %rdx, 16(%rbx)")
+        self.emit("movq %r12, 24(%rbx)")
+        self._emit_spin_unlock("(%rbx)")
+        self.emit("movq %r13, %rax")
+        self.emit("jmp vyl_sched_take_ret")
+        self.emit("vyl_sched_take_missed:")
+        self._emit_spin_unlock("(%r14)")
+        self.emit("jmp vyl_sched_take_victim")
+        self.emit("vyl_sched_take_ret:")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit("vyl_task_deadlock:")
+        self.emit("leaq .task_deadlock(%rip), %rsi")
+        self.emit(f"movl ${len(deadlock)}, %edx")
+        self.emit("vyl_task_die:")  # rsi=message, rdx=length
+        self.emit("andq $-16, %rsp")
+        self.emit("push %rsi")
+        self.emit("push %rdx")
+        self.emit("call vyl_flush_all")
+        self.emit("movl $2, %edi")
+        self.emit("pop %rdx")
+        self.emit("pop %rsi")
+        self.emit("call write")
+        self.emit("movq $1, %rdi")
+        self.emit("movq $231, %rax")  # exit_group
+        self.emit("syscall")
+
+        # vyl_task_release(rdi=task): unlink it and keep or unmap its stack
+        self.emit("vyl_task_release:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("andq $-16, %rsp")
+        self._emit_spin_lock("vyl_task_lock(%rip)")
+        self.emit("movq 48(%rdi), %rax")
+        self.emit("movq 56(%rdi), %rcx")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jz vyl_task_release_head")
+        self.emit("movq %rax, 48(%rcx)")
+        self.emit("jmp vyl_task_release_next")
+        self.emit("vyl_task_release_head:")
+        self.emit("movq %rax, vyl_task_all(%rip)")
+        self.emit("vyl_task_release_next:")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_task_release_keep")
+        self.emit("movq %rcx, 56(%rax)")
+        self.emit("vyl_task_release_keep:")
+        self.emit(f"cmpq ${cache}, vyl_task_cached(%rip)")
+        self.emit("jae vyl_task_release_unmap")
+        self.emit("movq vyl_task_free(%rip), %rax")
+        self.emit("movq %rax, 40(%rdi)")
+        self.emit("movq %rdi, vyl_task_free(%rip)")
+        self.emit("incq vyl_task_cached(%rip)")
+        self._emit_spin_unlock("vyl_task_lock(%rip)")
+        self.emit("leave")
+        self.emit("ret")
+        self.emit("vyl_task_release_unmap:")
+        self._emit_spin_unlock("vyl_task_lock(%rip)")
+        self.emit(f"subq ${below}, %rdi")
+        self.emit(f"movl ${TASK_STACK_SIZE}, %esi")
+        self.emit("call munmap")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_task_await(rdi=task) -> its result; the handle is spent afterwards
+        self.emit(".globl vyl_task_await")
+        self.emit("vyl_task_await:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
+        self.emit("xorl %r12d, %r12d")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_task_await_ret")
+        self.emit("vyl_task_await_check:")
+        self._emit_spin_lock("120(%rbx)")
+        self.emit("cmpq $0, 8(%rbx)")
+        self.emit("jne vyl_task_await_done")
+        self.emit(f"movq {current}, %rax")
+        self.emit("movq %rax, 32(%rbx)")
+        self.emit("leaq 120(%rbx), %rax")
+        self.emit(f"movq %rax, {self.tls('vyl_park_unlock')}")
+        self.emit("call vyl_task_park")
+        self.emit("jmp vyl_task_await_check")
+        self.emit("vyl_task_await_done:")
+        self._emit_spin_unlock("120(%rbx)")
+        self.emit("movq 24(%rbx), %r12")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_task_release")
+        self.emit("vyl_task_await_ret:")
+        self.emit("movq %r12, %rax")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_task_detach(rdi=task): nobody will await it; free it once done
+        self.emit(".globl vyl_task_detach")
+        self.emit("vyl_task_detach:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self._emit_spin_lock("120(%rbx)")
+        self.emit("cmpq $0, 8(%rbx)")
+        self.emit("jne vyl_task_detach_done")
+        self.emit("movq $1, 16(%rbx)")
+        self._emit_spin_unlock("120(%rbx)")
+        self.emit("jmp vyl_task_detach_ret")
+        self.emit("vyl_task_detach_done:")
+        self._emit_spin_unlock("120(%rbx)")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_task_release")
+        self.emit("vyl_task_detach_ret:")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_task_yield: go to the back of the run queue
+        self.emit(".globl vyl_task_yield")
+        self.emit("vyl_task_yield:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit(f"movq {current}, %rax")
+        self.emit(f"movq %rax, {self.tls('vyl_park_requeue')}")
+        self.emit("call vyl_task_park")
+        self.emit("xorl %eax, %eax")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_loop_init -> epoll fd; also lifts the open-file limit to its
+        # hard maximum, since every connection a task waits on is a descriptor.
+        # Of two workers racing here, the loser closes its fd.
+        self.emit("vyl_loop_init:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $24, %rsp")
+        self.emit("movq vyl_epoll_fd(%rip), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jns vyl_loop_init_ret")
+        self.emit("movl $7, %edi")  # RLIMIT_NOFILE
+        self.emit("movq %rsp, %rsi")
+        self.emit("call getrlimit")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_loop_init_epoll")
+        self.emit("movq 8(%rsp), %rax")
+        self.emit("movq %rax, (%rsp)")
+        self.emit("movl $7, %edi")
+        self.emit("movq %rsp, %rsi")
+        self.emit("call setrlimit")
+        self.emit("vyl_loop_init_epoll:")
+        self.emit("movl $0x80000, %edi")  # EPOLL_CLOEXEC
+        self.emit("call epoll_create1")
+        self.emit("movslq %eax, %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("js vyl_loop_init_done")
+        self.emit("movq $-1, %rax")
+        self.emit("lock cmpxchgq %rbx, vyl_epoll_fd(%rip)")
+        self.emit("je vyl_loop_init_done")
+        self.emit("movq %rax, 8(%rsp)")
+        self.emit("movl %ebx, %edi")
+        self.emit("call close")
+        self.emit("movq 8(%rsp), %rbx")
+        self.emit("vyl_loop_init_done:")
+        self.emit("movq %rbx, %rax")
+        self.emit("vyl_loop_init_ret:")
+        self.emit("movq -8(%rbp), %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_io_wait(rdi=fd, rsi=events) -> 0 once the fd is ready, -1 if it
+        # cannot be polled. The scheduler arms the fd after the task is off
+        # its stack, so the worker that sees the event can resume it at once.
+        self.emit(".globl vyl_io_wait")
+        self.emit("vyl_io_wait:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movl %edi, %ebx")
+        self.emit("movl %esi, %r12d")
+        self.emit("orl $0x40000000, %r12d")  # EPOLLONESHOT
+        self.emit("cmpq $0, vyl_epoll_fd(%rip)")
+        self.emit("jge vyl_io_wait_park")
+        self.emit("call vyl_loop_init")
+        self.emit("testq %rax, %rax")
+        self.emit("js vyl_io_wait_fail")
+        self.emit("vyl_io_wait_park:")
+        self.emit(f"movq %rbx, {self.tls('vyl_park_fd')}")
+        self.emit(f"movq %r12, {self.tls('vyl_park_events')}")
+        self.emit("lock incq vyl_io_waiting(%rip)")
+        self.emit("call vyl_sched_notify")  # an idle worker can take over polling
+        self.emit("call vyl_task_park")
+        self.emit(f"movq {current}, %rax")
+        self.emit("movq 128(%rax), %rax")
+        self.emit("jmp vyl_io_wait_ret")
+        self.emit("vyl_io_wait_fail:")
+        self.emit("movq $-1, %rax")
+        self.emit("vyl_io_wait_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_io_arm(rdi=fd, rsi=events, rdx=task) -> 0, or -1 if the fd cannot
+        # be polled. Registrations are one-shot, so a later wait on the same
+        # fd re-arms it with MOD and only a new fd costs an ADD.
+        self.emit("vyl_io_arm:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $24, %rsp")  # (%rsp) struct epoll_event
+        self.emit("movl %edi, %ebx")
+        self.emit("movl %esi, (%rsp)")
+        self.emit("movq %rdx, 4(%rsp)")
+        self.emit("movq $0, 128(%rdx)")
+        self.emit("movl vyl_epoll_fd(%rip), %edi")
+        self.emit("movl $3, %esi")  # EPOLL_CTL_MOD
+        self.emit("movl %ebx, %edx")
+        self.emit("movq %rsp, %rcx")
+        self.emit("call epoll_ctl")
+        self.emit("testl %eax, %eax")
+        self.emit("jz vyl_io_arm_ret")
+        self.emit("call __errno_location")
+        self.emit("cmpl $2, (%rax)")  # ENOENT: not registered yet
+        self.emit("jne vyl_io_arm_fail")
+        self.emit("movl vyl_epoll_fd(%rip), %edi")
+        self.emit("movl $1, %esi")  # EPOLL_CTL_ADD
+        self.emit("movl %ebx, %edx")
+        self.emit("movq %rsp, %rcx")
+        self.emit("call epoll_ctl")
+        self.emit("testl %eax, %eax")
+        self.emit("jz vyl_io_arm_ret")
+        self.emit("vyl_io_arm_fail:")
+        self.emit("movl $-1, %eax")
+        self.emit("vyl_io_arm_ret:")
+        self.emit("movslq %eax, %rax")
+        self.emit("movq -8(%rbp), %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # Non-blocking socket calls that park the task instead of failing with
+        # EAGAIN: rdi=fd, rsi=buf, rdx=len, rcx=flags, as for recv/send/accept4
+        self.emit(".globl vyl_sock_recv")
+        self.emit("vyl_sock_recv:")
+        self.emit("leaq recv(%rip), %r8")
+        self.emit("movl $1, %r9d")  # EPOLLIN
+        self.emit("jmp vyl_sock_io")
+        self.emit(".globl vyl_sock_send")
+        self.emit("vyl_sock_send:")
+        self.emit("leaq send(%rip), %r8")
+        self.emit("movl $4, %r9d")  # EPOLLOUT
+        self.emit("jmp vyl_sock_io")
+        self.emit(".globl vyl_sock_accept")
+        self.emit("vyl_sock_accept:")
+        self.emit("leaq vyl_accept4(%rip), %r8")
+        self.emit("movl $1, %r9d")
+        self.emit("jmp vyl_sock_io")
+        self.emit("vyl_accept4:")  # accept4 returns an int; widen it like recv's ssize_t
+        self.emit("subq $8, %rsp")
+        self.emit("call accept4")
+        self.emit("addq $8, %rsp")
+        self.emit("movslq %eax, %rax")
+        self.emit("ret")
+        self.emit("vyl_sock_io:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        for reg in ("%rbx", "%r12", "%r13", "%r14", "%r15"):
+            self.emit(f"push {reg}")
+        self.emit("subq $8, %rsp")
+        self.emit("andq $-16, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("movq %rcx, %r14")
+        self.emit("movq %r8, %r15")
+        self.emit("movl %r9d, (%rsp)")
+        self.emit("vyl_sock_io_try:")
+        self.emit("movl %ebx, %edi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("movl %r14d, %ecx")
+        self.emit("call *%r15")
+        self.emit("testq %rax, %rax")
+        self.emit("jns vyl_sock_io_ret")
+        self.emit("call __errno_location")
+        self.emit("movl (%rax), %eax")
+        self.emit("cmpl $4, %eax")  # EINTR
+        self.emit("je vyl_sock_io_try")
+        self.emit("cmpl $11, %eax")  # EAGAIN
+        self.emit("je vyl_sock_io_wait")
+        self.emit("cmpl $115, %eax")  # EINPROGRESS: a Fast Open SYN is still out
+        self.emit("jne vyl_sock_io_fail")
+        self.emit("vyl_sock_io_wait:")
+        self.emit("movl %ebx, %edi")
+        self.emit("movl (%rsp), %esi")
+        self.emit("call vyl_io_wait")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_sock_io_try")
+        self.emit("vyl_sock_io_fail:")
+        self.emit("movq $-1, %rax")
+        self.emit("vyl_sock_io_ret:")
+        self.emit("leaq -40(%rbp), %rsp")
+        for reg in ("%r15", "%r14", "%r13", "%r12", "%rbx"):
+            self.emit(f"pop {reg}")
+        self.emit("leave")
+        self.emit("ret")
 
-        # Send request
-        self.emit("movq -48(%rbp), %rax")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_send_plain")
+        # The same for OpenSSL, which reports a blocked socket through
+        # SSL_get_error: rdi=ssl, rsi=buf, rdx=len
+        self.emit(".globl vyl_ssl_read")
+        self.emit("vyl_ssl_read:")
+        self.emit("leaq SSL_read(%rip), %rcx")
+        self.emit("jmp vyl_ssl_io")
+        self.emit(".globl vyl_ssl_write")
+        self.emit("vyl_ssl_write:")
+        self.emit("leaq SSL_write(%rip), %rcx")
+        self.emit("jmp vyl_ssl_io")
+        self.emit(".globl vyl_ssl_handshake")
+        self.emit("vyl_ssl_handshake:")
+        self.emit("leaq SSL_connect(%rip), %rcx")
+        self.emit("vyl_ssl_io:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        for reg in ("%rbx", "%r12", "%r13", "%r14", "%r15"):
+            self.emit(f"push {reg}")
+        self.emit("subq $8, %rsp")
+        self.emit("andq $-16, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("movq %rcx, %r14")
+        self.emit("vyl_ssl_io_try:")
         self.emit("movq %rbx, %rdi")
-        self.emit("movq %r13, %rsi")
-        self.emit("call vyl_tls_send")
-        self.emit("jmp vyl_http_after_send")
-        self.emit("vyl_http_send_plain:")
+        self.emit("movq %r12, %rsi")
+        self.emit("movl %r13d, %edx")
+        self.emit("call *%r14")
+        self.emit("testl %eax, %eax")
+        self.emit("jg vyl_ssl_io_done")
         self.emit("movq %rbx, %rdi")
-        self.emit("movq %r13, %rsi")
-        self.emit("call vyl_tcp_send")
-        self.emit("vyl_http_after_send:")
+        self.emit("movl %eax, %esi")
+        self.emit("call SSL_get_error")
+        self.emit("movl $1, %r15d")
+        self.emit("cmpl $2, %eax")  # SSL_ERROR_WANT_READ
+        self.emit("je vyl_ssl_io_wait")
+        self.emit("cmpl $3, %eax")  # SSL_ERROR_WANT_WRITE
+        self.emit("jne vyl_ssl_io_fail")
+        self.emit("movl $4, %r15d")
+        self.emit("vyl_ssl_io_wait:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call SSL_get_fd")
+        self.emit("movl %eax, %edi")
+        self.emit("movl %r15d, %esi")
+        self.emit("call vyl_io_wait")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_ssl_io_try")
+        self.emit("vyl_ssl_io_fail:")
+        self.emit("movq $-1, %rax")
+        self.emit("jmp vyl_ssl_io_ret")
+        self.emit("vyl_ssl_io_done:")
+        self.emit("movslq %eax, %rax")
+        self.emit("vyl_ssl_io_ret:")
+        self.emit("leaq -40(%rbp), %rsp")
+        for reg in ("%r15", "%r14", "%r13", "%r12", "%rbx"):
+            self.emit(f"pop {reg}")
+        self.emit("leave")
+        self.emit("ret")
 
-        # Receive (single chunk up to 65535)
-        self.emit("movq $65535, %rsi")
-        self.emit("movq -48(%rbp), %rax")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_recv_plain")
+    def generate_chan_runtime(self):
+        """Emit the bounded channels behind Chan, ChanSend and ChanRecv.
+
+        The buffer is a ring of [sequence, value] cells: a sender claims the
+        next send position with cmpxchg once the cell's sequence says it is
+        free, writes the value and publishes it by advancing the sequence, and
+        a receiver does the mirror image, so neither side takes a lock while
+        the ring is neither full nor empty. Only a task that has to wait takes
+        the channel lock, queues a node on its own stack and parks; the other
+        side wakes one waiter after every successful send or receive.
+        """
+        hdr = CHAN_HEADER_SIZE
+
+        # vyl_chan_new(rdi=capacity) -> channel; capacity rounds up to a power of two
+        self.emit(".globl vyl_chan_new")
+        self.emit("vyl_chan_new:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit(f"movl ${CHAN_MIN_CAPACITY}, %ebx")
+        self.emit(f"cmpq ${CHAN_MIN_CAPACITY}, %rdi")
+        self.emit("jle vyl_chan_new_sized")
+        self.emit("decq %rdi")
+        self.emit("bsrq %rdi, %rcx")
+        self.emit("incl %ecx")
+        self.emit("movl $1, %ebx")
+        self.emit("shlq %cl, %rbx")
+        self.emit("vyl_chan_new_sized:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("shlq $4, %rdi")
+        self.emit(f"addq ${hdr}, %rdi")
+        self.emit("call vyl_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_chan_new_ret")
+        self.emit("movq %rbx, 0(%rax)")
+        self.emit("leaq -1(%rbx), %rcx")
+        self.emit("movq %rcx, 8(%rax)")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("vyl_chan_new_cell:")  # cell i starts with sequence i: free for send i
+        self.emit("movq %rcx, %rdx")
+        self.emit("shlq $4, %rdx")
+        self.emit(f"movq %rcx, {hdr}(%rax,%rdx)")
+        self.emit("incq %rcx")
+        self.emit("cmpq %rbx, %rcx")
+        self.emit("jb vyl_chan_new_cell")
+        self.emit("vyl_chan_new_ret:")
+        self.emit("movq -8(%rbp), %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_chan_try_send(rdi=chan, rsi=value) -> 1, or 0 when full. Leaf;
+        # clobbers rax, rcx, rdx.
+        self.emit("vyl_chan_try_send:")
+        self.emit("movq 64(%rdi), %rax")
+        self.emit("vyl_chan_try_send_cell:")
+        self.emit("movq %rax, %rcx")
+        self.emit("andq 8(%rdi), %rcx")
+        self.emit("shlq $4, %rcx")
+        self.emit(f"leaq {hdr}(%rdi,%rcx), %rcx")
+        self.emit("movq (%rcx), %rdx")
+        self.emit("subq %rax, %rdx")
+        self.emit("jz vyl_chan_try_send_claim")
+        self.emit("js vyl_chan_try_fail")  # the receiver has not freed it yet
+        self.emit("movq 64(%rdi), %rax")  # another sender got there first
+        self.emit("jmp vyl_chan_try_send_cell")
+        self.emit("vyl_chan_try_send_claim:")
+        self.emit("leaq 1(%rax), %rdx")
+        self.emit("lock cmpxchgq %rdx, 64(%rdi)")
+        self.emit("jne vyl_chan_try_send_cell")  # %rax = the position now
+        self.emit("movq %rsi, 8(%rcx)")
+        self.emit("xchgq %rdx, (%rcx)")  # publish; the fence orders the waiter check
+        self.emit("movl $1, %eax")
+        self.emit("ret")
+        self.emit("vyl_chan_try_fail:")
+        self.emit("xorl %eax, %eax")
+        self.emit("ret")
+
+        # vyl_chan_try_recv(rdi=chan) -> rax=1 and rdx=value, or rax=0 when
+        # empty. Leaf; clobbers rax, rcx, rdx, rsi.
+        self.emit("vyl_chan_try_recv:")
+        self.emit("movq 128(%rdi), %rax")
+        self.emit("vyl_chan_try_recv_cell:")
+        self.emit("movq %rax, %rcx")
+        self.emit("andq 8(%rdi), %rcx")
+        self.emit("shlq $4, %rcx")
+        self.emit(f"leaq {hdr}(%rdi,%rcx), %rcx")
+        self.emit("movq (%rcx), %rdx")
+        self.emit("subq %rax, %rdx")
+        self.emit("decq %rdx")
+        self.emit("jz vyl_chan_try_recv_claim")
+        self.emit("js vyl_chan_try_fail")  # nothing sent there yet
+        self.emit("movq 128(%rdi), %rax")
+        self.emit("jmp vyl_chan_try_recv_cell")
+        self.emit("vyl_chan_try_recv_claim:")
+        self.emit("leaq 1(%rax), %rdx")
+        self.emit("lock cmpxchgq %rdx, 128(%rdi)")
+        self.emit("jne vyl_chan_try_recv_cell")
+        self.emit("movq 8(%rcx), %rsi")
+        self.emit("movq $0, 8(%rcx)")  # the collector need not keep it alive
+        self.emit("addq 0(%rdi), %rax")  # free for the send one lap later
+        self.emit("xchgq %rax, (%rcx)")
+        self.emit("movq %rsi, %rdx")
+        self.emit("movl $1, %eax")
+        self.emit("ret")
+
+        # vyl_chan_wake(rdi=chan, rsi=waiter list offset): resume the first waiter
+        self.emit("vyl_chan_wake:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self._emit_spin_lock("24(%rbx)")
+        self.emit("movq (%rbx,%r12), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_chan_wake_none")
+        self.emit("movq (%rax), %rcx")
+        self.emit("movq %rcx, (%rbx,%r12)")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jnz vyl_chan_wake_task")
+        self.emit("movq $0, 8(%rbx,%r12)")
+        self.emit("vyl_chan_wake_task:")
+        self.emit("movq 8(%rax), %rdi")
+        self._emit_spin_unlock("24(%rbx)")
+        self.emit("call vyl_task_ready")
+        self.emit("jmp vyl_chan_wake_ret")
+        self.emit("vyl_chan_wake_none:")
+        self._emit_spin_unlock("24(%rbx)")
+        self.emit("vyl_chan_wake_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_chan_enqueue(rdi=chan, rsi=list offset, rdx=node): append a
+        # [next, task] node for the current task; the caller holds the lock
+        self.emit("vyl_chan_enqueue:")
+        self.emit("movq $0, (%rdx)")
+        self.emit(f"movq {self.tls('vyl_task_current')}, %rax")
+        self.emit("movq %rax, 8(%rdx)")
+        self.emit("addq %rsi, %rdi")
+        self.emit("movq 8(%rdi), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_chan_enqueue_first")
+        self.emit("movq %rdx, (%rax)")
+        self.emit("jmp vyl_chan_enqueue_tail")
+        self.emit("vyl_chan_enqueue_first:")
+        self.emit("movq %rdx, (%rdi)")
+        self.emit("vyl_chan_enqueue_tail:")
+        self.emit("movq %rdx, 8(%rdi)")
+        self.emit("mfence")  # the node is visible before the ring is checked again
+        self.emit("ret")
+
+        # vyl_chan_unlink(rdi=chan, rsi=list offset, rdx=node): drop a node that
+        # did not have to wait after all; the caller holds the lock
+        self.emit("vyl_chan_unlink:")
+        self.emit("addq %rsi, %rdi")
+        self.emit("movq %rdi, %rax")  # list head and node share the next slot
+        self.emit("xorl %ecx, %ecx")  # previous node, 0 for the head
+        self.emit("vyl_chan_unlink_scan:")
+        self.emit("movq (%rax), %rsi")
+        self.emit("testq %rsi, %rsi")
+        self.emit("jz vyl_chan_unlink_ret")
+        self.emit("cmpq %rdx, %rsi")
+        self.emit("je vyl_chan_unlink_found")
+        self.emit("movq %rsi, %rax")
+        self.emit("movq %rsi, %rcx")
+        self.emit("jmp vyl_chan_unlink_scan")
+        self.emit("vyl_chan_unlink_found:")
+        self.emit("movq (%rdx), %rsi")
+        self.emit("movq %rsi, (%rax)")
+        self.emit("cmpq %rdx, 8(%rdi)")
+        self.emit("jne vyl_chan_unlink_ret")
+        self.emit("movq %rcx, 8(%rdi)")
+        self.emit("vyl_chan_unlink_ret:")
+        self.emit("ret")
+
+        # vyl_chan_send(rdi=chan, rsi=value) -> 1, or 0 once the channel is
+        # closed; waits while it is full
+        self.emit(".globl vyl_chan_send")
+        self.emit("vyl_chan_send:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("subq $16, %rsp")  # (%rsp) waiter node
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_chan_send_closed")
+        self.emit("vyl_chan_send_try:")
+        self.emit("cmpq $0, 16(%rbx)")
+        self.emit("jne vyl_chan_send_closed")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("call vyl_chan_try_send")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_chan_send_sent")
+        self._emit_spin_lock("24(%rbx)")
+        self.emit("cmpq $0, 16(%rbx)")
+        self.emit("jne vyl_chan_send_closed_unlock")
         self.emit("movq %rbx, %rdi")
-        self.emit("call vyl_tls_recv")
-        self.emit("jmp vyl_http_after_recv")
-        self.emit("vyl_http_recv_plain:")
+        self.emit("movl $48, %esi")
+        self.emit("movq %rsp, %rdx")
+        self.emit("call vyl_chan_enqueue")
         self.emit("movq %rbx, %rdi")
-        self.emit("call vyl_tcp_recv")
-        self.emit("vyl_http_after_recv:")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_cleanup")
-        self.emit("movq %rax, %r12")
+        self.emit("movq %r12, %rsi")
+        self.emit("call vyl_chan_try_send")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_chan_send_raced")
+        self.emit("leaq 24(%rbx), %rax")
+        self.emit(f"movq %rax, {self.tls('vyl_park_unlock')}")
+        self.emit("call vyl_task_park")  # the waker took the node off the list
+        self.emit("jmp vyl_chan_send_try")
+        self.emit("vyl_chan_send_raced:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movl $48, %esi")
+        self.emit("movq %rsp, %rdx")
+        self.emit("call vyl_chan_unlink")
+        self._emit_spin_unlock("24(%rbx)")
+        self.emit("vyl_chan_send_sent:")
+        self.emit("cmpq $0, 32(%rbx)")
+        self.emit("je vyl_chan_send_ok")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movl $32, %esi")
+        self.emit("call vyl_chan_wake")
+        self.emit("vyl_chan_send_ok:")
+        self.emit("movl $1, %eax")
+        self.emit("jmp vyl_chan_send_ret")
+        self.emit("vyl_chan_send_closed_unlock:")
+        self._emit_spin_unlock("24(%rbx)")
+        self.emit("vyl_chan_send_closed:")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_chan_send_ret:")
+        self.emit("addq $16, %rsp")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_chan_recv(rdi=chan) -> next value; waits while the channel is
+        # empty, and gives 0 once it is closed and drained
+        self.emit(".globl vyl_chan_recv")
+        self.emit("vyl_chan_recv:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("subq $16, %rsp")  # (%rsp) waiter node
+        self.emit("movq %rdi, %rbx")
+        self.emit("xorl %r12d, %r12d")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_chan_recv_ret")
+        self.emit("vyl_chan_recv_try:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_chan_try_recv")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_chan_recv_got")
+        self._emit_spin_lock("24(%rbx)")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movl $32, %esi")
+        self.emit("movq %rsp, %rdx")
+        self.emit("call vyl_chan_enqueue")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_chan_try_recv")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_chan_recv_raced")
+        self.emit("cmpq $0, 16(%rbx)")
+        self.emit("jne vyl_chan_recv_closed")
+        self.emit("leaq 24(%rbx), %rax")
+        self.emit(f"movq %rax, {self.tls('vyl_park_unlock')}")
+        self.emit("call vyl_task_park")
+        self.emit("jmp vyl_chan_recv_try")
+        self.emit("vyl_chan_recv_raced:")
+        self.emit("movq %rdx, %r12")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movl $32, %esi")
+        self.emit("movq %rsp, %rdx")
+        self.emit("call vyl_chan_unlink")
+        self._emit_spin_unlock("24(%rbx)")
+        self.emit("jmp vyl_chan_recv_woke")
+        self.emit("vyl_chan_recv_got:")
+        self.emit("movq %rdx, %r12")
+        self.emit("vyl_chan_recv_woke:")
+        self.emit("cmpq $0, 48(%rbx)")
+        self.emit("je vyl_chan_recv_ret")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movl $48, %esi")
+        self.emit("call vyl_chan_wake")
+        self.emit("jmp vyl_chan_recv_ret")
+        self.emit("vyl_chan_recv_closed:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movl $32, %esi")
+        self.emit("movq %rsp, %rdx")
+        self.emit("call vyl_chan_unlink")
+        self._emit_spin_unlock("24(%rbx)")
+        self.emit("vyl_chan_recv_ret:")
+        self.emit("movq %r12, %rax")
+        self.emit("addq $16, %rsp")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_chan_close(rdi=chan) -> 0: later sends fail, and every waiter
+        # wakes up to drain what is left or see the close
+        self.emit(".globl vyl_chan_close")
+        self.emit("vyl_chan_close:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("subq $16, %rsp")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_chan_close_ret")
+        self.emit("movq %rdi, %rbx")
+        self._emit_spin_lock("24(%rbx)")
+        self.emit("movq $1, 16(%rbx)")
+        self.emit("movq 32(%rbx), %r12")  # receivers, then senders
+        self.emit("movq 48(%rbx), %rax")
+        self.emit("movq %rax, 8(%rsp)")
+        self.emit("movq $0, 32(%rbx)")
+        self.emit("movq $0, 40(%rbx)")
+        self.emit("movq $0, 48(%rbx)")
+        self.emit("movq $0, 56(%rbx)")
+        self._emit_spin_unlock("24(%rbx)")
+        self.emit("movq %r12, %rbx")
+        self.emit("movq 8(%rsp), %r12")
+        self.emit("vyl_chan_close_wake:")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jnz vyl_chan_close_task")
+        self.emit("movq %r12, %rbx")
+        self.emit("xorl %r12d, %r12d")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_chan_close_ret")
+        self.emit("vyl_chan_close_task:")
+        self.emit("movq 8(%rbx), %rdi")
+        self.emit("movq (%rbx), %rbx")  # read before the waiter can run and reuse it
+        self.emit("call vyl_task_ready")
+        self.emit("jmp vyl_chan_close_wake")
+        self.emit("vyl_chan_close_ret:")
+        self.emit("xorl %eax, %eax")
+        self.emit("addq $16, %rsp")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_chan_len(rdi=chan) -> values waiting in it
+        self.emit(".globl vyl_chan_len")
+        self.emit("vyl_chan_len:")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_chan_len_ret")
+        self.emit("movq 128(%rdi), %rcx")  # receive position first: never ahead
+        self.emit("movq 64(%rdi), %rax")
+        self.emit("subq %rcx, %rax")
+        self.emit("vyl_chan_len_ret:")
+        self.emit("ret")
+
+    def generate_bench_runtime(self):
+        """Emit NowNs and the Bench, BenchNext, BenchReport harness.
+
+        BenchNext closes the running sample and opens the next one, so a
+        `while (BenchNext(b))` loop times every pass of its body and nothing
+        else: the clock is read again after the bookkeeping. The first samples
+        warm caches and the branch predictors and are dropped. VYL_BENCH_WARMUP
+        and VYL_BENCH_SAMPLES override the counts, which is how `vyl bench`
+        runs VYL kernels and their C baselines (bench/bench.h) alike.
+        """
+        hdr = BENCH_HEADER_SIZE
+
+        # vyl_clock_ns() -> CLOCK_MONOTONIC in nanoseconds
+        self.emit(".globl vyl_clock_ns")
+        self.emit("vyl_clock_ns:")
+        self.emit("subq $24, %rsp")
+        self.emit("movl $1, %edi")  # CLOCK_MONOTONIC
+        self.emit("movq %rsp, %rsi")
+        self.emit("call clock_gettime")
+        self.emit("imulq $1000000000, (%rsp), %rax")
+        self.emit("addq 8(%rsp), %rax")
+        self.emit("addq $24, %rsp")
+        self.emit("ret")
+
+        # vyl_bench_env(rdi=variable, rsi=default) -> its value, or the default
+        # when it is unset or negative
+        self.emit(".globl vyl_bench_env")
+        self.emit("vyl_bench_env:")
+        self.emit("push %rbx")
+        self.emit("movq %rsi, %rbx")
+        self.emit("call getenv")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_bench_env_default")
+        self.emit("movq %rax, %rdi")
+        self.emit("xorl %esi, %esi")
+        self.emit("movl $10, %edx")
+        self.emit("call strtol")
+        self.emit("testq %rax, %rax")
+        self.emit("jns vyl_bench_env_ret")
+        self.emit("vyl_bench_env_default:")
+        self.emit("movq %rbx, %rax")
+        self.emit("vyl_bench_env_ret:")
+        self.emit("pop %rbx")
+        self.emit("ret")
+
+        # vyl_bench_new(rdi=name, rsi=ops per sample) -> bench
+        self.emit(".globl vyl_bench_new")
+        self.emit("vyl_bench_new:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("movq %rdi, %r12")
+        self.emit("movq %rsi, %r13")
+        self.emit("testq %r13, %r13")
+        self.emit("jg vyl_bench_new_ops")
+        self.emit("movl $1, %r13d")
+        self.emit("vyl_bench_new_ops:")
+        self.emit("leaq .str_bench_warmup(%rip), %rdi")
+        self.emit(f"movl ${BENCH_DEFAULT_WARMUP}, %esi")
+        self.emit("call vyl_bench_env")
+        self.emit("movq %rax, %r14")
+        self.emit("leaq .str_bench_samples(%rip), %rdi")
+        self.emit(f"movl ${BENCH_DEFAULT_SAMPLES}, %esi")
+        self.emit("call vyl_bench_env")
+        self.emit("movq %rax, %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jnz vyl_bench_new_alloc")
+        self.emit("movl $1, %ebx")
+        self.emit("vyl_bench_new_alloc:")
+        self.emit(f"leaq {hdr}(,%rbx,8), %rdi")
+        self.emit("call vyl_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_bench_new_ret")
+        self.emit("movq %r12, 0(%rax)")
+        self.emit("movq %r13, 8(%rax)")
+        self.emit("movq %r14, 16(%rax)")
+        self.emit("movq %rbx, 24(%rax)")
+        self.emit("vyl_bench_new_ret:")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_bench_next(rdi=bench) -> 1 to run the body once more, 0 when
+        # every sample is taken
+        self.emit(".globl vyl_bench_next")
+        self.emit("vyl_bench_next:")
+        self.emit("push %rbx")
+        self.emit("movq %rdi, %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_bench_next_done")
+        self.emit("call vyl_clock_ns")
+        self.emit("movq 40(%rbx), %rcx")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jz vyl_bench_next_check")  # no sample running yet
+        self.emit("subq %rcx, %rax")
+        self.emit("cmpq $0, 16(%rbx)")
+        self.emit("jle vyl_bench_next_record")
+        self.emit("decq 16(%rbx)")
+        self.emit("jmp vyl_bench_next_check")
+        self.emit("vyl_bench_next_record:")
+        self.emit("movq 32(%rbx), %rdx")
+        self.emit(f"movq %rax, {hdr}(%rbx,%rdx,8)")
+        self.emit("incq 32(%rbx)")
+        self.emit("vyl_bench_next_check:")
+        self.emit("movq 32(%rbx), %rdx")
+        self.emit("cmpq 24(%rbx), %rdx")
+        self.emit("jge vyl_bench_next_done")
+        self.emit("call vyl_clock_ns")
+        self.emit("movq %rax, 40(%rbx)")
+        self.emit("movl $1, %eax")
+        self.emit("pop %rbx")
+        self.emit("ret")
+        self.emit("vyl_bench_next_done:")
+        self.emit("xorl %eax, %eax")
+        self.emit("pop %rbx")
+        self.emit("ret")
+
+        # vyl_bench_cmp(rdi, rsi) -> qsort order of two sample words
+        self.emit(".globl vyl_bench_cmp")
+        self.emit("vyl_bench_cmp:")
+        self.emit("movq (%rdi), %rax")
+        self.emit("cmpq (%rsi), %rax")
+        self.emit("setg %al")
+        self.emit("setl %cl")
+        self.emit("movzbl %al, %eax")
+        self.emit("movzbl %cl, %ecx")
+        self.emit("subl %ecx, %eax")
+        self.emit("ret")
+
+        # vyl_bench_report(rdi=bench): one JSON line with the median, p99 and
+        # minimum sample and the ops/s the median works out to
+        self.emit(".globl vyl_bench_report")
+        self.emit("vyl_bench_report:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("subq $288, %rsp")  # snprintf's four stack arguments, then the line
+        self.emit("movq %rdi, %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_bench_report_ret")
+        self.emit("movq 32(%rbx), %r12")
+        self.emit("testq %r12, %r12")
+        self.emit("jz vyl_bench_report_ret")
+        self.emit(f"leaq {hdr}(%rbx), %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movl $8, %edx")
+        self.emit("leaq vyl_bench_cmp(%rip), %rcx")
+        self.emit("call qsort")
+        self.emit("movq %r12, %rcx")
+        self.emit("shrq $1, %rcx")
+        self.emit(f"movq {hdr}(%rbx,%rcx,8), %rax")
+        self.emit("movq %rax, 0(%rsp)")   # median
+        self.emit("imulq $99, %r12, %rax")
+        self.emit("addq $99, %rax")
+        self.emit("xorl %edx, %edx")
+        self.emit("movl $100, %ecx")
+        self.emit("divq %rcx")
+        self.emit(f"movq {hdr - 8}(%rbx,%rax,8), %rax")
+        self.emit("movq %rax, 8(%rsp)")   # p99: sample ceil(n * 0.99)
+        self.emit(f"movq {hdr}(%rbx), %rax")
+        self.emit("movq %rax, 16(%rsp)")  # min
+        self.emit("movq 0(%rsp), %rcx")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jz vyl_bench_report_rate")
+        self.emit("movq 8(%rbx), %rax")
+        self.emit("movq $1000000000, %rdx")
+        self.emit("mulq %rdx")
+        self.emit("divq %rcx")
+        self.emit("vyl_bench_report_rate:")
+        self.emit("movq %rax, 24(%rsp)")  # ops/s
+        self.emit("leaq 32(%rsp), %rdi")
+        self.emit("movl $256, %esi")
+        self.emit("leaq .fmt_bench(%rip), %rdx")
+        self.emit("movq 0(%rbx), %rcx")
+        self.emit("movq %r12, %r8")
+        self.emit("movq 8(%rbx), %r9")
+        self.emit("xorl %eax, %eax")
+        self.emit("call snprintf")
+        self.emit("cmpl $255, %eax")
+        self.emit("jbe vyl_bench_report_print")
+        self.emit("movl $255, %eax")
+        self.emit("vyl_bench_report_print:")
+        self.emit("leaq 32(%rsp), %rsi")
+        self.emit("movl %eax, %edx")
+        self.emit("call vyl_print_bytes")
+        self.emit("vyl_bench_report_ret:")
+        self.emit("xorl %eax, %eax")
+        self.emit("addq $288, %rsp")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit(".section .data")
+        self.emit(".str_bench_warmup: .asciz \"VYL_BENCH_WARMUP\"")
+        self.emit(".str_bench_samples: .asciz \"VYL_BENCH_SAMPLES\"")
+        self.emit(".fmt_bench: .asciz \"{\\\"bench\\\":\\\"%s\\\",\\\"samples\\\":%ld,\\\"ops\\\":%ld,"
+                  "\\\"median_ns\\\":%ld,\\\"p99_ns\\\":%ld,\\\"min_ns\\\":%ld,\\\"ops_per_sec\\\":%ld}\\n\"")
+        self.emit(".section .text")
+
+    def generate_perf_map_runtime(self):
+        """Emit the /tmp/perf-<pid>.map writer.
+
+        perf names samples outside any mapped file, such as code the hot-swap
+        runtime loads into anonymous memory, from this map; vyl_perf_map_add
+        appends one "start size name" line. With --perf-map main first calls
+        vyl_perf_map_write, which adds every function the compiler laid out
+        (the PERF_MAP_SECTION records). The section symbols are weak, so a
+        program built without the flag links to an empty table.
+        """
+        size = PERF_MAP_RECORD_SIZE
+        path = PERF_MAP_PATH_SIZE
+        start, stop = f"__start_{PERF_MAP_SECTION}", f"__stop_{PERF_MAP_SECTION}"
+
+        # vyl_perf_map_open -> fd of the map, opened for appending on first use;
+        # negative when it cannot be opened
+        self.emit("vyl_perf_map_open:")
+        self.emit("movq vyl_perf_map_fd(%rip), %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jns vyl_perf_map_open_ret")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit(f"subq ${path}, %rsp")
+        self.emit("call getpid")
+        self.emit("movq %rsp, %rdi")
+        self.emit(f"movl ${path}, %esi")
+        self.emit("leaq .fmt_perf_map_path(%rip), %rdx")
+        self.emit("movl %eax, %ecx")
+        self.emit("xorl %eax, %eax")
+        self.emit("call snprintf")
+        self.emit("movq %rsp, %rdi")
+        self.emit("movl $0x441, %esi")  # O_WRONLY | O_CREAT | O_APPEND
+        self.emit("movl $0644, %edx")
+        self.emit("xorl %eax, %eax")
+        self.emit("call open")
+        self.emit("movslq %eax, %rax")
+        self.emit("movq %rax, vyl_perf_map_fd(%rip)")
+        self.emit("leave")
+        self.emit("vyl_perf_map_open_ret:")
+        self.emit("ret")
+
+        # vyl_perf_map_add(rdi=start, rsi=size, rdx=name): name a code range
+        self.emit(".globl vyl_perf_map_add")
+        self.emit("vyl_perf_map_add:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("call vyl_perf_map_open")
+        self.emit("testq %rax, %rax")
+        self.emit("js vyl_perf_map_add_ret")
+        self.emit("movl %eax, %edi")
+        self.emit("leaq .fmt_perf_map_line(%rip), %rsi")
+        self.emit("movq %rbx, %rdx")
+        self.emit("movq %r12, %rcx")
+        self.emit("movq %r13, %r8")
+        self.emit("xorl %eax, %eax")
+        self.emit("call dprintf")
+        self.emit("vyl_perf_map_add_ret:")
+        self.emit("leaq -24(%rbp), %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_perf_map_write: add the functions of this program
+        self.emit(".globl vyl_perf_map_write")
+        self.emit("vyl_perf_map_write:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit(f"leaq {start}(%rip), %rbx")
+        self.emit(f"leaq {stop}(%rip), %r12")
+        self.emit("vyl_perf_map_write_next:")
+        self.emit("cmpq %r12, %rbx")
+        self.emit("jae vyl_perf_map_write_done")
+        self.emit("movq 0(%rbx), %rdi")
+        self.emit("movq 8(%rbx), %rsi")
+        self.emit("movq 16(%rbx), %rdx")
+        self.emit("call vyl_perf_map_add")
+        self.emit(f"addq ${size}, %rbx")
+        self.emit("jmp vyl_perf_map_write_next")
+        self.emit("vyl_perf_map_write_done:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
 
-        # Strip headers (
+        self.emit(f".weak {start}")
+        self.emit(f".weak {stop}")
+        self.emit(".section .data")
+        self.emit(".balign 8")
+        self.emit("vyl_perf_map_fd: .quad -1")
+        self.emit(".section .rodata")
+        self.emit(".fmt_perf_map_path: .asciz \"/tmp/perf-%d.map\"")
+        self.emit(".fmt_perf_map_line: .asciz \"%lx %lx %s\\n\"")
+        self.emit(".section .text")
+
+    def generate_alloc_profile_runtime(self):
+        """Emit the --profile-alloc counters and their report.
+
+        Program code stores its site record in vyl_prof_site before every
+        runtime call (see emit), so vyl_alloc charges the allocation to the
+        source line that asked for it, however deep in the runtime it
+        happens; allocations on behalf of no site go to vyl_prof_other. The
+        live heap grows by every request and is reset by each collection to
+        the slot bytes that survived it. vyl_prof_dump writes the sites by
+        bytes, the heap high-water mark and the GC pause histogram to stderr.
+        """
+        size = PROF_SITE_SIZE
+        buckets = PROF_PAUSE_BUCKETS
+        start, stop = f"__start_{PROF_SITE_SECTION}", f"__stop_{PROF_SITE_SECTION}"
+
+        # vyl_prof_alloc(rdi=size): count one allocation; keeps rdi
+        self.emit("vyl_prof_alloc:")
+        self.emit(f"movq {self.tls('vyl_prof_site')}, %rax")
+        self.emit("testq %rax, %rax")
+        self.emit("jnz vyl_prof_alloc_site")
+        self.emit("leaq vyl_prof_other(%rip), %rax")
+        self.emit("vyl_prof_alloc_site:")
+        self.emit("lock incq 0(%rax)")
+        self.emit("lock addq %rdi, 8(%rax)")
+        self.emit("movq %rdi, %rcx")
+        self.emit("lock xaddq %rcx, vyl_prof_live(%rip)")
+        self.emit("addq %rdi, %rcx")
+        self.emit("cmpq vyl_prof_peak(%rip), %rcx")
+        self.emit("jbe vyl_prof_alloc_ret")
+        self.emit("movq %rcx, vyl_prof_peak(%rip)")  # racy, but only ever raised
+        self.emit("vyl_prof_alloc_ret:")
+        self.emit("ret")
+
+        # vyl_prof_gc_done: close the pause vyl_collect opened, under its lock
+        self.emit("vyl_prof_gc_done:")
+        self.emit("subq $8, %rsp")
+        self.emit("call vyl_clock_ns")
+        self.emit("subq vyl_prof_gc_start(%rip), %rax")
+        self.emit("incq vyl_prof_gc_count(%rip)")
+        self.emit("addq %rax, vyl_prof_gc_total(%rip)")
+        self.emit("cmpq vyl_prof_gc_max(%rip), %rax")
+        self.emit("jbe vyl_prof_gc_bucket")
+        self.emit("movq %rax, vyl_prof_gc_max(%rip)")
+        self.emit("vyl_prof_gc_bucket:")
+        self.emit("xorl %edx, %edx")
+        self.emit("shrq $10, %rax")
+        self.emit("jz vyl_prof_gc_count_it")
+        self.emit("bsrq %rax, %rdx")
+        self.emit("incq %rdx")
+        self.emit(f"cmpq ${buckets - 1}, %rdx")
+        self.emit("jbe vyl_prof_gc_count_it")
+        self.emit(f"movl ${buckets - 1}, %edx")
+        self.emit("vyl_prof_gc_count_it:")
+        self.emit("leaq vyl_prof_gc_hist(%rip), %rcx")
+        self.emit("incq (%rcx,%rdx,8)")
+        self.emit("movq vyl_prof_swept(%rip), %rax")
+        self.emit("movq %rax, vyl_prof_live(%rip)")
+        self.emit("addq $8, %rsp")
+        self.emit("ret")
 
+        # vyl_prof_cmp(rdi, rsi) -> qsort order of two site records, most bytes first
+        self.emit("vyl_prof_cmp:")
+        self.emit("movq 8(%rsi), %rax")
+        self.emit("cmpq 8(%rdi), %rax")
+        self.emit("seta %al")
+        self.emit("setb %cl")
+        self.emit("movzbl %al, %eax")
+        self.emit("movzbl %cl, %ecx")
+        self.emit("subl %ecx, %eax")
+        self.emit("ret")
 
+        # vyl_prof_dump: the report, on stderr so program output stays clean
+        self.emit(".globl vyl_prof_dump")
+        self.emit("vyl_prof_dump:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit(f"leaq {start}(%rip), %r12")
+        self.emit(f"leaq {stop}(%rip), %r13")
         self.emit("movq %r12, %rdi")
-        self.emit("call strlen")
+        self.emit("movq %r13, %rsi")
+        self.emit("subq %r12, %rsi")
+        self.emit(f"shrq ${size.bit_length() - 1}, %rsi")
+        self.emit(f"movl ${size}, %edx")
+        self.emit("leaq vyl_prof_cmp(%rip), %rcx")
+        self.emit("call qsort")
+        self.emit("movl $2, %edi")
+        self.emit("leaq .fmt_prof_head(%rip), %rsi")
+        self.emit("leaq .str_prof_site(%rip), %rdx")
+        self.emit("leaq .str_prof_allocs(%rip), %rcx")
+        self.emit("leaq .str_prof_bytes(%rip), %r8")
+        self.emit("xorl %eax, %eax")
+        self.emit("call dprintf")
+        self.emit("vyl_prof_dump_site:")
+        self.emit("cmpq %r13, %r12")
+        self.emit("jae vyl_prof_dump_heap")
+        self.emit("cmpq $0, 0(%r12)")
+        self.emit("je vyl_prof_dump_next")
+        self.emit("movl $2, %edi")
+        self.emit("leaq .fmt_prof_site(%rip), %rsi")
+        self.emit("movq 16(%r12), %rdx")
+        self.emit("movq 0(%r12), %rcx")
+        self.emit("movq 8(%r12), %r8")
+        self.emit("xorl %eax, %eax")
+        self.emit("call dprintf")
+        self.emit("vyl_prof_dump_next:")
+        self.emit(f"addq ${size}, %r12")
+        self.emit("jmp vyl_prof_dump_site")
+        self.emit("vyl_prof_dump_heap:")
+        self.emit("movl $2, %edi")
+        self.emit("leaq .fmt_prof_heap(%rip), %rsi")
+        self.emit("movq vyl_prof_peak(%rip), %rdx")
+        self.emit("movq vyl_prof_live(%rip), %rcx")
+        self.emit("xorl %eax, %eax")
+        self.emit("call dprintf")
+        self.emit("movl $1000, %ebx")
+        self.emit("movq vyl_prof_gc_total(%rip), %rax")
+        self.emit("xorl %edx, %edx")
+        self.emit("divq %rbx")
         self.emit("movq %rax, %rcx")
+        self.emit("movq vyl_prof_gc_max(%rip), %rax")
+        self.emit("xorl %edx, %edx")
+        self.emit("divq %rbx")
+        self.emit("movq %rax, %r8")
+        self.emit("movl $2, %edi")
+        self.emit("leaq .fmt_prof_gc(%rip), %rsi")
+        self.emit("movq vyl_prof_gc_count(%rip), %rdx")
+        self.emit("xorl %eax, %eax")
+        self.emit("call dprintf")
+        self.emit("xorl %ebx, %ebx")
+        self.emit("leaq vyl_prof_gc_hist(%rip), %r14")
+        self.emit("vyl_prof_dump_pause:")
+        self.emit("movq (%r14,%rbx,8), %r12")
+        self.emit("testq %r12, %r12")
+        self.emit("jz vyl_prof_dump_pause_next")
+        self.emit("movl $1024, %eax")  # bucket b holds pauses below 1024 << b ns
+        self.emit("movl %ebx, %ecx")
+        self.emit("shlq %cl, %rax")
+        self.emit("xorl %edx, %edx")
+        self.emit("movl $1000, %ecx")
+        self.emit("divq %rcx")
+        self.emit("movq %rax, %rdx")
+        self.emit("movl $2, %edi")
+        self.emit("leaq .fmt_prof_pause(%rip), %rsi")
+        self.emit(f"cmpq ${buckets - 1}, %rbx")
+        self.emit("jne vyl_prof_dump_pause_print")
+        self.emit("leaq .fmt_prof_pause_last(%rip), %rsi")
+        self.emit("shrq $1, %rdx")
+        self.emit("vyl_prof_dump_pause_print:")
+        self.emit("movq %r12, %rcx")
+        self.emit("xorl %eax, %eax")
+        self.emit("call dprintf")
+        self.emit("vyl_prof_dump_pause_next:")
+        self.emit("incq %rbx")
+        self.emit(f"cmpq ${buckets}, %rbx")
+        self.emit("jb vyl_prof_dump_pause")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        self.emit(f".section {PROF_SITE_SECTION},\"aw\"")
+        self.emit(".balign 8")
+        self.emit("vyl_prof_other: .quad 0, 0, .str_prof_other, 0")
+        self.emit(".section .data")
+        self.emit(".balign 8")
+        for name in ("live", "peak", "swept", "gc_start", "gc_count", "gc_total", "gc_max"):
+            self.emit(f"vyl_prof_{name}: .quad 0")
+        self.emit(f"vyl_prof_gc_hist: .zero {8 * buckets}")
+        self.emit(".section .tbss,\"awT\",@nobits")
+        self.emit(".balign 8")
+        self.emit("vyl_prof_site: .zero 8")
+        self.emit(".section .rodata")
+        self.emit(".str_prof_other: .asciz \"(runtime)\"")
+        self.emit(".str_prof_site: .asciz \"site\"")
+        self.emit(".str_prof_allocs: .asciz \"allocs\"")
+        self.emit(".str_prof_bytes: .asciz \"bytes\"")
+        self.emit(".fmt_prof_head: .asciz \"Allocation profile:\\n  %-48s %12s %14s\\n\"")
+        self.emit(".fmt_prof_site: .asciz \"  %-48s %12ld %14ld\\n\"")
+        self.emit(".fmt_prof_heap: .asciz \"Live heap: %ld bytes high-water mark, %ld bytes at exit\\n\"")
+        self.emit(".fmt_prof_gc: .asciz \"GC: %ld collection(s), %ld us paused in total, %ld us longest\\n\"")
+        self.emit(".fmt_prof_pause: .asciz \"  pause < %ld us: %ld\\n\"")
+        self.emit(".fmt_prof_pause_last: .asciz \"  pause >= %ld us: %ld\\n\"")
+        self.emit(".section .text")
+
+    def generate_reader_runtime(self):
+        """Emit MapFile and the streaming LineReader.
+
+        MapFile maps the file read-only behind one anonymous page that holds
+        the string header, so the result is an ordinary string whose bytes
+        come straight from the page cache. A LineReader refills a fixed 64 KiB
+        buffer with read(2) and hands out every line in one reused string.
+        """
+        data = READER_HEADER_SIZE
+        page = PAGE_SIZE
+
+        # vyl_map_file(rdi=path) -> string over the mapped file, or 0.
+        # Layout: [header page][file pages][zero page]; the bytes after EOF
+        # read as zero, so the string stays NUL-terminated.
+        self.emit(".globl vyl_map_file")
+        self.emit("vyl_map_file:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("subq $144, %rsp")  # struct stat
+        self.emit("xorl %esi, %esi")  # O_RDONLY
+        self.emit("call open")
+        self.emit("movslq %eax, %rbx")
+        self.emit("testq %rbx, %rbx")
+        self.emit("js vyl_map_file_fail")
+        self.emit("movl %ebx, %edi")
+        self.emit("movq %rsp, %rsi")
+        self.emit("call fstat")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_map_file_close")
+        self.emit("movq 48(%rsp), %r12")  # st_size
+        self.emit(f"leaq {2 * page - 1}(%r12), %r13")
+        self.emit(f"andq ${-page}, %r13")
+        self.emit(f"addq ${page}, %r13")  # whole mapping
+        self.emit("xorl %edi, %edi")
+        self.emit("movq %r13, %rsi")
+        self.emit("movl $3, %edx")  # PROT_READ | PROT_WRITE
+        self.emit("movl $0x22, %ecx")  # MAP_PRIVATE | MAP_ANONYMOUS
+        self.emit("movl $-1, %r8d")
+        self.emit("xorl %r9d, %r9d")
+        self.emit("call mmap")
+        self.emit("cmpq $-1, %rax")
+        self.emit("je vyl_map_file_close")
+        self.emit("movq %rax, %r14")
+        self.emit("testq %r12, %r12")
+        self.emit("jz vyl_map_file_header")
+        self.emit(f"leaq {page}(%r14), %rdi")
         self.emit("movq %r12, %rsi")
-        self.emit("movq $0, %rdx")
-        self.emit("vyl_http_scan:")
-        self.emit("cmpq %rcx, %rdx")
-        self.emit("jge vyl_http_no_headers")
-        self.emit("movb (%rsi,%rdx,1), %al")
-        self.emit("cmpb $13, %al")
-        self.emit("jne vyl_http_next")
-        self.emit("cmpq %rcx, %rdx")
-        self.emit("addq $3, %rdx")
-        self.emit("cmpq %rcx, %rdx")
-        self.emit("jge vyl_http_next")
-        self.emit("movb -3(%rsi,%rdx,1), %al")
-        self.emit("cmpb $10, %al")
-        self.emit("jne vyl_http_next")
-        self.emit("movb -2(%rsi,%rdx,1), %al")
-        self.emit("cmpb $13, %al")
-        self.emit("jne vyl_http_next")
-        self.emit("movb -1(%rsi,%rdx,1), %al")
-        self.emit("cmpb $10, %al")
-        self.emit("jne vyl_http_next")
-        self.emit("addq $1, %rdx")
-        self.emit("leaq (%rsi,%rdx,1), %rax")
+        self.emit("movl $1, %edx")  # PROT_READ
+        self.emit("movl $0x12, %ecx")  # MAP_PRIVATE | MAP_FIXED
+        self.emit("movl %ebx, %r8d")
+        self.emit("xorl %r9d, %r9d")
+        self.emit("call mmap")
+        self.emit("cmpq $-1, %rax")
+        self.emit("je vyl_map_file_unmap")
+        self.emit(f"leaq {page}(%r14), %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movl $2, %edx")  # MADV_SEQUENTIAL: read ahead, drop behind
+        self.emit("call madvise")
+        self.emit("vyl_map_file_header:")
+        self.emit(f"movq %r13, {page - 24}(%r14)")  # mapping size, for UnmapFile
+        self.emit(f"movq %r12, {page - 16}(%r14)")
+        self.emit(f"movq %r12, {page - 8}(%r14)")
+        self.emit("movl %ebx, %edi")
+        self.emit("call close")  # the mapping outlives the descriptor
+        self.emit(f"leaq {page}(%r14), %rax")
+        self.emit("jmp vyl_map_file_done")
+        self.emit("vyl_map_file_unmap:")
+        self.emit("movq %r14, %rdi")
+        self.emit("movq %r13, %rsi")
+        self.emit("call munmap")
+        self.emit("vyl_map_file_close:")
+        self.emit("movl %ebx, %edi")
+        self.emit("call close")
+        self.emit("vyl_map_file_fail:")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_map_file_done:")
+        self.emit("addq $144, %rsp")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_unmap_file(rdi=string from vyl_map_file) -> munmap result
+        self.emit(".globl vyl_unmap_file")
+        self.emit("vyl_unmap_file:")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_unmap_file_ret")
+        self.emit("movq -24(%rdi), %rsi")
+        self.emit(f"subq ${page}, %rdi")
+        self.emit("jmp munmap")
+        self.emit("vyl_unmap_file_ret:")
+        self.emit("xorl %eax, %eax")
+        self.emit("ret")
+
+        # vyl_reader_new(rdi=FILE*) -> reader on the same fd, or 0
+        self.emit(".globl vyl_reader_new")
+        self.emit("vyl_reader_new:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_reader_new_ret")
+        self.emit("movq %rdi, %rbx")
+        self.emit(f"movq ${READER_HEADER_SIZE + READER_BUFFER_SIZE}, %rdi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_reader_new_ret")
         self.emit("movq %rax, %r12")
-        self.emit("jmp vyl_http_done")
-        self.emit("vyl_http_next:")
-        self.emit("incq %rdx")
-        self.emit("jmp vyl_http_scan")
-        self.emit("vyl_http_no_headers:")
-        self.emit("movq %rsi, %r12")
-        self.emit("vyl_http_done:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call fileno")
+        self.emit("movslq %eax, %rax")
+        self.emit("movq %rax, (%r12)")
+        self.emit("movq $0, 8(%r12)")
+        self.emit("movq $0, 16(%r12)")
+        self.emit("movq %rbx, 32(%r12)")
+        # The line string owns its own header; it starts as big as one refill
+        self.emit(f"movq ${16 + READER_BUFFER_SIZE + 1}, %rdi")
+        self.emit("call malloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_reader_new_oom")
+        self.emit(f"movq ${READER_BUFFER_SIZE}, (%rax)")
+        self.emit("movq $0, 8(%rax)")
+        self.emit("movb $0, 16(%rax)")
+        self.emit("addq $16, %rax")
+        self.emit("movq %rax, 24(%r12)")
         self.emit("movq %r12, %rax")
-        self.emit("jmp vyl_http_ret")
-
-        self.emit("vyl_http_cleanup:")
-        self.emit("movq $0, %rax")
-
-        self.emit("vyl_http_ret:")
-        self.emit("addq $168, %rsp")
-        self.emit("pop %r13")
+        self.emit("jmp vyl_reader_new_ret")
+        self.emit("vyl_reader_new_oom:")
+        self.emit("movq %r12, %rdi")
+        self.emit("call free")
+        self.emit("xorl %eax, %eax")
+        self.emit("vyl_reader_new_ret:")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        self.emit("vyl_http_fail:")
-        self.emit("movq $0, %rax")
-        self.emit("addq $168, %rsp")
+        # vyl_reader_fill(rdi=reader) -> bytes now buffered; 0 at end of file
+        self.emit(".globl vyl_reader_fill")
+        self.emit("vyl_reader_fill:")
+        self.emit("movq 16(%rdi), %rax")
+        self.emit("subq 8(%rdi), %rax")
+        self.emit("jnz vyl_reader_fill_ret")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("vyl_reader_fill_retry:")
+        self.emit("movq (%rbx), %rdi")
+        self.emit(f"leaq {data}(%rbx), %rsi")
+        self.emit(f"movq ${READER_BUFFER_SIZE}, %rdx")
+        self.emit("call read")
+        self.emit("testq %rax, %rax")
+        self.emit("jns vyl_reader_fill_done")
+        self.emit("call __errno_location")
+        self.emit("cmpl $4, (%rax)")  # EINTR
+        self.emit("je vyl_reader_fill_retry")
+        self.emit("xorl %eax, %eax")  # other errors end the stream
+        self.emit("vyl_reader_fill_done:")
+        self.emit("movq $0, 8(%rbx)")
+        self.emit("movq %rax, 16(%rbx)")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("vyl_reader_fill_ret:")
+        self.emit("ret")
+
+        # vyl_reader_take(rdi=reader, rsi=ptr, rdx=n): append to the line
+        # string, doubling it when a line outgrows the buffer. ptr points
+        # into the reader's own buffer, which never moves.
+        self.emit(".globl vyl_reader_take")
+        self.emit("vyl_reader_take:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("subq $16, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("movq 24(%rbx), %rax")
+        self.emit("movq -8(%rax), %r14")  # length so far
+        self.emit("addq %r14, %rdx")  # required capacity
+        self.emit("cmpq -16(%rax), %rdx")
+        self.emit("jbe vyl_reader_take_copy")
+        self.emit("movq -16(%rax), %rsi")
+        self.emit("addq %rsi, %rsi")
+        self.emit("cmpq %rdx, %rsi")
+        self.emit("cmovbq %rdx, %rsi")
+        self.emit("movq %rsi, (%rsp)")
+        self.emit("leaq -16(%rax), %rdi")
+        self.emit("addq $17, %rsi")  # header and terminator
+        self.emit("call realloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_reader_take_short")
+        self.emit("movq (%rsp), %rcx")
+        self.emit("movq %rcx, (%rax)")
+        self.emit("addq $16, %rax")
+        self.emit("movq %rax, 24(%rbx)")
+        self.emit("jmp vyl_reader_take_copy")
+        self.emit("vyl_reader_take_short:")  # out of memory: keep what fits
+        self.emit("movq 24(%rbx), %rax")
+        self.emit("movq -16(%rax), %r13")
+        self.emit("subq %r14, %r13")
+        self.emit("vyl_reader_take_copy:")
+        self.emit("movq 24(%rbx), %rax")
+        self.emit("leaq (%rax,%r14), %rdi")
+        self.emit("addq %r13, %r14")
+        self.emit("movq %r14, -8(%rax)")
+        self.emit("movb $0, (%rax,%r14)")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("call memcpy")
+        self.emit("addq $16, %rsp")
+        self.emit("pop %r14")
         self.emit("pop %r13")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        self.emit(".section .rodata")
-        self.emit(".fmt_http_get: .asciz \"GET %s HTTP/1.0\\r\\nHost: %s\\r\\nUser-Agent: vyl/0.1\\r\\nConnection: close\\r\\n\\r\\n\"")
-        self.emit(".http_loc: .asciz \"Location:\"")
-        self.emit(".http_prefix: .asciz \"http://\"")
-        self.emit(".https_prefix: .asciz \"https://\"")
-        self.emit(".http_get_prefix: .asciz \"GET \"")
-        self.emit(".http_get_mid: .asciz \" HTTP/1.0\\r\\nHost: \"")
-        self.emit(".http_get_suffix: .asciz \"\\r\\nUser-Agent: vyl/0.1\\r\\nConnection: close\\r\\n\\r\\n\"")
-        self.emit(".section .text")
-
-        # vyl_http_download(host, path, use_tls, dest) -> int (0 fail, 1 success)
-        self.emit(".globl vyl_http_download")
-        self.emit("vyl_http_download:")
+        # vyl_reader_line(rdi=reader) -> next line without its newline. The
+        # string is reused by the next ReadLine/ReadChunk; "" at end of file.
+        self.emit(".globl vyl_reader_line")
+        self.emit("vyl_reader_line:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
         self.emit("push %r13")
         self.emit("push %r14")
-        self.emit("push %r15")
-        # 5 pushes = 40 bytes below rbp. After 5 pushes rsp % 16 == 8.
-        # Need subq that makes rsp % 16 == 0 for proper call alignment.
-        # 216 bytes: 8 + 216 = 224, 224 % 16 == 0
-        self.emit("subq $216, %rsp")
-        # Locals layout: -48(host), -56(path), -64(use_tls), -72(dest), -80(buf), -88(first_chunk), -96(redirect)
-        self.emit("movq %rdi, -48(%rbp)")   # host
-        self.emit("movq %rsi, -56(%rbp)")   # path
-        self.emit("movq %rdx, -64(%rbp)")   # use_tls
-        self.emit("movq %rcx, -72(%rbp)")   # dest path
-        self.emit("movq $0, -96(%rbp)")     # redirect counter
-
-        # Open dest file
-        self.emit("movq -72(%rbp), %rdi")
-        self.emit("leaq .mode_wb(%rip), %rsi")
-        self.emit("call fopen")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq 24(%rbx), %rax")
+        self.emit("movq $0, -8(%rax)")
+        self.emit("movb $0, (%rax)")
+        self.emit("vyl_reader_line_loop:")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call vyl_reader_fill")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_reader_line_done")
+        self.emit("movq %rax, %r13")  # bytes available
+        self.emit("movq 8(%rbx), %rax")
+        self.emit(f"leaq {data}(%rbx,%rax), %r12")
+        self.emit("movq %r12, %rdi")
+        self.emit("movl $10, %esi")
+        self.emit("movq %r13, %rdx")
+        self.emit("call memchr")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_reader_line_partial")
         self.emit("movq %rax, %r14")
-        self.emit("cmpq $0, %r14")
-        self.emit("je vyl_http_dl_fail")
-
-        self.emit("vyl_http_dl_start:")
-        # limit redirects to 5
-        self.emit("movq -96(%rbp), %rax")
-        self.emit("cmpq $5, %rax")
-        self.emit("jge vyl_http_dl_fail_close")
-
-        # Build request string without varargs to avoid alignment issues
-        self.emit("movq -48(%rbp), %rdi")   # host
-        self.emit("call strlen")
-        self.emit("movq %rax, %r12")       # len_host
-        self.emit("movq -56(%rbp), %rdi")  # path
-        self.emit("call strlen")
-        self.emit("movq %rax, %r13")       # len_path
-        self.emit("movq %r12, %rax")
-        self.emit("addq %r13, %rax")
-        self.emit("addq $66, %rax")        # constant parts + null
-        self.emit("movq %rax, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_fail_close")
-        self.emit("movq %rax, %r13")       # req buffer
-        # strcpy(req, "GET ")
-        self.emit("movq %r13, %rdi")
-        self.emit("leaq .http_get_prefix(%rip), %rsi")
-        self.emit("call strcpy")
-        # strcat(req, path)
-        self.emit("movq %r13, %rdi")
-        self.emit("movq -56(%rbp), %rsi")
-        self.emit("call strcat")
-        # strcat(req, " HTTP/1.0\\r\\nHost: ")
-        self.emit("movq %r13, %rdi")
-        self.emit("leaq .http_get_mid(%rip), %rsi")
-        self.emit("call strcat")
-        # strcat(req, host)
-        self.emit("movq %r13, %rdi")
-        self.emit("movq -48(%rbp), %rsi")
-        self.emit("call strcat")
-        # strcat(req, suffix)
-        self.emit("movq %r13, %rdi")
-        self.emit("leaq .http_get_suffix(%rip), %rsi")
-        self.emit("call strcat")
-
-        # Connect
-        self.emit("movq -64(%rbp), %rax")
-        self.emit("cmpq $0, %rax")
-        self.emit("jne vyl_http_dl_tls")
-        self.emit("movq -48(%rbp), %rdi")
-        self.emit("movq $80, %rsi")
-        self.emit("call vyl_tcp_connect")
-        self.emit("jmp vyl_http_dl_conn_done")
-        self.emit("vyl_http_dl_tls:")
-        self.emit("movq -48(%rbp), %rdi")
-        self.emit("movq $443, %rsi")
-        self.emit("call vyl_tls_connect")
-        self.emit("vyl_http_dl_conn_done:")
-        self.emit("movq %rax, %rbx")
-        self.emit("cmpq $0, %rbx")
-        self.emit("je vyl_http_dl_fail_close")
-
-        # Send request
-        self.emit("movq -64(%rbp), %rax")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_send_plain")
+        self.emit("subq %r12, %r14")  # line bytes before the newline
+        self.emit("leaq 1(%r14), %rax")
+        self.emit("addq %rax, 8(%rbx)")
         self.emit("movq %rbx, %rdi")
-        self.emit("movq %r13, %rsi")
-        self.emit("call vyl_tls_send")
-        self.emit("jmp vyl_http_dl_after_send")
-        self.emit("vyl_http_dl_send_plain:")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r14, %rdx")
+        self.emit("call vyl_reader_take")
+        self.emit("jmp vyl_reader_line_done")
+        self.emit("vyl_reader_line_partial:")  # no newline yet: keep it all, refill
+        self.emit("addq %r13, 8(%rbx)")
         self.emit("movq %rbx, %rdi")
-        self.emit("movq %r13, %rsi")
-        self.emit("call vyl_tcp_send")
-        self.emit("vyl_http_dl_after_send:")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("call vyl_reader_take")
+        self.emit("jmp vyl_reader_line_loop")
+        self.emit("vyl_reader_line_done:")
+        self.emit("movq 24(%rbx), %rax")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
 
-        # recv loop - use 64KB buffer for faster downloads
-        self.emit("movq $65536, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_fail_conn")
-        self.emit("movq %rax, -80(%rbp)")  # buf
-        self.emit("movq $1, -88(%rbp)")     # first_chunk flag
-        self.emit("vyl_http_dl_loop:")
-        self.emit("movq -64(%rbp), %rax")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_plain_recv")
-        self.emit("movq %rbx, %rdi")
-        self.emit("movq -80(%rbp), %rsi")
-        self.emit("movq $65535, %rdx")
-        self.emit("call SSL_read")
-        self.emit("jmp vyl_http_dl_after_recv")
-        self.emit("vyl_http_dl_plain_recv:")
-        self.emit("movq %rbx, %rdi")
-        self.emit("movq -80(%rbp), %rsi")
-        self.emit("movq $65535, %rdx")
-        self.emit("movq $0, %rcx")
-        self.emit("call recv")
-        self.emit("vyl_http_dl_after_recv:")
-        self.emit("cmpq $0, %rax")
-        self.emit("jle vyl_http_dl_done")
-        self.emit("movq %rax, %r12")
-        # Null-terminate buffer at offset r12
-        self.emit("movq -80(%rbp), %rdi")
-        self.emit("movb $0, (%rdi,%r12,1)")
-
-        # Load buffer pointer for write - needed for both first and subsequent chunks
-        self.emit("movq -80(%rbp), %rsi")
-
-        # handle redirects on first chunk (3xx with Location) or errors (4xx/5xx)
-        self.emit("cmpq $0, -88(%rbp)")
-        self.emit("je vyl_http_dl_write")
-        self.emit("movq $0, -88(%rbp)")
-        # %rsi already has buffer from above
-        # Check HTTP status code at position 9 (after "HTTP/1.x ")
-        # 2xx = success, 3xx = redirect, 4xx/5xx = error
-        self.emit("movb 9(%rsi), %al")
-        # Check for 4xx or 5xx errors
-        self.emit("cmpb $'4', %al")
-        self.emit("je vyl_http_dl_fail_conn")   # 4xx error
-        self.emit("cmpb $'5', %al")
-        self.emit("je vyl_http_dl_fail_conn")   # 5xx error
-        # Check for 3xx redirect
-        self.emit("cmpb $'3', %al")
-        self.emit("jne vyl_http_dl_strip_headers")  # 2xx, go strip headers
-        self.emit("movb 10(%rsi), %al")
-        self.emit("cmpb $'0', %al")
-        self.emit("jne vyl_http_dl_strip_headers")
-        self.emit("movb 11(%rsi), %al")
-        self.emit("cmpb $'1', %al")
-        self.emit("je vyl_http_dl_redir")
-        self.emit("cmpb $'2', %al")
-        self.emit("je vyl_http_dl_redir")
-        self.emit("cmpb $'7', %al")
-        self.emit("je vyl_http_dl_redir")
-        self.emit("cmpb $'8', %al")
-        self.emit("jne vyl_http_dl_strip_headers")
-
-        self.emit("vyl_http_dl_redir:")
-        # find Location header
-        self.emit("movq $0, %rdx")
-        self.emit("movq %r12, %rcx")
-        self.emit("vyl_http_dl_find_loc:")
-        self.emit("cmpq %rcx, %rdx")
-        self.emit("jge vyl_http_dl_strip_headers")
-        self.emit("leaq (%rsi,%rdx,1), %rdi")
-        self.emit("leaq .http_loc(%rip), %rsi")
-        self.emit("movq $9, %rdx")
-        self.emit("call strncmp")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_loc_found")
-        self.emit("movq -80(%rbp), %rsi")
-        self.emit("movq %rdx, %rax")
-        self.emit("incq %rax")
+        # vyl_reader_chunk(rdi=reader) -> the next buffered block (up to 64 KiB)
+        # in the reused string; "" at end of file
+        self.emit(".globl vyl_reader_chunk")
+        self.emit("vyl_reader_chunk:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq 24(%rbx), %rax")
+        self.emit("movq $0, -8(%rax)")
+        self.emit("movb $0, (%rax)")
+        self.emit("call vyl_reader_fill")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_reader_chunk_done")
+        self.emit("movq 8(%rbx), %rcx")
+        self.emit(f"leaq {data}(%rbx,%rcx), %rsi")
+        self.emit("movq 16(%rbx), %rcx")
+        self.emit("movq %rcx, 8(%rbx)")
         self.emit("movq %rax, %rdx")
-        self.emit("jmp vyl_http_dl_find_loc")
-
-        self.emit("vyl_http_dl_loc_found:")
-        # rdi points to "Location:"; value starts at +10 (including space)
-        self.emit("addq $10, %rdi")
-        self.emit("movq %rdi, %r15")      # save location value ptr
-
-        # detect scheme
-        self.emit("movq %r15, %rdi")
-        self.emit("leaq .https_prefix(%rip), %rsi")
-        self.emit("movq $8, %rdx")
-        self.emit("call strncmp")
-        self.emit("cmpq $0, %rax")
-        self.emit("jne vyl_http_dl_check_http")
-        self.emit("movq $1, -64(%rbp)")    # use_tls=1
-        self.emit("addq $8, %r15")         # skip https://
-        self.emit("jmp vyl_http_dl_host_parsed")
-        self.emit("vyl_http_dl_check_http:")
-        self.emit("movq %r15, %rdi")
-        self.emit("leaq .http_prefix(%rip), %rsi")
-        self.emit("movq $7, %rdx")
-        self.emit("call strncmp")
-        self.emit("cmpq $0, %rax")
-        self.emit("jne vyl_http_dl_relative")
-        self.emit("movq $0, -64(%rbp)")    # use_tls=0
-        self.emit("addq $7, %r15")         # skip http://
-        self.emit("jmp vyl_http_dl_host_parsed")
-
-        # relative redirect: host stays the same, path becomes location value
-        self.emit("vyl_http_dl_relative:")
-        self.emit("movq -48(%rbp), %rax")
-        self.emit("movq %rax, %rdi")       # host stays
-        self.emit("movq %r15, %rsi")       # path pointer
-        self.emit("jmp vyl_http_dl_copy_host_path")
-
-        # absolute redirect host parsed at r15 (start of host)
-        self.emit("vyl_http_dl_host_parsed:")
-        # find '/' separator to split host/path
-        self.emit("movq %r15, %rdi")
-        self.emit("movq $47, %rsi")
-        self.emit("call strchr")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_strip_headers")
-        self.emit("movq %rax, %rsi")       # rsi = path ptr
-        self.emit("movb $0, (%rax)")       # null-terminate host in-place
-        self.emit("movq %r15, %rdi")       # rdi = host ptr
-        self.emit("movq %rsi, %r9")        # save path ptr
-
-        self.emit("vyl_http_dl_copy_host_path:")
-        # copy host
-        self.emit("call strlen")
-        self.emit("incq %rax")
-        self.emit("movq %rax, %r12")
-        self.emit("movq %rax, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_strip_headers")
-        self.emit("movq %rax, %r10")       # new host
-        self.emit("movq %r10, %rdi")
-        self.emit("movq %r15, %rsi")
-        self.emit("call strcpy")
-        # copy path
-        self.emit("movq %r9, %rdi")
-        self.emit("call strlen")
-        self.emit("incq %rax")
-        self.emit("movq %rax, %r12")
-        self.emit("movq %rax, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_strip_headers")
-        self.emit("movq %rax, %r11")       # new path
-        self.emit("movq %r11, %rdi")
-        self.emit("movq %r9, %rsi")
-        self.emit("call strcpy")
-
-        # update host/path and restart request
-        self.emit("movq %r10, -48(%rbp)")
-        self.emit("movq %r11, -56(%rbp)")
-        self.emit("incq -96(%rbp)")        # redirect++
-        self.emit("movq %rbx, %rdi")
-        self.emit("cmpq $0, -64(%rbp)")
-        self.emit("jne vyl_http_dl_close_tls")
-        self.emit("call close")
-        self.emit("jmp vyl_http_dl_restart")
-        self.emit("vyl_http_dl_close_tls:")
-        self.emit("call vyl_tls_close")
-        self.emit("vyl_http_dl_restart:")
-        self.emit("movq $1, -88(%rbp)")
-        self.emit("jmp vyl_http_dl_start")
-
-        # strip headers on first chunk (fallback or non-redirect)
-        # Look for \r\n\r\n sequence
-        self.emit("vyl_http_dl_strip_headers:")
-        self.emit("movq -80(%rbp), %rsi")
-        self.emit("movq $0, %rdx")          # offset counter
-        self.emit("movq %r12, %rcx")        # length
-        self.emit("vyl_http_dl_scan:")
-        self.emit("cmpq %rcx, %rdx")
-        self.emit("jge vyl_http_dl_write")  # didn't find \r\n\r\n, write everything
-        self.emit("movb (%rsi,%rdx,1), %al")
-        self.emit("cmpb $13, %al")          # is it \r?
-        self.emit("jne vyl_http_dl_scan_next")
-        # Found \r at rdx. Check if next 3 bytes are \n\r\n
-        self.emit("movq %rdx, %rax")
-        self.emit("addq $3, %rax")
-        self.emit("cmpq %rcx, %rax")
-        self.emit("jge vyl_http_dl_scan_next")  # not enough bytes remaining
-        self.emit("movb 1(%rsi,%rdx,1), %al")   # byte at rdx+1
-        self.emit("cmpb $10, %al")              # == \n?
-        self.emit("jne vyl_http_dl_scan_next")
-        self.emit("movb 2(%rsi,%rdx,1), %al")   # byte at rdx+2
-        self.emit("cmpb $13, %al")              # == \r?
-        self.emit("jne vyl_http_dl_scan_next")
-        self.emit("movb 3(%rsi,%rdx,1), %al")   # byte at rdx+3
-        self.emit("cmpb $10, %al")              # == \n?
-        self.emit("jne vyl_http_dl_scan_next")
-        # Found \r\n\r\n! Body starts at rdx+4
-        self.emit("addq $4, %rdx")
-        self.emit("leaq (%rsi,%rdx,1), %rsi")  # rsi = body start
-        self.emit("movq %rcx, %rax")
-        self.emit("subq %rdx, %rax")
-        self.emit("movq %rax, %r12")           # r12 = remaining body length
-        self.emit("jmp vyl_http_dl_write")
-        self.emit("vyl_http_dl_scan_next:")
-        self.emit("incq %rdx")
-        self.emit("jmp vyl_http_dl_scan")
-
-        self.emit("vyl_http_dl_write:")
-        self.emit("cmpq $0, %r12")
-        self.emit("jle vyl_http_dl_loop")
-        # fwrite(buf, 1, len, file)
-        self.emit("movq %rsi, %rdi")
-        self.emit("movq $1, %rsi")
-        self.emit("movq %r12, %rdx")
-        self.emit("movq %r14, %rcx")
-        self.emit("call fwrite")
-        self.emit("jmp vyl_http_dl_loop")
-
-        self.emit("vyl_http_dl_done:")
-        # Close the connection properly
-        self.emit("movq -64(%rbp), %rax")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_done_plain")
-        # TLS cleanup: call SSL_shutdown and SSL_free (rbx holds SSL*)
-        self.emit("movq %rbx, %rdi")
-        self.emit("call SSL_shutdown")
-        self.emit("movq %rbx, %rdi")
-        self.emit("call SSL_free")
-        self.emit("jmp vyl_http_dl_done_fclose")
-        self.emit("vyl_http_dl_done_plain:")
-        # Plain socket: close fd (rbx holds socket fd)
-        self.emit("movq %rbx, %rdi")
-        self.emit("call close")
-        self.emit("vyl_http_dl_done_fclose:")
-        self.emit("movq %r14, %rdi")
-        self.emit("call fclose")
-        self.emit("movq $1, %rax")
-        self.emit("jmp vyl_http_dl_ret")
-
-        self.emit("vyl_http_dl_fail_conn:")
-        # Check if TLS or plain
-        self.emit("movq -64(%rbp), %rax")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_http_dl_fail_plain")
-        # TLS cleanup
-        self.emit("movq %rbx, %rdi")
-        self.emit("call SSL_shutdown")
-        self.emit("movq %rbx, %rdi")
-        self.emit("call SSL_free")
-        self.emit("jmp vyl_http_dl_fail_close")
-        self.emit("vyl_http_dl_fail_plain:")
         self.emit("movq %rbx, %rdi")
-        self.emit("call close")
-        self.emit("vyl_http_dl_fail_close:")
-        self.emit("cmpq $0, %r14")
-        self.emit("je vyl_http_dl_fail")
-        self.emit("movq %r14, %rdi")
-        self.emit("call fclose")
-        self.emit("vyl_http_dl_fail:")
-        self.emit("movq $0, %rax")
-
-        self.emit("vyl_http_dl_ret:")
-        self.emit("addq $216, %rsp")
-        self.emit("pop %r15")
-        self.emit("pop %r14")
-        self.emit("pop %r13")
+        self.emit("call vyl_reader_take")
+        self.emit("vyl_reader_chunk_done:")
+        self.emit("movq 24(%rbx), %rax")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_mkdir_p(path) -> int (1 success, 0 fail)
-        self.emit(".globl vyl_mkdir_p")
-        self.emit("vyl_mkdir_p:")
+        # vyl_reader_eof(rdi=reader) -> 1 once nothing is buffered or left to read
+        self.emit(".globl vyl_reader_eof")
+        self.emit("vyl_reader_eof:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
-        self.emit("subq $272, %rsp")  # 256-byte buffer + alignment (272 % 16 == 0)
-        self.emit("movq %rdi, %rcx")               # rcx = path (format arg)
-        self.emit("leaq -256(%rbp), %rdi")         # rdi = buffer
-        self.emit("movq $256, %rsi")               # rsi = size
-        self.emit("leaq .fmt_mkdirp(%rip), %rdx")  # rdx = format string
-        self.emit("movq $0, %rax")
-        self.emit("call snprintf")
-        self.emit("leaq -256(%rbp), %rdi")
-        self.emit("call system")
-        self.emit("cmpq $0, %rax")
+        self.emit("movl $1, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_reader_eof_ret")
+        self.emit("call vyl_reader_fill")
+        self.emit("testq %rax, %rax")
         self.emit("sete %al")
         self.emit("movzbq %al, %rax")
-        self.emit("addq $272, %rsp")
+        self.emit("vyl_reader_eof_ret:")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_remove_all(path) -> int (1 success, 0 fail)
-        self.emit(".globl vyl_remove_all")
-        self.emit("vyl_remove_all:")
+        # vyl_reader_close(rdi=reader): close the file and free both buffers
+        self.emit(".globl vyl_reader_close")
+        self.emit("vyl_reader_close:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
-        self.emit("subq $272, %rsp")               # 272 % 16 == 0, keeps alignment
-        self.emit("movq %rdi, %rcx")               # rcx = path (format arg)
-        self.emit("leaq -256(%rbp), %rdi")         # rdi = buffer
-        self.emit("movq $256, %rsi")               # rsi = size
-        self.emit("leaq .fmt_rmrf(%rip), %rdx")    # rdx = format string
-        self.emit("movq $0, %rax")
-        self.emit("call snprintf")
-        self.emit("leaq -256(%rbp), %rdi")
-        self.emit("call system")
-        self.emit("cmpq $0, %rax")
-        self.emit("sete %al")
-        self.emit("movzbq %al, %rax")
-        self.emit("addq $272, %rsp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_reader_close_ret")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq 32(%rbx), %rdi")
+        self.emit("call fclose")
+        self.emit("movq 24(%rbx), %rdi")
+        self.emit("subq $16, %rdi")
+        self.emit("call free")
+        self.emit("movq %rbx, %rdi")
+        self.emit("call free")
+        self.emit("vyl_reader_close_ret:")
+        self.emit("xorl %eax, %eax")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_readdir(dir) -> string (entry name, or empty string if done)
-        # Returns d_name field from struct dirent
-        self.emit(".globl vyl_readdir")
-        self.emit("vyl_readdir:")
+    def generate_string_builder_runtime(self):
+        """Emit the StringBuilder helpers.
+
+        A builder is a one-word managed cell pointing at a string buffer whose
+        header capacity grows by doubling; -8(buf) is the length written so far.
+        """
+        # vyl_sb_new() -> builder with a small initial buffer
+        self.emit(".globl vyl_sb_new")
+        self.emit("vyl_sb_new:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
-        self.emit("subq $8, %rsp")  # Maintain 16-byte alignment (8 + 8 = 16)
-        self.emit("movq %rdi, %rbx")  # Save dir handle
-        self.emit("call readdir")     # Returns struct dirent*
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_readdir_done")
-        # struct dirent has d_name at offset 19 (on x86-64 Linux)
-        self.emit("addq $19, %rax")   # Point to d_name
-        # Skip "." and ".." entries
-        self.emit("movb (%rax), %cl")
-        self.emit("cmpb $'.', %cl")
-        self.emit("jne vyl_readdir_ret")
-        self.emit("movb 1(%rax), %cl")
-        self.emit("cmpb $0, %cl")
-        self.emit("je vyl_readdir_next")  # "." entry
-        self.emit("cmpb $'.', %cl")
-        self.emit("jne vyl_readdir_ret")
-        self.emit("movb 2(%rax), %cl")
-        self.emit("cmpb $0, %cl")
-        self.emit("jne vyl_readdir_ret")  # Not ".."
-        self.emit("vyl_readdir_next:")
+        self.emit("subq $8, %rsp")
+        self.emit("movq $8, %rdi")
+        self.emit("call vyl_alloc")
+        self.emit("movq %rax, %rbx")
+        self.emit(f"movq ${SB_MIN_CAPACITY}, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("movq $0, -8(%rax)")
+        self.emit("movb $0, (%rax)")
+        self.emit("movq %rax, (%rbx)")
+        self.emit("movq %rbx, %rax")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_sb_reserve(sb, extra): make room for extra more bytes
+        self.emit(".globl vyl_sb_reserve")
+        self.emit("vyl_sb_reserve:")
+        self.emit("movq (%rdi), %rax")
+        self.emit("movq -8(%rax), %rdx")
+        self.emit("addq %rsi, %rdx")  # required capacity
+        self.emit("cmpq -16(%rax), %rdx")
+        self.emit("ja vyl_sb_grow")
+        self.emit("ret")
+        self.emit("vyl_sb_grow:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rax, %r12")  # old buffer
+        self.emit("movq -16(%rax), %rdi")
+        self.emit("addq %rdi, %rdi")  # double, or jump straight to what is needed
+        self.emit("cmpq %rdx, %rdi")
+        self.emit("cmovbq %rdx, %rdi")
+        self.emit("call vyl_str_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_sb_grow_ret")
+        self.emit("movq -8(%r12), %rdx")
+        self.emit("movq %rdx, -8(%rax)")
+        self.emit("movq %rax, (%rbx)")
+        self.emit("movq %rax, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("incq %rdx")  # keep the terminator
+        self.emit("call memcpy")
+        self.emit("vyl_sb_grow_ret:")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_sb_append_bytes(sb, ptr, n)
+        self.emit(".globl vyl_sb_append_bytes")
+        self.emit("vyl_sb_append_bytes:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("subq $8, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rdx, %r13")
+        self.emit("movq %rdx, %rsi")
+        self.emit("call vyl_sb_reserve")
+        self.emit("movq (%rbx), %rax")
+        self.emit("movq -8(%rax), %rdi")
+        self.emit("leaq (%rdi,%r13,1), %rcx")
+        self.emit("movq %rcx, -8(%rax)")
+        self.emit("movb $0, (%rax,%rcx,1)")
+        self.emit("addq %rax, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("movq %r13, %rdx")
+        self.emit("call memcpy")
+        self.emit("addq $8, %rsp")
+        self.emit("pop %r13")
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_sb_append(sb, str); a null string appends nothing
+        self.emit(".globl vyl_sb_append")
+        self.emit("vyl_sb_append:")
+        self.emit("testq %rsi, %rsi")
+        self.emit("jz vyl_sb_append_ret")
+        self.emit("movq -8(%rsi), %rdx")
+        self.emit("jmp vyl_sb_append_bytes")
+        self.emit("vyl_sb_append_ret:")
+        self.emit("ret")
+
+        # vyl_sb_append_int(sb, n): format n in place, no temporary string
+        self.emit(".globl vyl_sb_append_int")
+        self.emit("vyl_sb_append_int:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $40, %rsp")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %rdi")
+        self.emit("leaq -8(%rbp), %rsi")
+        self.emit("call vyl_itoa")
         self.emit("movq %rbx, %rdi")
-        self.emit("call readdir")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_readdir_done")
-        self.emit("addq $19, %rax")
-        self.emit("jmp vyl_readdir_ret")
-        self.emit("vyl_readdir_done:")
-        self.emit("leaq .empty_str(%rip), %rax")
-        self.emit("vyl_readdir_ret:")
+        self.emit("movq %rax, %rsi")
+        self.emit("call vyl_sb_append_bytes")
+        self.emit("movq -8(%rbp), %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_sb_build(sb) -> string copy of the current contents
+        self.emit(".globl vyl_sb_build")
+        self.emit("vyl_sb_build:")
+        self.emit("movq (%rdi), %rdi")
+        self.emit("movq -8(%rdi), %rdx")
+        self.emit("xorl %esi, %esi")
+        self.emit("jmp vyl_substring")
+
+    def generate_vector_runtime(self):
+        """Emit Vec/Push/Pop.
+
+        Every array carries [capacity, length] in the 16 bytes before its data,
+        so a vector is an ordinary array: Len and indexing work unchanged. Push
+        appends in place while there is room and otherwise moves the elements
+        into a buffer of twice the capacity, returning the new data pointer.
+        """
+        # vyl_vec_new(rdi=capacity) -> empty array with room for capacity elements
+        self.emit(".globl vyl_vec_new")
+        self.emit("vyl_vec_new:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("subq $8, %rsp")
+        self.emit("testq %rdi, %rdi")
+        self.emit(f"movq ${VEC_MIN_CAPACITY}, %rax")
+        self.emit("cmovleq %rax, %rdi")
+        self.emit("movq %rdi, %rbx")
+        self.emit(f"leaq {ARRAY_HEADER_SIZE}(,%rdi,8), %rdi")
+        self.emit("call vyl_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_vec_new_ret")
+        self.emit("movq %rbx, (%rax)")  # capacity; the zeroed length follows
+        self.emit(f"addq ${ARRAY_HEADER_SIZE}, %rax")
+        self.emit("vyl_vec_new_ret:")
         self.emit("addq $8, %rsp")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_unzip(zipPath, destDir) -> int (1 success, 0 fail)
-        self.emit(".globl vyl_unzip")
-        self.emit("vyl_unzip:")
+        # vyl_vec_push(rdi=vec, rsi=value) -> vec, or its grown replacement
+        self.emit(".globl vyl_vec_push")
+        self.emit("vyl_vec_push:")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_vec_grow")
+        self.emit("movq -8(%rdi), %rcx")
+        self.emit("cmpq -16(%rdi), %rcx")
+        self.emit("jae vyl_vec_grow")
+        self.emit("movq %rsi, (%rdi,%rcx,8)")
+        self.emit("incq %rcx")
+        self.emit("movq %rcx, -8(%rdi)")
+        self.emit("movq %rdi, %rax")
+        self.emit("ret")
+        self.emit("vyl_vec_grow:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
-        # After 2 pushes, rsp = rbp - 16, rsp % 16 == 0
-        # Need 512 byte buffer. 512 % 16 == 0, so just subq $512
-        self.emit("subq $512, %rsp")
-        self.emit("movq %rdi, %rbx")   # save zipPath
-        self.emit("movq %rsi, %r12")   # save destDir
-        # snprintf(buf, 512, "unzip -o -q %s -d %s", zipPath, destDir)
-        # buffer is at rsp (which is rbp - 16 - 512 = rbp - 528)
-        self.emit("movq %rsp, %rdi")
-        self.emit("movq $512, %rsi")
-        self.emit("leaq .fmt_unzip(%rip), %rdx")
-        self.emit("movq %rbx, %rcx")   # zipPath
-        self.emit("movq %r12, %r8")    # destDir
-        self.emit("movq $0, %rax")
-        self.emit("call snprintf")
-        self.emit("movq %rsp, %rdi")
-        self.emit("call system")
-        self.emit("cmpq $0, %rax")
-        self.emit("sete %al")
-        self.emit("movzbq %al, %rax")
-        self.emit("addq $512, %rsp")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("movq %rdi, %r12")  # old data
+        self.emit("movq %rsi, %r13")  # value
+        self.emit("xorq %r14, %r14")  # old length
+        self.emit(f"movq ${VEC_MIN_CAPACITY}, %rbx")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_vec_grow_alloc")
+        self.emit("movq -8(%rdi), %r14")
+        self.emit("movq -16(%rdi), %rax")
+        self.emit("addq %rax, %rax")
+        self.emit("cmpq %rbx, %rax")
+        self.emit("cmovaq %rax, %rbx")
+        self.emit("vyl_vec_grow_alloc:")
+        self.emit(f"leaq {ARRAY_HEADER_SIZE}(,%rbx,8), %rdi")
+        self.emit("call vyl_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_vec_grow_ret")
+        self.emit("movq %rbx, (%rax)")
+        self.emit("leaq 1(%r14), %rcx")
+        self.emit("movq %rcx, 8(%rax)")
+        self.emit(f"leaq {ARRAY_HEADER_SIZE}(%rax), %rbx")  # new data
+        self.emit("movq %r13, (%rbx,%r14,8)")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit("leaq (,%r14,8), %rdx")
+        self.emit("call memcpy")
+        self.emit("movq %rbx, %rax")
+        self.emit("vyl_vec_grow_ret:")
+        self.emit("pop %r14")
+        self.emit("pop %r13")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_copy_file(src, dst) -> int (1 success, 0 fail)
-        self.emit(".globl vyl_copy_file")
-        self.emit("vyl_copy_file:")
+        # vyl_vec_pop(rdi=vec) -> last element, shrinking the length by one
+        self.emit(".globl vyl_vec_pop")
+        self.emit("vyl_vec_pop:")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_vec_pop_empty")
+        self.emit("movq -8(%rdi), %rcx")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jz vyl_vec_pop_empty")
+        self.emit("decq %rcx")
+        self.emit("movq %rcx, -8(%rdi)")
+        self.emit("movq (%rdi,%rcx,8), %rax")
+        self.emit("ret")
+        self.emit("vyl_vec_pop_empty:")
+        self.emit("jmp vyl_bounds_fail")
+
+        # vyl_array_clone(rdi=array, rsi=depth) -> heap copy of a const array;
+        # with depth > 0 its elements are arrays, copied depth - 1 levels down
+        self.emit(".globl vyl_array_clone")
+        self.emit("vyl_array_clone:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
         self.emit("push %r13")
         self.emit("push %r14")
-        self.emit("subq $4120, %rsp")  # 4096-byte buffer
-        self.emit("movq %rdi, %r12")     # src path
-        self.emit("movq %rsi, %r13")     # dst path
-        # open src
-        self.emit("movq %r12, %rdi")
-        self.emit("leaq .mode_rb(%rip), %rsi")
-        self.emit("call fopen")
-        self.emit("movq %rax, %r12")     # src FILE*
-        self.emit("cmpq $0, %r12")
-        self.emit("je vyl_copy_fail")
-        # open dst
-        self.emit("movq %r13, %rdi")
-        self.emit("leaq .mode_wb(%rip), %rsi")
-        self.emit("call fopen")
-        self.emit("movq %rax, %r13")     # dst FILE*
-        self.emit("cmpq $0, %r13")
-        self.emit("je vyl_copy_close_src")
-        # buffer
-        self.emit("leaq -4096(%rbp), %r14")
-        self.emit("vyl_copy_loop:")
-        self.emit("movq %r14, %rdi")
-        self.emit("movq $1, %rsi")
-        self.emit("movq $4096, %rdx")
-        self.emit("movq %r12, %rcx")
-        self.emit("call fread")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_copy_done")
-        self.emit("movq %rax, %rbx")      # bytes read
+        self.emit("movq %rdi, %r12")  # source data
+        self.emit("movq %rsi, %r13")  # depth
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_array_clone_ret")
+        self.emit("movq -8(%rdi), %rbx")  # length
+        self.emit(f"leaq {ARRAY_HEADER_SIZE}(,%rbx,8), %rdi")
+        self.emit("call vyl_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_array_clone_ret")
+        self.emit("movq %rbx, (%rax)")
+        self.emit("movq %rbx, 8(%rax)")
+        self.emit(f"leaq {ARRAY_HEADER_SIZE}(%rax), %r14")  # new data
         self.emit("movq %r14, %rdi")
-        self.emit("movq $1, %rsi")
-        self.emit("movq %rbx, %rdx")
-        self.emit("movq %r13, %rcx")
-        self.emit("call fwrite")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_copy_fail_close")
-        self.emit("jmp vyl_copy_loop")
-        self.emit("vyl_copy_done:")
-        self.emit("movq %r12, %rdi")
-        self.emit("call fclose")
-        self.emit("movq %r13, %rdi")
-        self.emit("call fclose")
-        self.emit("movq $1, %rax")
-        self.emit("jmp vyl_copy_ret")
-        self.emit("vyl_copy_fail_close:")
-        self.emit("movq %r13, %rdi")
-        self.emit("call fclose")
-        self.emit("vyl_copy_close_src:")
-        self.emit("movq %r12, %rdi")
-        self.emit("call fclose")
-        self.emit("vyl_copy_fail:")
-        self.emit("movq $0, %rax")
-        self.emit("vyl_copy_ret:")
-        self.emit("addq $4112, %rsp")
+        self.emit("movq %r12, %rsi")
+        self.emit("leaq (,%rbx,8), %rdx")
+        self.emit("call memcpy")
+        self.emit("testq %r13, %r13")
+        self.emit("jz vyl_array_clone_done")
+        self.emit("decq %r13")
+        self.emit("vyl_array_clone_next:")
+        self.emit("testq %rbx, %rbx")
+        self.emit("jz vyl_array_clone_done")
+        self.emit("decq %rbx")
+        self.emit("movq (%r14,%rbx,8), %rdi")
+        self.emit("movq %r13, %rsi")
+        self.emit("call vyl_array_clone")
+        self.emit("movq %rax, (%r14,%rbx,8)")
+        self.emit("jmp vyl_array_clone_next")
+        self.emit("vyl_array_clone_done:")
+        self.emit("movq %r14, %rax")
+        self.emit("vyl_array_clone_ret:")
         self.emit("pop %r14")
         self.emit("pop %r13")
         self.emit("pop %r12")
@@ -3493,110 +10217,717 @@ class CodeGenerator:
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_strconcat(s1, s2) -> new string s1+s2
-        self.emit(".globl vyl_strconcat")
-        self.emit("vyl_strconcat:")
+    def generate_map_runtime(self):
+        """Emit the Map<K, V> runtime.
+
+        A map is a fixed handle pointing at one flat slot array, so lookups
+        touch a single cache line in the common case and only a resize
+        allocates. Values are stored as raw words whatever V is; the key type
+        selects the _int or _str variant of the hash and probe routines.
+        """
+        slot = MAP_SLOT_SIZE
+
+        # vyl_map_new() -> empty map handle
+        self.emit(".globl vyl_map_new")
+        self.emit("vyl_map_new:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
-        self.emit("push %r12")
-        self.emit("push %r13")
-        self.emit("subq $8, %rsp")  # align to 16
-        self.emit("movq %rdi, %r12")  # s1
-        self.emit("movq %rsi, %r13")  # s2
-        # len1 = strlen(s1)
-        self.emit("call strlen")
+        self.emit("subq $8, %rsp")
+        self.emit(f"movq ${MAP_HEADER_SIZE}, %rdi")
+        self.emit("call vyl_alloc")
         self.emit("movq %rax, %rbx")
-        # len2 = strlen(s2)
-        self.emit("movq %r13, %rdi")
-        self.emit("call strlen")
-        # allocate len1 + len2 + 1
-        self.emit("addq %rbx, %rax")
-        self.emit("addq $1, %rax")
-        self.emit("movq %rax, %rdi")
+        self.emit(f"movq ${MAP_MIN_CAPACITY * slot}, %rdi")
         self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_strconcat_fail")
-        self.emit("movq %rax, %rbx")  # save result
-        # strcpy(result, s1)
-        self.emit("movq %rax, %rdi")
-        self.emit("movq %r12, %rsi")
-        self.emit("call strcpy")
-        # strcat(result, s2)
-        self.emit("movq %rbx, %rdi")
-        self.emit("movq %r13, %rsi")
-        self.emit("call strcat")
+        self.emit("movq %rax, (%rbx)")
+        self.emit(f"movq ${MAP_MIN_CAPACITY}, 8(%rbx)")
         self.emit("movq %rbx, %rax")
-        self.emit("jmp vyl_strconcat_ret")
-        self.emit("vyl_strconcat_fail:")
-        self.emit("movq $0, %rax")
-        self.emit("vyl_strconcat_ret:")
         self.emit("addq $8, %rsp")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+        # vyl_map_grow(rdi=map): rehash into twice the slots, or the same number
+        # when most of the load is deleted entries. Stored hashes are reused.
+        self.emit(".globl vyl_map_grow")
+        self.emit("vyl_map_grow:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq 8(%rbx), %r12")  # old capacity
+        self.emit("movq %r12, %r13")
+        self.emit("movq 16(%rbx), %rax")
+        self.emit("addq %rax, %rax")
+        self.emit("cmpq %r12, %rax")
+        self.emit("jb vyl_map_grow_alloc")
+        self.emit("addq %r13, %r13")
+        self.emit("vyl_map_grow_alloc:")
+        self.emit(f"imulq ${slot}, %r13, %rdi")
+        self.emit("call vyl_alloc")
+        self.emit("testq %rax, %rax")
+        self.emit("jz vyl_map_grow_ret")
+        self.emit("movq %rax, %r14")
+        self.emit("movq (%rbx), %rsi")
+        self.emit(f"imulq ${slot}, %r12, %rcx")
+        self.emit("addq %rsi, %rcx")  # end of old slots
+        self.emit("leaq -1(%r13), %r8")  # new mask
+        self.emit("vyl_map_grow_loop:")
+        self.emit("cmpq %rcx, %rsi")
+        self.emit("jae vyl_map_grow_done")
+        self.emit("movq (%rsi), %rax")
+        self.emit("cmpq $2, %rax")
+        self.emit("jb vyl_map_grow_next")
+        self.emit("movq %rax, %rdx")
+        self.emit("andq %r8, %rdx")
+        self.emit("vyl_map_grow_probe:")
+        self.emit("leaq (%rdx,%rdx,2), %r9")
+        self.emit("leaq (%r14,%r9,8), %r9")
+        self.emit("cmpq $0, (%r9)")
+        self.emit("je vyl_map_grow_place")
+        self.emit("incq %rdx")
+        self.emit("andq %r8, %rdx")
+        self.emit("jmp vyl_map_grow_probe")
+        self.emit("vyl_map_grow_place:")
+        self.emit("movq %rax, (%r9)")
+        self.emit("movq 8(%rsi), %rax")
+        self.emit("movq %rax, 8(%r9)")
+        self.emit("movq 16(%rsi), %rax")
+        self.emit("movq %rax, 16(%r9)")
+        self.emit("vyl_map_grow_next:")
+        self.emit(f"addq ${slot}, %rsi")
+        self.emit("jmp vyl_map_grow_loop")
+        self.emit("vyl_map_grow_done:")
+        self.emit("movq %r14, (%rbx)")
+        self.emit("movq %r13, 8(%rbx)")
+        self.emit("movq 16(%rbx), %rax")
+        self.emit("movq %rax, 24(%rbx)")  # deleted slots are gone
+        self.emit("vyl_map_grow_ret:")
+        self.emit("pop %r14")
         self.emit("pop %r13")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_strfind(haystack, needle) -> index or -1
-        self.emit(".globl vyl_strfind")
-        self.emit("vyl_strfind:")
+        # vyl_map_keys(rdi=map) -> array of the live keys, in slot order
+        self.emit(".globl vyl_map_keys")
+        self.emit("vyl_map_keys:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
-        self.emit("subq $8, %rsp")
-        self.emit("movq %rdi, %rbx")  # save haystack
-        # strstr(haystack, needle)
-        self.emit("call strstr")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_strfind_notfound")
-        # found: return offset = result - haystack
-        self.emit("subq %rbx, %rax")
-        self.emit("jmp vyl_strfind_ret")
-        self.emit("vyl_strfind_notfound:")
-        self.emit("movq $-1, %rax")
-        self.emit("vyl_strfind_ret:")
-        self.emit("addq $8, %rsp")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq 16(%rbx), %rdi")
+        self.emit("call vyl_vec_new")
+        self.emit("movq %rax, %r12")
+        self.emit("movq (%rbx), %rsi")
+        self.emit(f"imulq ${slot}, 8(%rbx), %rcx")
+        self.emit("addq %rsi, %rcx")
+        self.emit("xorl %edx, %edx")
+        self.emit("vyl_map_keys_loop:")
+        self.emit("cmpq %rcx, %rsi")
+        self.emit("jae vyl_map_keys_done")
+        self.emit("cmpq $2, (%rsi)")
+        self.emit("jb vyl_map_keys_next")
+        self.emit("movq 8(%rsi), %rax")
+        self.emit("movq %rax, (%r12,%rdx,8)")
+        self.emit("incq %rdx")
+        self.emit("vyl_map_keys_next:")
+        self.emit(f"addq ${slot}, %rsi")
+        self.emit("jmp vyl_map_keys_loop")
+        self.emit("vyl_map_keys_done:")
+        self.emit("movq %rdx, -8(%r12)")
+        self.emit("movq %r12, %rax")
+        self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-        # vyl_substring(str, start, len) -> new string
-        self.emit(".globl vyl_substring")
-        self.emit("vyl_substring:")
+        # vyl_map_hash_int(rdi=key) -> rax: Fibonacci multiply, high half folded down
+        self.emit(".globl vyl_map_hash_int")
+        self.emit("vyl_map_hash_int:")
+        self.emit("movabsq $0x9E3779B97F4A7C15, %rax")
+        self.emit("imulq %rdi, %rax")
+        self.emit("movq %rax, %rdx")
+        self.emit("shrq $32, %rdx")
+        self.emit("xorq %rdx, %rax")
+        self._emit_map_hash_fixup()
+
+        # vyl_map_hash_str(rdi=str) -> rax: FNV-1a over 8-byte words then the
+        # tail bytes, with a final avalanche so the low bits index well.
+        # A null string hashes like the empty string.
+        self.emit(".globl vyl_map_hash_str")
+        self.emit("vyl_map_hash_str:")
+        self.emit("movabsq $0xCBF29CE484222325, %rax")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_map_hash_str_mix")
+        self.emit("movq -8(%rdi), %rcx")
+        self.emit("vyl_map_hash_str_mix:")
+        self.emit("xorq %rcx, %rax")
+        self.emit("movabsq $0x100000001B3, %r8")
+        self.emit("vyl_map_hash_str_words:")
+        self.emit("cmpq $8, %rcx")
+        self.emit("jb vyl_map_hash_str_bytes")
+        self.emit("xorq (%rdi), %rax")
+        self.emit("imulq %r8, %rax")
+        self.emit("addq $8, %rdi")
+        self.emit("subq $8, %rcx")
+        self.emit("jmp vyl_map_hash_str_words")
+        self.emit("vyl_map_hash_str_bytes:")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jz vyl_map_hash_str_done")
+        self.emit("movzbl (%rdi), %edx")
+        self.emit("xorq %rdx, %rax")
+        self.emit("imulq %r8, %rax")
+        self.emit("incq %rdi")
+        self.emit("decq %rcx")
+        self.emit("jmp vyl_map_hash_str_bytes")
+        self.emit("vyl_map_hash_str_done:")
+        self.emit("movq %rax, %rdx")
+        self.emit("shrq $29, %rdx")
+        self.emit("xorq %rdx, %rax")
+        self.emit("movabsq $0xBF58476D1CE4E5B9, %rdx")
+        self.emit("imulq %rdx, %rax")
+        self.emit("movq %rax, %rdx")
+        self.emit("shrq $32, %rdx")
+        self.emit("xorq %rdx, %rax")
+        self._emit_map_hash_fixup()
+
+        # vyl_map_probe_int(rdi=map, rsi=key, rdx=hash) -> rax=slot, rdx=found.
+        # When the key is absent rax is the slot an insert should use: the
+        # first deleted slot on the probe path, else the empty one ending it.
+        self.emit(".globl vyl_map_probe_int")
+        self.emit("vyl_map_probe_int:")
+        self.emit("movq (%rdi), %r8")
+        self.emit("movq 8(%rdi), %r9")
+        self.emit("decq %r9")
+        self.emit("movq %rdx, %rcx")
+        self.emit("andq %r9, %rcx")
+        self.emit("xorl %r10d, %r10d")
+        self.emit("vyl_map_probe_int_loop:")
+        self.emit("leaq (%rcx,%rcx,2), %rax")
+        self.emit("leaq (%r8,%rax,8), %rax")
+        self.emit("movq (%rax), %r11")
+        self.emit("testq %r11, %r11")
+        self.emit("jz vyl_map_probe_int_empty")
+        self.emit("cmpq %rdx, %r11")
+        self.emit("jne vyl_map_probe_int_next")
+        self.emit("cmpq %rsi, 8(%rax)")
+        self.emit("jne vyl_map_probe_int_next")
+        self.emit("movl $1, %edx")
+        self.emit("ret")
+        self.emit("vyl_map_probe_int_next:")
+        self.emit("cmpq $1, %r11")
+        self.emit("jne vyl_map_probe_int_step")
+        self.emit("testq %r10, %r10")
+        self.emit("cmovzq %rax, %r10")
+        self.emit("vyl_map_probe_int_step:")
+        self.emit("incq %rcx")
+        self.emit("andq %r9, %rcx")
+        self.emit("jmp vyl_map_probe_int_loop")
+        self.emit("vyl_map_probe_int_empty:")
+        self.emit("testq %r10, %r10")
+        self.emit("cmovnzq %r10, %rax")
+        self.emit("xorl %edx, %edx")
+        self.emit("ret")
+
+        # vyl_map_probe_str: as above, comparing bytes only when hashes match
+        self.emit(".globl vyl_map_probe_str")
+        self.emit("vyl_map_probe_str:")
         self.emit("push %rbp")
         self.emit("movq %rsp, %rbp")
         self.emit("push %rbx")
         self.emit("push %r12")
         self.emit("push %r13")
+        self.emit("push %r14")
+        self.emit("push %r15")
         self.emit("subq $8, %rsp")
-        self.emit("movq %rdi, %r12")  # str
-        self.emit("movq %rsi, %r13")  # start
-        self.emit("movq %rdx, %rbx")  # len
-        # allocate len + 1
-        self.emit("movq %rbx, %rdi")
-        self.emit("addq $1, %rdi")
-        self.emit("call vyl_alloc")
-        self.emit("cmpq $0, %rax")
-        self.emit("je vyl_substring_fail")
-        self.emit("movq %rax, %rdi")  # dest
-        # src = str + start
-        self.emit("leaq (%r12,%r13,1), %rsi")
-        self.emit("movq %rbx, %rdx")  # n
-        self.emit("call memcpy")
-        # null terminate
-        self.emit("movb $0, (%rax,%rbx,1)")
-        self.emit("jmp vyl_substring_ret")
-        self.emit("vyl_substring_fail:")
-        self.emit("movq $0, %rax")
-        self.emit("vyl_substring_ret:")
+        self.emit("movq (%rdi), %rbx")  # slots
+        self.emit("movq 8(%rdi), %r12")
+        self.emit("decq %r12")  # mask
+        self.emit("movq %rdx, %r13")  # hash
+        self.emit("movq %rsi, %r14")  # key
+        self.emit("movq %rdx, %r15")
+        self.emit("andq %r12, %r15")  # index
+        self.emit("movq $0, -48(%rbp)")  # first deleted slot seen
+        self.emit("vyl_map_probe_str_loop:")
+        self.emit("leaq (%r15,%r15,2), %rax")
+        self.emit("leaq (%rbx,%rax,8), %rax")
+        self.emit("movq (%rax), %rcx")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jz vyl_map_probe_str_empty")
+        self.emit("cmpq %r13, %rcx")
+        self.emit("jne vyl_map_probe_str_next")
+        self.emit("movq 8(%rax), %rdi")
+        self.emit("cmpq %r14, %rdi")
+        self.emit("je vyl_map_probe_str_found")
+        self.emit("movq %r14, %rsi")
+        self.emit("call vyl_streq")
+        self.emit("movq %rax, %rdx")
+        self.emit("leaq (%r15,%r15,2), %rax")
+        self.emit("leaq (%rbx,%rax,8), %rax")
+        self.emit("testq %rdx, %rdx")
+        self.emit("jnz vyl_map_probe_str_found")
+        self.emit("jmp vyl_map_probe_str_step")
+        self.emit("vyl_map_probe_str_next:")
+        self.emit("cmpq $1, %rcx")
+        self.emit("jne vyl_map_probe_str_step")
+        self.emit("cmpq $0, -48(%rbp)")
+        self.emit("jne vyl_map_probe_str_step")
+        self.emit("movq %rax, -48(%rbp)")
+        self.emit("vyl_map_probe_str_step:")
+        self.emit("incq %r15")
+        self.emit("andq %r12, %r15")
+        self.emit("jmp vyl_map_probe_str_loop")
+        self.emit("vyl_map_probe_str_found:")
+        self.emit("movl $1, %edx")
+        self.emit("jmp vyl_map_probe_str_ret")
+        self.emit("vyl_map_probe_str_empty:")
+        self.emit("movq -48(%rbp), %rcx")
+        self.emit("testq %rcx, %rcx")
+        self.emit("cmovnzq %rcx, %rax")
+        self.emit("xorl %edx, %edx")
+        self.emit("vyl_map_probe_str_ret:")
         self.emit("addq $8, %rsp")
+        self.emit("pop %r15")
+        self.emit("pop %r14")
         self.emit("pop %r13")
         self.emit("pop %r12")
         self.emit("pop %rbx")
         self.emit("leave")
         self.emit("ret")
 
-def generate_assembly(program: Program) -> str:
-    generator = CodeGenerator()
-    return generator.generate(program)
+        for kind in ("int", "str"):
+            # vyl_map_set_<kind>(rdi=map, rsi=key, rdx=value)
+            self.emit(f".globl vyl_map_set_{kind}")
+            self.emit(f"vyl_map_set_{kind}:")
+            self.emit("push %rbp")
+            self.emit("movq %rsp, %rbp")
+            self.emit("push %rbx")
+            self.emit("push %r12")
+            self.emit("push %r13")
+            self.emit("push %r14")
+            self.emit("movq %rdi, %rbx")
+            self.emit("movq %rsi, %r12")
+            self.emit("movq %rdx, %r13")
+            # keep the load (live + deleted slots) at or under 3/4
+            self.emit("movq 24(%rbx), %rax")
+            self.emit("leaq 4(,%rax,4), %rax")
+            self.emit("movq 8(%rbx), %rcx")
+            self.emit("leaq (%rcx,%rcx,2), %rcx")
+            self.emit("cmpq %rcx, %rax")
+            self.emit(f"jbe vyl_map_set_{kind}_hash")
+            self.emit("movq %rbx, %rdi")
+            self.emit("call vyl_map_grow")
+            self.emit(f"vyl_map_set_{kind}_hash:")
+            self.emit("movq %r12, %rdi")
+            self.emit(f"call vyl_map_hash_{kind}")
+            self.emit("movq %rax, %r14")
+            self.emit("movq %rbx, %rdi")
+            self.emit("movq %r12, %rsi")
+            self.emit("movq %r14, %rdx")
+            self.emit(f"call vyl_map_probe_{kind}")
+            self.emit("testq %rdx, %rdx")
+            self.emit(f"jnz vyl_map_set_{kind}_store")
+            self.emit("cmpq $0, (%rax)")
+            self.emit(f"jne vyl_map_set_{kind}_reuse")
+            self.emit("incq 24(%rbx)")
+            self.emit(f"vyl_map_set_{kind}_reuse:")
+            self.emit("movq %r14, (%rax)")
+            self.emit("movq %r12, 8(%rax)")
+            self.emit("incq 16(%rbx)")
+            self.emit(f"vyl_map_set_{kind}_store:")
+            self.emit("movq %r13, 16(%rax)")
+            self.emit("xorl %eax, %eax")
+            self.emit("pop %r14")
+            self.emit("pop %r13")
+            self.emit("pop %r12")
+            self.emit("pop %rbx")
+            self.emit("leave")
+            self.emit("ret")
+
+            # vyl_map_get_<kind>(rdi=map, rsi=key) -> value, 0 when absent.
+            # Empty and deleted slots hold a zero value, so no branch is needed.
+            self._emit_map_lookup("get", kind)
+            self.emit("movq 16(%rax), %rax")
+            self._emit_map_lookup_ret()
+
+            # vyl_map_has_<kind>(rdi=map, rsi=key) -> 1/0
+            self._emit_map_lookup("has", kind)
+            self.emit("movq %rdx, %rax")
+            self._emit_map_lookup_ret()
+
+            # vyl_map_delete_<kind>(rdi=map, rsi=key) -> 1 if the key was present
+            self._emit_map_lookup("delete", kind)
+            self.emit("testq %rdx, %rdx")
+            self.emit(f"jz vyl_map_delete_{kind}_ret")
+            self.emit("movq $1, (%rax)")
+            self.emit("movq $0, 8(%rax)")
+            self.emit("movq $0, 16(%rax)")
+            self.emit("decq 16(%rbx)")
+            self.emit(f"vyl_map_delete_{kind}_ret:")
+            self.emit("movq %rdx, %rax")
+            self._emit_map_lookup_ret()
+
+    def _emit_map_hash_fixup(self):
+        """Move hashes off the empty (0) and deleted (1) markers and return."""
+        self.emit("movl $2, %edx")
+        self.emit("cmpq %rdx, %rax")
+        self.emit("cmovbq %rdx, %rax")
+        self.emit("ret")
+
+    def _emit_map_lookup(self, op: str, kind: str):
+        """Prologue shared by get/has/delete: hash and probe the key."""
+        self.emit(f".globl vyl_map_{op}_{kind}")
+        self.emit(f"vyl_map_{op}_{kind}:")
+        self.emit("push %rbp")
+        self.emit("movq %rsp, %rbp")
+        self.emit("push %rbx")
+        self.emit("push %r12")
+        self.emit("movq %rdi, %rbx")
+        self.emit("movq %rsi, %r12")
+        self.emit("movq %rsi, %rdi")
+        self.emit(f"call vyl_map_hash_{kind}")
+        self.emit("movq %rax, %rdx")
+        self.emit("movq %rbx, %rdi")
+        self.emit("movq %r12, %rsi")
+        self.emit(f"call vyl_map_probe_{kind}")
+
+    def _emit_map_lookup_ret(self):
+        self.emit("pop %r12")
+        self.emit("pop %rbx")
+        self.emit("leave")
+        self.emit("ret")
+
+    def generate_simd_runtime(self):
+        """Emit CPU feature detection and the array kernels.
+
+        vyl_cpu_init records SSE4.2 and AVX2 support (including OS support
+        for the YMM state) once at startup; each kernel then takes its AVX2
+        path, an SSE path, or plain scalar code, and finishes the elements
+        that do not fill a whole vector with scalar code too. Every kernel
+        takes an array data pointer in %rdi (null is an empty array).
+        """
+        self.emit(".section .data")
+        self.emit("vyl_cpu_features: .quad 0")
+        self.emit(".section .text")
+        self.emit(".globl vyl_cpu_init")
+        self.emit("vyl_cpu_init:")
+        self.emit("push %rbx")
+        self.emit("xorl %r8d, %r8d")
+        self.emit("xorl %eax, %eax")
+        self.emit("cpuid")
+        self.emit("movl %eax, %r9d")  # highest standard leaf
+        self.emit("movl $1, %eax")
+        self.emit("cpuid")
+        self.emit("btl $20, %ecx")
+        self.emit("jnc vyl_cpu_init_avx")
+        self.emit(f"orl ${CPU_SSE42}, %r8d")
+        self.emit("vyl_cpu_init_avx:")
+        self.emit("andl $0x18000000, %ecx")  # OSXSAVE and AVX
+        self.emit("cmpl $0x18000000, %ecx")
+        self.emit("jne vyl_cpu_init_done")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("xgetbv")
+        self.emit("andl $6, %eax")  # XMM and YMM state enabled by the OS
+        self.emit("cmpl $6, %eax")
+        self.emit("jne vyl_cpu_init_done")
+        self.emit("cmpl $7, %r9d")
+        self.emit("jb vyl_cpu_init_done")
+        self.emit("movl $7, %eax")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("cpuid")
+        self.emit("btl $5, %ebx")
+        self.emit("jnc vyl_cpu_init_done")
+        self.emit(f"orl ${CPU_AVX2}, %r8d")
+        self.emit("vyl_cpu_init_done:")
+        self.emit("movq %r8, vyl_cpu_features(%rip)")
+        self.emit("pop %rbx")
+        self.emit("ret")
+
+        self._emit_sum_kernel("vyl_sum_i64", dec=False)
+        self._emit_sum_kernel("vyl_sum_f64", dec=True)
+        for name, dec, is_max in (("vyl_min_i64", False, False), ("vyl_max_i64", False, True),
+                                  ("vyl_min_f64", True, False), ("vyl_max_f64", True, True)):
+            self._emit_minmax_kernel(name, dec, is_max)
+
+        # vyl_find_i64(rdi=data, rsi=value) -> first index holding exactly value, or -1
+        self.emit(".globl vyl_find_i64")
+        self.emit("vyl_find_i64:")
+        self.emit("xorl %edx, %edx")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_find_tail")
+        self.emit("movq -8(%rdi), %rcx")
+        self.emit("movq %rsi, %xmm1")
+        self.emit("punpcklqdq %xmm1, %xmm1")
+        self.emit(f"testb ${CPU_AVX2}, vyl_cpu_features(%rip)")
+        self.emit("jz vyl_find_sse")
+        self.emit("vinsertf128 $1, %xmm1, %ymm1, %ymm1")
+        self.emit("vyl_find_avx:")
+        self.emit("leaq 4(%rdx), %r8")
+        self.emit("cmpq %rcx, %r8")
+        self.emit("ja vyl_find_avx_end")
+        self.emit("vpcmpeqq (%rdi,%rdx,8), %ymm1, %ymm0")
+        self.emit("vmovmskpd %ymm0, %eax")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_find_avx_hit")
+        self.emit("movq %r8, %rdx")
+        self.emit("jmp vyl_find_avx")
+        self.emit("vyl_find_avx_hit:")
+        self.emit("vzeroupper")
+        self.emit("jmp vyl_find_hit")
+        self.emit("vyl_find_avx_end:")
+        self.emit("vzeroupper")
+        self.emit("jmp vyl_find_tail")
+        self.emit("vyl_find_sse:")
+        self.emit(f"testb ${CPU_SSE42}, vyl_cpu_features(%rip)")
+        self.emit("jz vyl_find_tail")
+        self.emit("vyl_find_sse_loop:")
+        self.emit("leaq 2(%rdx), %r8")
+        self.emit("cmpq %rcx, %r8")
+        self.emit("ja vyl_find_tail")
+        self.emit("movdqu (%rdi,%rdx,8), %xmm0")
+        self.emit("pcmpeqq %xmm1, %xmm0")
+        self.emit("movmskpd %xmm0, %eax")
+        self.emit("testl %eax, %eax")
+        self.emit("jnz vyl_find_hit")
+        self.emit("movq %r8, %rdx")
+        self.emit("jmp vyl_find_sse_loop")
+        self.emit("vyl_find_hit:")  # lane mask in %eax, vector start in %rdx
+        self.emit("bsfl %eax, %eax")
+        self.emit("addq %rdx, %rax")
+        self.emit("ret")
+        self.emit("vyl_find_tail:")
+        self.emit("cmpq %rcx, %rdx")
+        self.emit("jae vyl_find_none")
+        self.emit("cmpq %rsi, (%rdi,%rdx,8)")
+        self.emit("je vyl_find_tail_hit")
+        self.emit("incq %rdx")
+        self.emit("jmp vyl_find_tail")
+        self.emit("vyl_find_tail_hit:")
+        self.emit("movq %rdx, %rax")
+        self.emit("ret")
+        self.emit("vyl_find_none:")
+        self.emit("movq $-1, %rax")
+        self.emit("ret")
+
+        # vyl_fill_i64(rdi=data, rsi=value): store value into every element
+        self.emit(".globl vyl_fill_i64")
+        self.emit("vyl_fill_i64:")
+        self.emit("xorl %edx, %edx")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_fill_tail")
+        self.emit("movq -8(%rdi), %rcx")
+        self.emit("movq %rsi, %xmm0")
+        self.emit("punpcklqdq %xmm0, %xmm0")
+        self.emit(f"testb ${CPU_AVX2}, vyl_cpu_features(%rip)")
+        self.emit("jz vyl_fill_sse")
+        self.emit("vinsertf128 $1, %xmm0, %ymm0, %ymm0")
+        self.emit("vyl_fill_avx:")
+        self.emit("leaq 4(%rdx), %rax")
+        self.emit("cmpq %rcx, %rax")
+        self.emit("ja vyl_fill_avx_end")
+        self.emit("vmovdqu %ymm0, (%rdi,%rdx,8)")
+        self.emit("movq %rax, %rdx")
+        self.emit("jmp vyl_fill_avx")
+        self.emit("vyl_fill_avx_end:")
+        self.emit("vzeroupper")
+        self.emit("vyl_fill_sse:")
+        self.emit("leaq 2(%rdx), %rax")
+        self.emit("cmpq %rcx, %rax")
+        self.emit("ja vyl_fill_tail")
+        self.emit("movdqu %xmm0, (%rdi,%rdx,8)")
+        self.emit("movq %rax, %rdx")
+        self.emit("jmp vyl_fill_sse")
+        self.emit("vyl_fill_tail:")
+        self.emit("cmpq %rcx, %rdx")
+        self.emit("jae vyl_fill_ret")
+        self.emit("movq %rsi, (%rdi,%rdx,8)")
+        self.emit("incq %rdx")
+        self.emit("jmp vyl_fill_tail")
+        self.emit("vyl_fill_ret:")
+        self.emit("xorl %eax, %eax")
+        self.emit("ret")
+
+        # vyl_array_copy(rdi=dst, rsi=src) -> elements copied, min of both lengths.
+        # libc's memmove already picks its widest implementation per CPU.
+        self.emit(".globl vyl_array_copy")
+        self.emit("vyl_array_copy:")
+        self.emit("xorl %eax, %eax")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_array_copy_ret")
+        self.emit("testq %rsi, %rsi")
+        self.emit("jz vyl_array_copy_ret")
+        self.emit("movq -8(%rdi), %rax")
+        self.emit("movq -8(%rsi), %rdx")
+        self.emit("cmpq %rax, %rdx")
+        self.emit("cmovbq %rdx, %rax")
+        self.emit("push %rbx")
+        self.emit("movq %rax, %rbx")
+        self.emit("leaq (,%rax,8), %rdx")
+        self.emit("call memmove")
+        self.emit("movq %rbx, %rax")
+        self.emit("pop %rbx")
+        self.emit("vyl_array_copy_ret:")
+        self.emit("ret")
+
+    def _emit_sum_kernel(self, name: str, dec: bool):
+        """name(rdi=data) -> sum of the elements; two AVX2 accumulators, then SSE2."""
+        load, vadd, add = ("movupd", "vaddpd", "addpd") if dec else ("movdqu", "vpaddq", "paddq")
+        self.emit(f".globl {name}")
+        self.emit(f"{name}:")
+        self.emit("xorl %eax, %eax")
+        self.emit("pxor %xmm0, %xmm0")
+        self.emit("xorl %edx, %edx")
+        self.emit("xorl %ecx, %ecx")
+        self.emit("testq %rdi, %rdi")
+        self.emit(f"jz {name}_tail")
+        self.emit("movq -8(%rdi), %rcx")
+        self.emit(f"testb ${CPU_AVX2}, vyl_cpu_features(%rip)")
+        self.emit(f"jz {name}_sse")
+        self.emit("vpxor %ymm0, %ymm0, %ymm0")
+        self.emit("vpxor %ymm1, %ymm1, %ymm1")
+        self.emit(f"{name}_avx:")
+        self.emit("leaq 8(%rdx), %rax")
+        self.emit("cmpq %rcx, %rax")
+        self.emit(f"ja {name}_avx_end")
+        self.emit(f"{vadd} (%rdi,%rdx,8), %ymm0, %ymm0")
+        self.emit(f"{vadd} 32(%rdi,%rdx,8), %ymm1, %ymm1")
+        self.emit("movq %rax, %rdx")
+        self.emit(f"jmp {name}_avx")
+        self.emit(f"{name}_avx_end:")
+        self.emit(f"{vadd} %ymm1, %ymm0, %ymm0")
+        self.emit("vextractf128 $1, %ymm0, %xmm1")
+        self.emit(f"{vadd} %xmm1, %xmm0, %xmm0")
+        self.emit("vzeroupper")
+        self.emit(f"{name}_sse:")
+        self.emit("leaq 2(%rdx), %rax")
+        self.emit("cmpq %rcx, %rax")
+        self.emit(f"ja {name}_sse_end")
+        self.emit(f"{load} (%rdi,%rdx,8), %xmm1")
+        self.emit(f"{add} %xmm1, %xmm0")
+        self.emit("movq %rax, %rdx")
+        self.emit(f"jmp {name}_sse")
+        self.emit(f"{name}_sse_end:")
+        if dec:
+            self.emit("movapd %xmm0, %xmm1")
+            self.emit("unpckhpd %xmm1, %xmm1")
+            self.emit("addsd %xmm1, %xmm0")
+        else:
+            self.emit("pshufd $0x4e, %xmm0, %xmm1")
+            self.emit("paddq %xmm1, %xmm0")
+            self.emit("movq %xmm0, %rax")
+        self.emit(f"{name}_tail:")
+        self.emit("cmpq %rcx, %rdx")
+        self.emit(f"jae {name}_ret")
+        self.emit("addsd (%rdi,%rdx,8), %xmm0" if dec else "addq (%rdi,%rdx,8), %rax")
+        self.emit("incq %rdx")
+        self.emit(f"jmp {name}_tail")
+        self.emit(f"{name}_ret:")
+        if dec:
+            self.emit("movq %xmm0, %rax")
+        self.emit("ret")
+
+    def _emit_minmax_kernel(self, name: str, dec: bool, is_max: bool):
+        """name(rdi=data) -> smallest or largest element; an empty array aborts.
+
+        Lanes start from the first elements (re-reading element 0 is harmless
+        for min/max) and are folded into the scalar answer in %rax through the
+        red zone. 64-bit integer compares need AVX2 or SSE4.2 (pcmpgtq).
+        """
+        def combine_scalar(mem):
+            if dec:
+                self.emit("movq %rax, %xmm2")
+                self.emit(f"{'maxsd' if is_max else 'minsd'} {mem}, %xmm2")
+                self.emit("movq %xmm2, %rax")
+            else:
+                self.emit(f"movq {mem}, %r8")
+                self.emit("cmpq %r8, %rax")
+                self.emit(f"{'cmovlq' if is_max else 'cmovgq'} %r8, %rax")
+
+        self.emit(f".globl {name}")
+        self.emit(f"{name}:")
+        self.emit("testq %rdi, %rdi")
+        self.emit("jz vyl_bounds_fail")
+        self.emit("movq -8(%rdi), %rcx")
+        self.emit("testq %rcx, %rcx")
+        self.emit("jz vyl_bounds_fail")
+        self.emit("movq (%rdi), %rax")
+        self.emit("movl $1, %edx")
+        self.emit(f"testb ${CPU_AVX2}, vyl_cpu_features(%rip)")
+        self.emit(f"jz {name}_sse")
+        self.emit("cmpq $4, %rcx")
+        self.emit(f"jb {name}_sse")
+        self.emit("vmovdqu (%rdi), %ymm0")
+        self.emit("movl $4, %edx")
+        self.emit(f"{name}_avx:")
+        self.emit("leaq 4(%rdx), %r8")
+        self.emit("cmpq %rcx, %r8")
+        self.emit(f"ja {name}_avx_end")
+        self.emit("vmovdqu (%rdi,%rdx,8), %ymm1")
+        if dec:
+            self.emit(f"{'vmaxpd' if is_max else 'vminpd'} %ymm1, %ymm0, %ymm0")
+        else:
+            # mask the lanes where the new element wins, then blend it in
+            self.emit("vpcmpgtq %ymm0, %ymm1, %ymm2" if is_max else "vpcmpgtq %ymm1, %ymm0, %ymm2")
+            self.emit("vpblendvb %ymm2, %ymm1, %ymm0, %ymm0")
+        self.emit("movq %r8, %rdx")
+        self.emit(f"jmp {name}_avx")
+        self.emit(f"{name}_avx_end:")
+        self.emit("vmovdqu %ymm0, -32(%rsp)")
+        self.emit("vzeroupper")
+        for lane in range(4):
+            combine_scalar(f"{lane * 8 - 32}(%rsp)")
+        self.emit(f"jmp {name}_tail")
+        self.emit(f"{name}_sse:")
+        if not dec:
+            self.emit(f"testb ${CPU_SSE42}, vyl_cpu_features(%rip)")
+            self.emit(f"jz {name}_tail")
+        self.emit("cmpq $2, %rcx")
+        self.emit(f"jb {name}_tail")
+        self.emit("movdqu (%rdi), %xmm0")
+        self.emit("movl $2, %edx")
+        self.emit(f"{name}_sse_loop:")
+        self.emit("leaq 2(%rdx), %r8")
+        self.emit("cmpq %rcx, %r8")
+        self.emit(f"ja {name}_sse_end")
+        self.emit("movdqu (%rdi,%rdx,8), %xmm1")
+        if dec:
+            self.emit(f"{'maxpd' if is_max else 'minpd'} %xmm1, %xmm0")
+        else:
+            self.emit("movdqa %xmm1, %xmm2" if is_max else "movdqa %xmm0, %xmm2")
+            self.emit("pcmpgtq %xmm0, %xmm2" if is_max else "pcmpgtq %xmm1, %xmm2")
+            self.emit("pand %xmm2, %xmm1")
+            self.emit("pandn %xmm0, %xmm2")
+            self.emit("por %xmm2, %xmm1")
+            self.emit("movdqa %xmm1, %xmm0")
+        self.emit("movq %r8, %rdx")
+        self.emit(f"jmp {name}_sse_loop")
+        self.emit(f"{name}_sse_end:")
+        self.emit("movdqu %xmm0, -16(%rsp)")
+        for lane in range(2):
+            combine_scalar(f"{lane * 8 - 16}(%rsp)")
+        self.emit(f"{name}_tail:")
+        self.emit("cmpq %rcx, %rdx")
+        self.emit(f"jae {name}_ret")
+        combine_scalar("(%rdi,%rdx,8)")
+        self.emit("incq %rdx")
+        self.emit(f"jmp {name}_tail")
+        self.emit(f"{name}_ret:")
+        self.emit("ret")
+
+def generate_assembly(program: Program, opt_level: int = 1, unit: Optional[int] = None, root_unit: int = 0,
+                      profile_alloc: bool = False, perf_map: bool = False, sources: Optional[List[str]] = None) -> str:
+    generator = CodeGenerator(opt_level, profile_alloc, perf_map, sources)
+    return generator.generate(program, unit, root_unit)
+
+
+def generate_runtime_assembly(profile_alloc: bool = False) -> str:
+    return CodeGenerator(profile_alloc=profile_alloc).generate_runtime()
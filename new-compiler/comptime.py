@@ -0,0 +1,778 @@
+"""
+VYL Compile-Time Evaluation - `const` declarations and `comptime` functions
+
+An interpreter over the checked AST for the pure subset of VYL: int, dec,
+bool and string values, arrays of them, locals, if/while/for, calls to user
+functions and the builtins in BUILTINS. It runs between validation and the
+optimizer:
+
+    comptime Function Fib(n: int) -> int { ... }
+    const int F = Fib(40);              # F is an immediate wherever it is read
+    const int[] SQUARES = Squares(256); # the whole table is laid out in .rodata
+    Print(Fib(30));                     # comptime call, constant arguments: folded
+
+- A `const` initializer must evaluate or the build fails. Scalars and strings
+  become Literals, and reads of them inside functions become Literals too;
+  arrays become a ConstArray, which codegen lays out as read-only data.
+  Writing one, directly, through Pop or the like, or by passing it to a
+  function that writes that parameter, is an error (ArrayUses). Where one
+  is stored, returned or passed on to code not followed there, that code
+  gets a fresh copy (ArrayClone), so a const never changes.
+- A global `var` initializer is evaluated the same way when it can be, so the
+  variable starts out holding its value in .data instead of zero.
+- A call to a `comptime` function with constant arguments is replaced by its
+  result when that is a scalar or a string. Arrays are only folded into
+  `const` declarations: one folded call site would hand every caller the
+  same array.
+
+Evaluation has no side effects and gives the same results on every build.
+Reading a mutable global, I/O, structs, async code or a builtin missing from
+BUILTINS stops it with NotConstant. The functions are pure, so calls with
+scalar arguments are memoized and recursive definitions like Fib run in
+linear time. MAX_STEPS bounds runaway loops.
+"""
+
+import math
+from typing import Any, Dict, List, Optional, Set
+
+try:
+    from .parser import (
+        ASTNode,
+        AddressOf,
+        ArrayClone,
+        ArrayLiteral,
+        Assignment,
+        BinaryExpr,
+        Block,
+        ConstArray,
+        ForStmt,
+        FunctionCall,
+        FunctionDef,
+        Identifier,
+        IfStmt,
+        IndexExpr,
+        InterpString,
+        Literal,
+        Program,
+        ReturnStmt,
+        StructDef,
+        TupleUnpack,
+        UnaryExpr,
+        VarDecl,
+        WhileStmt,
+    )
+    from .optimizer import _children, _rewrite, _wrap64, collect_assigned, substitute, walk
+    from .regalloc import parse_interp_parts
+    from .validator import ValidationError
+except ImportError:  # pragma: no cover - fallback for direct execution
+    from parser import (
+        ASTNode,
+        AddressOf,
+        ArrayClone,
+        ArrayLiteral,
+        Assignment,
+        BinaryExpr,
+        Block,
+        ConstArray,
+        ForStmt,
+        FunctionCall,
+        FunctionDef,
+        Identifier,
+        IfStmt,
+        IndexExpr,
+        InterpString,
+        Literal,
+        Program,
+        ReturnStmt,
+        StructDef,
+        TupleUnpack,
+        UnaryExpr,
+        VarDecl,
+        WhileStmt,
+    )
+    from optimizer import _children, _rewrite, _wrap64, collect_assigned, substitute, walk
+    from regalloc import parse_interp_parts
+    from validator import ValidationError
+
+MAX_STEPS = 50_000_000   # statements and loop iterations per build
+MAX_CALL_DEPTH = 1000    # nested user function calls
+BUILTINS = ("Array", "Length", "Len", "Push", "Pop", "StrLen", "Sqrt")
+
+
+class NotConstant(Exception):
+    """The expression cannot be evaluated at compile time."""
+
+    def __init__(self, message: str, node=None):
+        super().__init__(message)
+        self.line = getattr(node, "line", 0)
+        self.column = getattr(node, "column", 0)
+
+
+class VylArray(list):
+    """An array value; elem is its element type once known ("dec" elements
+    are kept as floats). Arrays held by a const are frozen."""
+
+    def __init__(self, items=(), elem: Optional[str] = None, frozen: bool = False):
+        super().__init__(items)
+        self.elem = elem
+        self.frozen = frozen
+
+
+class _Return:
+    __slots__ = ("value",)
+
+    def __init__(self, value):
+        self.value = value
+
+
+def _type_name(value) -> str:
+    if isinstance(value, bool):
+        return "bool"
+    if isinstance(value, int):
+        return "int"
+    if isinstance(value, float):
+        return "dec"
+    if isinstance(value, str):
+        return "string"
+    return f"{value.elem or 'int'}[]"
+
+
+def _truthy(value) -> bool:
+    if isinstance(value, (bool, int, float)):
+        return value != 0
+    raise NotConstant(f"a {_type_name(value)} is not a condition")
+
+
+class Evaluator:
+    """Runs functions of one program at compile time."""
+
+    def __init__(self, program: Program):
+        self.functions: Dict[str, FunctionDef] = {}
+        self.consts: Dict[str, VarDecl] = {}
+        for stmt in program.statements:
+            if isinstance(stmt, FunctionDef):
+                self.functions[stmt.name] = stmt
+            elif isinstance(stmt, VarDecl) and stmt.is_const:
+                self.consts[stmt.name] = stmt
+        self.values: Dict[str, Any] = {}  # evaluated consts
+        self.pending: Set[str] = set()
+        self.memo: Dict[tuple, Any] = {}
+        self.steps = 0
+        self.depth = 0
+
+    # ---------- entry points ----------
+    def const_value(self, name: str, node=None):
+        """Value of the const `name`, evaluated on first use."""
+        if name in self.values:
+            return self.values[name]
+        decl = self.consts.get(name)
+        if decl is None:
+            raise NotConstant(f"'{name}' is not a constant", node)
+        if name in self.pending:
+            raise NotConstant(f"const '{name}' depends on itself", node)
+        self.pending.add(name)
+        try:
+            value = self.convert(self.evaluate(decl.value, {}), decl.var_type, decl.value)
+        finally:
+            self.pending.discard(name)
+        self.values[name] = _freeze(value)
+        return self.values[name]
+
+    def evaluate(self, expr, env: Dict[str, Any]):
+        try:
+            return self.expression(expr, env, {})
+        except RecursionError:
+            raise NotConstant("compile-time recursion is too deep", expr) from None
+
+    # ---------- statements ----------
+    def run(self, stmts: List, env: Dict[str, Any], types: Dict[str, Optional[str]]) -> Optional[_Return]:
+        for stmt in stmts:
+            self.tick(stmt)
+            result = self.statement(stmt, env, types)
+            if result is not None:
+                return result
+        return None
+
+    def statement(self, stmt, env, types) -> Optional[_Return]:
+        if isinstance(stmt, Block):
+            if stmt.deferred or stmt.arena is not None:
+                raise NotConstant("defer and @arena blocks run only at run time", stmt)
+            return self.run(stmt.statements, env, types)
+        if isinstance(stmt, VarDecl):
+            if stmt.value is None:
+                if stmt.var_type not in (None, "int", "dec", "bool"):
+                    raise NotConstant(f"'{stmt.name}' has no value", stmt)
+                value = 0
+            else:
+                value = _thaw(self.expression(stmt.value, env, types))
+            types[stmt.name] = stmt.var_type
+            env[stmt.name] = self.convert(value, stmt.var_type, stmt)
+            return None
+        if isinstance(stmt, Assignment):
+            value = _thaw(self.expression(stmt.value, env, types))
+            if stmt.target is None:
+                if stmt.name not in env:
+                    raise NotConstant(f"assigns the global '{stmt.name}'", stmt)
+                env[stmt.name] = self.convert(value, types.get(stmt.name), stmt)
+            elif isinstance(stmt.target, IndexExpr):
+                array = self.expression(stmt.target.receiver, env, types)
+                index = self.index(array, self.expression(stmt.target.index, env, types), stmt)
+                if array.frozen:
+                    raise NotConstant("writes to a const array", stmt)
+                array[index] = self.convert(value, array.elem, stmt)
+            else:
+                raise NotConstant(f"assigns through a {type(stmt.target).__name__}", stmt)
+            return None
+        if isinstance(stmt, IfStmt):
+            if _truthy(self.expression(stmt.condition, env, types)):
+                return self.statement(stmt.then_block, env, types)
+            if stmt.else_block is not None:
+                return self.statement(stmt.else_block, env, types)
+            return None
+        if isinstance(stmt, WhileStmt):
+            while _truthy(self.expression(stmt.condition, env, types)):
+                self.tick(stmt)
+                result = self.statement(stmt.body, env, types)
+                if result is not None:
+                    return result
+            return None
+        if isinstance(stmt, ForStmt):
+            # Inclusive, with the bound re-read every iteration, like codegen
+            env[stmt.var_name] = self.integer(self.expression(stmt.start, env, types), stmt)
+            types[stmt.var_name] = "int"
+            while env[stmt.var_name] <= self.integer(self.expression(stmt.end, env, types), stmt):
+                self.tick(stmt)
+                result = self.statement(stmt.body, env, types)
+                if result is not None:
+                    return result
+                env[stmt.var_name] = _wrap64(env[stmt.var_name] + 1)
+            return None
+        if isinstance(stmt, ReturnStmt):
+            return _Return(None if stmt.value is None else _thaw(self.expression(stmt.value, env, types)))
+        self.expression(stmt, env, types)
+        return None
+
+    def tick(self, node):
+        self.steps += 1
+        if self.steps > MAX_STEPS:
+            raise NotConstant(f"compile-time evaluation took more than {MAX_STEPS} steps", node)
+
+    # ---------- expressions ----------
+    def expression(self, expr, env, types):
+        if isinstance(expr, Literal):
+            if expr.literal_type == "dec":
+                return float(expr.value)
+            if expr.literal_type == "bool":
+                return bool(expr.value)
+            return expr.value
+        if isinstance(expr, Identifier):
+            if expr.name in env:
+                return env[expr.name]
+            return self.const_value(expr.name, expr)
+        if isinstance(expr, UnaryExpr):
+            value = self.expression(expr.operand, env, types)
+            if expr.operator in ("!", "NOT"):
+                return not _truthy(value)
+            if isinstance(value, (bool, str)) or not isinstance(value, (int, float)):
+                raise NotConstant(f"unary '{expr.operator}' on a {_type_name(value)}", expr)
+            if expr.operator == "-":
+                return -value if isinstance(value, float) else _wrap64(-value)
+            return value
+        if isinstance(expr, BinaryExpr):
+            return self.binary(expr, env, types)
+        if isinstance(expr, ArrayLiteral):
+            items = [self.expression(e, env, types) for e in expr.elements]
+            elem = expr.element_type or (_type_name(items[0]) if items else None)
+            if elem == "dec" or any(isinstance(item, float) for item in items):
+                elem = "dec"
+                items = [float(item) for item in items]
+            return VylArray(items, elem)
+        if isinstance(expr, IndexExpr):
+            array = self.expression(expr.receiver, env, types)
+            return array[self.index(array, self.expression(expr.index, env, types), expr)]
+        if isinstance(expr, FunctionCall):
+            if expr.name in self.functions:
+                args = [self.expression(arg, env, types) for arg in expr.arguments]
+                return self.call(self.functions[expr.name], args, expr)
+            if expr.name in BUILTINS:
+                return self.builtin(expr, [self.expression(arg, env, types) for arg in expr.arguments])
+            raise NotConstant(f"calls '{expr.name}', which only runs at run time", expr)
+        if isinstance(expr, ConstArray):
+            return _frozen(expr.elements, expr.element_type)
+        raise NotConstant(f"{type(expr).__name__} only runs at run time", expr)
+
+    def binary(self, expr: BinaryExpr, env, types):
+        op = expr.operator
+        left = self.expression(expr.left, env, types)
+        if op in ("&&", "||"):
+            if _truthy(left) == (op == "||"):
+                return op == "||"
+            return _truthy(self.expression(expr.right, env, types))
+        right = self.expression(expr.right, env, types)
+        if isinstance(left, str) or isinstance(right, str):
+            if op == "+" and all(isinstance(v, str) or type(v) is int for v in (left, right)):
+                return str(left) + str(right)
+            if op in ("==", "!=") and isinstance(left, str) and isinstance(right, str):
+                return (left == right) == (op == "==")
+            raise NotConstant(f"'{op}' on a string and a {_type_name(right if isinstance(left, str) else left)}", expr)
+        if not all(isinstance(v, (int, float)) for v in (left, right)):
+            raise NotConstant(f"'{op}' on arrays", expr)
+        if op in ("==", "!=", "<", ">", "<=", ">="):
+            return {"==": left == right, "!=": left != right, "<": left < right,
+                    ">": left > right, "<=": left <= right, ">=": left >= right}[op]
+        if isinstance(left, float) or isinstance(right, float):
+            left, right = float(left), float(right)
+            if op == "+":
+                return left + right
+            if op == "-":
+                return left - right
+            if op == "*":
+                return left * right
+            if op == "/":
+                if right == 0:
+                    raise NotConstant("divides by zero", expr)
+                return left / right
+        else:
+            left, right = int(left), int(right)
+            if op == "+":
+                return _wrap64(left + right)
+            if op == "-":
+                return _wrap64(left - right)
+            if op == "*":
+                return _wrap64(left * right)
+            if op in ("/", "%"):
+                if right == 0:
+                    raise NotConstant("divides by zero", expr)
+                quotient = abs(left) // abs(right)
+                if (left < 0) != (right < 0):
+                    quotient = -quotient
+                return _wrap64(quotient) if op == "/" else left - quotient * right
+        raise NotConstant(f"operator '{op}'", expr)
+
+    def call(self, func: FunctionDef, args: List, node):
+        if func.is_async or func.type_params:
+            raise NotConstant(f"'{func.name}' is async or generic", node)
+        params = func.params
+        if len(args) > len(params):
+            raise NotConstant(f"'{func.name}' takes {len(params)} arguments", node)
+        env: Dict[str, Any] = {}
+        types: Dict[str, Optional[str]] = {}
+        for idx, (pname, ptype, default) in enumerate(params):
+            if idx < len(args):
+                value = args[idx]
+            elif default is not None:
+                value = self.expression(default, {}, {})
+            else:
+                raise NotConstant(f"'{func.name}' is missing argument '{pname}'", node)
+            env[pname] = self.convert(value, ptype, node)
+            types[pname] = ptype
+
+        key = None
+        if all(not isinstance(v, VylArray) for v in env.values()):
+            key = (func.name, *((type(v), v) for v in env.values()))
+            if key in self.memo:
+                return self.memo[key]
+        self.depth += 1
+        if self.depth > MAX_CALL_DEPTH:
+            raise NotConstant(f"calls nest deeper than {MAX_CALL_DEPTH}", node)
+        try:
+            result = self.run(func.body.statements if func.body else [], env, types)
+        finally:
+            self.depth -= 1
+        value = self.convert(result.value if result and result.value is not None else 0, func.return_type, node)
+        if key is not None and not isinstance(value, VylArray):
+            self.memo[key] = value
+        return value
+
+    def builtin(self, call: FunctionCall, args: List):
+        name = call.name
+        if name == "Array":
+            count = self.integer(args[0], call)
+            if count < 0:
+                raise NotConstant("Array with a negative length", call)
+            return VylArray([0] * count)
+        if name in ("Length", "Len", "StrLen"):
+            value = args[0]
+            if isinstance(value, str):
+                return len(value.encode("utf-8"))
+            if isinstance(value, VylArray):
+                return len(value)
+        elif name == "Push" and isinstance(args[0], VylArray):
+            # A const array is full, so Push grows a copy of it, as at run time
+            array = _thaw(args[0])
+            array.append(self.convert(args[1], array.elem, call))
+            return array
+        elif name == "Pop" and isinstance(args[0], VylArray):
+            if args[0].frozen or not args[0]:
+                raise NotConstant("pops a const or empty array", call)
+            return args[0].pop()
+        elif name == "Sqrt":
+            value = args[0]
+            if isinstance(value, float) and value >= 0:
+                return math.sqrt(value)
+            if type(value) is int and value >= 0:
+                return math.isqrt(value)
+        raise NotConstant(f"{name} of these arguments", call)
+
+    # ---------- values ----------
+    def integer(self, value, node) -> int:
+        if type(value) is int or isinstance(value, bool):
+            return int(value)
+        raise NotConstant(f"expected an int, got a {_type_name(value)}", node)
+
+    def index(self, array, index, node) -> int:
+        if not isinstance(array, VylArray):
+            raise NotConstant(f"indexes a {_type_name(array)}", node)
+        index = self.integer(index, node)
+        if not 0 <= index < len(array):
+            raise NotConstant(f"index {index} is out of bounds for length {len(array)}", node)
+        return index
+
+    def convert(self, value, typ: Optional[str], node):
+        """Apply the conversion codegen makes when value lands in a typ slot."""
+        if typ == "dec" and isinstance(value, (int, float)) and not isinstance(value, bool):
+            return float(value)
+        if typ == "int" and isinstance(value, float):
+            if not math.isfinite(value) or not -2 ** 63 <= value < 2 ** 63:
+                raise NotConstant("a dec out of int range", node)
+            return int(value)
+        if typ and (typ.endswith("[]") or typ == "array") and isinstance(value, VylArray):
+            elem = typ[:-2] if typ.endswith("[]") else None
+            if elem and value.elem is None and not value.frozen:
+                value.elem = elem
+                if elem == "dec":
+                    value[:] = [float(item) for item in value]
+        return value
+
+
+def _freeze(value):
+    if isinstance(value, VylArray):
+        return VylArray([_freeze(item) for item in value], value.elem, frozen=True)
+    return value
+
+
+def _frozen(items: list, elem: str) -> VylArray:
+    """The value of a ConstArray's elements."""
+    inner = elem[:-2] if elem.endswith("[]") else None
+    return VylArray([_frozen(item, inner) if isinstance(item, list) else item for item in items], elem, frozen=True)
+
+
+def _thaw(value):
+    """What a variable, element or return value gets from a const array: a
+    writable copy, as ArrayClone makes at run time."""
+    if isinstance(value, VylArray) and value.frozen:
+        return VylArray([_thaw(item) for item in value], value.elem)
+    return value
+
+
+def to_node(value, template):
+    """The AST node for a folded value, at template's position: a Literal,
+    or a ConstArray for arrays."""
+    line, column = template.line, template.column
+    if isinstance(value, VylArray):
+        return ConstArray(elements=[_plain(item) for item in value], element_type=value.elem or "int",
+                          line=line, column=column)
+    if isinstance(value, str):
+        try:
+            value.encode("utf-8")
+        except UnicodeEncodeError:
+            raise NotConstant("the string is not valid UTF-8", template) from None
+    return Literal(value=value, literal_type=_type_name(value), line=line, column=column)
+
+
+def _plain(value):
+    """Nested arrays as plain lists; ConstArray elements hold no VylArrays."""
+    if isinstance(value, VylArray):
+        return [_plain(item) for item in value]
+    return value
+
+
+def _function_bodies(program: Program):
+    for stmt in program.statements:
+        if isinstance(stmt, FunctionDef):
+            yield stmt.params, stmt.body
+        elif isinstance(stmt, StructDef):
+            for method in stmt.methods:
+                yield [("self", stmt.name, None)] + list(method.params), method.body
+
+
+def evaluate_program(program: Program) -> Dict[str, int]:
+    """Fold consts, global initializers and comptime calls in place.
+    Returns counts for the driver's summary."""
+    counts = {"constants": 0, "calls": 0}
+    evaluator = Evaluator(program)
+
+    for stmt in program.statements:
+        if not isinstance(stmt, VarDecl) or stmt.value is None or isinstance(stmt.value, Literal):
+            continue
+        try:
+            value = evaluator.const_value(stmt.name, stmt) if stmt.is_const else \
+                evaluator.convert(evaluator.evaluate(stmt.value, {}), stmt.var_type, stmt)
+            node = to_node(value, stmt.value)
+        except NotConstant as e:
+            if stmt.is_const:
+                raise ValidationError(f"const '{stmt.name}' is not a compile-time constant: {e}",
+                                      e.line or stmt.line, e.column or stmt.column) from None
+            print(f"Warning: global '{stmt.name}' is not a compile-time constant ({e}); it starts out zero")
+            continue
+        stmt.value = node
+        if stmt.var_type is None and isinstance(node, ConstArray):
+            stmt.var_type = f"{node.element_type}[]"
+        counts["constants"] += 1
+    for stmt in program.statements:
+        if isinstance(stmt, VarDecl) and stmt.is_const and isinstance(stmt.value, Literal):
+            evaluator.const_value(stmt.name, stmt)  # literal consts are read by functions too
+
+    scalars = {name: to_node(value, evaluator.consts[name]) for name, value in evaluator.values.items()
+               if not isinstance(value, VylArray)}
+    for params, body in _function_bodies(program):
+        if body is None:
+            continue
+        shadowed = collect_assigned(body) | {param[0] for param in params}
+        env = {name: node for name, node in scalars.items() if name not in shadowed}
+        _fold_block(body, evaluator, env, counts)
+    check_const_arrays(program, evaluator.consts)
+    return counts
+
+
+READ, ESCAPE, WRITE = 0, 1, 2
+# Builtins that change the array passed as their first argument in place
+WRITING_BUILTINS = ("Pop", "ArrayFill", "ArrayCopy", "AtomicAdd", "AtomicStore", "AtomicCas")
+# Builtins that only read the arrays passed to them. Push copies a full
+# array, and a const's is always full, but the copy shares its elements
+READING_BUILTINS = ("Len", "Length", "Print", "ArraySum", "ArrayMin", "ArrayMax", "ArrayFind",
+                    "AtomicLoad", "Push")
+
+
+class ArrayUses:
+    """How function bodies use arrays, to keep const arrays unchanged.
+
+    Every name gets two levels, one for the array itself and one for the
+    arrays it holds: READ when only elements and the length are read, ESCAPE
+    when it may reach code not followed here (copied, stored, returned, or
+    passed to a method or an unlisted builtin) and WRITE when it may be
+    changed in place. Parameters of functions are summarised the same way and
+    solved to a fixed point, so passing an array on is followed through.
+    """
+
+    def __init__(self, program: Program):
+        self.functions = {stmt.name: stmt for stmt in program.statements
+                          if isinstance(stmt, FunctionDef) and stmt.body is not None}
+        self.summaries = {name: [(READ, READ)] * len(func.params) for name, func in self.functions.items()}
+        changed = True
+        while changed:
+            changed = False
+            for name, func in self.functions.items():
+                uses = self.scan(func.body)
+                summary = [tuple(uses.get(param[0], (READ, READ))[:2]) for param in func.params]
+                if summary != self.summaries[name]:
+                    self.summaries[name] = summary
+                    changed = True
+
+    def scan(self, body: Block) -> Dict[str, list]:
+        """name -> [own level, element level, first writing node, message,
+        escapes]; escapes lists (expression, index depth, own, element) for
+        each place an array reached from the name may escape."""
+        uses: Dict[str, list] = {}
+
+        def note(name, own, elem, node, what):
+            use = uses.setdefault(name, [READ, READ, None, "", []])
+            if WRITE in (own, elem) and use[2] is None:
+                use[2], use[3] = node, what
+            use[0], use[1] = max(use[0], own), max(use[1], elem)
+
+        def array(n, own, elem, node=None, what=""):
+            # a[i][j] hands the levels to the arrays a holds
+            expr, depth = n, 0
+            while isinstance(n, IndexExpr):
+                visit(n.index)
+                n, depth = n.receiver, depth + 1
+            if isinstance(n, Identifier):
+                note(n.name, own if depth == 0 else READ, elem if depth == 0 else max(own, elem), node, what)
+                if ESCAPE in (own, elem):
+                    uses[n.name][4].append((expr, depth, own, elem))
+            else:
+                visit(n)
+
+        def value(n):
+            """n is stored, returned or passed where it is not followed."""
+            if isinstance(n, (list, tuple)):
+                for item in n:
+                    value(item)
+            else:
+                array(n, ESCAPE, ESCAPE)
+
+        def read(n):
+            if isinstance(n, Identifier):
+                note(n.name, READ, READ, None, "")
+            else:
+                visit(n)
+
+        def visit(n):
+            if isinstance(n, (list, tuple)):
+                for item in n:
+                    visit(item)
+                return
+            if not isinstance(n, ASTNode):
+                return
+            if isinstance(n, Identifier):
+                array(n, ESCAPE, ESCAPE)
+            elif isinstance(n, AddressOf) and isinstance(n.operand, Identifier):
+                note(n.operand.name, WRITE, WRITE, n, "Cannot take the address of const '{}'")
+            elif isinstance(n, IndexExpr):
+                array(n, READ, READ)
+            elif isinstance(n, Assignment) and isinstance(n.target, IndexExpr):
+                array(n.target.receiver, WRITE, READ, n, "Cannot assign to an element of const '{}'")
+                visit(n.target.index)
+                value(n.value)
+            elif isinstance(n, (VarDecl, Assignment)):
+                if isinstance(n, Assignment) and n.target is not None:
+                    visit(n.target)
+                value(n.value)
+            elif isinstance(n, BinaryExpr):
+                read(n.left)
+                read(n.right)
+            elif isinstance(n, UnaryExpr):
+                read(n.operand)
+            elif isinstance(n, FunctionCall) and n.name in self.functions:
+                summary = self.summaries[n.name]
+                for index, arg in enumerate(n.arguments):
+                    own, elem = summary[index] if index < len(summary) else (ESCAPE, ESCAPE)
+                    array(arg, own, elem, n, f"'{n.name}' would modify const '{{}}', which is passed to it")
+            elif isinstance(n, FunctionCall) and n.name in WRITING_BUILTINS and n.arguments:
+                array(n.arguments[0], WRITE, READ, n, f"{n.name} would modify const '{{}}'")
+                for arg in n.arguments[1:]:
+                    read(arg)
+            elif isinstance(n, FunctionCall) and n.name in READING_BUILTINS:
+                if n.name == "Push" and n.arguments:
+                    array(n.arguments[0], READ, ESCAPE)
+                    value(n.arguments[1:])
+                else:
+                    for arg in n.arguments:
+                        array(arg, READ, READ)
+            elif isinstance(n, InterpString):
+                for expr in parse_interp_parts(n):
+                    read(expr)
+            elif isinstance(n, (Block, IfStmt, WhileStmt, ForStmt)):
+                # conditions and bounds are only read
+                for _, child in _children(n):
+                    if isinstance(child, (list, Block, IfStmt)):
+                        visit(child)
+                    else:
+                        read(child)
+            else:
+                for _, child in _children(n):
+                    value(child)
+
+        visit(body)
+        return uses
+
+
+def _declared(body: Block, params) -> Set[str]:
+    names = {param[0] for param in params}
+
+    def visit(n):
+        if isinstance(n, VarDecl):
+            names.add(n.name)
+        elif isinstance(n, TupleUnpack):
+            names.update(n.names)
+        elif isinstance(n, ForStmt):
+            names.add(n.var_name)
+
+    walk(body, visit)
+    return names
+
+
+def check_const_arrays(program: Program, consts: Dict[str, VarDecl]):
+    """Reject code that may change a const array, and hand a copy of it to
+    code it may escape to (ArrayUses)."""
+    analysis = ArrayUses(program)
+    arrays = {name: decl for name, decl in consts.items() if isinstance(decl.value, ConstArray)}
+    for params, body in _function_bodies(program):
+        if body is None:
+            continue
+        uses = analysis.scan(body)
+        declared = _declared(body, params)
+        found = {name: decl for name, decl in arrays.items() if name not in declared}
+        walk(body, lambda n: found.__setitem__(n.name, n)
+             if isinstance(n, VarDecl) and n.is_const and isinstance(n.value, ConstArray) else None)
+        clones = {}
+        for name, decl in found.items():
+            if name not in uses:
+                continue
+            own, elem, node, what, escapes = uses[name]
+            nesting = decl.value.element_type.count("[]")
+            if own == WRITE or (nesting and elem == WRITE):
+                raise ValidationError(what.format(name), node.line, node.column)
+            for expr, depth, own, elem in escapes:
+                # Arrays nested below expr; a negative count means expr is a scalar
+                below = nesting - depth
+                if below >= 0 and (own == ESCAPE or (below and elem == ESCAPE)):
+                    clones[id(expr)] = ArrayClone(array=expr, depth=below, line=expr.line, column=expr.column)
+        if clones:
+            _rewrite(body, lambda n: clones.get(id(n)))
+
+
+def _fold_block(body: Block, evaluator: Evaluator, env: Dict[str, Any], counts: Dict[str, int]):
+    """Substitute scalar consts, fold local consts and comptime calls with
+    constant arguments, in statement order."""
+    stats = {"propagated": 0}
+    for idx, stmt in enumerate(body.statements):
+        stmt = substitute(stmt, env, stats)
+        body.statements[idx] = stmt = _fold_calls(stmt, evaluator, counts)
+        if isinstance(stmt, VarDecl) and stmt.is_const:
+            try:
+                value = evaluator.convert(evaluator.evaluate(stmt.value, {}), stmt.var_type, stmt)
+                stmt.value = to_node(value, stmt.value)
+            except NotConstant as e:
+                raise ValidationError(f"const '{stmt.name}' is not a compile-time constant: {e}",
+                                      e.line or stmt.line, e.column or stmt.column) from None
+            if isinstance(stmt.value, Literal):
+                env[stmt.name] = stmt.value
+            elif stmt.var_type is None:
+                stmt.var_type = f"{stmt.value.element_type}[]"
+            counts["constants"] += 1
+        for child in _blocks(stmt):
+            _fold_block(child, evaluator, env, counts)
+
+
+def _blocks(stmt):
+    if isinstance(stmt, Block):
+        yield stmt
+    elif isinstance(stmt, IfStmt):
+        yield stmt.then_block
+        if stmt.else_block is not None:
+            # an elif is an IfStmt in else_block
+            yield from _blocks(stmt.else_block)
+    elif isinstance(stmt, (WhileStmt, ForStmt)):
+        yield stmt.body
+
+
+def _fold_calls(node, evaluator: Evaluator, counts: Dict[str, int]):
+    """Replace comptime calls whose arguments are constants, innermost first;
+    blocks are left to _fold_block."""
+    if isinstance(node, list):
+        return [_fold_calls(item, evaluator, counts) for item in node]
+    if isinstance(node, tuple):
+        return tuple(_fold_calls(item, evaluator, counts) for item in node)
+    if not hasattr(node, "__dataclass_fields__") or isinstance(node, Block):
+        return node
+    for name in node.__dataclass_fields__:
+        if name not in ("line", "column"):
+            setattr(node, name, _fold_calls(getattr(node, name), evaluator, counts))
+    if isinstance(node, FunctionCall):
+        func = evaluator.functions.get(node.name)
+        if func is not None and func.is_comptime:
+            try:
+                args = [evaluator.evaluate(arg, {}) for arg in node.arguments]
+            except NotConstant:
+                return node  # arguments known only at run time: an ordinary call
+            try:
+                value = evaluator.call(func, args, node)
+            except (NotConstant, RecursionError) as e:
+                raise ValidationError(f"comptime function '{func.name}' cannot run at compile time: {e}",
+                                      getattr(e, "line", 0) or node.line, getattr(e, "column", 0) or node.column) from None
+            if not isinstance(value, VylArray):
+                counts["calls"] += 1
+                return to_node(value, node)
+    return node
@@ -0,0 +1,287 @@
+"""
+VYL Escape Analysis - find allocations that can live in the stack frame
+
+A struct, tuple or fixed-size array escapes when a pointer to it may outlive
+the function that created it: it is returned, stored into a field, array,
+global or another variable, has its address taken, or is passed to a callee
+that lets that parameter escape. Everything else is only ever used through
+``p.field``, ``p[i]``, ``Len(p)`` and friends, so the code generator can
+carve it out of the frame instead of calling ``vyl_alloc``.
+
+The analysis is flow-insensitive and conservative:
+    - any use of a name outside the known-safe positions below is an escape
+    - callee parameters are summarised per function (and per method name,
+      across all structs) and solved to a fixed point, so recursion is fine
+    - an allocation site is only moved to the stack when it initialises a
+      ``var`` that never escapes and does not mention that var itself, or when
+      it is a tuple literal unpacked on the spot (``var a, b = (b, a)``)
+"""
+
+from dataclasses import fields
+from typing import Callable, Dict, List, Optional, Set
+
+try:
+    from .parser import (
+        ASTNode,
+        AddressOf,
+        Assignment,
+        BinaryExpr,
+        Block,
+        BoundsCheck,
+        FieldAccess,
+        FunctionCall,
+        FunctionDef,
+        MethodDef,
+        Identifier,
+        IndexExpr,
+        InterpString,
+        MethodCall,
+        NewExpr,
+        ArrayLiteral,
+        Literal,
+        Program,
+        SelfExpr,
+        SpawnExpr,
+        StructDef,
+        TupleLiteral,
+        TupleUnpack,
+        VarDecl,
+    )
+    from .regalloc import parse_interp_parts
+except ImportError:  # pragma: no cover - fallback for direct execution
+    from parser import (
+        ASTNode,
+        AddressOf,
+        Assignment,
+        BinaryExpr,
+        Block,
+        BoundsCheck,
+        FieldAccess,
+        FunctionCall,
+        FunctionDef,
+        MethodDef,
+        Identifier,
+        IndexExpr,
+        InterpString,
+        MethodCall,
+        NewExpr,
+        ArrayLiteral,
+        Literal,
+        Program,
+        SelfExpr,
+        SpawnExpr,
+        StructDef,
+        TupleLiteral,
+        TupleUnpack,
+        VarDecl,
+    )
+    from regalloc import parse_interp_parts
+
+
+# Builtins that read through a pointer argument but never keep it
+NON_ESCAPING_BUILTINS = frozenset({
+    "Len", "Length", "Pop", "Print", "MapLen",
+    "ArraySum", "ArrayMin", "ArrayMax", "ArrayFind", "ArrayFill", "ArrayCopy",
+    "ChanRecv", "ChanClose", "ChanLen", "AtomicAdd", "AtomicLoad", "AtomicStore", "AtomicCas",
+})
+# Objects bigger than this stay on the heap so frames remain small
+STACK_OBJECT_LIMIT = 1024
+
+
+class EscapeWalker:
+    """Collects the names whose pointer value may escape a function body."""
+
+    def __init__(self, analysis: "EscapeAnalysis"):
+        self.analysis = analysis
+        self.escaped: Set[str] = set()
+
+    def escape(self, node):
+        if isinstance(node, Identifier):
+            self.escaped.add(node.name)
+        elif isinstance(node, SelfExpr):
+            self.escaped.add("self")
+        else:
+            self.visit(node)
+
+    def visit_safe(self, node):
+        """Visit a position that only reads through the pointer."""
+        if not isinstance(node, (Identifier, SelfExpr)):
+            self.visit(node)
+
+    def visit(self, node):
+        if node is None:
+            return
+        if isinstance(node, (list, tuple)):
+            for item in node:
+                self.visit(item)
+            return
+        if not isinstance(node, ASTNode):
+            return
+
+        if isinstance(node, (Identifier, SelfExpr)):
+            self.escape(node)
+        elif isinstance(node, (FieldAccess, IndexExpr)):
+            self.visit_safe(node.receiver)
+            if isinstance(node, IndexExpr):
+                self.visit(node.index)
+        elif isinstance(node, BoundsCheck):
+            self.visit_safe(node.array)
+            self.visit(node.low)
+            self.visit(node.high)
+        elif isinstance(node, Assignment):
+            self.visit(node.value)
+            if node.target is not None:
+                self.visit(node.target)
+        elif isinstance(node, VarDecl):
+            self.visit(node.value)
+        elif isinstance(node, TupleUnpack):
+            self.visit_safe(node.value)
+        elif isinstance(node, BinaryExpr) and node.operator in ("==", "!="):
+            self.visit_safe(node.left)
+            self.visit_safe(node.right)
+        elif isinstance(node, FunctionCall):
+            escaping = self.analysis.call_escapes(node.name, len(node.arguments))
+            for index, arg in enumerate(node.arguments):
+                if index in escaping:
+                    self.escape(arg)
+                else:
+                    self.visit_safe(arg)
+        elif isinstance(node, SpawnExpr):
+            for arg in node.operand.arguments:
+                self.escape(arg)  # shared with a task that may run on another core
+        elif isinstance(node, MethodCall):
+            escaping = self.analysis.method_escapes(node.method_name, len(node.arguments) + 1)
+            for index, arg in enumerate([node.receiver] + list(node.arguments)):
+                if index in escaping:
+                    self.escape(arg)
+                else:
+                    self.visit_safe(arg)
+        elif isinstance(node, AddressOf):
+            self.escape(node.operand)
+        elif isinstance(node, InterpString):
+            for expr in parse_interp_parts(node):
+                self.visit(expr)
+        else:
+            for fld in fields(node):
+                if fld.name in ("line", "column"):
+                    continue
+                self.visit(getattr(node, fld.name))
+
+
+class StackPlan:
+    """Per-function result: which allocations and struct locals use the frame."""
+
+    def __init__(self):
+        self.sites: Dict[int, int] = {}  # id(allocation node) -> size in bytes
+        self.locals: Set[str] = set()  # struct locals whose storage is in the frame
+
+
+class EscapeAnalysis:
+    """Whole-program parameter summaries plus per-function stack planning."""
+
+    def __init__(self, program: Program):
+        self.functions: Dict[str, FunctionDef] = {}
+        self.methods: Dict[str, List[MethodDef]] = {}
+        for stmt in program.statements:
+            if isinstance(stmt, FunctionDef):
+                self.functions[stmt.name] = stmt
+            elif isinstance(stmt, StructDef):
+                for method in stmt.methods:
+                    self.methods.setdefault(method.name, []).append(method)
+        self.param_summary: Dict[str, Set[int]] = {name: set() for name in self.functions}
+        self.method_summary: Dict[str, Set[int]] = {name: set() for name in self.methods}
+        self._solve()
+
+    def call_escapes(self, name: str, argc: int) -> Set[int]:
+        if name in NON_ESCAPING_BUILTINS:
+            return set()
+        if name in self.functions and self.functions[name].is_async:
+            return set(range(argc))  # the task may run after this frame is gone
+        if name in self.param_summary:
+            return self.param_summary[name]
+        return set(range(argc))  # other builtins and unknown callees
+
+    def method_escapes(self, name: str, argc: int) -> Set[int]:
+        return self.method_summary.get(name, set(range(argc)))
+
+    def escaping_names(self, body: Optional[Block]) -> Set[str]:
+        walker = EscapeWalker(self)
+        if body:
+            walker.visit(body.statements)
+        return walker.escaped
+
+    def _solve(self):
+        """Grow the summaries from "nothing escapes" until they are stable."""
+        changed = True
+        while changed:
+            changed = False
+            for name, func in self.functions.items():
+                changed |= self._update(self.param_summary[name], [p[0] for p in func.params], func.body)
+            for name, methods in self.methods.items():
+                for method in methods:
+                    params = ["self"] + [p[0] for p in method.params]
+                    changed |= self._update(self.method_summary[name], params, method.body)
+
+    def _update(self, summary: Set[int], params: List[str], body: Optional[Block]) -> bool:
+        escaped = self.escaping_names(body)
+        new = {index for index, pname in enumerate(params) if pname in escaped} - summary
+        summary |= new
+        return bool(new)
+
+    def plan(self, params: List[str], body: Optional[Block], struct_locals: List[str],
+             size_of: Callable[[ASTNode], Optional[int]]) -> StackPlan:
+        """Choose the allocations of one function body that may use its frame."""
+        plan = StackPlan()
+        if not body:
+            return plan
+        escaped = self.escaping_names(body) | set(params)
+        plan.locals = {name for name in struct_locals if name not in escaped}
+
+        def add_site(node):
+            if not is_allocation(node):
+                return
+            size = size_of(node)
+            if size is not None and size <= STACK_OBJECT_LIMIT:
+                plan.sites[id(node)] = size
+
+        def scan(node):
+            if node is None:
+                return
+            if isinstance(node, (list, tuple)):
+                for item in node:
+                    scan(item)
+                return
+            if not isinstance(node, ASTNode):
+                return
+            if isinstance(node, VarDecl) and node.value is not None and node.name not in escaped:
+                if not _mentions(node.value, node.name):
+                    add_site(node.value)
+            elif isinstance(node, TupleUnpack) and isinstance(node.value, TupleLiteral):
+                add_site(node.value)  # unpacked immediately, never visible
+            for fld in fields(node):
+                if fld.name not in ("line", "column"):
+                    scan(getattr(node, fld.name))
+
+        scan(body.statements)
+        return plan
+
+
+def is_allocation(node: ASTNode) -> bool:
+    """Allocation expressions the planner knows how to size."""
+    if isinstance(node, (NewExpr, ArrayLiteral, TupleLiteral)):
+        return True
+    return (isinstance(node, FunctionCall) and node.name == "Array" and len(node.arguments) == 1
+            and isinstance(node.arguments[0], Literal) and node.arguments[0].literal_type == "int")
+
+
+def _mentions(node, name: str) -> bool:
+    if isinstance(node, Identifier):
+        return node.name == name
+    if isinstance(node, InterpString):
+        return any(_mentions(expr, name) for expr in parse_interp_parts(node))
+    if isinstance(node, (list, tuple)):
+        return any(_mentions(item, name) for item in node)
+    if not isinstance(node, ASTNode):
+        return False
+    return any(_mentions(getattr(node, fld.name), name)
+               for fld in fields(node) if fld.name not in ("line", "column"))
@@ -19,7 +19,7 @@ try:
         Block, Assignment, FunctionCall, MethodCall, NewExpr,
         BinaryExpr, UnaryExpr, Identifier, Literal, FieldAccess,
         IndexExpr, IfStmt, WhileStmt, ForStmt, ReturnStmt,
-        ArrayLiteral, AddressOf, Dereference, SelfExpr,
+        ArrayLiteral, AddressOf, Dereference, AwaitExpr, SpawnExpr, SelfExpr,
         TupleLiteral, TupleUnpack, EnumDef, InterfaceDef
     )
 except ImportError:
@@ -28,11 +28,61 @@ except ImportError:
         Block, Assignment, FunctionCall, MethodCall, NewExpr,
         BinaryExpr, UnaryExpr, Identifier, Literal, FieldAccess,
         IndexExpr, IfStmt, WhileStmt, ForStmt, ReturnStmt,
-        ArrayLiteral, AddressOf, Dereference, SelfExpr,
+        ArrayLiteral, AddressOf, Dereference, AwaitExpr, SpawnExpr, SelfExpr,
         TupleLiteral, TupleUnpack, EnumDef, InterfaceDef
     )
 
 
+# Generic types implemented by the runtime rather than by a VYL struct. Their
+# instantiations are not copied into new structs: the key type picks a
+# specialised runtime routine and values are stored unboxed in 8-byte slots.
+# Task<T> is the handle an async call returns; awaiting it yields a T.
+BUILTIN_GENERICS = {"Map": ("K", "V"), "Task": ("T",), "Chan": ("T",)}
+MAP_KEY_TYPES = ("int", "string")
+
+
+def map_type_args(type_str: Optional[str]) -> Optional[Tuple[str, str]]:
+    """Return (K, V) for a concrete "Map<K, V>" type, None for anything else.
+
+    Example: "Map<string, int>" -> ("string", "int")
+             "Map" -> None (untyped result of Map())
+    """
+    if not type_str:
+        return None
+    base_name, args = parse_generic_type(type_str)
+    if base_name != "Map" or len(args) != len(BUILTIN_GENERICS["Map"]):
+        return None
+    return (args[0], args[1])
+
+
+def task_result_type(type_str: Optional[str]) -> Optional[str]:
+    """Return T for a "Task<T>" handle type, None for anything else."""
+    if not type_str or not type_str.endswith(">"):
+        return None
+    base_name, args = parse_generic_type(type_str)
+    if base_name != "Task" or len(args) != 1:
+        return None
+    return args[0]
+
+
+def chan_elem_type(type_str: Optional[str]) -> Optional[str]:
+    """Return T for a "Chan<T>" channel type, None for anything else."""
+    if not type_str or not type_str.endswith(">"):
+        return None
+    base_name, args = parse_generic_type(type_str)
+    if base_name != "Chan" or len(args) != 1:
+        return None
+    return args[0]
+
+
+def map_key_kind(type_str: Optional[str]) -> Optional[str]:
+    """Runtime specialisation for a map type: "str", "int", or None if unknown."""
+    args = map_type_args(type_str)
+    if args is None:
+        return None
+    return "str" if args[0] == "string" else "int"
+
+
 def mangle_generic_name(base_name: str, type_args: List[str]) -> str:
     """Generate mangled name for generic instantiation.
     
@@ -181,7 +231,7 @@ def find_generic_usages(program: Program, generic_structs: Dict[str, StructDef])
                 scan_expr(elem)
         elif isinstance(expr, AddressOf):
             scan_expr(expr.operand)
-        elif isinstance(expr, Dereference):
+        elif isinstance(expr, (Dereference, AwaitExpr, SpawnExpr)):
             scan_expr(expr.operand)
         elif isinstance(expr, TupleLiteral):
             for elem in expr.elements:
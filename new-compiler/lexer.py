@@ -10,7 +10,7 @@ Token Types:
     Literals: INTEGER, DECIMAL, STRING, TRUE, FALSE
     Identifiers: variable/function names
     Operators: +, -, *, /, =, ==, !=, <, >, <=, >=, &&, ||, .., ->
-    Punctuation: (, ), {, }, [, ], ;, ,, ., :
+    Punctuation: (, ), {, }, [, ], ;, ,, ., :, @
     Special: NEWLINE, COMMENT, EOF
 """
 
@@ -51,6 +51,9 @@ KEYWORDS = {
     'Interface': 'INTERFACE',
     'defer': 'DEFER',
     'Defer': 'DEFER',
+    'async': 'ASYNC',
+    'await': 'AWAIT',
+    'spawn': 'SPAWN',
     'new': 'NEW',
     'import': 'IMPORT',
     'function': 'FUNCTION',
@@ -68,6 +71,8 @@ KEYWORDS = {
     'false': 'FALSE',
     'let': 'LET',
     'mut': 'MUT',
+    'const': 'CONST',
+    'comptime': 'COMPTIME',
     'self': 'SELF',
     'null': 'NULL',
 }
@@ -367,6 +372,7 @@ class Lexer:
         if char == '.': return Token('DOT', '.', line=line, column=column)
         if char == ':': return Token('COLON', ':', line=line, column=column)
         if char == '?': return Token('QUESTION', '?', line=line, column=column)
+        if char == '@': return Token('AT', '@', line=line, column=column)
         
         # Unknown character
         raise SyntaxError(f"Unexpected character '{char}' at line {line}, column {column}")
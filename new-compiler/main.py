@@ -21,9 +21,13 @@ import sys
 import os
 import subprocess
 import argparse
+import multiprocessing
 import shutil
+import tempfile
 import re
+from dataclasses import dataclass
 from pathlib import Path
+from typing import List, Optional
 
 # Handle both module and standalone execution
 try:
@@ -32,8 +36,14 @@ try:
     from .resolver import resolve_program
     from .type_checker import type_check
     from .validator import validate_program, ValidationError
-    from .codegen import generate_assembly, CodegenError
+    from .codegen import generate_assembly, generate_runtime_assembly, CodegenError
     from .generics import instantiate_generics
+    from .optimizer import optimize_program, DEFAULT_OPT_LEVEL, UNROLL_FACTORS
+    from .comptime import evaluate_program
+    from .parser import Program
+    from .cache import BuildCache, content_hash, default_cache_dir
+    from .metrics import BuildStats, PassTimer, count_nodes, function_names
+    from .bench import bench_main
 except ImportError:
     # Running as standalone script
     if __name__ == '__main__' and __package__ is None:
@@ -44,8 +54,14 @@ except ImportError:
         from resolver import resolve_program
         from type_checker import type_check
         from validator import validate_program, ValidationError
-        from codegen import generate_assembly, CodegenError
+        from codegen import generate_assembly, generate_runtime_assembly, CodegenError
         from generics import instantiate_generics
+        from optimizer import optimize_program, DEFAULT_OPT_LEVEL, UNROLL_FACTORS
+        from comptime import evaluate_program
+        from parser import Program
+        from cache import BuildCache, content_hash, default_cache_dir
+        from metrics import BuildStats, PassTimer, count_nodes, function_names
+        from bench import bench_main
     else:
         raise
 
@@ -82,91 +98,114 @@ def resolve_module_path(module_spec: str) -> Path:
         return VYL_MODULES_DIR / base_module / f"{subpath}.vyl"
 
 
-def preprocess_includes(source_code: str, base_dir: Path, seen: set[Path]) -> str:
-    """Recursively inline .vyl files.
-    
+@dataclass
+class ModuleUnit:
+    """One source file compiled on its own; dependencies come first in the list."""
+    name: str  # as written in the include/import, or the root file's path
+    path: Optional[Path]
+    text: str  # directives blanked out, so line numbers still match the file
+    digest: str
+
+
+def _directive_target(line: str, base_dir: Path) -> Optional[tuple[str, Path, str]]:
+    """(name, path, kind) for an include/import line, None for anything else."""
+    dotted_match = IMPORT_DOTTED_PATTERN.match(line)
+    if dotted_match:
+        module_spec = dotted_match.group(1)
+        return module_spec, resolve_module_path(module_spec).resolve(), "import"
+    simple_match = IMPORT_SIMPLE_PATTERN.match(line)
+    if simple_match:
+        module_name = simple_match.group(1)
+        return module_name, resolve_module_path(module_name).resolve(), "import"
+    import_match = IMPORT_PATTERN.match(line)
+    if import_match:
+        module_name = import_match.group(1)
+        return module_name, (VYL_MODULES_DIR / module_name / "mod.vyl").resolve(), "import"
+    include_match = INCLUDE_PATTERN.match(line)
+    if include_match:
+        rel_path = include_match.group(1)
+        return rel_path, (base_dir / rel_path).resolve(), "include"
+    return None
+
+
+def load_modules(source_code: str, base_dir: Path, root_path: Optional[Path] = None) -> List[ModuleUnit]:
+    """Split a program into per-file units in dependency order.
+
     - include "path.vyl" -> relative to current file's directory
     - import "name" -> looks up ~/.vyl/modules/<name>/mod.vyl
     - import stdlib.io -> looks up ~/.vyl/modules/stdlib/io.vyl
+
+    A file reached twice (a diamond) is loaded once; reaching a file that is
+    still being loaded is a cycle.
     """
-    result = []
-    for line in source_code.splitlines():
-        # Check for dotted import first: import stdlib.io
-        dotted_match = IMPORT_DOTTED_PATTERN.match(line)
-        if dotted_match:
-            module_spec = dotted_match.group(1)
-            module_path = resolve_module_path(module_spec).resolve()
-            if module_path in seen:
-                raise SyntaxError(f"Cyclic import detected for module '{module_spec}'")
-            if not module_path.exists():
-                # Provide helpful error message
-                parts = module_spec.split('.')
-                raise FileNotFoundError(
-                    f"Module '{module_spec}' not found. Expected: {module_path}\n"
-                    f"Install with: vpm install {parts[0]}"
-                )
-            seen.add(module_path)
-            module_text = module_path.read_text()
-            result.append(f"// begin import {module_spec}")
-            result.append(preprocess_includes(module_text, module_path.parent, seen))
-            result.append(f"// end import {module_spec}")
-            continue
-        
-        # Check for simple module import: import stdlib
-        simple_match = IMPORT_SIMPLE_PATTERN.match(line)
-        if simple_match:
-            module_name = simple_match.group(1)
-            module_path = resolve_module_path(module_name).resolve()
-            if module_path in seen:
-                raise SyntaxError(f"Cyclic import detected for module '{module_name}'")
-            if not module_path.exists():
+    units: List[ModuleUnit] = []
+    loaded: set[Path] = set()
+    loading: set[Path] = {root_path} if root_path else set()
+
+    def visit(name: str, path: Optional[Path], text: str, directory: Path) -> None:
+        lines = text.splitlines()
+        for i, line in enumerate(lines):
+            target = _directive_target(line, directory)
+            if target is None:
+                continue
+            dep_name, dep_path, kind = target
+            lines[i] = ""
+            if dep_path in loading:
+                if kind == "include":
+                    raise SyntaxError(f"Cyclic include detected at {dep_path}")
+                raise SyntaxError(f"Cyclic import detected for module '{dep_name}'")
+            if dep_path in loaded:
+                continue
+            if not dep_path.exists():
+                if kind == "include":
+                    raise FileNotFoundError(f"Include not found: {dep_path}")
                 raise FileNotFoundError(
-                    f"Module '{module_name}' not found. Expected: {module_path}\n"
-                    f"Install with: vpm install {module_name}"
+                    f"Module '{dep_name}' not found. Expected: {dep_path}\n"
+                    f"Install with: vpm install {dep_name.split('.')[0]}"
                 )
-            seen.add(module_path)
-            module_text = module_path.read_text()
-            result.append(f"// begin import {module_name}")
-            result.append(preprocess_includes(module_text, module_path.parent, seen))
-            result.append(f"// end import {module_name}")
-            continue
-        
-        # Check for quoted import: import "name" (legacy)
-        import_match = IMPORT_PATTERN.match(line)
-        if import_match:
-            module_name = import_match.group(1)
-            module_path = (VYL_MODULES_DIR / module_name / "mod.vyl").resolve()
-            if module_path in seen:
-                raise SyntaxError(f"Cyclic import detected for module '{module_name}'")
-            if not module_path.exists():
-                raise FileNotFoundError(
-                    f"Module '{module_name}' not found. Expected: {module_path}\n"
-                    f"Install with: vpm install {module_name}"
-                )
-            seen.add(module_path)
-            module_text = module_path.read_text()
-            result.append(f"// begin import {module_name}")
-            result.append(preprocess_includes(module_text, module_path.parent, seen))
-            result.append(f"// end import {module_name}")
-            continue
-        
-        # Check for include (local files)
-        include_match = INCLUDE_PATTERN.match(line)
-        if include_match:
-            rel_path = include_match.group(1)
-            include_path = (base_dir / rel_path).resolve()
-            if include_path in seen:
-                raise SyntaxError(f"Cyclic include detected at {include_path}")
-            if not include_path.exists():
-                raise FileNotFoundError(f"Include not found: {include_path}")
-            seen.add(include_path)
-            included_text = include_path.read_text()
-            result.append(f"// begin include {rel_path}")
-            result.append(preprocess_includes(included_text, include_path.parent, seen))
-            result.append(f"// end include {rel_path}")
-            continue
-        result.append(line)
-    return "\n".join(result) + "\n"
+            loading.add(dep_path)
+            visit(dep_name, dep_path, dep_path.read_text(), dep_path.parent)
+            loading.discard(dep_path)
+            loaded.add(dep_path)
+        body = "\n".join(lines) + "\n"
+        units.append(ModuleUnit(name, path, body, content_hash(body)))
+
+    visit(str(root_path or "<input>"), None, source_code, base_dir)
+    return units
+
+
+def parse_modules(units: List[ModuleUnit], cache: Optional[BuildCache], timer: Optional[PassTimer] = None) -> tuple[Program, int]:
+    """Tokenize and parse each unit, or take its AST from the cache, and
+    concatenate them into one Program. Returns it and the tokens lexed."""
+    timer = timer or PassTimer()
+    statements = []
+    token_count = 0
+    for index, unit in enumerate(units):
+        key = cache.key("ast", unit.digest) if cache else None
+        with timer.stage("ast cache"):
+            program = cache.load("ast", key) if cache else None
+        if program is None:
+            try:
+                with timer.stage("tokenize"):
+                    tokens = tokenize(unit.text)
+                with timer.stage("parse"):
+                    program = parse(tokens)
+            except SyntaxError as e:
+                if unit.path is None:
+                    raise
+                raise SyntaxError(f"{unit.name}: {e}") from e
+            token_count += len(tokens)
+            if cache:
+                cache.store("ast", key, program)
+        for stmt in program.statements:
+            stmt.unit = index  # which object file it goes to in a split build
+        statements.extend(program.statements)
+    return Program(statements=statements), token_count
+
+
+def source_names(units: List[ModuleUnit]) -> List[str]:
+    """The file each unit's .file/.loc line entries point at."""
+    return [str(unit.path) if unit.path else unit.name for unit in units]
 
 
 def assemble_with_keystone(assembly: str):
@@ -178,11 +217,15 @@ def assemble_with_keystone(assembly: str):
 
     ks = Ks(KS_ARCH_X86, KS_MODE_64)
     ks.syntax = KS_OPT_SYNTAX_ATT
+    # Keystone knows no unwind or line-table directives; a flat binary has no
+    # use for them anyway
+    assembly = "\n".join(line for line in assembly.splitlines()
+                         if not line.startswith((".cfi_", ".loc ", ".file ")))
     encoding, _ = ks.asm(assembly)
     return bytes(encoding)
 
 
-def compile_vyl(source_code: str, output_file: str, generate_assembly_only: bool = False, target: str = "elf", source_path: str | None = None, use_keystone: bool = False, keep_asm: bool = False) -> bool:
+def compile_vyl(source_code: str, output_file: str, generate_assembly_only: bool = False, target: str = "elf", source_path: str | None = None, use_keystone: bool = False, keep_asm: bool = False, opt_level: int = DEFAULT_OPT_LEVEL, unroll: int = 0, cache_dir: str | None = None, time_passes: bool = False, show_stats: bool = False, profile_alloc: bool = False, perf_map: bool = False) -> bool:
     """
     Compile VYL source code to assembly, object, executable, or flat binary.
     
@@ -193,134 +236,61 @@ def compile_vyl(source_code: str, output_file: str, generate_assembly_only: bool
         target: 'elf' (default executable), 'mach' (Mach-O object), or 'pe' (PE/COFF object)
         source_path: Optional path of the source file to resolve relative includes
         use_keystone: If True, assemble to a flat .bin using Keystone in addition to normal outputs
+        opt_level: Optimization level 0-2 (see optimizer.py); 0 also disables register allocation
+        unroll: Unroll counted for loops by this factor (4 or 8); 0 disables unrolling
+        cache_dir: Reuse ASTs and assembly stored here by earlier builds (see cache.py); None disables caching
+        time_passes: Print wall time and peak RSS per stage (see metrics.py)
+        show_stats: Print AST node, generic instance, instruction and vyl_alloc site counts; skips cached code
+        profile_alloc: Build with the instrumented allocator, which reports allocation sites, the
+            live-heap high-water mark and GC pauses on stderr at exit (see generate_alloc_profile_runtime)
+        perf_map: Write /tmp/perf-<pid>.map with every function at startup (see generate_perf_map_runtime)
     
     Returns:
         True if compilation succeeded, False otherwise
     """
+    timer = PassTimer(time_passes)
+    stats = BuildStats(show_stats)
     try:
-        # Step 0: Resolve includes
-        base_dir = Path(source_path).resolve().parent if source_path else Path.cwd()
+        # Step 0: Resolve includes into one unit per file
+        root_path = Path(source_path).resolve() if source_path else None
+        base_dir = root_path.parent if root_path else Path.cwd()
         print("Step 0: Resolving includes...")
-        source_code_expanded = preprocess_includes(source_code, base_dir, set())
+        with timer.stage("includes"):
+            units = load_modules(source_code, base_dir, root_path)
+        cache = BuildCache(Path(cache_dir)) if cache_dir else None
 
-        # Step 1: Lexical analysis
+        # Step 1-2: Lexical analysis and parsing, skipped for cached units
         print("Step 1: Tokenizing...")
-        tokens = tokenize(source_code_expanded)
-        print(f"  Generated {len(tokens)} tokens")
-        
-        # Step 2: Parsing
         print("Step 2: Parsing...")
-        ast = parse(tokens)
+        ast, token_count = parse_modules(units, cache, timer)
+        sources = source_names(units)
+        print(f"  Generated {token_count} tokens for {len(units)} module(s), "
+              f"{cache.hits if cache else 0} reused from cache")
         print("  AST generated successfully")
-        
-        # Step 2a: Instantiate generics (monomorphization)
-        print("Step 2a: Instantiating generics...")
-        ast = instantiate_generics(ast)
-        print("  Generics instantiated")
-        
-        # Step 2b: Resolve symbols / basic semantics
-        print("Step 2b: Resolving symbols...")
-        resolve_program(ast)
-        print("  Resolution passed")
-
-        # Step 2c: Type checking
-        print("Step 2c: Type checking...")
-        type_check(ast)
-        print("  Type checking passed")
-
-        # Step 2d: Additional validation (legacy checks)
-        print("Step 2d: Validating AST...")
-        validate_program(ast)
-        print("  Validation passed")
-
-        # Step 3: Code generation
-        print("Step 3: Generating assembly...")
-        assembly = generate_assembly(ast)
-        
-        # Determine output paths
-        if generate_assembly_only:
-            asm_file = output_file
-            executable_file = None
-        else:
-            asm_file = output_file + ".s"
-            executable_file = output_file
-        
-        # Write assembly to file
-        with open(asm_file, 'w') as f:
-            f.write(assembly)
-        print(f"  Assembly written to {asm_file}")
-
-        # Optional: assemble to flat machine code using Keystone
-        if use_keystone:
-            try:
-                machine_code = assemble_with_keystone(assembly)
-                bin_file = output_file + ".bin"
-                with open(bin_file, 'wb') as bf:
-                    bf.write(machine_code)
-                print(f"  Machine code written to {bin_file} (flat binary)")
-            except Exception as ke:
-                print(f"  Keystone assembly failed: {ke}")
-                return False
-        
-        if generate_assembly_only:
-            return True
-
-        # Step 4: Assemble and link per target
-        print("Step 4: Assembling and linking...")
-        try:
-            if target == "elf":
-                tool = shutil.which('gcc')
-                if not tool:
-                    print("  Error: gcc not found. Please install gcc.")
-                    return False
-                result = subprocess.run([tool, '-no-pie', asm_file, '-o', executable_file, '-lssl', '-lcrypto'], capture_output=True, text=True)
-                if result.returncode != 0:
-                    err = result.stderr.strip()
-                    if 'crypto' in err and ('not found' in err or 'cannot find' in err):
-                        print("  Error: libcrypto missing (OpenSSL). Install libssl-dev or openssl-devel.")
-                    print(f"  Error: {result.stderr}")
-                    return False
-                print(f"  Executable written to {executable_file}")
-                if not keep_asm:
-                    os.remove(asm_file)
-                return True
-
-            if target == "mach":
-                # Produce Mach-O object; linking requires macOS SDK
-                tool = shutil.which('clang')
-                if not tool:
-                    print("  Error: clang not found. Install clang to build Mach-O.")
-                    return False
-                object_file = executable_file if executable_file.endswith('.o') else executable_file + '.o'
-                result = subprocess.run([tool, '-target', 'x86_64-apple-darwin', '-c', asm_file, '-o', object_file], capture_output=True, text=True)
-                if result.returncode != 0:
-                    print(f"  Error: {result.stderr}")
-                    return False
-                print(f"  Mach-O object written to {object_file}")
-                return True
-
-            if target == "pe":
-                tool = shutil.which('x86_64-w64-mingw32-gcc') or shutil.which('clang')
-                if not tool:
-                    print("  Error: mingw-w64 gcc/clang not found. Install a PE-capable toolchain.")
-                    return False
-                object_file = executable_file if executable_file.endswith('.obj') else executable_file + '.obj'
-                cmd = [tool, '-c', asm_file, '-o', object_file]
-                if os.path.basename(tool).startswith('clang'):
-                    cmd = [tool, '-target', 'x86_64-w64-windows-gnu', '-c', asm_file, '-o', object_file]
-                result = subprocess.run(cmd, capture_output=True, text=True)
-                if result.returncode != 0:
-                    print(f"  Error: {result.stderr}")
-                    return False
-                print(f"  PE object written to {object_file}")
-                return True
-
-            print(f"  Error: Unknown target '{target}'")
-            return False
-
-        except Exception as e:
-            print(f"  Error during assembly/linking: {e}")
-            return False
+        if stats.enabled:
+            stats.parsed_nodes = count_nodes(ast)
+
+        # An executable is linked from one object per module plus the runtime
+        # archive; everything else needs the program as one assembly file
+        if target == "elf" and not (generate_assembly_only or keep_asm or use_keystone):
+            return build_executable(ast, units, output_file, opt_level, unroll, cache, timer, stats, profile_alloc, perf_map)
+
+        # Steps 2a-3 see the whole program, so their output is cached per
+        # program; --stats needs the code, so it always regenerates it
+        assembly = None
+        if cache:
+            asm_key = cache.key("asm", str(opt_level), str(unroll), str(int(profile_alloc)), str(int(perf_map)),
+                                *(unit.digest for unit in units), *sources)
+            if not stats.enabled:
+                assembly = cache.load("asm", asm_key)
+            if assembly is not None:
+                print("Step 2a-3: Reusing cached assembly")
+        if assembly is None:
+            assembly = generate_program(ast, opt_level, unroll, timer, stats, profile_alloc, perf_map, sources)
+            if cache:
+                cache.store("asm", asm_key, assembly)
+
+        return write_outputs(assembly, output_file, generate_assembly_only, target, use_keystone, keep_asm, timer)
             
     except ValidationError as e:
         print(f"Validation Error: {e}")
@@ -339,10 +309,287 @@ def compile_vyl(source_code: str, output_file: str, generate_assembly_only: bool
         import traceback
         traceback.print_exc()
         return False
+    finally:
+        timer.report()
+        stats.report()
+
+
+def generate_program(ast: Program, opt_level: int, unroll: int, timer: Optional[PassTimer] = None, stats: Optional[BuildStats] = None,
+                     profile_alloc: bool = False, perf_map: bool = False, sources: Optional[List[str]] = None) -> str:
+    """Steps 2a-3: the whole-program passes, then one assembly file."""
+    timer = timer or PassTimer()
+    stats = stats or BuildStats()
+    ast = run_passes(ast, opt_level, unroll, timer, stats)
+
+    # Step 3: Code generation
+    print("Step 3: Generating assembly...")
+    with timer.stage("codegen"):
+        assembly = generate_assembly(ast, opt_level, profile_alloc=profile_alloc, perf_map=perf_map, sources=sources)
+    stats.record_assembly(assembly)
+    return assembly
+
+
+def run_passes(ast: Program, opt_level: int, unroll: int, timer: Optional[PassTimer] = None, stats: Optional[BuildStats] = None) -> Program:
+    """Steps 2a-2f: monomorphize, check, evaluate constants and optimize the merged program."""
+    timer = timer or PassTimer()
+    stats = stats or BuildStats()
+    # Step 2a: Instantiate generics (monomorphization)
+    print("Step 2a: Instantiating generics...")
+    with timer.stage("generics"):
+        generic_ast = instantiate_generics(ast)
+    stats.record_instances(ast, generic_ast)
+    ast = generic_ast
+    print("  Generics instantiated")
+    
+    # Step 2b: Resolve symbols / basic semantics
+    print("Step 2b: Resolving symbols...")
+    with timer.stage("resolve"):
+        resolve_program(ast)
+    print("  Resolution passed")
+
+    # Step 2c: Type checking
+    print("Step 2c: Type checking...")
+    with timer.stage("type check"):
+        type_check(ast)
+    print("  Type checking passed")
+
+    # Step 2d: Additional validation (legacy checks)
+    print("Step 2d: Validating AST...")
+    with timer.stage("validate"):
+        validate_program(ast)
+    print("  Validation passed")
+
+    # Step 2e: Compile-time evaluation of consts and comptime calls
+    print("Step 2e: Evaluating constants...")
+    with timer.stage("comptime"):
+        folded = evaluate_program(ast)
+    print(f"  Evaluated {folded['constants']} constant(s) and {folded['calls']} comptime call(s)")
+
+    # Step 2f: AST optimization passes
+    print(f"Step 2f: Optimizing (-O{opt_level})...")
+    with timer.stage("optimize"):
+        counts = optimize_program(ast, opt_level, unroll)
+    print(f"  Folded {counts['folded']}, propagated {counts['propagated']}, "
+          f"removed {counts['removed']}, hoisted {counts['hoisted']}, "
+          f"reduced {counts['reduced']}, unrolled {counts['unrolled']}, "
+          f"bounds checks removed {counts['unchecked']}, inlined {counts['inlined']}, "
+          f"vectorized {counts['vectorized']}")
+    if stats.enabled:
+        stats.optimized_nodes = count_nodes(ast)
+        stats.functions = function_names(ast)
+    return ast
+
+
+RUNTIME_ARCHIVE = "libvylrt.a"
+
+# The optimized program and its file names, set before forking the codegen
+# workers so they inherit them instead of unpickling a copy each
+_split_program: Optional[Program] = None
+_split_sources: List[str] = []
+
+
+def _build_object(job: tuple) -> Optional[str]:
+    """Generate and assemble one object: a module, or the runtime archive.
+    Runs in a worker process; returns an error message or None."""
+    unit, root_unit, opt_level, out_path, profile_alloc, perf_map = job
+    out = Path(out_path)
+    if unit is None:
+        assembly = generate_runtime_assembly(profile_alloc)
+        obj = out.with_suffix(".o")
+    else:
+        assembly = generate_assembly(_split_program, opt_level, unit, root_unit, profile_alloc, perf_map, _split_sources)
+        obj = out
+    asm_file = obj.with_suffix(".s")
+    asm_file.write_text(assembly)
+    result = subprocess.run([shutil.which('gcc'), '-c', str(asm_file), '-o', str(obj)], capture_output=True, text=True)
+    if result.returncode != 0:
+        return result.stderr
+    if unit is None:
+        result = subprocess.run(['ar', 'rcs', str(out), str(obj)], capture_output=True, text=True)
+        if result.returncode != 0:
+            return result.stderr
+    return None
+
+
+def build_executable(ast: Program, units: List[ModuleUnit], output_file: str, opt_level: int, unroll: int, cache: Optional[BuildCache], timer: PassTimer, stats: BuildStats,
+                     profile_alloc: bool = False, perf_map: bool = False) -> bool:
+    """Steps 2a-4 for an ELF executable: one object per module, built in
+    parallel, linked against libvylrt.a. Objects are cached per program like
+    whole-program assembly, and the archive per compiler version (the
+    --profile-alloc runtime separately)."""
+    global _split_program, _split_sources
+    tool = shutil.which('gcc')
+    if not tool:
+        print("  Error: gcc not found. Please install gcc.")
+        return False
+    root_unit = len(units) - 1
+    digests = [unit.digest for unit in units]
+    sources = source_names(units)
+    with tempfile.TemporaryDirectory(prefix="vyl-build-") as tmpdir:
+        build_dir = Path(tmpdir)
+        objects = [build_dir / f"unit{index}.o" for index in range(len(units))]
+        runtime = build_dir / RUNTIME_ARCHIVE
+        jobs = []
+        obj_keys = [cache.key("obj", str(opt_level), str(unroll), str(int(profile_alloc)), str(int(perf_map)), str(index),
+                              *digests, *sources) if cache else None
+                    for index in range(len(units))]
+        for index, obj in enumerate(objects):
+            data = cache.load("obj", obj_keys[index]) if cache and not stats.enabled else None
+            if data is None:
+                jobs.append((index, root_unit, opt_level, str(obj), profile_alloc, perf_map))
+            else:
+                obj.write_bytes(data)
+        runtime_key = (cache.key("rt", "profile") if profile_alloc else cache.key("rt")) if cache else None
+        cached_runtime = cache.path("rt", runtime_key) if cache else None
+        if cached_runtime is not None:
+            runtime = cached_runtime
+        else:
+            jobs.append((None, root_unit, opt_level, str(runtime), profile_alloc, perf_map))
+
+        if any(job[0] is not None for job in jobs):
+            _split_program = run_passes(ast, opt_level, unroll, timer, stats)
+            _split_sources = sources
+        if jobs:
+            workers = min(len(jobs), os.cpu_count() or 1)
+            print(f"Step 3: Generating and assembling {len(jobs)} object(s) on {workers} process(es)...")
+            with timer.stage("codegen + as", external=True):
+                if workers > 1:
+                    with multiprocessing.get_context("fork").Pool(workers) as pool:
+                        errors = pool.map(_build_object, jobs)
+                else:
+                    errors = [_build_object(job) for job in jobs]
+            _split_program = None
+            _split_sources = []
+            for error in errors:
+                if error:
+                    print(f"  Error: {error}")
+                    return False
+            for job in jobs:
+                if job[0] is not None:
+                    stats.record_assembly(Path(job[3]).with_suffix(".s").read_text())
+        else:
+            print("Step 2a-3: Reusing cached objects")
+
+        if cache:
+            for index, obj in enumerate(objects):
+                if any(job[0] == index for job in jobs):
+                    cache.store("obj", obj_keys[index], obj.read_bytes())
+            if cached_runtime is None:
+                cache.store("rt", runtime_key, runtime.read_bytes())
+
+        # Step 4: The link is the one serial step
+        print("Step 4: Linking...")
+        cmd = [tool, '-no-pie', *map(str, objects), str(runtime), '-o', output_file, '-lssl', '-lcrypto', '-lz']
+        with timer.stage("link", external=True):
+            result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            err = result.stderr.strip()
+            if 'crypto' in err and ('not found' in err or 'cannot find' in err):
+                print("  Error: libcrypto missing (OpenSSL). Install libssl-dev or openssl-devel.")
+            print(f"  Error: {result.stderr}")
+            return False
+    print(f"  Executable written to {output_file}")
+    return True
+
+
+def write_outputs(assembly: str, output_file: str, generate_assembly_only: bool, target: str, use_keystone: bool, keep_asm: bool, timer: Optional[PassTimer] = None) -> bool:
+    """Write the assembly, then assemble and link it for the target."""
+    # Determine output paths
+    if generate_assembly_only:
+        asm_file = output_file
+        executable_file = None
+    else:
+        asm_file = output_file + ".s"
+        executable_file = output_file
+    
+    # Write assembly to file
+    with open(asm_file, 'w') as f:
+        f.write(assembly)
+    print(f"  Assembly written to {asm_file}")
+
+    # Optional: assemble to flat machine code using Keystone
+    if use_keystone:
+        try:
+            machine_code = assemble_with_keystone(assembly)
+            bin_file = output_file + ".bin"
+            with open(bin_file, 'wb') as bf:
+                bf.write(machine_code)
+            print(f"  Machine code written to {bin_file} (flat binary)")
+        except Exception as ke:
+            print(f"  Keystone assembly failed: {ke}")
+            return False
+    
+    if generate_assembly_only:
+        return True
+
+    # Step 4: Assemble and link per target
+    print("Step 4: Assembling and linking...")
+    with (timer or PassTimer()).stage("as + link", external=True):
+        return _assemble_and_link(asm_file, executable_file, target, keep_asm)
+
+
+def _assemble_and_link(asm_file: str, executable_file: str, target: str, keep_asm: bool) -> bool:
+    try:
+        if target == "elf":
+            tool = shutil.which('gcc')
+            if not tool:
+                print("  Error: gcc not found. Please install gcc.")
+                return False
+            result = subprocess.run([tool, '-no-pie', asm_file, '-o', executable_file, '-lssl', '-lcrypto', '-lz'], capture_output=True, text=True)
+            if result.returncode != 0:
+                err = result.stderr.strip()
+                if 'crypto' in err and ('not found' in err or 'cannot find' in err):
+                    print("  Error: libcrypto missing (OpenSSL). Install libssl-dev or openssl-devel.")
+                print(f"  Error: {result.stderr}")
+                return False
+            print(f"  Executable written to {executable_file}")
+            if not keep_asm:
+                os.remove(asm_file)
+            return True
+
+        if target == "mach":
+            # Produce Mach-O object; linking requires macOS SDK
+            tool = shutil.which('clang')
+            if not tool:
+                print("  Error: clang not found. Install clang to build Mach-O.")
+                return False
+            object_file = executable_file if executable_file.endswith('.o') else executable_file + '.o'
+            result = subprocess.run([tool, '-target', 'x86_64-apple-darwin', '-c', asm_file, '-o', object_file], capture_output=True, text=True)
+            if result.returncode != 0:
+                print(f"  Error: {result.stderr}")
+                return False
+            print(f"  Mach-O object written to {object_file}")
+            return True
+
+        if target == "pe":
+            tool = shutil.which('x86_64-w64-mingw32-gcc') or shutil.which('clang')
+            if not tool:
+                print("  Error: mingw-w64 gcc/clang not found. Install a PE-capable toolchain.")
+                return False
+            object_file = executable_file if executable_file.endswith('.obj') else executable_file + '.obj'
+            cmd = [tool, '-c', asm_file, '-o', object_file]
+            if os.path.basename(tool).startswith('clang'):
+                cmd = [tool, '-target', 'x86_64-w64-windows-gnu', '-c', asm_file, '-o', object_file]
+            result = subprocess.run(cmd, capture_output=True, text=True)
+            if result.returncode != 0:
+                print(f"  Error: {result.stderr}")
+                return False
+            print(f"  PE object written to {object_file}")
+            return True
+
+        print(f"  Error: Unknown target '{target}'")
+        return False
+
+    except Exception as e:
+        print(f"  Error during assembly/linking: {e}")
+        return False
 
 
 def main():
     """Main CLI entry point"""
+    if sys.argv[1:2] == ["bench"]:
+        sys.exit(bench_main(sys.argv[2:], compile_vyl))
+
     parser = argparse.ArgumentParser(
         description="VYL Compiler - Compile VYL source code to x86-64 assembly",
         formatter_class=argparse.RawDescriptionHelpFormatter,
@@ -352,6 +599,8 @@ Examples:
   vyl -c program.vyl -o myapp     # Compile to myapp
   vyl -c program.vyl -S           # Generate program.s only
   vyl -c program.vyl -S -o out.s  # Generate out.s
+  vyl -c program.vyl -O2          # Compile with loop-invariant code motion
+  vyl bench                       # Run bench/ against its C baselines
         """
     )
     
@@ -367,6 +616,20 @@ Examples:
                        help='Generate PE/COFF object (Windows)')
     parser.add_argument('-k', '--keystone', action='store_true',
                        help='Also assemble with Keystone and emit a flat .bin')
+    parser.add_argument('-O', dest='opt_level', type=int, choices=[0, 1, 2], default=DEFAULT_OPT_LEVEL,
+                       help='Optimization level: 0 (none), 1 (fold/propagate/DCE, default), 2 (+LICM)')
+    parser.add_argument('--unroll', type=int, choices=[0, *UNROLL_FACTORS], default=0,
+                       help='Unroll counted for loops by 4 or 8 (needs -O1 or higher)')
+    parser.add_argument('--time-passes', action='store_true',
+                       help='Report wall time and peak RSS for every compiler stage')
+    parser.add_argument('--stats', action='store_true',
+                       help='Report AST node, generic instance, instruction and vyl_alloc call site counts')
+    parser.add_argument('--profile-alloc', action='store_true',
+                       help='Instrument allocations: per-site counts and bytes, live-heap peak and GC pauses, reported at exit')
+    parser.add_argument('--perf-map', action='store_true',
+                       help='Write /tmp/perf-<pid>.map with every function at startup, for perf')
+    parser.add_argument('--no-cache', action='store_true',
+                       help='Rebuild every module instead of reusing ~/.vyl/cache ($VYL_CACHE_DIR)')
     
     # Also support direct file argument for convenience
     parser.add_argument('input_file', nargs='?', help='Input VYL source file (alternative to -c)')
@@ -415,7 +678,10 @@ Examples:
     print(f"Compiling {input_file} (target={target})...")
     print("-" * 50)
     
-    success = compile_vyl(source_code, output_file, args.assembly, target, input_file, args.keystone, keep_asm=args.keep_asm)
+    success = compile_vyl(source_code, output_file, args.assembly, target, input_file, args.keystone, keep_asm=args.keep_asm, opt_level=args.opt_level, unroll=args.unroll,
+                          cache_dir=None if args.no_cache else str(default_cache_dir()),
+                          time_passes=args.time_passes, show_stats=args.stats, profile_alloc=args.profile_alloc,
+                          perf_map=args.perf_map)
     
     print("-" * 50)
     if success:
@@ -0,0 +1,154 @@
+"""
+VYL Compiler Metrics - where a build spends its time and what it produces
+
+``--time-passes`` wraps every stage of compile_vyl in PassTimer.stage and
+prints wall time and peak RSS per stage. Peak RSS is the process high-water
+mark after the stage (it never goes down, so a jump marks the stage that
+grew it); stages that run gcc or codegen workers report the peak of the
+child processes instead.
+
+``--stats`` prints BuildStats: AST node counts per node type, generic struct
+instances, instructions emitted per function and ``call vyl_alloc`` sites.
+"""
+
+import resource
+import time
+from collections import Counter
+from contextlib import contextmanager
+from typing import Dict, Iterable, Iterator, List, Optional, Tuple
+
+try:
+    from .optimizer import walk
+    from .parser import FunctionDef, Program, StructDef
+except ImportError:
+    from optimizer import walk
+    from parser import FunctionDef, Program, StructDef
+
+
+def _peak_rss_kb(children: bool) -> int:
+    who = resource.RUSAGE_CHILDREN if children else resource.RUSAGE_SELF
+    return resource.getrusage(who).ru_maxrss
+
+
+class PassTimer:
+    """Wall time and peak RSS per stage; a no-op unless enabled."""
+
+    def __init__(self, enabled: bool = False):
+        self.enabled = enabled
+        self.rows: List[Tuple[str, float, int, bool]] = []  # name, seconds, peak KB, external
+
+    @contextmanager
+    def stage(self, name: str, external: bool = False):
+        if not self.enabled:
+            yield
+            return
+        start = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.add(name, time.perf_counter() - start, external)
+
+    def add(self, name: str, seconds: float, external: bool = False) -> None:
+        """Record a stage, folding repeats (one per module) into one row."""
+        if not self.enabled:
+            return
+        peak = _peak_rss_kb(external)
+        for i, (row_name, row_seconds, row_peak, row_external) in enumerate(self.rows):
+            if row_name == name:
+                self.rows[i] = (name, row_seconds + seconds, max(row_peak, peak), row_external)
+                return
+        self.rows.append((name, seconds, peak, external))
+
+    def report(self) -> None:
+        if not self.enabled or not self.rows:
+            return
+        total = sum(seconds for _, seconds, _, _ in self.rows)
+        print("Pass timings:")
+        print(f"  {'stage':<22}{'wall ms':>10}{'share':>8}{'peak RSS MB':>14}")
+        for name, seconds, peak, external in self.rows:
+            share = seconds / total * 100 if total else 0.0
+            where = " (children)" if external else ""
+            print(f"  {name:<22}{seconds * 1000:>10.1f}{share:>7.1f}%{peak / 1024:>14.1f}{where}")
+        print(f"  {'total':<22}{total * 1000:>10.1f}")
+
+
+def count_nodes(program: Program) -> Counter:
+    counts: Counter = Counter()
+    walk(program.statements, lambda node: counts.update([type(node).__name__]))
+    return counts
+
+
+def function_names(program: Program) -> List[str]:
+    """Labels of the program's own functions and methods, as codegen names them."""
+    names = []
+    for stmt in program.statements:
+        if isinstance(stmt, FunctionDef):
+            names.append(stmt.name)
+        elif isinstance(stmt, StructDef):
+            names.extend(f"{stmt.name}_{method.name}" for method in stmt.methods)
+    return names
+
+
+def function_instructions(assembly: str, functions: Iterable[str]) -> Iterator[Tuple[str, str]]:
+    """(function, instruction) for everything emitted under `functions`'
+    labels, up to the next global label or section switch; local labels
+    and directives are not instructions."""
+    wanted = set(functions)
+    current: Optional[str] = None
+    for line in assembly.splitlines():
+        line = line.strip()
+        if line.startswith(".globl "):
+            name = line[len(".globl "):].strip()
+            current = name if name in wanted else None
+        elif line.startswith(".section"):
+            current = None
+        elif current is not None and line and not line.startswith(".") and not line.endswith(":"):
+            yield current, line
+
+
+class BuildStats:
+    """What --stats reports, filled in as the stages run."""
+
+    def __init__(self, enabled: bool = False):
+        self.enabled = enabled
+        self.parsed_nodes: Counter = Counter()
+        self.optimized_nodes: Counter = Counter()
+        self.instances: List[str] = []
+        self.functions: List[str] = []
+        self.instructions: Dict[str, int] = {}
+        self.alloc_sites = 0
+
+    def record_instances(self, before: Program, after: Program) -> None:
+        if not self.enabled:
+            return
+        seen = {id(stmt) for stmt in before.statements}
+        self.instances = [stmt.name for stmt in after.statements
+                          if isinstance(stmt, StructDef) and id(stmt) not in seen]
+
+    def record_assembly(self, assembly: str) -> None:
+        """Count one program's (or one module's) code; runtime routines are
+        not among self.functions, so they do not count."""
+        if not self.enabled:
+            return
+        for name, line in function_instructions(assembly, self.functions):
+            self.instructions[name] = self.instructions.get(name, 0) + 1
+            if line == "call vyl_alloc":
+                self.alloc_sites += 1
+
+    def report(self) -> None:
+        if not self.enabled:
+            return
+        print("Build stats:")
+        for title, counts in (("AST nodes parsed", self.parsed_nodes),
+                              ("AST nodes after optimization", self.optimized_nodes)):
+            if not counts:
+                continue
+            top = ", ".join(f"{name} {n}" for name, n in counts.most_common(8))
+            print(f"  {title}: {sum(counts.values())} ({top})")
+        print(f"  Generic instances: {len(self.instances)}"
+              + (f" ({', '.join(self.instances)})" if self.instances else ""))
+        total = sum(self.instructions.values())
+        print(f"  Instructions emitted: {total} in {len(self.instructions)} function(s)")
+        for name, n in sorted(self.instructions.items(), key=lambda item: -item[1]):
+            print(f"    {name:<30}{n:>8}")
+        print(f"  vyl_alloc call sites: {self.alloc_sites}")
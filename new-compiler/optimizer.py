@@ -0,0 +1,1807 @@
+"""
+VYL Optimizer - AST pass manager run between validation and code generation
+
+Optimization levels:
+    -O0: no AST passes; every local lives in its stack slot
+    -O1: constant folding, copy/constant propagation, dead-code elimination,
+         loop-bound hoisting, bounds-check elimination
+    -O2: -O1 plus loop-invariant code motion, strength reduction of
+         induction-variable products (``i * 8`` becomes a running sum),
+         inlining of small non-recursive functions and methods and
+         vectorization of element-wise ``for`` loops over int[]/dec[] arrays
+
+Counted ``for`` loops can additionally be unrolled by 4 or 8 (``--unroll``).
+
+Passes rewrite the AST in place and are repeated until none of them reports
+a change (bounded by MAX_ROUNDS). All passes work on one function body at a
+time; globals are never propagated or hoisted because any call may change
+them. Inlining runs first, so the copied callee code is optimized in the
+caller's context.
+"""
+
+import copy
+from dataclasses import fields
+from typing import Callable, Dict, List, Optional, Set
+
+try:
+    from .parser import (
+        ASTNode,
+        AddressOf,
+        ArrayClone,
+        ArrayLiteral,
+        Assignment,
+        BinaryExpr,
+        Block,
+        BoundsCheck,
+        ConstArray,
+        DeferStmt,
+        ForStmt,
+        FunctionCall,
+        FunctionDef,
+        Identifier,
+        IfStmt,
+        IndexExpr,
+        InterpString,
+        Literal,
+        MethodCall,
+        Program,
+        ReturnStmt,
+        SelfExpr,
+        SpawnExpr,
+        StructDef,
+        TryExpr,
+        TupleUnpack,
+        UnaryExpr,
+        VarDecl,
+        WhileStmt,
+    )
+    from .escape import NON_ESCAPING_BUILTINS
+    from .regalloc import parse_interp_parts
+    from .validator import BUILTIN_FUNCTIONS
+except ImportError:  # pragma: no cover - fallback for direct execution
+    from parser import (
+        ASTNode,
+        AddressOf,
+        ArrayClone,
+        ArrayLiteral,
+        Assignment,
+        BinaryExpr,
+        Block,
+        BoundsCheck,
+        ConstArray,
+        DeferStmt,
+        ForStmt,
+        FunctionCall,
+        FunctionDef,
+        Identifier,
+        IfStmt,
+        IndexExpr,
+        InterpString,
+        Literal,
+        MethodCall,
+        Program,
+        ReturnStmt,
+        SelfExpr,
+        SpawnExpr,
+        StructDef,
+        TryExpr,
+        TupleUnpack,
+        UnaryExpr,
+        VarDecl,
+        WhileStmt,
+    )
+    from escape import NON_ESCAPING_BUILTINS
+    from regalloc import parse_interp_parts
+    from validator import BUILTIN_FUNCTIONS
+
+
+MAX_ROUNDS = 4
+DEFAULT_OPT_LEVEL = 1
+UNROLL_FACTORS = (4, 8)
+# Larger loop bodies are not unrolled; counted in AST nodes
+UNROLL_MAX_NODES = 48
+# Derived induction variables per loop, to bound register pressure
+MAX_DERIVED_IVS = 4
+# Callee bodies up to this many AST nodes are copied into their callers at -O2
+INLINE_MAX_NODES = 40
+# Parameter and result types an inlined call binds without any conversion
+INLINE_SCALAR_TYPES = ("int", "bool", "string")
+# Element-wise operators the code generator has packed SSE2/AVX2 forms for
+VECTOR_OPERATORS = {"int": ("+", "-"), "dec": ("+", "-", "*", "/")}
+
+INT64_MIN = -(2 ** 63)
+INT64_MAX = 2 ** 63 - 1
+
+# Builtins that only read their argument's length, which changes only through
+# Push/Pop on that array or an alias of it, or in a callee it is passed to
+PURE_READ_BUILTINS = ("Len", "Length")
+# Builtins that change the length of the array passed as their first argument
+RESIZING_BUILTINS = ("Push", "Pop")
+# Builtins that return a new array no other name holds yet
+FRESH_ARRAY_BUILTINS = ("Array", "Vec")
+# Builtins that only change memory, which nobody sees once a failed bounds
+# check has stopped the program
+QUIET_BUILTINS = PURE_READ_BUILTINS + RESIZING_BUILTINS + FRESH_ARRAY_BUILTINS + (
+    "ArraySum", "ArrayMin", "ArrayMax", "ArrayFind", "ArrayFill", "ArrayCopy")
+COMPARISON_OPS = ("==", "!=", "<", ">", "<=", ">=")
+
+
+def _wrap64(value: int) -> int:
+    """Wrap an integer to signed 64-bit two's complement like the hardware does."""
+    value &= 2 ** 64 - 1
+    return value - 2 ** 64 if value > INT64_MAX else value
+
+
+def _is_numeric_literal(node) -> bool:
+    return isinstance(node, Literal) and node.literal_type in ("int", "bool")
+
+
+def _literal_int(node: Literal) -> int:
+    if node.literal_type == "bool":
+        return 1 if node.value else 0
+    return int(node.value)
+
+
+def _children(node):
+    """Yield (field_name, value) for the AST-bearing fields of a node."""
+    for fld in fields(node):
+        if fld.name in ("line", "column"):
+            continue
+        yield fld.name, getattr(node, fld.name)
+
+
+def walk(node, visit: Callable[[ASTNode], None]):
+    """Pre-order walk over every AST node, including interpolated parts."""
+    if isinstance(node, (list, tuple)):
+        for item in node:
+            walk(item, visit)
+        return
+    if not isinstance(node, ASTNode):
+        return
+    visit(node)
+    if isinstance(node, InterpString):
+        for expr in parse_interp_parts(node):
+            walk(expr, visit)
+        return
+    for _, value in _children(node):
+        walk(value, visit)
+
+
+def collect_reads(node) -> Set[str]:
+    """Names read anywhere inside node (identifiers, self, interpolation)."""
+    names: Set[str] = set()
+
+    def visit(n):
+        if isinstance(n, Identifier):
+            names.add(n.name)
+        elif isinstance(n, SelfExpr):
+            names.add("self")
+        elif isinstance(n, ForStmt):
+            names.add(n.var_name)
+
+    walk(node, visit)
+    return names
+
+
+def collect_assigned(node) -> Set[str]:
+    """Names written by declarations, assignments, unpacking and for loops,
+    and arrays whose length may change inside node."""
+    names: Set[str] = set(_passed_arrays(node))
+
+    def visit(n):
+        if isinstance(n, VarDecl):
+            names.add(n.name)
+        elif isinstance(n, Assignment) and n.target is None:
+            names.add(n.name)
+        elif isinstance(n, TupleUnpack):
+            names.update(n.names)
+        elif isinstance(n, ForStmt):
+            names.add(n.var_name)
+        elif _resized_array(n):
+            names.add(n.arguments[0].name)
+
+    walk(node, visit)
+    return names
+
+
+def _resized_array(n) -> bool:
+    """Push/Pop on a named array change its length without an assignment."""
+    return (
+        isinstance(n, FunctionCall)
+        and n.name in RESIZING_BUILTINS
+        and bool(n.arguments)
+        and isinstance(n.arguments[0], Identifier)
+    )
+
+
+def _passed_arrays(node) -> Set[str]:
+    """Arrays used inside node that are also passed to a user function or
+    method there, which may Push or Pop them. Scalars are passed by value,
+    so only names node indexes or takes the length of count."""
+    passed: Set[str] = set()
+    arrays: Set[str] = set()
+
+    def visit(n):
+        if _is_user_call(n):
+            passed.update(arg.name for arg in n.arguments if isinstance(arg, Identifier))
+        elif isinstance(n, IndexExpr) and isinstance(n.receiver, Identifier):
+            arrays.add(n.receiver.name)
+        elif isinstance(n, BoundsCheck):
+            arrays.add(n.array.name)
+        elif (
+            isinstance(n, FunctionCall)
+            and n.name in PURE_READ_BUILTINS + RESIZING_BUILTINS
+            and n.arguments
+            and isinstance(n.arguments[0], Identifier)
+        ):
+            arrays.add(n.arguments[0].name)
+
+    walk(node, visit)
+    return passed & arrays
+
+
+def _is_user_call(n) -> bool:
+    return isinstance(n, MethodCall) or (isinstance(n, FunctionCall) and n.name not in BUILTIN_FUNCTIONS)
+
+
+def _shared_arrays(body: Block, params: Set[str]) -> Set[str]:
+    """Names that may hold the same array as some other name: parameters,
+    copies (``var b = a``), anything stored, returned or passed to a user
+    function, and what any call but Array/Vec returned. Indexing, Len and
+    builtins that keep nothing leave a name private, as does storing Push's
+    result back into the array it grew."""
+    shared = set(params)
+
+    def use(n):
+        if not isinstance(n, Identifier):
+            visit(n)
+
+    def visit(n):
+        if isinstance(n, (list, tuple)):
+            for item in n:
+                visit(item)
+            return
+        if not isinstance(n, ASTNode):
+            return
+        if isinstance(n, Identifier):
+            shared.add(n.name)
+        elif isinstance(n, IndexExpr):
+            use(n.receiver)
+            visit(n.index)
+        elif isinstance(n, BoundsCheck):
+            visit([n.low, n.high])
+        elif isinstance(n, BinaryExpr):
+            use(n.left)
+            use(n.right)
+        elif isinstance(n, FunctionCall) and n.name in NON_ESCAPING_BUILTINS:
+            for arg in n.arguments:
+                use(arg)
+        elif isinstance(n, InterpString):
+            for expr in parse_interp_parts(n):
+                use(expr)
+        elif isinstance(n, VarDecl) or (isinstance(n, Assignment) and n.target is None):
+            value = n.value
+            if (
+                isinstance(value, FunctionCall)
+                and value.name == "Push"
+                and value.arguments
+                and isinstance(value.arguments[0], Identifier)
+                and value.arguments[0].name == n.name
+            ):
+                visit(value.arguments[1:])
+                return
+            if not (value is None or isinstance(value, (ArrayClone, ArrayLiteral, ConstArray))
+                    or isinstance(value, FunctionCall) and value.name in FRESH_ARRAY_BUILTINS):
+                shared.add(n.name)
+            visit(value)
+        elif isinstance(n, TupleUnpack):
+            shared.update(n.names)
+            visit(n.value)
+        else:
+            for _, value in _children(n):
+                visit(value)
+
+    visit(body)
+    return shared
+
+
+def _may_resize_through_alias(node, array: str, ctx: "FunctionContext") -> bool:
+    """True when array may be shared and node calls a user function or method,
+    or resizes some array, any of which could shrink it under another name."""
+    if array not in ctx.shared_arrays:
+        return False
+    found = []
+
+    def visit(n):
+        if _is_user_call(n) or (isinstance(n, FunctionCall) and n.name in RESIZING_BUILTINS):
+            found.append(n)
+
+    walk(node, visit)
+    return bool(found)
+
+
+def collect_addressed(node) -> Set[str]:
+    names: Set[str] = set()
+
+    def visit(n):
+        if isinstance(n, AddressOf) and isinstance(n.operand, Identifier):
+            names.add(n.operand.name)
+
+    walk(node, visit)
+    return names
+
+
+def is_pure(expr) -> bool:
+    """True when evaluating expr has no side effects and cannot trap."""
+    if isinstance(expr, (Literal, Identifier, SelfExpr)):
+        return True
+    if isinstance(expr, UnaryExpr):
+        return is_pure(expr.operand)
+    if isinstance(expr, BinaryExpr):
+        if expr.operator in ("/", "%"):
+            if not (_is_numeric_literal(expr.right) and _literal_int(expr.right) != 0):
+                return False
+        return is_pure(expr.left) and is_pure(expr.right)
+    return False
+
+
+class FunctionContext:
+    """Per-function facts shared by the passes."""
+
+    def __init__(self, params: List[tuple], body: Block, globals_: Set[str],
+                 functions: Set[str] = frozenset()):
+        self.body = body
+        self.globals = globals_
+        self.functions = functions  # user-defined function names
+        self.params = {param[0] for param in params}
+        self.shared_arrays = _shared_arrays(body, self.params)
+        self.addressed = collect_addressed(body)
+        self.types: Dict[str, Optional[str]] = {}
+        for param in params:
+            self.types[param[0]] = param[1] or "int"
+
+        def visit(n):
+            if isinstance(n, VarDecl):
+                if n.var_type:
+                    declared = n.var_type
+                elif isinstance(n.value, Literal):
+                    declared = n.value.literal_type
+                else:
+                    declared = None  # inferred at codegen time; treat as unknown
+                if n.name in self.types and self.types[n.name] != declared:
+                    declared = None
+                self.types[n.name] = declared
+            elif isinstance(n, TupleUnpack):
+                for name in n.names:
+                    self.types[name] = None
+            elif isinstance(n, ForStmt):
+                self.types.setdefault(n.var_name, "int")
+
+        walk(body, visit)
+
+    def is_local(self, name: str) -> bool:
+        return (
+            name in self.types
+            and name not in self.globals
+            and name not in self.addressed
+            and name not in ("argc", "argv")
+        )
+
+
+# ---------- constant folding ----------
+def fold_expr(expr, stats: Dict[str, int]):
+    """Fold constant sub-expressions of expr bottom-up; returns the new node."""
+    if isinstance(expr, (list, tuple)):
+        return type(expr)(fold_expr(e, stats) for e in expr)
+    if not isinstance(expr, ASTNode) or isinstance(expr, (Block, InterpString)):
+        return expr
+    for name, value in _children(expr):
+        if isinstance(value, ASTNode) or isinstance(value, list):
+            setattr(expr, name, fold_expr(value, stats))
+        elif isinstance(value, tuple):
+            setattr(expr, name, tuple(fold_expr(v, stats) for v in value))
+
+    if isinstance(expr, UnaryExpr) and _is_numeric_literal(expr.operand):
+        value = _literal_int(expr.operand)
+        if expr.operator == "-":
+            stats["folded"] += 1
+            return Literal(value=_wrap64(-value), literal_type="int", line=expr.line, column=expr.column)
+        if expr.operator in ("!", "NOT"):
+            stats["folded"] += 1
+            return Literal(value=value == 0, literal_type="bool", line=expr.line, column=expr.column)
+
+    if isinstance(expr, BinaryExpr):
+        left, right, op = expr.left, expr.right, expr.operator
+        if _is_numeric_literal(left) and _is_numeric_literal(right):
+            a, b = _literal_int(left), _literal_int(right)
+            result = None
+            if op == "+":
+                result = a + b
+            elif op == "-":
+                result = a - b
+            elif op == "*":
+                result = a * b
+            elif op in ("/", "%") and b != 0:
+                quotient = abs(a) // abs(b)
+                if (a < 0) != (b < 0):
+                    quotient = -quotient
+                result = quotient if op == "/" else a - quotient * b
+            elif op in ("==", "!=", "<", ">", "<=", ">="):
+                table = {
+                    "==": a == b, "!=": a != b, "<": a < b,
+                    ">": a > b, "<=": a <= b, ">=": a >= b,
+                }
+                stats["folded"] += 1
+                return Literal(value=table[op], literal_type="bool", line=expr.line, column=expr.column)
+            elif op == "&&":
+                stats["folded"] += 1
+                return Literal(value=bool(a and b), literal_type="bool", line=expr.line, column=expr.column)
+            elif op == "||":
+                stats["folded"] += 1
+                return Literal(value=bool(a or b), literal_type="bool", line=expr.line, column=expr.column)
+            if result is not None:
+                stats["folded"] += 1
+                return Literal(value=_wrap64(result), literal_type="int", line=expr.line, column=expr.column)
+        if (
+            op == "+"
+            and isinstance(left, Literal)
+            and left.literal_type == "string"
+            and isinstance(right, Literal)
+            and right.literal_type in ("string", "int")
+        ):
+            stats["folded"] += 1
+            return Literal(value=left.value + str(right.value), literal_type="string",
+                           line=expr.line, column=expr.column)
+        if op in ("*", "/") and _is_numeric_literal(right) and _literal_int(right) == 1 and right.literal_type == "int":
+            stats["folded"] += 1
+            return left
+    return expr
+
+
+def fold_statements(stmts: List[ASTNode], stats: Dict[str, int]) -> List[ASTNode]:
+    for idx, stmt in enumerate(stmts):
+        stmts[idx] = fold_statement(stmt, stats)
+    return stmts
+
+
+def fold_statement(stmt, stats: Dict[str, int]):
+    if isinstance(stmt, Block):
+        fold_statements(stmt.statements, stats)
+    elif isinstance(stmt, IfStmt):
+        stmt.condition = fold_expr(stmt.condition, stats)
+        fold_statement(stmt.then_block, stats)
+        if stmt.else_block is not None:
+            fold_statement(stmt.else_block, stats)
+    elif isinstance(stmt, WhileStmt):
+        stmt.condition = fold_expr(stmt.condition, stats)
+        fold_statement(stmt.body, stats)
+    elif isinstance(stmt, ForStmt):
+        stmt.start = fold_expr(stmt.start, stats)
+        stmt.end = fold_expr(stmt.end, stats)
+        fold_statement(stmt.body, stats)
+    elif isinstance(stmt, DeferStmt):
+        fold_statement(stmt.body, stats)
+    elif isinstance(stmt, (VarDecl, Assignment, ReturnStmt, TupleUnpack)):
+        if stmt.value is not None:
+            stmt.value = fold_expr(stmt.value, stats)
+        if isinstance(stmt, Assignment) and stmt.target is not None:
+            stmt.target = fold_expr(stmt.target, stats)
+    else:
+        return fold_expr(stmt, stats)
+    return stmt
+
+
+# ---------- copy / constant propagation ----------
+def substitute(expr, env: Dict[str, ASTNode], stats: Dict[str, int]):
+    """Replace reads of names in env; never rewrites the operand of '&'."""
+    if not env:
+        return expr
+    if isinstance(expr, Identifier) and expr.name in env:
+        stats["propagated"] += 1
+        replacement = env[expr.name]
+        if isinstance(replacement, Literal):
+            return Literal(value=replacement.value, literal_type=replacement.literal_type,
+                           line=expr.line, column=expr.column)
+        return Identifier(name=replacement.name, line=expr.line, column=expr.column)
+    if not isinstance(expr, ASTNode) or isinstance(expr, (AddressOf, InterpString, Block)):
+        return expr
+    for name, value in _children(expr):
+        if isinstance(value, ASTNode):
+            setattr(expr, name, substitute(value, env, stats))
+        elif isinstance(value, list):
+            setattr(expr, name, [
+                tuple(substitute(v, env, stats) for v in item) if isinstance(item, tuple)
+                else substitute(item, env, stats)
+                for item in value
+            ])
+    return expr
+
+
+def _kill(env: Dict[str, ASTNode], names: Set[str]):
+    for key in list(env):
+        value = env[key]
+        if key in names or (isinstance(value, Identifier) and value.name in names):
+            del env[key]
+
+
+def propagate_block(stmts: List[ASTNode], env: Dict[str, ASTNode], ctx: FunctionContext,
+                    stats: Dict[str, int]):
+    for idx, stmt in enumerate(stmts):
+        stmts[idx] = propagate_statement(stmt, env, ctx, stats)
+
+
+def propagate_statement(stmt, env: Dict[str, ASTNode], ctx: FunctionContext, stats: Dict[str, int]):
+    if isinstance(stmt, (VarDecl, Assignment)) and (isinstance(stmt, VarDecl) or stmt.target is None):
+        if stmt.value is not None:
+            stmt.value = substitute(stmt.value, env, stats)
+        _kill(env, {stmt.name})
+        if stmt.value is not None and ctx.is_local(stmt.name):
+            value = stmt.value
+            dest_type = ctx.types.get(stmt.name)
+            if isinstance(value, Literal):
+                if dest_type == value.literal_type:
+                    env[stmt.name] = value
+                elif dest_type == "dec" and value.literal_type == "int":
+                    # the variable holds the widened value, not the int
+                    env[stmt.name] = Literal(value=float(value.value), literal_type="dec",
+                                             line=value.line, column=value.column)
+            elif (
+                isinstance(value, Identifier)
+                and value.name != stmt.name
+                and ctx.is_local(value.name)
+                and dest_type is not None
+                and ctx.types.get(value.name) == dest_type
+            ):
+                env[stmt.name] = value
+        return stmt
+    if isinstance(stmt, Assignment):
+        stmt.value = substitute(stmt.value, env, stats)
+        stmt.target = substitute(stmt.target, env, stats)
+        return stmt
+    if isinstance(stmt, TupleUnpack):
+        stmt.value = substitute(stmt.value, env, stats)
+        _kill(env, set(stmt.names))
+        return stmt
+    if isinstance(stmt, ReturnStmt):
+        if stmt.value is not None:
+            stmt.value = substitute(stmt.value, env, stats)
+        return stmt
+    if isinstance(stmt, Block):
+        propagate_block(stmt.statements, env, ctx, stats)
+        return stmt
+    if isinstance(stmt, IfStmt):
+        stmt.condition = substitute(stmt.condition, env, stats)
+        branches = [stmt.then_block] + ([stmt.else_block] if stmt.else_block is not None else [])
+        for branch in branches:
+            propagate_statement(branch, dict(env), ctx, stats)
+        _kill(env, collect_assigned(branches))
+        return stmt
+    if isinstance(stmt, WhileStmt):
+        _kill(env, collect_assigned(stmt))
+        stmt.condition = substitute(stmt.condition, env, stats)
+        propagate_statement(stmt.body, dict(env), ctx, stats)
+        return stmt
+    if isinstance(stmt, ForStmt):
+        stmt.start = substitute(stmt.start, env, stats)
+        _kill(env, collect_assigned(stmt))
+        stmt.end = substitute(stmt.end, env, stats)
+        propagate_statement(stmt.body, dict(env), ctx, stats)
+        return stmt
+    if isinstance(stmt, DeferStmt):
+        # Deferred code runs at return time; values may have changed by then
+        return stmt
+    return substitute(stmt, env, stats)
+
+
+# ---------- dead-code elimination ----------
+def _is_truthy_literal(node) -> Optional[bool]:
+    if _is_numeric_literal(node):
+        return _literal_int(node) != 0
+    return None
+
+
+def eliminate_dead_code(stmts: List[ASTNode], reads: Set[str], ctx: FunctionContext,
+                        stats: Dict[str, int]) -> List[ASTNode]:
+    result: List[ASTNode] = []
+    for idx, stmt in enumerate(stmts):
+        if isinstance(stmt, IfStmt):
+            taken = _is_truthy_literal(stmt.condition)
+            if taken is True:
+                stmt = stmt.then_block
+                stats["removed"] += 1
+            elif taken is False:
+                stats["removed"] += 1
+                if stmt.else_block is None:
+                    continue
+                stmt = stmt.else_block
+        if isinstance(stmt, WhileStmt) and _is_truthy_literal(stmt.condition) is False:
+            stats["removed"] += 1
+            continue
+
+        if isinstance(stmt, (VarDecl, Assignment)) and (isinstance(stmt, VarDecl) or stmt.target is None):
+            if stmt.name not in reads and ctx.is_local(stmt.name):
+                stats["removed"] += 1
+                if stmt.value is not None and not is_pure(stmt.value):
+                    result.append(stmt.value)
+                continue
+
+        if isinstance(stmt, Block):
+            stmt.statements = eliminate_dead_code(stmt.statements, reads, ctx, stats)
+        elif isinstance(stmt, IfStmt):
+            stmt.then_block.statements = eliminate_dead_code(stmt.then_block.statements, reads, ctx, stats)
+            if isinstance(stmt.else_block, Block):
+                stmt.else_block.statements = eliminate_dead_code(stmt.else_block.statements, reads, ctx, stats)
+            elif isinstance(stmt.else_block, IfStmt):
+                rewritten = eliminate_dead_code([stmt.else_block], reads, ctx, stats)
+                stmt.else_block = rewritten[0] if rewritten else None
+        elif isinstance(stmt, (WhileStmt, ForStmt)):
+            stmt.body.statements = eliminate_dead_code(stmt.body.statements, reads, ctx, stats)
+
+        result.append(stmt)
+        if isinstance(stmt, ReturnStmt):
+            # Code after a return is unreachable; defers are kept because
+            # codegen registers them in source order
+            rest = stmts[idx + 1:]
+            stats["removed"] += sum(1 for s in rest if not isinstance(s, DeferStmt))
+            result.extend(s for s in rest if isinstance(s, DeferStmt))
+            break
+    return result
+
+
+# ---------- loop-invariant code motion ----------
+def _is_invariant(expr, variant: Set[str], ctx: FunctionContext, allow_reads: bool) -> bool:
+    if isinstance(expr, Literal):
+        return True
+    if isinstance(expr, Identifier):
+        return ctx.is_local(expr.name) and expr.name not in variant
+    if isinstance(expr, UnaryExpr):
+        return _is_invariant(expr.operand, variant, ctx, allow_reads)
+    if isinstance(expr, BinaryExpr):
+        if not allow_reads and not is_pure(expr):
+            return False
+        return (_is_invariant(expr.left, variant, ctx, allow_reads)
+                and _is_invariant(expr.right, variant, ctx, allow_reads))
+    if allow_reads and isinstance(expr, FunctionCall) and expr.name in PURE_READ_BUILTINS:
+        return len(expr.arguments) == 1 and _is_invariant(expr.arguments[0], variant, ctx, allow_reads)
+    return False
+
+
+def _worth_hoisting(expr) -> bool:
+    return isinstance(expr, (BinaryExpr, UnaryExpr, FunctionCall))
+
+
+def _nested_blocks(stmt):
+    """Blocks directly nested in stmt, following elif chains."""
+    if isinstance(stmt, Block):
+        yield stmt
+    elif isinstance(stmt, IfStmt):
+        yield stmt.then_block
+        if isinstance(stmt.else_block, IfStmt):
+            yield from _nested_blocks(stmt.else_block)
+        elif stmt.else_block is not None:
+            yield stmt.else_block
+    elif isinstance(stmt, (WhileStmt, ForStmt)):
+        yield stmt.body
+
+
+def transform_loops(stmts: List[ASTNode], rewrite: Callable[[ASTNode], List[ASTNode]]) -> List[ASTNode]:
+    """Replace every loop with rewrite(loop), innermost loops first."""
+    result: List[ASTNode] = []
+    for stmt in stmts:
+        for block in _nested_blocks(stmt):
+            block.statements = transform_loops(block.statements, rewrite)
+        if isinstance(stmt, (WhileStmt, ForStmt)):
+            result.extend(rewrite(stmt))
+        else:
+            result.append(stmt)
+    return result
+
+
+def _fresh_name(ctx: FunctionContext, prefix: str) -> str:
+    """A compiler temporary name not yet used in the function; registers it as int."""
+    index = 0
+    while f"{prefix}{index}" in ctx.types:
+        index += 1
+    name = f"{prefix}{index}"
+    ctx.types[name] = "int"
+    return name
+
+
+def _contains(node, node_types) -> bool:
+    found = []
+    walk(node, lambda n: found.append(n) if isinstance(n, node_types) else None)
+    return bool(found)
+
+
+def hoist_loop_invariants(loop, ctx: FunctionContext, stats: Dict[str, int],
+                          defs: Dict[str, int]) -> List[ASTNode]:
+    """Move single-definition pure invariant declarations out of loop."""
+    variant = collect_assigned(loop)
+    hoisted: List[ASTNode] = []
+    body = loop.body.statements
+    seen_reads: Set[str] = set()
+    for inner in list(body):
+        if (
+            isinstance(inner, VarDecl)
+            and inner.value is not None
+            and defs.get(inner.name) == 1
+            and inner.name not in seen_reads
+            and ctx.is_local(inner.name)
+            and _worth_hoisting(inner.value)
+            and is_pure(inner.value)
+            and _is_invariant(inner.value, variant - {inner.name}, ctx, allow_reads=False)
+        ):
+            body.remove(inner)
+            hoisted.append(inner)
+            variant.discard(inner.name)
+            stats["hoisted"] += 1
+            continue
+        seen_reads |= collect_reads(inner)
+    return hoisted + [loop]
+
+
+def hoist_loop_bound(loop, ctx: FunctionContext, stats: Dict[str, int]) -> List[ASTNode]:
+    """Evaluate an invariant loop bound once, before the loop.
+
+    Bounds are evaluated at least once, so reads that may trap are fine.
+    """
+    if isinstance(loop, ForStmt):
+        holder, attr = loop, "end"
+    elif isinstance(loop.condition, BinaryExpr) and loop.condition.operator in COMPARISON_OPS:
+        holder, attr = loop.condition, "right"
+    else:
+        return [loop]
+    bound = getattr(holder, attr)
+    if not (_worth_hoisting(bound) and _is_invariant(bound, collect_assigned(loop), ctx, allow_reads=True)):
+        return [loop]
+    lengths: List[str] = []
+    walk(bound, lambda n: lengths.append(n.arguments[0].name)
+         if isinstance(n, FunctionCall) and n.name in PURE_READ_BUILTINS
+         and isinstance(n.arguments[0], Identifier) else None)
+    if any(_may_resize_through_alias(loop, array, ctx) for array in lengths):
+        return [loop]
+    temp = _fresh_name(ctx, "__bound")
+    stats["hoisted"] += 1
+    setattr(holder, attr, Identifier(name=temp, line=loop.line, column=loop.column))
+    return [VarDecl(name=temp, var_type="int", value=bound, line=loop.line, column=loop.column), loop]
+
+
+# ---------- induction variables ----------
+def _step_of(stmt, name: Optional[str] = None) -> Optional[int]:
+    """Step k of an update statement ``x = x + k`` / ``x = x - k`` (literal k)."""
+    if not (isinstance(stmt, Assignment) and stmt.target is None and isinstance(stmt.value, BinaryExpr)):
+        return None
+    if name is not None and stmt.name != name:
+        return None
+    value = stmt.value
+    left, right = value.left, value.right
+    if value.operator == "+" and isinstance(right, Identifier) and right.name == stmt.name:
+        left, right = right, left
+    if not (isinstance(left, Identifier) and left.name == stmt.name):
+        return None
+    if not (isinstance(right, Literal) and right.literal_type == "int"):
+        return None
+    if value.operator == "+":
+        return int(right.value)
+    if value.operator == "-":
+        return -int(right.value)
+    return None
+
+
+def find_induction_variables(loop, ctx: FunctionContext) -> Dict[str, int]:
+    """Basic induction variables of loop mapped to their step per iteration.
+
+    A basic induction variable is an int local whose only definition inside
+    the loop is one unconditional ``x = x +/- k`` in the loop body (or the
+    variable of a ``for`` loop, which the loop itself steps by one).
+    """
+    defs = _definition_counts(loop.body)
+    ivs: Dict[str, int] = {}
+    if isinstance(loop, ForStmt) and loop.var_name not in defs and ctx.is_local(loop.var_name):
+        ivs[loop.var_name] = 1
+    for stmt in loop.body.statements:
+        step = _step_of(stmt)
+        if (
+            step is not None
+            and defs.get(stmt.name) == 1
+            and ctx.is_local(stmt.name)
+            and ctx.types.get(stmt.name) == "int"
+        ):
+            ivs[stmt.name] = step
+    return ivs
+
+
+# ---------- strength reduction ----------
+def _iv_product(expr, ivs: Dict[str, int]) -> Optional[tuple]:
+    """(iv name, factor) when expr is ``iv * k`` or ``k * iv`` for literal k."""
+    if not (isinstance(expr, BinaryExpr) and expr.operator == "*"):
+        return None
+    for var, factor in ((expr.left, expr.right), (expr.right, expr.left)):
+        if (
+            isinstance(var, Identifier)
+            and var.name in ivs
+            and isinstance(factor, Literal)
+            and factor.literal_type == "int"
+            and int(factor.value) not in (0, 1)
+        ):
+            return var.name, int(factor.value)
+    return None
+
+
+def _replace_products(expr, temps: Dict[tuple, str], ivs: Dict[str, int], ctx: FunctionContext,
+                      stats: Dict[str, int]):
+    """Replace iv products by derived variables, allocating one per (iv, k)."""
+    key = _iv_product(expr, ivs)
+    if key is not None and (key in temps or len(temps) < MAX_DERIVED_IVS):
+        if key not in temps:
+            temps[key] = _fresh_name(ctx, "__iv")
+        stats["reduced"] += 1
+        return Identifier(name=temps[key], line=expr.line, column=expr.column)
+    if not isinstance(expr, ASTNode) or isinstance(expr, InterpString):
+        return expr
+    for name, value in _children(expr):
+        if isinstance(value, ASTNode):
+            setattr(expr, name, _replace_products(value, temps, ivs, ctx, stats))
+        elif isinstance(value, list):
+            setattr(expr, name, [
+                tuple(_replace_products(v, temps, ivs, ctx, stats) for v in item) if isinstance(item, tuple)
+                else _replace_products(item, temps, ivs, ctx, stats)
+                for item in value
+            ])
+    return expr
+
+
+def reduce_strength(loop, ctx: FunctionContext, stats: Dict[str, int]) -> List[ASTNode]:
+    """Replace ``iv * k`` inside loop by a derived variable advanced by step*k.
+
+    The derived variable is initialized right before the loop and updated
+    immediately after its induction variable, so ``t == iv * k`` holds at
+    every use inside the loop.
+    """
+    if _contains(loop.body, DeferStmt):
+        return [loop]
+    ivs = find_induction_variables(loop, ctx)
+    if isinstance(loop, ForStmt) and loop.var_name in ivs and not isinstance(loop.start, (Literal, Identifier)):
+        # The derived variable's initializer re-reads the start value
+        del ivs[loop.var_name]
+    if not ivs:
+        return [loop]
+
+    temps: Dict[tuple, str] = {}
+    loop.body = _replace_products(loop.body, temps, ivs, ctx, stats)
+    if isinstance(loop, WhileStmt):
+        loop.condition = _replace_products(loop.condition, temps, ivs, ctx, stats)
+    if not temps:
+        return [loop]
+
+    prologue: List[ASTNode] = []
+    line, column = loop.line, loop.column
+    for (var, factor), temp in temps.items():
+        if isinstance(loop, ForStmt) and var == loop.var_name:
+            base = copy.deepcopy(loop.start)
+        else:
+            base = Identifier(name=var, line=line, column=column)
+        init = BinaryExpr(left=base, operator="*", right=Literal(value=factor, literal_type="int"),
+                          line=line, column=column)
+        prologue.append(VarDecl(name=temp, var_type="int", value=init, line=line, column=column))
+
+    body = loop.body.statements
+    for (var, factor), temp in temps.items():
+        step = ivs[var] * factor
+        update = Assignment(name=temp, value=BinaryExpr(
+            left=Identifier(name=temp, line=line, column=column), operator="+",
+            right=Literal(value=_wrap64(step), literal_type="int"), line=line, column=column,
+        ), line=line, column=column)
+        if isinstance(loop, ForStmt) and var == loop.var_name:
+            body.append(update)
+        else:
+            index = next(i for i, stmt in enumerate(body) if _step_of(stmt, var) is not None)
+            body.insert(index + 1, update)
+    return prologue + [loop]
+
+
+# ---------- unrolling ----------
+def _node_count(node) -> int:
+    count = [0]
+
+    def visit(_):
+        count[0] += 1
+
+    walk(node, visit)
+    return count[0]
+
+
+def unroll_loop(loop, ctx: FunctionContext, stats: Dict[str, int], factor: int) -> List[ASTNode]:
+    """Unroll a counted ``for`` loop by factor, with a remainder loop.
+
+        for i in a..b { B }
+    becomes
+        var i = a; var limit = b - (factor - 1);
+        while (i <= limit) { B; i = i + 1; ... factor times }
+        while (i <= b) { B; i = i + 1; }
+    """
+    if not isinstance(loop, ForStmt) or not ctx.is_local(loop.var_name) or loop.vectorize:
+        return [loop]
+    var = loop.var_name
+    body = loop.body
+    if var in collect_assigned(body) or _node_count(body) > UNROLL_MAX_NODES:
+        return [loop]
+    if _contains(body, (WhileStmt, ForStmt, DeferStmt, ReturnStmt)):
+        return [loop]
+    end = loop.end
+    if not (isinstance(end, Literal) and end.literal_type == "int") and not (
+        isinstance(end, Identifier) and ctx.is_local(end.name) and end.name not in collect_assigned(body)
+    ):
+        return [loop]
+    if isinstance(loop.start, Literal) and isinstance(end, Literal) and int(end.value) - int(loop.start.value) < factor:
+        return [loop]
+
+    line, column = loop.line, loop.column
+
+    def ident(name):
+        return Identifier(name=name, line=line, column=column)
+
+    def step():
+        return Assignment(name=var, value=BinaryExpr(left=ident(var), operator="+",
+                                                     right=Literal(value=1, literal_type="int"),
+                                                     line=line, column=column), line=line, column=column)
+
+    def cond(bound):
+        return BinaryExpr(left=ident(var), operator="<=", right=bound, line=line, column=column)
+
+    limit = _fresh_name(ctx, "__unroll")
+    unrolled: List[ASTNode] = []
+    for _ in range(factor):
+        unrolled.extend(copy.deepcopy(body.statements))
+        unrolled.append(step())
+    remainder = copy.deepcopy(body.statements) + [step()]
+    stats["unrolled"] += 1
+    return [
+        VarDecl(name=var, var_type="int", value=loop.start, line=line, column=column),
+        VarDecl(name=limit, var_type="int", value=fold_expr(BinaryExpr(
+            left=copy.deepcopy(end), operator="-", right=Literal(value=factor - 1, literal_type="int"),
+            line=line, column=column), stats), line=line, column=column),
+        WhileStmt(condition=cond(ident(limit)), body=Block(statements=unrolled, line=line, column=column),
+                  line=line, column=column),
+        WhileStmt(condition=cond(copy.deepcopy(end)), body=Block(statements=remainder, line=line, column=column),
+                  line=line, column=column),
+    ]
+
+
+def _definitions(body: Block) -> Dict[str, List[Optional[ASTNode]]]:
+    """Every value assigned to each name (None when the value is unknown)."""
+    defs: Dict[str, List[Optional[ASTNode]]] = {}
+
+    def visit(n):
+        if isinstance(n, VarDecl):
+            defs.setdefault(n.name, []).append(n.value)
+        elif isinstance(n, Assignment) and n.target is None:
+            defs.setdefault(n.name, []).append(n.value)
+        elif isinstance(n, TupleUnpack):
+            for name in n.names:
+                defs.setdefault(name, []).append(None)
+        elif isinstance(n, ForStmt):
+            # The loop itself steps the variable upwards from start
+            defs.setdefault(n.var_name, []).append(n.start)
+        elif _resized_array(n):
+            defs.setdefault(n.arguments[0].name, []).append(None)
+
+    walk(body, visit)
+    for name in _passed_arrays(body):
+        defs.setdefault(name, []).append(None)
+    return defs
+
+
+def _definition_counts(body: Block) -> Dict[str, int]:
+    return {name: len(values) for name, values in _definitions(body).items()}
+
+
+# ---------- bounds-check elimination ----------
+def _index_offset(expr, var: str) -> Optional[int]:
+    """c when expr is ``var``, ``var + c``, ``c + var`` or ``var - c`` (literal c)."""
+    if isinstance(expr, Identifier) and expr.name == var:
+        return 0
+    if isinstance(expr, BinaryExpr) and expr.operator in ("+", "-"):
+        left, right = expr.left, expr.right
+        if expr.operator == "+" and isinstance(left, Literal):
+            left, right = right, left
+        if (
+            isinstance(left, Identifier)
+            and left.name == var
+            and isinstance(right, Literal)
+            and right.literal_type == "int"
+        ):
+            return int(right.value) if expr.operator == "+" else -int(right.value)
+    return None
+
+
+class RangeFacts:
+    """Function-wide facts the bounds-check proofs rely on."""
+
+    def __init__(self, ctx: FunctionContext):
+        self.ctx = ctx
+        self.defs = _definitions(ctx.body)
+        self.params = ctx.params
+
+    def single_definition(self, name: str) -> Optional[ASTNode]:
+        values = self.defs.get(name, [])
+        return values[0] if len(values) == 1 and name not in self.params else None
+
+    def is_stable_array(self, name: str) -> bool:
+        """A local array bound once (parameter or single declaration)."""
+        bindings = len(self.defs.get(name, [])) + (name in self.params)
+        return (self.ctx.is_local(name) and bindings <= 1
+                and not _may_resize_through_alias(self.ctx.body, name, self.ctx))
+
+    def is_nonnegative(self, name: str) -> bool:
+        """Every definition of name is a literal >= 0 or an increment."""
+        if name in self.params or not self.ctx.is_local(name):
+            return False
+        for value in self.defs.get(name, []):
+            if isinstance(value, Literal) and value.literal_type == "int" and int(value.value) >= 0:
+                continue
+            step = _index_offset(value, name) if isinstance(value, BinaryExpr) else None
+            if step is not None and step >= 0:
+                continue
+            return False
+        return True
+
+    def lower_bound(self, expr) -> Optional[int]:
+        if isinstance(expr, Literal) and expr.literal_type == "int":
+            return int(expr.value)
+        if isinstance(expr, Identifier) and self.is_nonnegative(expr.name):
+            return 0
+        return None
+
+    def length_minus(self, expr, loop) -> Optional[tuple]:
+        """(array, k) when expr always equals ``Len(array) - k`` inside loop."""
+        through_local = False
+        if isinstance(expr, Identifier) and self.ctx.is_local(expr.name):
+            if expr.name in collect_assigned(loop):
+                return None
+            expr = self.single_definition(expr.name)
+            through_local = True
+        k = 0
+        if (
+            isinstance(expr, BinaryExpr)
+            and expr.operator == "-"
+            and isinstance(expr.right, Literal)
+            and expr.right.literal_type == "int"
+        ):
+            expr, k = expr.left, int(expr.right.value)
+        if not (
+            isinstance(expr, FunctionCall)
+            and expr.name in PURE_READ_BUILTINS
+            and len(expr.arguments) == 1
+            and isinstance(expr.arguments[0], Identifier)
+        ):
+            return None
+        array = expr.arguments[0].name
+        if array in collect_assigned(loop) or not self.ctx.is_local(array):
+            return None
+        if _may_resize_through_alias(loop, array, self.ctx):
+            # A call or resize in the body may shrink it under another name
+            return None
+        if through_local and not self.is_stable_array(array):
+            # The bound was computed earlier; the array must not have changed since
+            return None
+        return array, k
+
+
+def _mark_safe_accesses(node, array: str, var: str, offsets, skip=(DeferStmt,)) -> int:
+    """Clear ``checked`` on array[var + c] for c in offsets; returns the count."""
+    marked = [0]
+
+    def visit(n):
+        if (
+            isinstance(n, IndexExpr)
+            and n.checked
+            and isinstance(n.receiver, Identifier)
+            and n.receiver.name == array
+            and _index_offset(n.index, var) in offsets
+        ):
+            n.checked = False
+            marked[0] += 1
+
+    def walk_skipping(n):
+        if isinstance(n, skip):
+            return
+        if isinstance(n, (list, tuple)):
+            for item in n:
+                walk_skipping(item)
+            return
+        if not isinstance(n, ASTNode):
+            return
+        visit(n)
+        for _, value in _children(n):
+            walk_skipping(value)
+
+    walk_skipping(node)
+    return marked[0]
+
+
+def _indexed_arrays(node, var: str) -> Set[tuple]:
+    """(array, c) for every local-array access ``array[var + c]`` inside node."""
+    found: Set[tuple] = set()
+
+    def visit(n):
+        if isinstance(n, IndexExpr) and isinstance(n.receiver, Identifier):
+            offset = _index_offset(n.index, var)
+            if offset is not None:
+                found.add((n.receiver.name, offset))
+
+    walk(node, visit)
+    return found
+
+
+def _may_leave_early(body: Block, ctx: FunctionContext) -> bool:
+    """True when an iteration may stop before reaching its last statement."""
+    exits = []
+
+    def visit(n):
+        if isinstance(n, (ReturnStmt, TryExpr, MethodCall, DeferStmt)):
+            exits.append(n)
+        elif isinstance(n, FunctionCall) and (n.name in ctx.functions or n.name == "Exit"):
+            exits.append(n)
+
+    walk(body, visit)
+    return bool(exits)
+
+
+def _is_quiet(body: Block) -> bool:
+    """True when an iteration does nothing visible after a failed bounds check
+    stops the program: no output or other I/O, no loop that may not end and
+    no division that may trap first."""
+    loud = []
+
+    def visit(n):
+        if isinstance(n, (MethodCall, WhileStmt)) or (isinstance(n, FunctionCall) and n.name not in QUIET_BUILTINS):
+            loud.append(n)
+        elif isinstance(n, BinaryExpr) and n.operator in ("/", "%") \
+                and not (_is_numeric_literal(n.right) and _literal_int(n.right) != 0):
+            loud.append(n)
+
+    walk(body, visit)
+    return not loud
+
+
+def eliminate_bounds_checks(loop, facts: RangeFacts, stats: Dict[str, int]) -> List[ASTNode]:
+    """Drop bounds checks that the loop's range proves redundant.
+
+    ``for i in a..Len(arr) - k`` and ``while (i < Len(arr) - k)`` bound every
+    ``arr[i + c]`` with small enough c; the lower bound comes from a or from
+    i never being assigned a negative value. For the other accesses of
+    counted loops that run on every iteration (other arrays, or any array
+    when the range proves nothing), one BoundsCheck of the whole index range
+    is placed before the loop instead. When the body can print or do other
+    I/O before the access that fails, failing up front would lose that
+    output, so the loop is versioned instead: the checks guard the unchecked
+    loop and an out-of-bounds range runs the loop as written.
+    """
+    ctx = facts.ctx
+    if isinstance(loop, ForStmt):
+        var = loop.var_name
+        if var in collect_assigned(loop.body) or not ctx.is_local(var):
+            return [loop]
+        low = facts.lower_bound(loop.start)
+        upper = facts.length_minus(loop.end, loop)
+        region = loop.body
+        excess = 0  # i <= Len(array) - k - excess
+    else:
+        cond = loop.condition
+        if not (isinstance(cond, BinaryExpr) and cond.operator in ("<", "<=", ">", ">=")):
+            return [loop]
+        left, op, right = cond.left, cond.operator, cond.right
+        if op in (">", ">="):
+            left, right, op = right, left, {">": "<", ">=": "<="}[op]
+        if not isinstance(left, Identifier) or left.name not in find_induction_variables(loop, ctx):
+            return [loop]
+        var = left.name
+        low = 0 if facts.is_nonnegative(var) else None
+        upper = facts.length_minus(right, loop)
+        # Only statements before the update see the value the condition tested
+        body = loop.body.statements
+        update = next(i for i, stmt in enumerate(body) if _step_of(stmt, var) is not None)
+        region = body[:update]
+        excess = 1 if op == "<" else 0
+
+    proven: Set[tuple] = set()
+    if upper is not None and low is not None:
+        array, k = upper
+        # i + c < Len(array) needs c < k + excess; i + c >= 0 needs c >= -low
+        offsets = range(-low, k + excess)
+        removed = _mark_safe_accesses(region, array, var, offsets)
+        stats["unchecked"] += removed
+        proven = {(array, offset) for offset in offsets}
+
+    if not isinstance(loop, ForStmt) or _may_leave_early(loop.body, ctx):
+        return [loop]
+    bounds_simple = all(
+        isinstance(bound, Literal) and bound.literal_type == "int"
+        or isinstance(bound, Identifier) and ctx.is_local(bound.name) and bound.name not in collect_assigned(loop)
+        for bound in (loop.start, loop.end)
+    )
+    if not bounds_simple:
+        return [loop]
+    quiet = _is_quiet(loop.body)
+    if not quiet and _contains(loop.body, BoundsCheck):
+        return [loop]  # already versioned inside; one copy per loop level at most
+    original = None if quiet else copy.deepcopy(loop)
+    # Accesses in top-level statements run on every iteration
+    unconditional: Set[tuple] = set()
+    for stmt in loop.body.statements:
+        if not isinstance(stmt, (IfStmt, WhileStmt, ForStmt, Block)):
+            unconditional |= _indexed_arrays(stmt, var)
+    checks: List[ASTNode] = []
+    for array, offset in sorted(unconditional - proven):
+        if not ctx.is_local(array) or array in collect_assigned(loop) \
+                or _may_resize_through_alias(loop, array, ctx):
+            continue
+
+        def shifted(bound):
+            return BinaryExpr(left=copy.deepcopy(bound), operator="+",
+                              right=Literal(value=offset, literal_type="int"),
+                              line=loop.line, column=loop.column)
+
+        checks.append(BoundsCheck(array=Identifier(name=array, line=loop.line, column=loop.column),
+                                  low=shifted(loop.start), high=shifted(loop.end),
+                                  line=loop.line, column=loop.column))
+        stats["unchecked"] += _mark_safe_accesses(loop.body, array, var, (offset,))
+    if quiet or not checks:
+        return checks + [loop]
+    guard = checks[0]
+    for check in checks[1:]:
+        guard = BinaryExpr(left=guard, operator="&&", right=check, line=loop.line, column=loop.column)
+    return [IfStmt(condition=guard,
+                   then_block=Block(statements=[loop], line=loop.line, column=loop.column),
+                   else_block=Block(statements=[original], line=loop.line, column=loop.column),
+                   line=loop.line, column=loop.column)]
+
+
+# ---------- vectorization ----------
+def _vector_element_type(ctx: FunctionContext, name: str) -> Optional[str]:
+    declared = ctx.types.get(name)
+    if declared in ("array", "int[]"):
+        return "int"
+    return "dec" if declared == "dec[]" else None
+
+
+def vectorize_loop(loop, ctx: FunctionContext, stats: Dict[str, int]) -> List[ASTNode]:
+    """Mark ``for i in a..b { c[i] = x op y; }`` for SIMD code generation.
+
+    x and y are ``arr[i]`` of arrays with c's element type, or literals and
+    locals the loop cannot change; at least one is an array. Every access
+    must already be proven in bounds (or the function be ``@unchecked``),
+    since a vector iteration touches several elements at once. Arrays are
+    distinct objects or the same one, so lanes never overlap partially.
+    """
+    if not isinstance(loop, ForStmt) or not ctx.is_local(loop.var_name) or len(loop.body.statements) != 1:
+        return [loop]
+    var = loop.var_name
+    stmt = loop.body.statements[0]
+    if not (isinstance(stmt, Assignment) and isinstance(stmt.target, IndexExpr)
+            and isinstance(stmt.value, BinaryExpr)):
+        return [loop]
+
+    def element_access(node) -> bool:
+        return (isinstance(node, IndexExpr) and isinstance(node.receiver, Identifier)
+                and ctx.is_local(node.receiver.name)
+                and _vector_element_type(ctx, node.receiver.name) == elem
+                and isinstance(node.index, Identifier) and node.index.name == var
+                and (not node.checked or ctx.body.unchecked))
+
+    def invariant(node) -> bool:
+        if isinstance(node, Literal):
+            return node.literal_type == "int" or (elem == "dec" and node.literal_type == "dec")
+        return (isinstance(node, Identifier) and node.name != var and ctx.is_local(node.name)
+                and ctx.types.get(node.name) in (("int",) if elem == "int" else ("int", "dec")))
+
+    elem = _vector_element_type(ctx, stmt.target.receiver.name) if isinstance(stmt.target.receiver, Identifier) else None
+    if elem is None or not element_access(stmt.target) or stmt.value.operator not in VECTOR_OPERATORS[elem]:
+        return [loop]
+    operands = (stmt.value.left, stmt.value.right)
+    if not any(element_access(op) for op in operands) or not all(
+            element_access(op) or invariant(op) for op in operands):
+        return [loop]
+    end = loop.end
+    if not (isinstance(end, Literal) and end.literal_type == "int"
+            or isinstance(end, Identifier) and ctx.is_local(end.name) and ctx.types.get(end.name) == "int"):
+        return [loop]
+    loop.vectorize = elem
+    stats["vectorized"] += 1
+    return [loop]
+
+
+# ---------- inlining ----------
+# Name the lowered returns of an inlined body store to; renamed per call site
+INLINE_RESULT = "__result"
+
+
+class InlineCandidate:
+    """A callee small and simple enough to copy into its callers.
+
+    ``expression`` is set for bodies that are a single ``return E`` of an int or
+    bool: those calls are replaced by E itself. ``lowered`` is the body with
+    every return turned into a store to INLINE_RESULT, spliced in front of the
+    calling statement; None when the returns cannot be rewritten that way.
+    """
+
+    def __init__(self, params: List[tuple], return_type: Optional[str], body: Block):
+        self.params = params  # [(name, type, default)], self first for methods
+        self.return_type = return_type
+        declared = {p[0] for p in params}
+
+        def visit(n):
+            if isinstance(n, VarDecl):
+                declared.add(n.name)
+            elif isinstance(n, TupleUnpack):
+                declared.update(n.names)
+            elif isinstance(n, ForStmt):
+                declared.add(n.var_name)
+
+        walk(body, visit)
+        self.free = (collect_reads(body) | collect_assigned(body)) - declared - {"self"}
+        self.locals = declared
+        self.expression = None
+        if (return_type in ("int", "bool") and len(body.statements) == 1
+                and isinstance(body.statements[0], ReturnStmt) and body.statements[0].value is not None):
+            self.expression = body.statements[0].value
+        result = INLINE_RESULT if return_type else None
+        self.lowered = _lower_returns(copy.deepcopy(body.statements), result)
+        if result and self.lowered is not None:
+            self.locals.add(result)
+
+
+def _inline_candidate(name: str, params: List[tuple], return_type: Optional[str], body: Optional[Block],
+                      bindable: Callable[[Optional[str]], bool]) -> Optional[InlineCandidate]:
+    if body is None or _node_count(body) > INLINE_MAX_NODES:
+        return None
+    if return_type is not None and return_type not in INLINE_SCALAR_TYPES:
+        return None
+    if not all(bindable(p[1]) for p in params) or any(p[0] == "self" for p in params[1:]):
+        return None
+
+    def unsupported(n):
+        if isinstance(n, (DeferStmt, TryExpr, InterpString)):
+            return True  # run at, or return from, the caller's exit; or unrenamable
+        if isinstance(n, Block) and (n.unchecked or n.arena is not None or n.deferred):
+            return True
+        if isinstance(n, VarDecl) and n.value is None:
+            return True  # would become one struct shared by every call in the caller
+        if isinstance(n, FunctionCall) and n.name == name:
+            return True
+        return isinstance(n, MethodCall) and n.method_name == name
+
+    found = []
+    walk(body, lambda n: found.append(n) if unsupported(n) else None)
+    if found:
+        return None
+    candidate = InlineCandidate(params, return_type, copy.deepcopy(body))
+    if candidate.expression is None and candidate.lowered is None:
+        return None
+    return candidate
+
+
+def _else_statements(stmt: IfStmt) -> List[ASTNode]:
+    if stmt.else_block is None:
+        return []
+    if isinstance(stmt.else_block, IfStmt):
+        return [stmt.else_block]
+    return stmt.else_block.statements
+
+
+def _always_returns(stmts: List[ASTNode]) -> bool:
+    for stmt in stmts:
+        if isinstance(stmt, ReturnStmt):
+            return True
+        if isinstance(stmt, Block) and _always_returns(stmt.statements):
+            return True
+        if (isinstance(stmt, IfStmt) and stmt.else_block is not None
+                and _always_returns(stmt.then_block.statements) and _always_returns(_else_statements(stmt))):
+            return True
+    return False
+
+
+def _lower_returns(stmts: List[ASTNode], result: Optional[str]) -> Optional[List[ASTNode]]:
+    """Turn the returns of an inlined body into stores to result.
+
+    Statements after an ``if`` that returns on one side move into the other
+    side, so nothing is duplicated:
+
+        if (c) { return a; }           if (c) { r = a; }
+        S; return b;              =>   else { S; r = b; }
+
+    Returns inside loops have no such form; those bodies give None.
+    """
+    lowered: List[ASTNode] = []
+    for idx, stmt in enumerate(stmts):
+        if isinstance(stmt, ReturnStmt):
+            if stmt.value is not None and result is not None:
+                lowered.append(Assignment(name=result, value=stmt.value, line=stmt.line, column=stmt.column))
+            elif stmt.value is not None and not is_pure(stmt.value):
+                lowered.append(stmt.value)
+            return lowered
+        if not _contains(stmt, ReturnStmt):
+            lowered.append(stmt)
+            continue
+        rest = stmts[idx + 1:]
+        if isinstance(stmt, Block):
+            tail = _lower_returns(stmt.statements + rest, result)
+            return None if tail is None else lowered + tail
+        if not isinstance(stmt, IfStmt):
+            return None
+        then_stmts, else_stmts = stmt.then_block.statements, _else_statements(stmt)
+        if _always_returns(then_stmts):
+            else_stmts = else_stmts + rest
+        elif _always_returns(else_stmts) and stmt.else_block is not None:
+            then_stmts = then_stmts + rest
+        elif rest:
+            return None
+        then_part = _lower_returns(then_stmts, result)
+        else_part = _lower_returns(else_stmts, result)
+        if then_part is None or else_part is None:
+            return None
+        lowered.append(IfStmt(
+            condition=stmt.condition,
+            then_block=Block(statements=then_part, line=stmt.then_block.line, column=stmt.then_block.column),
+            else_block=Block(statements=else_part, line=stmt.line, column=stmt.column) if else_part else None,
+            line=stmt.line, column=stmt.column,
+        ))
+        return lowered
+    return lowered
+
+
+def _pure_except(expr, call, ctx: FunctionContext) -> bool:
+    """True when expr, apart from call, is pure and reads only unreachable locals."""
+    if expr is call:
+        return True
+    if isinstance(expr, (Literal, SelfExpr)):
+        return True
+    if isinstance(expr, Identifier):
+        return ctx.is_local(expr.name)
+    if isinstance(expr, UnaryExpr):
+        return _pure_except(expr.operand, call, ctx)
+    if isinstance(expr, BinaryExpr):
+        if expr.operator in ("/", "%") and not (_is_numeric_literal(expr.right) and _literal_int(expr.right) != 0):
+            return False
+        return _pure_except(expr.left, call, ctx) and _pure_except(expr.right, call, ctx)
+    if isinstance(expr, (FunctionCall, MethodCall)) and _contains_node(expr, call):
+        # Runs after its arguments, call among them
+        args = list(expr.arguments) + ([expr.receiver] if isinstance(expr, MethodCall) else [])
+        return all(_pure_except(arg, call, ctx) for arg in args)
+    return False
+
+
+def _contains_node(node, target) -> bool:
+    found = []
+    walk(node, lambda n: found.append(n) if n is target else None)
+    return bool(found)
+
+
+def _read_counts(node) -> Dict[str, int]:
+    counts: Dict[str, int] = {}
+
+    def visit(n):
+        if isinstance(n, (Identifier, SelfExpr)):
+            key = "self" if isinstance(n, SelfExpr) else n.name
+            counts[key] = counts.get(key, 0) + 1
+
+    walk(node, visit)
+    return counts
+
+
+def _rewrite(node, replace: Callable[[ASTNode], Optional[ASTNode]]):
+    """Rebuild node top-down; a non-None replace(n) takes the place of n."""
+    if isinstance(node, list):
+        return [_rewrite(item, replace) for item in node]
+    if isinstance(node, tuple):
+        return tuple(_rewrite(item, replace) for item in node)
+    if not isinstance(node, ASTNode):
+        return node
+    replacement = replace(node)
+    if replacement is not None:
+        return replacement
+    for name, value in _children(node):
+        setattr(node, name, _rewrite(value, replace))
+    return node
+
+
+class Inliner:
+    """Copies small non-recursive functions and methods into their callers.
+
+    Candidates are snapshotted before any caller changes, so inlined code is
+    never inlined into again: mutual recursion stops after one level. Calls
+    inside ``@unchecked`` or ``@arena`` code keep their own checks and
+    allocator and are left alone.
+    """
+
+    def __init__(self, program: Program, stats: Dict[str, int]):
+        self.stats = stats
+        structs = {stmt.name for stmt in program.statements if isinstance(stmt, StructDef)}
+
+        def bindable(type_str: Optional[str]) -> bool:
+            return bool(type_str) and (type_str in INLINE_SCALAR_TYPES or type_str in structs
+                                       or type_str == "array" or type_str.endswith("[]"))
+
+        # A spawned function is entered through its __spawn_ stub, so keep the call
+        spawned: Set[str] = set()
+        walk(program, lambda n: spawned.add(n.operand.name) if isinstance(n, SpawnExpr) else None)
+
+        self.candidates: Dict[tuple, InlineCandidate] = {}
+        for stmt in program.statements:
+            if (isinstance(stmt, FunctionDef) and stmt.name != "Main" and not stmt.type_params
+                    and not stmt.is_async and stmt.name not in spawned):
+                candidate = _inline_candidate(stmt.name, list(stmt.params), stmt.return_type, stmt.body, bindable)
+                if candidate:
+                    self.candidates[(None, stmt.name)] = candidate
+            elif isinstance(stmt, StructDef):
+                for method in stmt.methods:
+                    params = [("self", stmt.name, None)] + [(p[0], p[1], None) for p in method.params]
+                    candidate = _inline_candidate(method.name, params, method.return_type, method.body, bindable)
+                    if candidate:
+                        self.candidates[(stmt.name, method.name)] = candidate
+
+    def run(self, ctx: FunctionContext):
+        if self.candidates and not ctx.body.unchecked:
+            ctx.body.statements = self.inline_block(ctx.body.statements, ctx)
+
+    def inline_block(self, stmts: List[ASTNode], ctx: FunctionContext) -> List[ASTNode]:
+        result: List[ASTNode] = []
+        for stmt in stmts:
+            if isinstance(stmt, DeferStmt) or (isinstance(stmt, Block) and (stmt.unchecked or stmt.arena is not None)):
+                result.append(stmt)
+                continue
+            for block in _nested_blocks(stmt):
+                block.statements = self.inline_block(block.statements, ctx)
+            stmt = self.inline_statement_expressions(stmt, ctx)
+            # Each round takes one call out of the statement
+            expanded = self.inline_statement(stmt, ctx)
+            while expanded is not None:
+                result.append(expanded[0])
+                stmt = expanded[1] if len(expanded) > 1 else None
+                expanded = self.inline_statement(stmt, ctx) if stmt is not None else None
+            if stmt is not None:
+                result.append(stmt)
+        return result
+
+    def inline_statement_expressions(self, stmt, ctx: FunctionContext):
+        """Replace expression-bodied calls in the statement's own expressions."""
+        if isinstance(stmt, IfStmt):
+            branch = stmt
+            while isinstance(branch, IfStmt):
+                branch.condition = self.inline_expr(branch.condition, ctx)
+                branch = branch.else_block
+        elif isinstance(stmt, WhileStmt):
+            stmt.condition = self.inline_expr(stmt.condition, ctx)
+        elif isinstance(stmt, ForStmt):
+            stmt.start = self.inline_expr(stmt.start, ctx)
+            stmt.end = self.inline_expr(stmt.end, ctx)
+        elif isinstance(stmt, (VarDecl, Assignment, ReturnStmt, TupleUnpack)):
+            for attr in ("value", "target"):
+                if getattr(stmt, attr, None) is not None:
+                    setattr(stmt, attr, self.inline_expr(getattr(stmt, attr), ctx))
+        elif not isinstance(stmt, Block):
+            return self.inline_expr(stmt, ctx)
+        return stmt
+
+    def inline_expr(self, expr, ctx: FunctionContext):
+        if isinstance(expr, (list, tuple)):
+            return type(expr)(self.inline_expr(item, ctx) for item in expr)
+        if not isinstance(expr, ASTNode) or isinstance(expr, (AddressOf, InterpString, Block)):
+            return expr
+        for name, value in _children(expr):
+            setattr(expr, name, self.inline_expr(value, ctx))
+        found = self.callee(expr, ctx)
+        if not found or found[0].expression is None:
+            return expr
+        candidate, args = found
+        uses = _read_counts(candidate.expression)
+        env: Dict[str, ASTNode] = {}
+        for (pname, _, _), arg in zip(candidate.params, args):
+            # Arguments are substituted unevaluated, so they must be pure, read
+            # only locals the callee cannot reach, and be cheap if repeated
+            leaf = isinstance(arg, (Literal, Identifier, SelfExpr))
+            if not (is_pure(arg) and all(ctx.is_local(n) for n in collect_reads(arg))
+                    and (leaf or uses.get(pname, 0) <= 1)):
+                return expr
+            env[pname] = arg
+        self.stats["inlined"] += 1
+
+        def bind(n):
+            key = "self" if isinstance(n, SelfExpr) else n.name if isinstance(n, Identifier) else None
+            return copy.deepcopy(env[key]) if key in env else None
+
+        return _rewrite(copy.deepcopy(candidate.expression), bind)
+
+    def inline_statement(self, stmt, ctx: FunctionContext) -> Optional[List[ASTNode]]:
+        """Splice a callee in front of the statement that calls it.
+
+        Either the statement is the call, or the call is the only part of
+        what the statement evaluates first that can have side effects, with
+        everything else reading locals the callee cannot reach. Running the
+        callee ahead of the statement then changes nothing. Returns the
+        inlined block and the rewritten statement, or None.
+        """
+        call = self._leading_call(stmt, ctx)
+        found = self.callee(call, ctx) if call is not None else None
+        if not found:
+            return None
+        candidate, args = found
+        names = {name: _fresh_name(ctx, f"__inl_{name.strip('_')}") for name in sorted(candidate.locals)}
+
+        def rename(n):
+            if isinstance(n, SelfExpr):
+                return Identifier(name=names["self"], line=n.line, column=n.column)
+            if isinstance(n, Identifier) and n.name in names:
+                return Identifier(name=names[n.name], line=n.line, column=n.column)
+            if isinstance(n, (VarDecl, Assignment)) and n.name in names:
+                n.name = names[n.name]
+            elif isinstance(n, TupleUnpack):
+                n.names = [names.get(name, name) for name in n.names]
+            elif isinstance(n, ForStmt) and n.var_name in names:
+                n.var_name = names[n.var_name]
+            return None
+
+        # Arguments are bound in the order calls evaluate them: right to left
+        code: List[ASTNode] = [
+            VarDecl(name=names[pname], var_type=ptype, value=arg, line=call.line, column=call.column)
+            for (pname, ptype, _), arg in reversed(list(zip(candidate.params, args)))
+        ]
+        if candidate.return_type:
+            code.append(VarDecl(name=names[INLINE_RESULT], var_type=candidate.return_type,
+                                line=call.line, column=call.column))
+        code.extend(_rewrite(copy.deepcopy(candidate.lowered), rename))
+        self.stats["inlined"] += 1
+        inlined = Block(statements=code, line=call.line, column=call.column)
+        if call is stmt:
+            return [inlined]
+        if isinstance(stmt, VarDecl) and stmt.var_type is None:
+            # What codegen would have inferred from the call
+            stmt.var_type = "string" if candidate.return_type == "string" else "int"
+        result = Identifier(name=names[INLINE_RESULT], line=call.line, column=call.column)
+        return [inlined, _rewrite(stmt, lambda n: result if n is call else None)]
+
+    def _leading_call(self, stmt, ctx: FunctionContext):
+        """The inlinable call a statement makes before anything else observable."""
+        if isinstance(stmt, (FunctionCall, MethodCall)):
+            root = stmt
+        elif isinstance(stmt, (VarDecl, ReturnStmt)) or (isinstance(stmt, Assignment) and stmt.target is None):
+            root = stmt.value
+        elif isinstance(stmt, IfStmt):
+            root = stmt.condition
+        else:
+            return None
+        if root is None:
+            return None
+        whole = root if self._spliceable(root, ctx) else None
+        if isinstance(stmt, VarDecl) and stmt.var_type is None:
+            return whole  # the declared type is inferred from the call at the root
+        # Calls run after their arguments, so the innermost call goes first
+        calls = []
+        walk(root, lambda n: calls.append(n) if isinstance(n, (FunctionCall, MethodCall)) else None)
+        innermost = [c for c in calls if not any(other is not c and _contains_node(c, other) for other in calls)]
+        if len(innermost) == 1 and self._spliceable(innermost[0], ctx) and _pure_except(root, innermost[0], ctx):
+            return innermost[0]
+        return whole
+
+    def _spliceable(self, call, ctx: FunctionContext) -> bool:
+        found = self.callee(call, ctx)
+        return bool(found) and found[0].lowered is not None
+
+    def callee(self, call, ctx: FunctionContext) -> Optional[tuple]:
+        """(candidate, arguments including defaults and self) for an inlinable call."""
+        if isinstance(call, FunctionCall):
+            candidate = self.candidates.get((None, call.name))
+            args = list(call.arguments)
+        elif isinstance(call, MethodCall) and isinstance(call.receiver, (Identifier, SelfExpr)):
+            receiver = "self" if isinstance(call.receiver, SelfExpr) else call.receiver.name
+            candidate = self.candidates.get((ctx.types.get(receiver), call.method_name))
+            args = [call.receiver] + list(call.arguments)
+        else:
+            return None
+        if candidate is None or candidate.free & set(ctx.types):
+            return None  # a caller local would shadow a global the callee uses
+        for _, _, default in candidate.params[len(args):]:
+            if default is None:
+                return None
+            args.append(copy.deepcopy(default))
+        if len(args) != len(candidate.params):
+            return None
+        return candidate, args
+
+
+# ---------- pass manager ----------
+class PassManager:
+    """Runs the passes selected by the optimization level over each function."""
+
+    def __init__(self, level: int = DEFAULT_OPT_LEVEL, unroll: int = 0):
+        self.level = level
+        self.unroll = unroll
+        self.stats: Dict[str, int] = {
+            "folded": 0, "propagated": 0, "removed": 0, "hoisted": 0, "reduced": 0, "unrolled": 0,
+            "unchecked": 0, "inlined": 0, "vectorized": 0,
+        }
+        # Passes repeated until nothing changes, then loop passes run once
+        self.passes: List[Callable[[FunctionContext], None]] = []
+        self.loop_passes: List[Callable[[FunctionContext], None]] = []
+        if level >= 1:
+            self.passes += [self.constant_fold, self.copy_propagate, self.dead_code, self.loop_bounds]
+            self.loop_passes.append(self.bounds_check_elimination)
+        if level >= 2:
+            self.passes.append(self.loop_invariant_motion)
+            self.loop_passes += [self.strength_reduction, self.vectorize_loops]
+        if level >= 1 and unroll:
+            self.loop_passes.append(self.unroll_loops)
+
+    def run(self, program: Program) -> Program:
+        if not self.passes:
+            return program
+        globals_ = {stmt.name for stmt in program.statements if isinstance(stmt, VarDecl)}
+        functions = {stmt.name for stmt in program.statements if isinstance(stmt, FunctionDef)}
+        inliner = Inliner(program, self.stats) if self.level >= 2 else None
+        for params, body in self._function_bodies(program):
+            if inliner:
+                inliner.run(FunctionContext(params, body, globals_, functions))
+            for _ in range(MAX_ROUNDS):
+                before = dict(self.stats)
+                for opt_pass in self.passes:
+                    opt_pass(FunctionContext(params, body, globals_, functions))
+                if self.stats == before:
+                    break
+            for opt_pass in self.loop_passes:
+                opt_pass(FunctionContext(params, body, globals_, functions))
+            # Fold the initial values of derived induction variables
+            self.constant_fold(FunctionContext(params, body, globals_, functions))
+        return program
+
+    def _function_bodies(self, program: Program):
+        for stmt in program.statements:
+            if isinstance(stmt, FunctionDef) and stmt.body:
+                yield stmt.params, stmt.body
+            elif isinstance(stmt, StructDef):
+                for method in stmt.methods:
+                    if method.body:
+                        yield [("self", stmt.name)] + list(method.params), method.body
+
+    def constant_fold(self, ctx: FunctionContext):
+        fold_statements(ctx.body.statements, self.stats)
+
+    def copy_propagate(self, ctx: FunctionContext):
+        propagate_block(ctx.body.statements, {}, ctx, self.stats)
+
+    def dead_code(self, ctx: FunctionContext):
+        reads = collect_reads(ctx.body)
+        ctx.body.statements = eliminate_dead_code(ctx.body.statements, reads, ctx, self.stats)
+
+    def loop_bounds(self, ctx: FunctionContext):
+        ctx.body.statements = transform_loops(
+            ctx.body.statements, lambda loop: hoist_loop_bound(loop, ctx, self.stats))
+
+    def loop_invariant_motion(self, ctx: FunctionContext):
+        defs = _definition_counts(ctx.body)
+        ctx.body.statements = transform_loops(
+            ctx.body.statements, lambda loop: hoist_loop_invariants(loop, ctx, self.stats, defs))
+
+    def bounds_check_elimination(self, ctx: FunctionContext):
+        facts = RangeFacts(ctx)
+        ctx.body.statements = transform_loops(
+            ctx.body.statements, lambda loop: eliminate_bounds_checks(loop, facts, self.stats))
+
+    def strength_reduction(self, ctx: FunctionContext):
+        ctx.body.statements = transform_loops(
+            ctx.body.statements, lambda loop: reduce_strength(loop, ctx, self.stats))
+
+    def vectorize_loops(self, ctx: FunctionContext):
+        ctx.body.statements = transform_loops(
+            ctx.body.statements, lambda loop: vectorize_loop(loop, ctx, self.stats))
+
+    def unroll_loops(self, ctx: FunctionContext):
+        ctx.body.statements = transform_loops(
+            ctx.body.statements, lambda loop: unroll_loop(loop, ctx, self.stats, self.unroll))
+
+
+def optimize_program(program: Program, level: int = DEFAULT_OPT_LEVEL, unroll: int = 0) -> Dict[str, int]:
+    """Optimize program in place; returns per-pass statistics."""
+    manager = PassManager(level, unroll)
+    manager.run(program)
+    return manager.stats
@@ -20,10 +20,12 @@ AST Node Types:
     - UnaryExpr: Unary expressions (-a, +a)
     - Literal: Integer, decimal, string, boolean literals
     - Identifier: Variable references
+    - BoundsCheck: Loop-hoisted range check (created by the optimizer)
+    - ArrayClone: Copy of a const array that leaves read-only use (created by comptime.py)
 """
 
 from dataclasses import dataclass, field
-from typing import List, Optional, Any
+from typing import List, Optional, Any, Tuple
 try:
     from .lexer import Token
 except ImportError:
@@ -50,6 +52,7 @@ class VarDecl(ASTNode):
     var_type: Optional[str] = None  # 'int', 'dec', 'string', 'bool'
     value: Optional[ASTNode] = None
     is_mutable: bool = True
+    is_const: bool = False  # const: the value is computed at compile time (comptime.py)
 
 
 @dataclass
@@ -75,6 +78,8 @@ class FunctionDef(ASTNode):
     return_type: Optional[str] = None
     body: Optional['Block'] = None
     type_params: List[str] = field(default_factory=list)  # Generic type parameters like [T, K]
+    is_async: bool = False  # async Function: calls spawn a task and return its handle
+    is_comptime: bool = False  # comptime Function: calls with constant arguments are folded
 
 
 @dataclass
@@ -106,6 +111,8 @@ class Block(ASTNode):
     """Code block: { statements }"""
     statements: List[ASTNode] = field(default_factory=list)
     deferred: List['DeferStmt'] = field(default_factory=list)  # Deferred statements
+    unchecked: bool = False  # @unchecked: index expressions skip bounds checks
+    arena: Optional[ASTNode] = None  # @arena(a): allocations inside come from arena a
 
 
 @dataclass
@@ -130,6 +137,7 @@ class ForStmt(ASTNode):
     start: ASTNode = None
     end: ASTNode = None
     body: Block = None
+    vectorize: Optional[str] = None  # element type, set by the optimizer for SIMD loops
 
 
 @dataclass
@@ -183,6 +191,7 @@ class IndexExpr(ASTNode):
     """Index access: expr[index]"""
     receiver: ASTNode = None
     index: ASTNode = None
+    checked: bool = True  # cleared by the optimizer when the index is proven in bounds
 
 
 @dataclass
@@ -199,6 +208,14 @@ class ArrayLiteral(ASTNode):
     element_type: Optional[str] = None  # inferred or explicit type
 
 
+@dataclass
+class ConstArray(ASTNode):
+    """An array computed at compile time (comptime.py), laid out as static data.
+    Elements are ints, floats (dec), bools, strs or nested lists."""
+    elements: List[Any] = field(default_factory=list)
+    element_type: str = "int"
+
+
 @dataclass
 class EnumDef(ASTNode):
     """Enum definition: Enum Name { VALUE1, VALUE2 = 10, ... }"""
@@ -263,6 +280,18 @@ class Dereference(ASTNode):
     operand: ASTNode = None
 
 
+@dataclass
+class AwaitExpr(ASTNode):
+    """Await expression: await task"""
+    operand: ASTNode = None
+
+
+@dataclass
+class SpawnExpr(ASTNode):
+    """Spawn expression: spawn f(args), a call run as a green thread"""
+    operand: ASTNode = None
+
+
 @dataclass
 class NullLiteral(ASTNode):
     """Null pointer literal"""
@@ -295,6 +324,30 @@ class TupleUnpack(ASTNode):
     pass
 
 
+@dataclass
+class BoundsCheck(ASTNode):
+    """Range check hoisted out of a loop: array[low..high] must be in bounds
+
+    Inserted by the optimizer; an empty range (low > high) always passes.
+    As an if condition it is true when the range is in bounds instead of
+    failing (the guard of a versioned loop).
+    """
+    array: ASTNode = None
+    low: ASTNode = None
+    high: ASTNode = None
+
+
+@dataclass
+class ArrayClone(ASTNode):
+    """Fresh heap copy of a const array, for code that may keep or change it
+
+    Inserted by comptime.py; depth counts the levels of nested arrays copied
+    below the outer one.
+    """
+    array: ASTNode = None
+    depth: int = 0
+
+
 class Parser:
     """
     Parser for VYL source code
@@ -389,8 +442,18 @@ class Parser:
             stmt = self.parse_var_decl()
         elif token_type == 'LET':
             stmt = self.parse_let_decl()
+        elif token_type == 'CONST':
+            stmt = self.parse_var_decl('CONST')
+        elif token_type == 'COMPTIME':
+            self.consume('COMPTIME')
+            stmt = self.parse_function_decl()
+            stmt.is_comptime = True
         elif token_type == 'FUNCTION':
             stmt = self.parse_function_decl()
+        elif token_type == 'ASYNC':
+            self.consume('ASYNC')
+            stmt = self.parse_function_decl()
+            stmt.is_async = True
         elif token_type == 'STRUCT':
             stmt = self.parse_struct_decl()
         elif token_type == 'ENUM':
@@ -447,6 +510,10 @@ class Parser:
             stmt = self.parse_for()
         elif token_type == 'DEFER':
             stmt = self.parse_defer()
+        elif token_type == 'AT':
+            stmt = self.parse_annotated()
+        elif token_type in ('AWAIT', 'SPAWN'):
+            stmt = self.parse_expression()
         else:
             raise SyntaxError(
                 f"Unexpected token {token_type} at line {self.current_token.line}"
@@ -462,6 +529,40 @@ class Parser:
         
         return stmt
 
+    def parse_annotation(self) -> Tuple[str, Optional[ASTNode]]:
+        """Parse: @unchecked or @arena(expr); returns (name, argument)"""
+        at_tok = self.consume('AT')
+        name_tok = self.consume('IDENTIFIER')
+        if name_tok.value == 'arena':
+            self.consume('LPAREN')
+            arena = self.parse_expression()
+            self.consume('RPAREN')
+            return name_tok.value, arena
+        if name_tok.value != 'unchecked':
+            raise SyntaxError(f"Unknown annotation '@{name_tok.value}' at line {at_tok.line}")
+        return name_tok.value, None
+
+    def parse_annotated(self) -> ASTNode:
+        """Parse: @unchecked Function ..., @unchecked { ... } or @arena(expr) { ... }"""
+        name, arena = self.parse_annotation()
+        self.skip_newlines()
+        if name == 'arena':
+            if not self.current_token or self.current_token.type != 'LBRACE':
+                raise SyntaxError(f"Expected block after @arena at line {self.current_token.line}")
+            stmt = self.parse_block()
+            stmt.arena = arena
+        elif self.current_token and self.current_token.type == 'FUNCTION':
+            stmt = self.parse_function_decl()
+            stmt.body.unchecked = True
+        elif self.current_token and self.current_token.type == 'LBRACE':
+            stmt = self.parse_block()
+            stmt.unchecked = True
+        else:
+            raise SyntaxError(
+                f"Expected function or block after @unchecked at line {self.current_token.line}"
+            )
+        return stmt
+
     def parse_function_decl(self) -> FunctionDef:
         """Parse: Function name(params) [-> type] { ... }"""
         fn_token = self.consume('FUNCTION')
@@ -562,6 +663,14 @@ class Parser:
                 # Parse a method
                 method = self.parse_method_decl()
                 methods.append(method)
+            elif self.current_token.type == 'AT':
+                at_line = self.current_token.line
+                if self.parse_annotation()[0] != 'unchecked':
+                    raise SyntaxError(f"Only @unchecked applies to methods (line {at_line})")
+                self.skip_newlines()
+                method = self.parse_method_decl()
+                method.body.unchecked = True
+                methods.append(method)
             else:
                 raise SyntaxError(
                     f"Expected field or method declaration in struct at line {self.current_token.line}"
@@ -692,11 +801,23 @@ class Parser:
             self.advance()
             return tok.value
         if tok.type == 'IDENTIFIER':
-            # Struct type or enum type
+            # Struct type or enum type, possibly generic: Map<string, int>
             self.advance()
-            return tok.value
+            return self.parse_type_arguments(tok.value)
         raise SyntaxError(f"Expected type, got {tok.type}")
 
+    def parse_type_arguments(self, base: str) -> str:
+        """Parse optional <T, ...> after a type name into "Base<T, ...>"."""
+        if not self.current_token or self.current_token.type != 'LT':
+            return base
+        self.consume('LT')
+        args = [self.parse_type_annotation()]
+        while self.current_token and self.current_token.type == 'COMMA':
+            self.consume('COMMA')
+            args.append(self.parse_type_annotation())
+        self.consume('GT')
+        return base + '<' + ', '.join(args) + '>'
+
     def parse_return(self) -> ReturnStmt:
         """Parse: return [expr]"""
         tok = self.consume('RETURN')
@@ -706,9 +827,10 @@ class Parser:
             value = None
         return ReturnStmt(value=value, line=tok.line, column=tok.column)
     
-    def parse_var_decl(self) -> ASTNode:
-        """Parse: var [type] name [= value] OR var x, y = tuple_expr"""
-        var_tok = self.consume('VAR')
+    def parse_var_decl(self, keyword: str = 'VAR') -> ASTNode:
+        """Parse: var [type] name [= value] OR var x, y = tuple_expr;
+        const [type] name = value with keyword 'CONST'"""
+        var_tok = self.consume(keyword)
 
         # Check for tuple unpacking: var x, y = ... or var int x, int y = ...
         # Look ahead to detect comma pattern
@@ -733,6 +855,11 @@ class Parser:
             if next_tok and next_tok.type == 'IDENTIFIER':
                 var_type = self.current_token.value
                 self.advance()
+            elif next_tok and next_tok.type == 'LT':
+                # Generic type: var Map<string, int> counts = Map()
+                var_type = self.current_token.value
+                self.advance()
+                var_type = self.parse_type_arguments(var_type)
             elif next_tok and next_tok.type == 'LBRACKET':
                 var_type = self.current_token.value
                 self.advance()
@@ -746,7 +873,7 @@ class Parser:
         first_name = self.consume('IDENTIFIER')
         
         # Check if this is tuple unpacking (comma after first name)
-        if self.current_token and self.current_token.type == 'COMMA':
+        if self.current_token and self.current_token.type == 'COMMA' and keyword == 'VAR':
             # This is tuple unpacking: var x, y = ...
             names = [first_name.value]
             types = [var_type]
@@ -782,9 +909,12 @@ class Parser:
         if self.current_token and self.current_token.type == 'ASSIGN':
             self.consume('ASSIGN')
             value = self.parse_expression()
+        elif keyword == 'CONST':
+            raise SyntaxError(f"const '{first_name.value}' needs a value at line {var_tok.line}")
 
-        return VarDecl(name=first_name.value, var_type=var_type, value=value, is_mutable=True,
-                      line=first_name.line, column=first_name.column)
+        is_const = keyword == 'CONST'
+        return VarDecl(name=first_name.value, var_type=var_type, value=value, is_mutable=not is_const,
+                      is_const=is_const, line=first_name.line, column=first_name.column)
 
     def parse_let_decl(self) -> VarDecl:
         """Parse: let [mut] name [: type] [= value] (immutable by default)"""
@@ -1099,6 +1229,22 @@ class Parser:
             operand = self.parse_unary()
             return Dereference(operand=operand, line=tok.line, column=tok.column)
         
+        # Await operator: await task
+        if self.current_token and self.current_token.type == 'AWAIT':
+            tok = self.current_token
+            self.advance()
+            operand = self.parse_unary()
+            return AwaitExpr(operand=operand, line=tok.line, column=tok.column)
+
+        # Spawn operator: spawn f(args)
+        if self.current_token and self.current_token.type == 'SPAWN':
+            tok = self.current_token
+            self.advance()
+            operand = self.parse_unary()
+            if not isinstance(operand, FunctionCall):
+                raise SyntaxError(f"Expected a function call after 'spawn' at line {tok.line}")
+            return SpawnExpr(operand=operand, line=tok.line, column=tok.column)
+        
         return self.parse_primary()
     
     def parse_primary(self) -> ASTNode:
@@ -0,0 +1,302 @@
+"""
+VYL Register Allocator - Linear-scan allocation of locals to machine registers
+
+The code generator treats every scalar local and parameter of a function as a
+virtual register. This module linearizes the function body in evaluation
+order, builds a live interval for each virtual register and assigns physical
+registers with the classic linear-scan algorithm (Poletto & Sarkar). Virtual
+registers that do not fit are spilled to their ``-N(%rbp)`` stack slot.
+
+Liveness is conservative rather than exact:
+    - an interval spans the first to the last reference of a variable
+    - any variable touched inside a loop is live for the whole loop
+    - variables referenced by a ``defer`` body are live until function exit
+    - variables whose address is taken (``&x``) are never allocated
+
+Intervals that never overlap a call may live in caller-saved registers
+(``%r8``-``%r11``, ``%rsi``, ``%rdi``); all others use callee-saved registers
+so they survive calls into libc and the VYL runtime.
+"""
+
+from dataclasses import dataclass, field, fields
+from typing import Callable, Dict, List, Optional, Set, Tuple
+
+try:
+    from .parser import (
+        ASTNode,
+        AddressOf,
+        AwaitExpr,
+        SpawnExpr,
+        Assignment,
+        BinaryExpr,
+        Block,
+        DeferStmt,
+        ForStmt,
+        FunctionCall,
+        Identifier,
+        InterpString,
+        MethodCall,
+        NewExpr,
+        ArrayLiteral,
+        ArrayClone,
+        TupleLiteral,
+        TupleUnpack,
+        SelfExpr,
+        VarDecl,
+        WhileStmt,
+    )
+except ImportError:  # pragma: no cover - fallback for direct execution
+    from parser import (
+        ASTNode,
+        AddressOf,
+        AwaitExpr,
+        SpawnExpr,
+        Assignment,
+        BinaryExpr,
+        Block,
+        DeferStmt,
+        ForStmt,
+        FunctionCall,
+        Identifier,
+        InterpString,
+        MethodCall,
+        NewExpr,
+        ArrayLiteral,
+        ArrayClone,
+        TupleLiteral,
+        TupleUnpack,
+        SelfExpr,
+        VarDecl,
+        WhileStmt,
+    )
+
+
+# Callee-saved registers survive calls; the prologue saves the ones we use.
+CALLEE_SAVED_REGS = ["%rbx", "%r12", "%r13", "%r14", "%r15"]
+# Caller-saved registers the expression emitter only touches while setting up
+# a call; intervals that overlap no call may live here without being saved.
+CALLER_SAVED_REGS = ["%r8", "%r9", "%r10", "%r11", "%rsi", "%rdi"]
+
+
+@dataclass
+class LiveInterval:
+    """Live range of one virtual register (a local or parameter)."""
+    name: str
+    start: int
+    end: int
+    weight: float = 0.0
+    crosses_call: bool = False
+    reg: Optional[str] = None
+    refs: List[int] = field(default_factory=list)
+
+
+class LivenessBuilder:
+    """Walks a function body in evaluation order and records references."""
+
+    def __init__(self, candidates: Set[str], is_call: Callable[[ASTNode], bool]):
+        self.candidates = candidates
+        self.is_call = is_call
+        self.position = 0
+        self.refs: Dict[str, List[Tuple[int, int]]] = {}  # name -> [(pos, loop depth)]
+        self.loops: List[Tuple[int, int]] = []
+        self.calls: List[Tuple[int, int]] = []
+        self.addressed: Set[str] = set()
+        self.deferred: Set[str] = set()
+        self.defer_calls = False
+        self.loop_depth = 0
+        self._in_defer = False
+
+    def tick(self) -> int:
+        self.position += 1
+        return self.position
+
+    def ref(self, name: str):
+        if name not in self.candidates:
+            return
+        self.refs.setdefault(name, []).append((self.tick(), self.loop_depth))
+        if self._in_defer:
+            self.deferred.add(name)
+
+    def visit(self, node):
+        if node is None:
+            return
+        if isinstance(node, (list, tuple)):
+            for item in node:
+                self.visit(item)
+            return
+        if not isinstance(node, ASTNode):
+            return
+
+        if self.is_call(node):
+            if self._in_defer:
+                self.defer_calls = True
+            start = self.tick()
+            self._visit_node(node)
+            self.calls.append((start, self.tick()))
+            return
+        self._visit_node(node)
+
+    def _visit_node(self, node):
+        if isinstance(node, Identifier):
+            self.ref(node.name)
+        elif isinstance(node, SelfExpr):
+            self.ref("self")
+        elif isinstance(node, AddressOf):
+            if isinstance(node.operand, Identifier):
+                self.addressed.add(node.operand.name)
+            self.visit(node.operand)
+        elif isinstance(node, VarDecl):
+            self.visit(node.value)
+            self.ref(node.name)
+        elif isinstance(node, Assignment):
+            self.visit(node.value)
+            if node.target is not None:
+                self.visit(node.target)
+            else:
+                self.ref(node.name)
+        elif isinstance(node, TupleUnpack):
+            self.visit(node.value)
+            for name in node.names:
+                self.ref(name)
+        elif isinstance(node, WhileStmt):
+            self._visit_loop(lambda: (self.visit(node.condition), self.visit(node.body)))
+        elif isinstance(node, ForStmt):
+            self.visit(node.start)
+            self.ref(node.var_name)
+            self._visit_loop(lambda: (
+                self.ref(node.var_name),
+                self.visit(node.end),
+                self.visit(node.body),
+                self.ref(node.var_name),
+            ))
+        elif isinstance(node, DeferStmt):
+            outer = self._in_defer
+            self._in_defer = True
+            self.visit(node.body)
+            self._in_defer = outer
+        elif isinstance(node, InterpString):
+            for expr in parse_interp_parts(node):
+                self.visit(expr)
+        else:
+            for fld in fields(node):
+                if fld.name in ("line", "column"):
+                    continue
+                self.visit(getattr(node, fld.name))
+
+    def _visit_loop(self, body: Callable[[], object]):
+        start = self.tick()
+        self.loop_depth += 1
+        body()
+        self.loop_depth -= 1
+        self.loops.append((start, self.tick()))
+
+
+def parse_interp_parts(node: InterpString) -> List[ASTNode]:
+    """Parse the expression parts of an interpolated string."""
+    try:
+        from .lexer import tokenize
+        from .parser import Parser
+    except ImportError:
+        from lexer import tokenize
+        from parser import Parser
+    exprs = []
+    for is_expr, value in node.parts:
+        if is_expr:
+            exprs.append(Parser(tokenize(value)).parse_expression())
+    return exprs
+
+
+def build_intervals(params: List[str], body: Optional[Block], candidates: Set[str],
+                    is_call: Callable[[ASTNode], bool],
+                    entry_calls: bool = False) -> Tuple[List[LiveInterval], LivenessBuilder]:
+    """Compute conservative live intervals for every candidate variable."""
+    builder = LivenessBuilder(candidates, is_call)
+    for name in params:
+        builder.ref(name)
+    if entry_calls:
+        # Struct locals are allocated at function entry, after params are homed
+        start = builder.tick()
+        builder.calls.append((start, builder.tick()))
+    if body:
+        builder.visit(body.statements)
+    function_end = builder.tick()
+
+    intervals: List[LiveInterval] = []
+    for name, refs in builder.refs.items():
+        if name in builder.addressed:
+            continue
+        positions = [pos for pos, _ in refs]
+        start, end = min(positions), max(positions)
+        for loop_start, loop_end in builder.loops:
+            if any(loop_start < pos < loop_end for pos in positions):
+                start = min(start, loop_start)
+                end = max(end, loop_end)
+        if name in builder.deferred:
+            end = function_end
+        weight = sum(10.0 ** min(depth, 6) for _, depth in refs)
+        crosses = builder.defer_calls or any(start < c_end and end > c_start for c_start, c_end in builder.calls)
+        intervals.append(LiveInterval(name, start, end, weight, crosses, refs=positions))
+    return intervals, builder
+
+
+def linear_scan(intervals: List[LiveInterval], callee_saved: List[str],
+                caller_saved: List[str]) -> Dict[str, str]:
+    """Assign registers to intervals; spill the cheapest interval under pressure."""
+    assignment: Dict[str, str] = {}
+    active: List[LiveInterval] = []
+    free_callee = list(callee_saved)
+    free_caller = list(caller_saved)
+
+    def release(iv: LiveInterval):
+        if iv.reg in callee_saved:
+            free_callee.append(iv.reg)
+        else:
+            free_caller.append(iv.reg)
+
+    for current in sorted(intervals, key=lambda iv: (iv.start, iv.end)):
+        for iv in list(active):
+            if iv.end < current.start:
+                active.remove(iv)
+                release(iv)
+
+        reg = None
+        if not current.crosses_call and free_caller:
+            reg = free_caller.pop(0)
+        elif free_callee:
+            reg = free_callee.pop(0)
+
+        if reg is None:
+            # Spill whichever live interval is cheapest and compatible
+            compatible = [iv for iv in active if iv.reg in callee_saved or not current.crosses_call]
+            victim = min(compatible, key=lambda iv: iv.weight, default=None)
+            if victim is None or victim.weight >= current.weight:
+                continue
+            active.remove(victim)
+            reg = victim.reg
+            victim.reg = None
+            del assignment[victim.name]
+
+        current.reg = reg
+        assignment[current.name] = reg
+        active.append(current)
+    return assignment
+
+
+def allocate_registers(params: List[str], body: Optional[Block], candidates: Set[str],
+                       is_call: Callable[[ASTNode], bool],
+                       entry_calls: bool = False) -> Dict[str, str]:
+    """Return a mapping of variable name -> physical register for one function."""
+    intervals, _ = build_intervals(params, body, candidates, is_call, entry_calls)
+    return linear_scan(intervals, CALLEE_SAVED_REGS, CALLER_SAVED_REGS)
+
+
+def is_call_node(node: ASTNode, is_stringish: Callable[[ASTNode], bool]) -> bool:
+    """True when emitting ``node`` may clobber caller-saved registers."""
+    if isinstance(node, (FunctionCall, MethodCall, NewExpr, ArrayLiteral, ArrayClone, TupleLiteral,
+                         InterpString, AwaitExpr, SpawnExpr)):
+        return True
+    if isinstance(node, Block) and node.arena is not None:
+        return True  # entering/leaving the scope calls into the runtime
+    if isinstance(node, BinaryExpr) and node.operator in ("+", "==", "!="):
+        return is_stringish(node.left) or is_stringish(node.right)
+    return False
@@ -31,6 +31,8 @@ try:
         SelfExpr,
         AddressOf,
         Dereference,
+        AwaitExpr,
+        SpawnExpr,
         NullLiteral,
         TupleLiteral,
         TupleUnpack,
@@ -67,6 +69,8 @@ except ImportError:  # pragma: no cover - fallback for direct execution
         SelfExpr,
         AddressOf,
         Dereference,
+        AwaitExpr,
+        SpawnExpr,
         NullLiteral,
         TupleLiteral,
         TupleUnpack,
@@ -95,6 +99,10 @@ BUILTIN_FUNCTIONS: Set[str] = {
     "Exit",
     "Sleep",
     "Now",
+    "NowNs",
+    "Bench",
+    "BenchNext",
+    "BenchReport",
     "RandInt",
     "Remove",
     "TcpConnect",
@@ -102,15 +110,33 @@ BUILTIN_FUNCTIONS: Set[str] = {
     "TcpRecv",
     "TcpClose",
     "TcpResolve",
+    "TcpListen",
+    "TcpAccept",
+    "Yield",
+    "Chan",
+    "ChanSend",
+    "ChanRecv",
+    "ChanClose",
+    "ChanLen",
+    "AtomicAdd",
+    "AtomicLoad",
+    "AtomicStore",
+    "AtomicCas",
     "TlsConnect",
     "TlsSend",
     "TlsRecv",
     "TlsClose",
     "HttpGet",
     "HttpDownload",
+    "HttpOpen",
+    "HttpStatus",
+    "HttpRead",
+    "HttpClose",
     "Array",
     "Length",
     "Sqrt",
+    "ToDec",
+    "ToInt",
     "MkdirP",
     "RemoveAll",
     "CopyFile",
@@ -120,6 +146,43 @@ BUILTIN_FUNCTIONS: Set[str] = {
     "CloseDir",
     "Alloc",
     "Free",
+    "ArenaNew",
+    "ArenaAlloc",
+    "ArenaReset",
+    "ArenaFree",
+    "MapFile",
+    "UnmapFile",
+    "LineReader",
+    "ReadLine",
+    "ReadChunk",
+    "ReaderEof",
+    "CloseReader",
+    "Flush",
+    "BufferedWriter",
+    "BufWrite",
+    "BufWriteInt",
+    "CloseWriter",
+    "StringBuilder",
+    "Append",
+    "AppendInt",
+    "Reserve",
+    "Build",
+    "Vec",
+    "Push",
+    "Pop",
+    "Map",
+    "MapSet",
+    "MapGet",
+    "MapHas",
+    "MapDelete",
+    "MapLen",
+    "MapKeys",
+    "ArraySum",
+    "ArrayMin",
+    "ArrayMax",
+    "ArrayFind",
+    "ArrayFill",
+    "ArrayCopy",
     "StrConcat",
     "StrLen",
     "StrFind",
@@ -242,7 +305,7 @@ def _resolve_statement(stmt, globals_table: Dict[str, tuple[str, bool]], locals_
         _resolve_expression(stmt.value, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
     elif isinstance(stmt, FunctionCall):
         _resolve_expression(stmt, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
-    elif isinstance(stmt, MethodCall):
+    elif isinstance(stmt, (MethodCall, AwaitExpr, SpawnExpr)):
         _resolve_expression(stmt, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
     elif isinstance(stmt, IfStmt):
         _resolve_expression(stmt.condition, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
@@ -262,6 +325,8 @@ def _resolve_statement(stmt, globals_table: Dict[str, tuple[str, bool]], locals_
         # Defer body is resolved in the current scope
         _resolve_statement(stmt.body, globals_table, dict(locals_table), functions, structs, enums, in_function, in_method, current_struct)
     elif isinstance(stmt, Block):
+        if stmt.arena is not None:
+            _resolve_expression(stmt.arena, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
         scope_locals = dict(locals_table)
         for inner in stmt.statements:
             _resolve_statement(inner, globals_table, scope_locals, functions, structs, enums, in_function, in_method, current_struct)
@@ -298,7 +363,7 @@ def _resolve_expression(expr, globals_table: Dict[str, tuple[str, bool]], locals
         _resolve_expression(expr.operand, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
     elif isinstance(expr, AddressOf):
         _resolve_expression(expr.operand, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
-    elif isinstance(expr, Dereference):
+    elif isinstance(expr, (Dereference, AwaitExpr, SpawnExpr)):
         _resolve_expression(expr.operand, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
     elif isinstance(expr, NullLiteral):
         return
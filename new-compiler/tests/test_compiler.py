@@ -1,4 +1,10 @@
+import contextlib
 import importlib.util
+import io
+import os
+import shutil
+import socket
+import subprocess
 import sys
 import tempfile
 from pathlib import Path
@@ -145,6 +151,1133 @@ class CompilerPipelineTests(unittest.TestCase):
             self.assertTrue(out_path.exists())
             self.assertIn("z", out_path.read_text())
 
+    def test_modules_are_cached_by_content_hash(self):
+        with tempfile.TemporaryDirectory() as tmpdir:
+            base_path = Path(tmpdir) / "main.vyl"
+            lib_path = Path(tmpdir) / "lib.vyl"
+            util_path = Path(tmpdir) / "util.vyl"
+            cache_dir = Path(tmpdir) / "cache"
+            util_path.write_text("Function One() -> int {\n  return 1;\n}\n")
+            lib_path.write_text('include "util.vyl"\nFunction Two() -> int {\n  return One() + 1;\n}\n')
+            base_path.write_text(
+                'include "util.vyl"\n'
+                'include "lib.vyl"\n'
+                "Main() {\n"
+                "  Print(Two());\n"
+                "}\n"
+            )
+            units = self.main_mod.load_modules(base_path.read_text(), Path(tmpdir), base_path)
+            self.assertEqual([unit.name for unit in units], ["util.vyl", "lib.vyl", str(base_path)])
+            self.assertEqual(units[1].text.splitlines()[0], "")  # directives keep their line
+
+            def build():
+                out_path = Path(tmpdir) / "program.s"
+                success = self.main_mod.compile_vyl(
+                    base_path.read_text(),
+                    str(out_path),
+                    generate_assembly_only=True,
+                    source_path=str(base_path),
+                    cache_dir=str(cache_dir),
+                )
+                self.assertTrue(success)
+                return out_path.read_text()
+
+            first = build()
+            self.assertEqual(len(list((cache_dir / "ast").iterdir())), 3)
+            self.assertEqual(len(list((cache_dir / "asm").iterdir())), 1)
+            self.assertEqual(build(), first)
+            self.assertEqual(len(list((cache_dir / "asm").iterdir())), 1)
+
+            util_path.write_text("Function One() -> int {\n  return 5;\n}\n")
+            self.assertNotEqual(build(), first)
+            self.assertEqual(len(list((cache_dir / "ast").iterdir())), 4)
+            self.assertEqual(len(list((cache_dir / "asm").iterdir())), 2)
+
+    def test_modules_generate_separate_objects_and_runtime(self):
+        with tempfile.TemporaryDirectory() as tmpdir:
+            base_path = Path(tmpdir) / "main.vyl"
+            (Path(tmpdir) / "lib.vyl").write_text(
+                "var int calls = 0;\n"
+                "async Function Twice(n: int) -> int {\n"
+                "  return n * 2;\n"
+                "}\n"
+            )
+            base_path.write_text(
+                'include "lib.vyl"\n'
+                "Main() {\n"
+                "  calls = calls + 1;\n"
+                "  Print(await Twice(calls));\n"
+                "}\n"
+            )
+            units = self.main_mod.load_modules(base_path.read_text(), Path(tmpdir), base_path)
+            ast, _ = self.main_mod.parse_modules(units, None)
+            ast = self.main_mod.run_passes(ast, 1, 0)
+            lib = self.main_mod.generate_assembly(ast, 1, 0, 1)
+            root = self.main_mod.generate_assembly(ast, 1, 1, 1)
+
+            self.assertIn(".globl Twice", lib)
+            self.assertIn(".globl __async_Twice", lib)
+            self.assertNotIn("\nmain:", lib)
+            self.assertNotIn("\ncalls:", lib)  # defined once, by the root unit
+            self.assertIn(".globl calls", root)
+            self.assertIn("call __async_Twice", root)
+            self.assertIn("\nmain:", root)
+            self.assertNotIn("\nvyl_alloc:", root)
+
+            runtime = self.main_mod.generate_runtime_assembly()
+            self.assertIn(".globl vyl_alloc", runtime)
+            self.assertIn(".globl vyl_task_spawn", runtime)
+            self.assertNotIn("\nMain:", runtime)
+
+    @unittest.skipUnless(shutil.which("gcc"), "gcc not installed")
+    def test_split_build_links_and_runs(self):
+        with tempfile.TemporaryDirectory() as tmpdir:
+            data_path = Path(tmpdir) / "data.txt"
+            data_path.write_text("hello")
+            base_path = Path(tmpdir) / "main.vyl"
+            (Path(tmpdir) / "lib.vyl").write_text(
+                "Function Size(path: string) -> int {\n"
+                "  return ReadFilesize(path);\n"
+                "}\n"
+            )
+            source = (
+                'include "lib.vyl"\n'
+                "Main() {\n"
+                f'  Print(Size("{data_path}"));\n'
+                "}\n"
+            )
+            base_path.write_text(source)
+            exe_path = Path(tmpdir) / "program"
+            with contextlib.redirect_stdout(io.StringIO()):
+                success = self.main_mod.compile_vyl(source, str(exe_path), source_path=str(base_path),
+                                                    cache_dir=str(Path(tmpdir) / "cache"))
+            self.assertTrue(success)
+            result = subprocess.run([str(exe_path)], capture_output=True, text=True, timeout=30)
+            self.assertEqual(result.returncode, 0)
+            self.assertEqual(result.stdout, "5\n")
+            if shutil.which("readelf"):
+                headers = subprocess.run(["readelf", "-lW", str(exe_path)], capture_output=True, text=True).stdout
+                stack = next(line for line in headers.splitlines() if "GNU_STACK" in line)
+                self.assertNotIn("RWE", stack)
+
+    def test_time_passes_and_stats_report_per_stage_and_function(self):
+        source = (
+            "Function Fill(n: int) -> array {\n"
+            "  var array a = Array(n);\n"
+            "  return a;\n"
+            "}\n"
+            "Main() {\n"
+            "  Print(Length(Fill(3)));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            output = io.StringIO()
+            with contextlib.redirect_stdout(output):
+                success = self.main_mod.compile_vyl(
+                    source, str(out_path), generate_assembly_only=True,
+                    time_passes=True, show_stats=True,
+                )
+            self.assertTrue(success)
+            report = output.getvalue()
+            for stage in ("tokenize", "parse", "type check", "optimize", "codegen"):
+                self.assertRegex(report, rf"\n  {stage} +\d+\.\d")
+            self.assertRegex(report, r"Instructions emitted: \d+ in 2 function\(s\)")
+            self.assertRegex(report, r"\n    Fill +\d+")
+            self.assertIn("vyl_alloc call sites: 1", report)
+
+    def test_bench_builtins_drive_the_harness_runtime(self):
+        source = (
+            "Main() {\n"
+            "  var sink = 0;\n"
+            "  var b = Bench(\"loop\", 10);\n"
+            "  while (BenchNext(b)) {\n"
+            "    for i in 1..10 {\n"
+            "      sink = sink + i;\n"
+            "    }\n"
+            "  }\n"
+            "  BenchReport(b);\n"
+            "  Print(NowNs() > 0);\n"
+            "  Print(sink);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            asm = out_path.read_text()
+        for call in ("call vyl_bench_new", "call vyl_bench_next", "call vyl_bench_report", "call vyl_clock_ns"):
+            self.assertIn(call, asm)
+        self.assertIn("VYL_BENCH_SAMPLES", asm)
+        self.assertIn("call qsort", asm)
+
+        bench = sys.modules[self.main_mod.bench_main.__module__]
+        record = bench.summarize("loop", [50, 10, 40, 20, 30], ops=10)
+        self.assertEqual((record["median_ns"], record["p99_ns"], record["min_ns"]), (30, 50, 10))
+        results = [{"bench": "loop", "vyl": record, "ratio": 1.6}]
+        baseline = {"results": [{"bench": "loop", "vyl": dict(record, median_ns=25)}]}
+        self.assertEqual(bench.compare(results, 100, None, 10), [])
+        self.assertEqual(len(bench.compare(results, 50, baseline, 10)), 2)
+
+    def test_profile_alloc_tags_call_sites_with_source_lines(self):
+        source = (
+            "Struct Point {\n"
+            "  var int x;\n"
+            "}\n"
+            "Function Make(x: int) -> Point {\n"
+            "  return new Point{x: x};\n"
+            "}\n"
+            "Main() {\n"
+            "  var s = GetArg(0);\n"
+            "  s = s + \"!\";\n"
+            "  var Point p = Make(1);\n"
+            "  Print(p.x);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            self.assertNotIn("vyl_prof", out_path.read_text())
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True, profile_alloc=True)
+            self.assertTrue(success)
+            asm = out_path.read_text()
+        self.assertRegex(asm, r"movq \$(\.Lalloc_site\d+), %fs:vyl_prof_site@tpoff\n\s*call vyl_alloc")
+        self.assertIn('"Make:5 NewExpr (vyl_alloc)"', asm)
+        self.assertRegex(asm, r'"Main:9 BinaryExpr \(vyl_\w+\)"')
+        self.assertIn(".section vyl_alloc_sites", asm)
+        self.assertIn("call vyl_prof_alloc", asm)      # vyl_alloc counts every request
+        self.assertIn("call vyl_prof_gc_done", asm)    # vyl_collect times its pause
+        main_stub = asm[asm.index("\nmain:"):]
+        self.assertLess(main_stub.index("call vyl_flush_all"), main_stub.index("call vyl_prof_dump"))
+
+    def test_frames_carry_cfi_line_entries_and_perf_map(self):
+        source = (
+            "Function Work(n: int) -> int {\n"
+            "  var s = 0;\n"
+            "  while (s < n) {\n"
+            "    s = s + 1;\n"
+            "  }\n"
+            "  return s;\n"
+            "}\n"
+            "Main() {\n"
+            "  Sleep(1);\n"
+            "  Print(Work(3));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            src_path = Path(tmpdir) / "work.vyl"
+            src_path.write_text(source)
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True,
+                                                source_path=str(src_path))
+            self.assertTrue(success)
+            asm = out_path.read_text()
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True,
+                                                source_path=str(src_path), perf_map=True)
+            self.assertTrue(success)
+            mapped = out_path.read_text()
+        self.assertIn(f'.file 1 "{src_path.resolve()}"', asm)
+        work = asm.split("\nWork:", 1)[1].split(".cfi_endproc", 1)[0]
+        self.assertRegex(work, r"^\s*\.cfi_startproc\npush %rbp\n\.cfi_def_cfa_offset 16\n\.cfi_offset %rbp, -16\n"
+                               r"movq %rsp, %rbp\n\.cfi_def_cfa_register %rbp\n")
+        for line in (2, 3, 4, 6):
+            self.assertRegex(work, rf"\.loc 1 {line} \d+\n")
+        self.assertIn(".cfi_def_cfa %rsp, 8\nret", work)
+        self.assertNotRegex(asm, r"\n(while|endwhile|ret)\d+:")  # loop labels are not symbols
+        # Sleep is a call, not a second frame inside Main's
+        main_body = asm.split("\nMain:", 1)[1].split(".cfi_endproc", 1)[0]
+        self.assertEqual(main_body.count("movq %rsp, %rbp"), 1)
+        self.assertIn("call vyl_sleep_ms", main_body)
+        self.assertEqual(asm.count(".cfi_startproc"), asm.count(".cfi_endproc"))
+
+        self.assertNotIn("call vyl_perf_map_write", asm)
+        self.assertIn(".section vyl_perf_map", mapped)
+        self.assertIn(".quad Work, .LWork_end - Work, .Lperf_name_Work", mapped)
+        self.assertIn('.Lperf_name_Main: .asciz "Main"', mapped)
+        main_stub = mapped[mapped.index("\nmain:"):]
+        self.assertLess(main_stub.index("call vyl_perf_map_write"), main_stub.index("call Main"))
+
+    def test_const_and_comptime_fold_into_rodata(self):
+        source = (
+            "Function Squares(n: int) -> array {\n"
+            "  var a = Array(n);\n"
+            "  for i in 0..n - 1 {\n"
+            "    a[i] = i * i;\n"
+            "  }\n"
+            "  return a;\n"
+            "}\n"
+            "comptime Function Fib(n: int) -> int {\n"
+            "  if (n < 2) {\n"
+            "    return n;\n"
+            "  }\n"
+            "  return Fib(n - 1) + Fib(n - 2);\n"
+            "}\n"
+            "const int[] SQ = Squares(16);\n"
+            "const string NAME = \"vyl\" + 2;\n"
+            "Main() {\n"
+            "  Print(SQ[15]);\n"
+            "  Print(Fib(30));\n"
+            "  Print(NAME);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            rodata = assembly.split("\nSQ:", 1)[1]
+            self.assertRegex(rodata, r"\.quad 16, 16\n\.Lconst\d+: \.quad 0, 1, 4, 9, 16, 25, 36, 49, 64, 81, "
+                                     r"100, 121, 144, 169, 196, 225\n")
+            self.assertRegex(rodata, r'\.quad 4, 4\n\.Lconst\d+: \.asciz "vyl2"')
+            self.assertIn(".section .rodata\nSQ:", assembly)
+            main_body = assembly.split("\nMain:", 1)[1].split("\nmain:", 1)[0]
+            self.assertIn("$832040", main_body)
+            self.assertNotIn("call Fib", main_body)
+            self.assertNotIn("call Squares", main_body)
+
+        # consts are immutable, and must be computable when compiled
+        for bad in (
+            "const int[] T = [1, 2];\nMain() {\n  T[0] = 5;\n}\n",
+            "const int N = Clock();\nMain() {\n  Print(N);\n}\n",
+            "comptime Function F(i: int) -> int {\n  var a = Array(2);\n  return a[i];\n}\n"
+            "Main() {\n  Print(F(5));\n}\n",
+        ):
+            with tempfile.TemporaryDirectory() as tmpdir:
+                out_path = Path(tmpdir) / "program.s"
+                self.assertFalse(self.main_mod.compile_vyl(bad, str(out_path), generate_assembly_only=True))
+
+        # including through Pop and callees the const is passed to
+        for bad, message in (
+            ("const T = [1, 2];\nMain() {\n  var s = Pop(T);\n}\n", "Pop would modify const 'T'"),
+            ("Function w(a: array) -> int {\n  a[0] = 42;\n  return a[0];\n}\n"
+             "Function v(a: array) -> int {\n  return w(a);\n}\n"
+             "const T = Array(2);\nMain() {\n  Print(v(T));\n}\n", "'v' would modify const 'T'"),
+        ):
+            with tempfile.TemporaryDirectory() as tmpdir:
+                out_path = Path(tmpdir) / "program.s"
+                output = io.StringIO()
+                with contextlib.redirect_stdout(output):
+                    self.assertFalse(self.main_mod.compile_vyl(bad, str(out_path), generate_assembly_only=True))
+                self.assertIn(message, output.getvalue())
+
+    @unittest.skipUnless(shutil.which("gcc"), "gcc not installed")
+    def test_const_arrays_are_copied_where_they_escape(self):
+        source = (
+            "Function Pair(x: int) -> array {\n"
+            "  var a = Array(2);\n"
+            "  a[0] = x;\n"
+            "  a[1] = x + 1;\n"
+            "  return a;\n"
+            "}\n"
+            "const T = Pair(1);\n"
+            "const U = Pair(3);\n"
+            "const V = U[0] * 10;\n"
+            "Function first(a: array) -> int {\n"
+            "  return a[0] + Len(a);\n"
+            "}\n"
+            "Function keep(a: array) -> array {\n"
+            "  return a;\n"
+            "}\n"
+            "comptime Function FirstOf(i: int) -> int {\n"
+            "  return U[i];\n"
+            "}\n"
+            "Main() {\n"
+            "  var b = U;\n"
+            "  b[0] = 5;\n"
+            "  var c = keep(U);\n"
+            "  c[1] = 7;\n"
+            "  Print(first(T));\n"
+            "  Print(U[0] + U[1]);\n"
+            "  Print(V + FirstOf(0));\n"
+            "  Print(b[0] + c[1]);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            asm_path = Path(tmpdir) / "program.s"
+            with contextlib.redirect_stdout(io.StringIO()):
+                self.assertTrue(self.main_mod.compile_vyl(source, str(asm_path), generate_assembly_only=True))
+            assembly = asm_path.read_text()
+            sections = {}
+            section = None
+            for line in assembly.splitlines():
+                if line.startswith(".section"):
+                    section = line.split()[1]
+                elif line.startswith(".Lconst"):
+                    sections[line.split(":")[1].strip()] = section
+            # Both stay read-only; b and c get copies of U
+            self.assertEqual(sections[".quad 1, 2"], ".rodata")
+            self.assertEqual(sections[".quad 3, 4"], ".rodata")
+            main_body = assembly.split("\nMain:", 1)[1].split("\nmain:", 1)[0]
+            self.assertEqual(main_body.count("call vyl_array_clone"), 2)
+
+            exe_path = Path(tmpdir) / "program"
+            with contextlib.redirect_stdout(io.StringIO()):
+                self.assertTrue(self.main_mod.compile_vyl(source, str(exe_path)))
+            result = subprocess.run([str(exe_path)], capture_output=True, text=True, timeout=30)
+            # U and what was folded from it at compile time agree
+            self.assertEqual((result.returncode, result.stdout), (0, "3\n7\n33\n12\n"))
+
+    def test_hot_loop_locals_live_in_registers(self):
+        source = (
+            "Function fib(n: int) -> int {\n"
+            "  var a = 0;\n"
+            "  var b = 1;\n"
+            "  var i = 0;\n"
+            "  while (i < n) {\n"
+            "    var t = a + b;\n"
+            "    a = b;\n"
+            "    b = t;\n"
+            "    i = i + 1;\n"
+            "  }\n"
+            "  return a;\n"
+            "}\n"
+            "Main() {\n"
+            "  Print(fib(40));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            fib_body = assembly.split("fib:", 1)[1].split("ret", 1)[0]
+            self.assertNotIn("(%rbp)", fib_body)
+            self.assertNotIn("push %rax", fib_body)
+
+    def test_constants_fold_and_loop_bounds_hoist(self):
+        source = (
+            "Main() {\n"
+            "  var arr = [1, 2, 3];\n"
+            "  var size = 4 * 1024;\n"
+            "  var i = 0;\n"
+            "  while (i < Len(arr)) {\n"
+            "    Print(arr[i] * size);\n"
+            "    i = i + 1;\n"
+            "  }\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True, opt_level=2)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            self.assertIn("shlq $12", assembly)
+            loop_body = assembly.split("while", 1)[1].split("endwhile", 1)[0]
+            self.assertNotIn("-8(%rax)", loop_body)
+
+    def test_loop_induction_products_are_strength_reduced(self):
+        source = (
+            "Function total(n: int) -> int {\n"
+            "  var s = 0;\n"
+            "  var j = 0;\n"
+            "  while (j < n) {\n"
+            "    s = s + j * 16;\n"
+            "    j = j + 1;\n"
+            "  }\n"
+            "  return s;\n"
+            "}\n"
+            "Main() {\n"
+            "  Print(total(10));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True, opt_level=2)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            body = assembly.split("total:", 1)[1].split("ret", 1)[0]
+            loop = body.split("while", 2)[2].split("endwhile", 1)[0]
+            self.assertIn("addq $16", loop)
+            self.assertNotIn("imulq", loop)
+            self.assertNotIn("shlq", loop)
+            self.assertNotIn("setl", loop)
+
+    def test_unroll_replicates_counted_loop_body(self):
+        source = (
+            "Main() {\n"
+            "  var x = 0;\n"
+            "  for i in 1..100 {\n"
+            "    x = x + i;\n"
+            "  }\n"
+            "  Print(x);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True, unroll=4)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_loop = assembly.split(".Lwhile1:", 1)[1].split(".Lendwhile2:", 1)[0]
+            self.assertEqual(main_loop.count("incq"), 4)
+
+    def test_bounds_checks_dropped_in_len_bounded_loop(self):
+        source = (
+            "Function total(arr: array) -> int {\n"
+            "  var t = 0;\n"
+            "  for i in 0..Len(arr) - 1 {\n"
+            "    t = t + arr[i];\n"
+            "  }\n"
+            "  return t + arr[0];\n"
+            "}\n"
+            "Main() {\n"
+            "  var arr = Array(4);\n"
+            "  Print(total(arr));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            body = out_path.read_text().split("total:", 1)[1].split("ret", 1)[0]
+            # Only the access after the loop keeps its check
+            self.assertEqual(body.count("call vyl_bounds_fail"), 1)
+
+    @unittest.skipUnless(shutil.which("gcc"), "gcc not installed")
+    def test_pop_inside_a_callee_keeps_len_bound_and_checks(self):
+        source = (
+            "Function shrink(a: array) -> int {\n"
+            "  var x = Pop(a);\n"
+            "  return x;\n"
+            "}\n"
+            "Main() {\n"
+            "  var arr = Array(0);\n"
+            "  for k in 1..10 {\n"
+            "    arr = Push(arr, k);\n"
+            "  }\n"
+            "  var total = 0;\n"
+            "  for i in 0..Len(arr) - 1 {\n"
+            "    shrink(arr);\n"
+            "    total = total + arr[i];\n"
+            "  }\n"
+            "  Print(total);\n"
+            "  Print(Len(arr));\n"
+            "}\n"
+        )
+        # Each iteration pops one element, so the loop stops halfway
+        for opt_level in (0, 1, 2):
+            with tempfile.TemporaryDirectory() as tmpdir:
+                exe_path = Path(tmpdir) / "program"
+                with contextlib.redirect_stdout(io.StringIO()):
+                    success = self.main_mod.compile_vyl(source, str(exe_path), opt_level=opt_level)
+                self.assertTrue(success)
+                result = subprocess.run([str(exe_path)], capture_output=True, text=True, timeout=30)
+                self.assertEqual((result.returncode, result.stdout), (0, "15\n5\n"), f"-O{opt_level}")
+
+    def test_failing_range_check_keeps_earlier_output(self):
+        source = (
+            "Main() {\n"
+            "  var a = Array(3);\n"
+            "  for i in 0..Len(a) {\n"
+            "    Print(i);\n"
+            "    a[i] = 1;\n"
+            "  }\n"
+            "}\n"
+        )
+        # The last iteration is out of bounds; everything printed before it stays
+        outputs = []
+        for opt_level in (0, 1):
+            with tempfile.TemporaryDirectory() as tmpdir:
+                exe_path = Path(tmpdir) / "program"
+                with contextlib.redirect_stdout(io.StringIO()):
+                    self.assertTrue(self.main_mod.compile_vyl(source, str(exe_path), opt_level=opt_level))
+                result = subprocess.run([str(exe_path)], capture_output=True, text=True, timeout=30)
+                outputs.append((result.returncode, result.stdout))
+        self.assertEqual(outputs[0], (1, "0\n1\n2\n3\n"))
+        self.assertEqual(outputs[1], outputs[0])
+
+    def test_unchecked_block_skips_bounds_checks(self):
+        source = (
+            "Main() {\n"
+            "  var arr = Array(4);\n"
+            "  @unchecked {\n"
+            "    arr[1] = 7;\n"
+            "    Print(arr[1]);\n"
+            "  }\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True, opt_level=0)
+            self.assertTrue(success)
+            main_body = out_path.read_text().split("Main:", 1)[1].split("ret", 1)[0]
+            self.assertNotIn("vyl_bounds_fail", main_body)
+
+    def test_runtime_uses_size_class_heap(self):
+        source = (
+            "Main() {\n"
+            "  var int p = Alloc(40);\n"
+            "  Free(p);\n"
+            "  GC();\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_body = assembly.split("Main:", 1)[1].split("ret", 1)[0]
+            self.assertIn("call vyl_free", main_body)
+            self.assertNotIn("malloc", assembly.split("vyl_alloc:", 1)[1].split("ret", 1)[0])
+            # Interior pointers resolve through the page map, not a list walk
+            find_body = assembly.split("vyl_gc_find:", 1)[1].split("ret", 1)[0]
+            self.assertIn("vyl_page_map(%rip)", find_body)
+            self.assertNotIn("call", find_body)
+
+    def test_arena_block_scopes_allocations(self):
+        source = (
+            "Function handle(a: int) -> int {\n"
+            "  @arena(a) {\n"
+            "    var buf = Array(8);\n"
+            "    return 1;\n"
+            "  }\n"
+            "  return 0;\n"
+            "}\n"
+            "Main() {\n"
+            "  var int a = ArenaNew(4096);\n"
+            "  Print(handle(a));\n"
+            "  ArenaReset(a);\n"
+            "  ArenaFree(a);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            body = assembly.split("handle:", 1)[1].split("\nMain:", 1)[0]
+            self.assertEqual(body.count("call vyl_arena_push"), 1)
+            # Both the early return and the block exit leave the scope
+            self.assertEqual(body.count("call vyl_arena_pop"), 2)
+            main_body = assembly.split("Main:", 1)[1].split("ret", 1)[0]
+            self.assertIn("call vyl_arena_reset", main_body)
+
+    def test_strings_carry_length_header(self):
+        source = (
+            "Main() {\n"
+            "  var string s = \"abc\" + \"de\";\n"
+            "  if (s == \"abcde\") { Print(StrLen(s)); }\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            self.assertIn(".quad 5, 5", assembly)
+            main_body = assembly.split("Main:", 1)[1].split("ret", 1)[0]
+            self.assertIn("call vyl_streq", main_body)
+            self.assertNotIn("strlen", main_body)
+            concat_body = assembly.split("vyl_strconcat:", 1)[1].split("\nret", 1)[0]
+            self.assertNotIn("strlen", concat_body)
+            self.assertIn("call memcpy", concat_body)
+
+    @unittest.skipUnless(shutil.which("gcc"), "gcc not installed")
+    def test_substring_is_clamped_to_the_header_length(self):
+        source = (
+            "Main() {\n"
+            "  var s = \"abc\";\n"
+            "  var t = Substring(s, 1, 100);\n"
+            "  Print(\"[\" + t + \"]\");\n"
+            "  Print(Len(t));\n"
+            "  Print(\"[\" + Substring(s, -5, 2) + Substring(s, 7, 2) + \"]\");\n"
+            "  Print(Len(Substring(s, 2, -3)));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            exe_path = Path(tmpdir) / "program"
+            with contextlib.redirect_stdout(io.StringIO()):
+                self.assertTrue(self.main_mod.compile_vyl(source, str(exe_path)))
+            result = subprocess.run([str(exe_path)], capture_output=True, text=True, timeout=30)
+            self.assertEqual((result.returncode, result.stdout), (0, "[bc]2\n[ab]0\n"))
+
+    def test_concat_chain_builds_in_one_allocation(self):
+        source = (
+            "Main() {\n"
+            "  var string user = \"vyl\";\n"
+            "  var int code = 7;\n"
+            "  Print(\"user={user} code={code} next={code + 1}\" + \"!\" + code);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            self.assertEqual(main_body.count("call vyl_str_build"), 1)
+            self.assertEqual(main_body.count("call vyl_itoa"), 3)
+            self.assertNotIn("vyl_strconcat", main_body)
+            self.assertNotIn("sprintf", main_body)
+
+    def test_string_builder_appends_in_place(self):
+        source = (
+            "Main() {\n"
+            "  var int sb = StringBuilder();\n"
+            "  for i in 0..9 {\n"
+            "    AppendInt(sb, i);\n"
+            "    Append(sb, \",\");\n"
+            "  }\n"
+            "  Print(Build(sb));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("call vyl_sb_append_int", main_body)
+            self.assertIn("call vyl_sb_append", main_body)
+            self.assertNotIn("vyl_str_build", main_body)
+            # Growth doubles the capacity instead of resizing per append
+            grow_body = assembly.split("vyl_sb_grow:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("addq %rdi, %rdi", grow_body)
+
+    def test_vec_push_shares_array_layout(self):
+        source = (
+            "Main() {\n"
+            "  var v = Vec(0);\n"
+            "  for i in 0..9 {\n"
+            "    v = Push(v, i);\n"
+            "  }\n"
+            "  Print(v[Len(v) - 1] + Pop(v));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("call vyl_vec_push", main_body)
+            self.assertIn("call vyl_vec_pop", main_body)
+            # Indexing reads the same -8 length header as Array()
+            self.assertIn("cmpq -8(%rdx), %rcx", main_body)
+            grow_body = assembly.split("vyl_vec_grow:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("call memcpy", grow_body)
+
+    def test_map_specializes_on_key_type(self):
+        source = (
+            "Main() {\n"
+            "  var Map<string, int> hits = Map();\n"
+            "  var Map<int, string> names = Map();\n"
+            "  MapSet(hits, \"/\", MapGet(hits, \"/\") + 1);\n"
+            "  MapSet(names, 7, \"seven\");\n"
+            "  Print(MapGet(names, 7));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("call vyl_map_new", main_body)
+            self.assertIn("call vyl_map_set_str", main_body)
+            self.assertIn("call vyl_map_get_str", main_body)
+            self.assertIn("call vyl_map_set_int", main_body)
+            self.assertIn("call vyl_map_get_int", main_body)
+            # A string value prints as a string: no boxing, no conversion
+            self.assertIn("call print_string", main_body)
+            # Only a resize allocates; lookups stay allocation-free
+            get_body = assembly.split("vyl_map_get_str:", 1)[1].split("\nret", 1)[0]
+            self.assertNotIn("vyl_alloc", get_body)
+
+    def test_non_escaping_allocations_use_the_frame(self):
+        source = (
+            "struct P {\n"
+            "  var int x;\n"
+            "  var int y;\n"
+            "}\n"
+            "var P kept;\n"
+            "Function norm(p: P) -> int {\n"
+            "  return p.x * p.x + p.y * p.y;\n"
+            "}\n"
+            "Function keep(p: P) -> int {\n"
+            "  kept = p;\n"
+            "  return 0;\n"
+            "}\n"
+            "Main() {\n"
+            "  var P local = new P{x: 3, y: 4};\n"
+            "  var a, b = (local.x, local.y);\n"
+            "  Print(norm(local) + a + b);\n"
+            "  var P shared = new P{x: 1, y: 2};\n"
+            "  keep(shared);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            # Only the struct handed to keep() (which stores it) is heap allocated
+            self.assertEqual(main_body.count("call vyl_alloc"), 1)
+            self.assertRegex(main_body, r"leaq -\d+\(%rbp\), %rax")
+
+    def test_small_tuples_return_in_registers(self):
+        source = (
+            "Function divmod(a: int, b: int) -> (int, int) {\n"
+            "  var q = a / b;\n"
+            "  return (q, a - q * b);\n"
+            "}\n"
+            "Main() {\n"
+            "  var q, r = divmod(17, 5);\n"
+            "  Print(q * 10 + r);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            divmod_body = assembly.split("divmod:", 1)[1].split("\nret", 1)[0]
+            self.assertNotIn("vyl_alloc", divmod_body)
+            self.assertIn("pop %rax", divmod_body)
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            self.assertNotIn("vyl_alloc", main_body)
+            self.assertRegex(main_body, r"call divmod\nmovq %rax, \S+\nmovq %rdx, ")
+
+    def test_small_calls_inline_and_self_tail_calls_jump(self):
+        source = (
+            "struct Point {\n"
+            "  var int x;\n"
+            "  Function getX() -> int {\n"
+            "    return self.x;\n"
+            "  }\n"
+            "}\n"
+            "Function max(a: int, b: int) -> int {\n"
+            "  if (a > b) {\n"
+            "    return a;\n"
+            "  }\n"
+            "  return b;\n"
+            "}\n"
+            "Function sumTo(n: int, acc: int) -> int {\n"
+            "  if (n == 0) {\n"
+            "    return acc;\n"
+            "  }\n"
+            "  return sumTo(n - 1, acc + n);\n"
+            "}\n"
+            "Main() {\n"
+            "  var Point p = new Point{x: 7};\n"
+            "  Print(max(p.getX(), 3));\n"
+            "  Print(sumTo(1000000, 0));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True, opt_level=2)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            self.assertNotIn("call max", main_body)
+            self.assertNotIn("call Point_getX", main_body)
+            self.assertIn("call sumTo", main_body)
+            sum_body = assembly.split("sumTo:", 1)[1].split("\nret", 1)[0]
+            self.assertNotIn("call sumTo", sum_body)
+            self.assertRegex(sum_body, r"jmp \.Ltail\d+")
+
+    def test_dec_uses_sse_arithmetic_and_float_registers(self):
+        source = (
+            "Function scale(n: int, x: dec) -> dec {\n"
+            "  return Sqrt(x) * n;\n"
+            "}\n"
+            "Main() {\n"
+            "  var dec r = scale(3, 2.25);\n"
+            "  if (r > 4) {\n"
+            "    Print(r / 2);\n"
+            "  }\n"
+            "  Print(ToInt(r));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            scale_body = assembly.split("scale:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("sqrtsd", scale_body)
+            self.assertIn("mulsd", scale_body)
+            self.assertIn("cvtsi2sdq", scale_body)
+            self.assertIn("movq %rax, %xmm0", scale_body)
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            self.assertRegex(main_body, r"movq \d+\(%rsp\), %xmm0\n")
+            self.assertIn("movq %xmm0, %rax", main_body)
+            self.assertIn("ucomisd", main_body)
+            self.assertIn("divsd", main_body)
+            self.assertIn("cvttsd2siq", main_body)
+            self.assertIn("call print_dec", main_body)
+
+    def test_elementwise_loops_vectorize_and_kernels_dispatch_on_cpuid(self):
+        source = (
+            "Main() {\n"
+            "  var int[] a = Array(1000);\n"
+            "  var int[] b = Array(1000);\n"
+            "  var int[] c = Array(1000);\n"
+            "  ArrayFill(a, 3);\n"
+            "  for i in 0..Len(c) - 1 {\n"
+            "    c[i] = a[i] + b[i];\n"
+            "  }\n"
+            "  Print(ArraySum(c));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True, opt_level=2)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("vpaddq (%rax,%rcx,8), %ymm0, %ymm0", main_body)
+            self.assertIn("paddq %xmm1, %xmm0", main_body)
+            self.assertIn("testb $2, vyl_cpu_features(%rip)", main_body)
+            self.assertNotIn("vyl_bounds_fail", main_body.split("vec_avx", 1)[1])
+            self.assertIn("call vyl_fill_i64", main_body)
+            self.assertIn("call vyl_sum_i64", main_body)
+            self.assertIn("call vyl_cpu_init", assembly.split("main:", 1)[1])
+            self.assertIn("xgetbv", assembly)
+
+    def test_print_is_buffered_and_flushed_at_exit(self):
+        source = (
+            "Main() {\n"
+            "  Print(42);\n"
+            "  var int w = BufferedWriter(Open(\"out.txt\", \"w\"));\n"
+            "  BufWriteInt(w, 7);\n"
+            "  CloseWriter(w);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            print_int = assembly.split("print_int:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("call vyl_itoa", print_int)
+            self.assertNotIn("printf", print_int)
+            self.assertIn("call vyl_flush_all", assembly.split("main:", 1)[1].split("syscall", 1)[0])
+            self.assertIn("call vyl_writer_new", assembly)
+            self.assertIn("call vyl_writer_write_int", assembly)
+            self.assertIn("call vyl_writer_close", assembly)
+
+    def test_map_file_and_line_reader_stream_without_reading_whole_file(self):
+        source = (
+            "Main() {\n"
+            "  var string m = MapFile(\"big.log\");\n"
+            "  Print(Len(m));\n"
+            "  var int r = LineReader(Open(\"big.log\", \"r\"));\n"
+            "  while (!ReaderEof(r)) {\n"
+            "    Print(ReadLine(r));\n"
+            "  }\n"
+            "  CloseReader(r);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+            main_body = assembly.split("Main:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("call vyl_map_file", main_body)
+            self.assertIn("call vyl_reader_line", main_body)
+            self.assertNotIn("vyl_read_all", main_body)
+            map_file = assembly.split("vyl_map_file:", 1)[1].split("\nret", 1)[0]
+            self.assertIn("call mmap", map_file)
+            self.assertIn("call madvise", map_file)
+            self.assertIn("call read", assembly.split("vyl_reader_fill:", 1)[1].split("\nret", 1)[0])
+
+    def test_file_helpers_run_in_process_instead_of_a_shell(self):
+        source = (
+            "Main() {\n"
+            "  Print(MkdirP(\"a/b\") + CopyFile(\"x\", \"a/b/x\") + Unzip(\"p.zip\", \"a\") + RemoveAll(\"a\"));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+
+            def routine(name):
+                return assembly.split(f"\n{name}:", 1)[1].split("\n.globl", 1)[0]
+
+            self.assertIn("call copy_file_range", routine("vyl_copy_file"))
+            self.assertIn("call sendfile", routine("vyl_copy_file"))
+            self.assertIn("call unlinkat", routine("vyl_remove_at"))
+            self.assertIn("movl $217, %eax", routine("vyl_remove_at"))
+            self.assertIn("call inflate", routine("vyl_zip_inflate"))
+            for name in ("vyl_copy_file", "vyl_mkdir_p", "vyl_remove_all", "vyl_remove_at", "vyl_unzip"):
+                self.assertNotIn("vyl_system", routine(name))
+            self.assertNotIn("rm -rf", assembly)
+
+    def test_http_client_keeps_connections_alive_and_streams_bodies(self):
+        source = (
+            "Main() {\n"
+            "  var r = HttpOpen(\"example.com\", \"/\", 1);\n"
+            "  var string piece = HttpRead(r);\n"
+            "  Print(HttpStatus(r) + StrLen(piece) + HttpClose(r));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+
+            def routine(name):
+                return assembly.split(f"\n{name}:", 1)[1].split("\n.globl", 1)[0]
+
+            self.assertIn("HTTP/1.1", assembly)
+            self.assertNotIn("HTTP/1.0", assembly)
+            self.assertIn("vyl_http_pool(%rip)", routine("vyl_http_connect"))
+            self.assertIn("vyl_http_pool(%rip)", routine("vyl_http_finish"))
+            self.assertIn("movl $16, %edx", routine("vyl_http_next"))  # chunk sizes are hex
+            self.assertIn("call vyl_http_next", routine("vyl_http_get"))
+            self.assertIn("call vyl_write_fd", routine("vyl_http_download"))
+
+    def test_reconnects_reuse_dns_answers_and_tls_sessions(self):
+        source = (
+            "Main() {\n"
+            "  var t = TlsConnect(\"example.com\", 443);\n"
+            "  Print(TcpConnect(\"example.com\", 80) + TlsClose(t));\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+
+            def routine(name):
+                return assembly.split(f"\n{name}:", 1)[1].split("\n.globl", 1)[0]
+
+            self.assertIn("call vyl_dns_lookup", routine("vyl_tcp_connect_fast"))
+            self.assertEqual(assembly.count("call getaddrinfo"), 2)  # the cache and TcpResolve
+            self.assertIn("movl $1, %edx", routine("vyl_tcp_connect_fast"))  # TCP_NODELAY
+            self.assertIn("movl $30, %edx", routine("vyl_tcp_connect_fast"))  # TCP_FASTOPEN_CONNECT
+            self.assertIn("call SSL_CTX_sess_set_new_cb", routine("vyl_tls_ensure_ctx"))
+            self.assertIn("call SSL_set_session", routine("vyl_tls_connect"))
+            self.assertIn("call vyl_tcp_connect_fast", routine("vyl_tls_connect"))
+
+    @unittest.skipUnless(shutil.which("gcc"), "gcc not installed")
+    def test_async_functions_run_as_tasks_on_the_epoll_loop(self):
+        with socket.socket() as probe:
+            probe.bind(("127.0.0.1", 0))
+            port = probe.getsockname()[1]
+        # The server task blocks in accept and recv while the client connects,
+        # so the exchange only finishes if both wait on the loop
+        source = (
+            "async Function Serve(l: int) -> string {\n"
+            "  var c = TcpAccept(l);\n"
+            "  var msg = TcpRecv(c, 64);\n"
+            "  TcpSend(c, \"echo:\" + msg);\n"
+            "  TcpClose(c);\n"
+            "  return msg;\n"
+            "}\n"
+            "async Function Ask(port: int, text: string) -> string {\n"
+            "  var fd = TcpConnect(\"127.0.0.1\", port);\n"
+            "  TcpSend(fd, text);\n"
+            "  var reply = TcpRecv(fd, 64);\n"
+            "  TcpClose(fd);\n"
+            "  return reply;\n"
+            "}\n"
+            "async Function Noop(x: int) -> int {\n"
+            "  return x;\n"
+            "}\n"
+            "Main() {\n"
+            f"  var l = TcpListen({port});\n"
+            "  var s = Serve(l);\n"
+            f"  var r = Ask({port}, \"ping\");\n"
+            "  Noop(1);\n"
+            "  Print(await r);\n"
+            "  Print(\"|\");\n"
+            "  Print(await s);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            with contextlib.redirect_stdout(io.StringIO()):
+                self.assertTrue(self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True))
+            assembly = out_path.read_text()
+
+            def routine(name):
+                return assembly.split(f"\n{name}:", 1)[1].split("\n.globl", 1)[0]
+
+            self.assertIn("jmp vyl_task_spawn", routine("__async_Serve"))
+            self.assertIn("call vyl_task_detach", routine("Main"))
+            self.assertEqual(routine("Main").count("call vyl_task_await"), 2)
+            self.assertIn("call epoll_wait", routine("vyl_sched_find"))
+
+            exe_path = Path(tmpdir) / "program"
+            with contextlib.redirect_stdout(io.StringIO()):
+                self.assertTrue(self.main_mod.compile_vyl(source, str(exe_path)))
+            result = subprocess.run([str(exe_path)], capture_output=True, text=True, timeout=30)
+            self.assertEqual((result.returncode, result.stdout), (0, "echo:ping|ping"))
+
+    @unittest.skipUnless(shutil.which("gcc"), "gcc not installed")
+    def test_spawn_runs_on_worker_threads_with_channels_and_atomics(self):
+        source = (
+            "Function Produce(ch: Chan<int>, n: int) {\n"
+            "  var i = 1;\n"
+            "  while (i <= n) {\n"
+            "    ChanSend(ch, i);\n"
+            "    i = i + 1;\n"
+            "  }\n"
+            "  ChanClose(ch);\n"
+            "}\n"
+            "Function Count(hits: array, n: int) -> int {\n"
+            "  var i = 0;\n"
+            "  while (i < n) {\n"
+            "    AtomicAdd(hits, 0, 1);\n"
+            "    i = i + 1;\n"
+            "  }\n"
+            "  return n;\n"
+            "}\n"
+            "Main() {\n"
+            "  var hits = Array(1);\n"
+            "  var a = spawn Count(hits, 50000);\n"
+            "  var b = spawn Count(hits, 50000);\n"
+            "  Print(await a + await b);\n"
+            "  Print(AtomicLoad(hits, 0));\n"
+            "  var ch = Chan(4);\n"
+            "  spawn Produce(ch, 100);\n"
+            "  var sum = 0;\n"
+            "  var v = ChanRecv(ch);\n"
+            "  while (v != 0) {\n"
+            "    sum = sum + v;\n"
+            "    v = ChanRecv(ch);\n"
+            "  }\n"
+            "  Print(sum);\n"
+            "  Print(AtomicCas(hits, 0, 100000, 7));\n"
+            "  Print(hits[0]);\n"
+            "}\n"
+        )
+        with tempfile.TemporaryDirectory() as tmpdir:
+            out_path = Path(tmpdir) / "program.s"
+            success = self.main_mod.compile_vyl(source, str(out_path), generate_assembly_only=True)
+            self.assertTrue(success)
+            assembly = out_path.read_text()
+
+            def routine(name):
+                return assembly.split(f"\n{name}:", 1)[1].split("\n.globl", 1)[0]
+
+            self.assertIn("jmp vyl_task_go", routine("__spawn_Count"))
+            self.assertIn("call vyl_task_detach", routine("Main"))
+            self.assertIn("lock xaddq", routine("Count"))
+            self.assertIn("lock cmpxchgq", routine("Main"))
+            self.assertIn("call pthread_create", routine("vyl_sched_start"))
+            self.assertIn("lock cmpxchgq", routine("vyl_chan_try_send"))
+            self.assertIn("leaq vyl_gc_free_lists@tpoff", routine("vyl_alloc"))
+
+            exe_path = Path(tmpdir) / "program"
+            with contextlib.redirect_stdout(io.StringIO()):
+                self.assertTrue(self.main_mod.compile_vyl(source, str(exe_path)))
+            # One worker runs the tasks in turn; several race on hits and the channel
+            for threads in ("1", "4"):
+                result = subprocess.run([str(exe_path)], capture_output=True, text=True, timeout=60,
+                                        env={**os.environ, "VYL_THREADS": threads})
+                self.assertEqual((result.returncode, result.stdout), (0, "100000\n100000\n5050\n1\n7\n"),
+                                 f"VYL_THREADS={threads}")
+
     def test_keystone_emits_bin_when_available(self):
         try:
             import keystone  # type: ignore  # noqa: F401
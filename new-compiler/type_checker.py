@@ -34,6 +34,8 @@ try:
         SelfExpr,
         AddressOf,
         Dereference,
+        AwaitExpr,
+        SpawnExpr,
         NullLiteral,
         TupleLiteral,
         TupleUnpack,
@@ -42,6 +44,7 @@ try:
         TryExpr,
     )
     from .validator import ValidationError
+    from .generics import MAP_KEY_TYPES, chan_elem_type, map_type_args, task_result_type
 except ImportError:  # pragma: no cover
     from parser import (  # type: ignore
         Program,
@@ -71,6 +74,8 @@ except ImportError:  # pragma: no cover
         SelfExpr,
         AddressOf,
         Dereference,
+        AwaitExpr,
+        SpawnExpr,
         NullLiteral,
         TupleLiteral,
         TupleUnpack,
@@ -79,6 +84,7 @@ except ImportError:  # pragma: no cover
         TryExpr,
     )
     from validator import ValidationError  # type: ignore
+    from generics import MAP_KEY_TYPES, chan_elem_type, map_type_args, task_result_type  # type: ignore
 
 TypeEnv = Dict[str, tuple[str, bool]]
 
@@ -86,6 +92,13 @@ NUMERIC = {"int", "dec"}
 BOOL = "bool"
 STRING = "string"
 
+# Map builtins typed against the map's K and V rather than a fixed signature
+MAP_BUILTINS = {"MapSet": 3, "MapGet": 2, "MapHas": 2, "MapDelete": 2, "MapKeys": 1}
+# Channel builtins typed against the T of a Chan<T>
+CHAN_BUILTINS = {"ChanSend": 2, "ChanRecv": 1, "ChanClose": 1, "ChanLen": 1}
+# SIMD array kernels typed against the element type of an int[] or dec[]
+ARRAY_KERNELS = {"ArraySum": 1, "ArrayMin": 1, "ArrayMax": 1, "ArrayFind": 2, "ArrayFill": 2, "ArrayCopy": 2}
+
 # Builtin signatures: name -> (param_types, return_type)
 # param_types can be None to mean "any" for that slot.
 BUILTINS: Dict[str, Tuple[List[Optional[str]], Optional[str]]] = {
@@ -107,6 +120,10 @@ BUILTINS: Dict[str, Tuple[List[Optional[str]], Optional[str]]] = {
     "Exit": (["int"], None),
     "Sleep": (["int"], "int"),
     "Now": ([], "int"),
+    "NowNs": ([], "int"),
+    "Bench": ([STRING, "int"], "int"),
+    "BenchNext": (["int"], BOOL),
+    "BenchReport": (["int"], None),
     "RandInt": ([], "int"),
     "Remove": ([STRING], "int"),
     "MkdirP": ([STRING], "int"),
@@ -128,18 +145,54 @@ BUILTINS: Dict[str, Tuple[List[Optional[str]], Optional[str]]] = {
     "TcpRecv": (["int", "int"], STRING),
     "TcpClose": (["int"], "int"),
     "TcpResolve": ([STRING], STRING),
+    "TcpListen": (["int"], "int"),
+    "TcpAccept": (["int"], "int"),
+    "Yield": ([], "int"),
+    "Chan": (["int"], "Chan"),
+    "AtomicAdd": (["int[]", "int", "int"], "int"),
+    "AtomicLoad": (["int[]", "int"], "int"),
+    "AtomicStore": (["int[]", "int", "int"], None),
+    "AtomicCas": (["int[]", "int", "int", "int"], BOOL),
     "TlsConnect": ([STRING, "int"], "int"),
     "TlsSend": (["int", STRING], "int"),
     "TlsRecv": (["int", "int"], STRING),
     "TlsClose": (["int"], "int"),
     "HttpGet": ([STRING, STRING, "int"], STRING),
     "HttpDownload": ([STRING, STRING, "int", STRING], "int"),
+    "HttpOpen": ([STRING, STRING, "int"], "int"),
+    "HttpStatus": (["int"], "int"),
+    "HttpRead": (["int"], STRING),
+    "HttpClose": (["int"], "int"),
     "Array": (["int"], "array"),
     "Length": (["array"], "int"),
+    "Vec": (["int"], "array"),
+    "Map": ([], "Map"),
+    "MapLen": (["Map"], "int"),
     "Len": ([None], "int"),  # Works on any array type
-    "Sqrt": (["int"], "int"),
+    "ToDec": (["int"], "dec"),
+    "ToInt": (["dec"], "int"),
     "Malloc": (["int"], "int"),
     "Free": (["int"], "int"),
+    "ArenaNew": (["int"], "int"),
+    "ArenaAlloc": (["int", "int"], "int"),
+    "ArenaReset": (["int"], None),
+    "ArenaFree": (["int"], None),
+    "MapFile": ([STRING], STRING),
+    "UnmapFile": ([STRING], "int"),
+    "LineReader": (["int"], "int"),
+    "ReadLine": (["int"], STRING),
+    "ReadChunk": (["int"], STRING),
+    "ReaderEof": (["int"], BOOL),
+    "CloseReader": (["int"], "int"),
+    "BufferedWriter": (["int"], "int"),
+    "BufWrite": (["int", STRING], None),
+    "BufWriteInt": (["int", "int"], None),
+    "CloseWriter": (["int"], "int"),
+    "StringBuilder": ([], "int"),
+    "Append": (["int", STRING], None),
+    "AppendInt": (["int", "int"], None),
+    "Reserve": (["int", "int"], None),
+    "Build": (["int"], STRING),
     "Memcpy": (["int", "int", "int"], "int"),
     "Memset": (["int", "int", "int"], "int"),
 }
@@ -203,12 +256,26 @@ def _register_function(funcs: Dict[str, FunctionDef], func: FunctionDef) -> None
     funcs[func.name] = func
 
 
+def _check_async_signature(func: FunctionDef, spawn: Optional[SpawnExpr] = None) -> None:
+    """Tasks start from six integer registers and hand back one word."""
+    kind, at = ("spawned", spawn) if spawn else ("async", func)
+    if func.name == "Main":
+        raise ValidationError(f"Main cannot be {kind}", at.line, at.column)
+    if len(func.params) > 6 or any(ptype == "dec" for _, ptype, _ in func.params):
+        raise ValidationError(f"{kind} function '{func.name}' takes at most 6 non-dec parameters", at.line, at.column)
+    ret = func.return_type or "int"
+    if ret == "dec" or ret.startswith("("):
+        raise ValidationError(f"{kind} function '{func.name}' cannot return '{ret}'", at.line, at.column)
+
+
 def _type_check_function(func: FunctionDef, globals_table: TypeEnv, functions: Dict[str, FunctionDef], structs: Dict[str, StructDef], enums: Dict[str, EnumDef]) -> None:
     locals_table: TypeEnv = {}
     for pname, ptype, pdefault in func.params:
         if pname in locals_table:
             raise ValidationError(f"Duplicate parameter '{pname}'", func.line, func.column)
         locals_table[pname] = (ptype or "int", True)
+    if func.is_async:
+        _check_async_signature(func)
 
     for stmt in func.body.statements if func.body else []:
         _type_check_statement(stmt, globals_table, locals_table, functions, structs, enums, func_ret=func.return_type or None)
@@ -294,7 +361,7 @@ def _type_check_statement(stmt, globals_table: TypeEnv, locals_table: TypeEnv, f
             _ensure_assignable(target_type, val_type, stmt.line, stmt.column)
     elif isinstance(stmt, FunctionCall):
         _type_of_expression(stmt, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
-    elif isinstance(stmt, MethodCall):
+    elif isinstance(stmt, (MethodCall, SpawnExpr)):
         _type_of_expression(stmt, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
     elif isinstance(stmt, IfStmt):
         cond_t = _type_of_expression(stmt.condition, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
@@ -318,6 +385,9 @@ def _type_check_statement(stmt, globals_table: TypeEnv, locals_table: TypeEnv, f
         # Type-check the deferred body in the current scope
         _type_check_statement(stmt.body, globals_table, dict(locals_table), functions, structs, enums, func_ret, in_method, current_struct)
     elif isinstance(stmt, Block):
+        if stmt.arena is not None:
+            arena_t = _type_of_expression(stmt.arena, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+            _ensure_assignable("int", arena_t, stmt.arena.line, stmt.arena.column)
         scope_locals = dict(locals_table)
         for inner in stmt.statements:
             _type_check_statement(inner, globals_table, scope_locals, functions, structs, enums, func_ret, in_method, current_struct)
@@ -361,6 +431,19 @@ def _type_of_expression(expr, globals_table: TypeEnv, locals_table: TypeEnv, fun
         if not t.startswith("*"):
             raise ValidationError(f"Cannot dereference non-pointer type '{t}'", expr.line, expr.column)
         return t[1:]  # remove leading *
+    if isinstance(expr, AwaitExpr):
+        t = _type_of_expression(expr.operand, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+        result = task_result_type(t)
+        if result is None:
+            _ensure_assignable("int", t, expr.operand.line, expr.operand.column)  # an untyped handle
+        return result or "int"
+    if isinstance(expr, SpawnExpr):
+        call = expr.operand
+        if call.name not in functions:
+            raise ValidationError(f"spawn needs a user function, got '{call.name}'", expr.line, expr.column)
+        _check_async_signature(functions[call.name], expr)
+        t = _type_of_expression(call, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+        return t if task_result_type(t) else f"Task<{t}>"
     if isinstance(expr, UnaryExpr):
         t = _type_of_expression(expr.operand, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
         if expr.operator in ('-', '+'):
@@ -423,6 +506,95 @@ def _type_of_expression(expr, globals_table: TypeEnv, locals_table: TypeEnv, fun
                 arg_t = _type_of_expression(arg, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
                 _ensure_assignable(STRING, arg_t, arg.line, arg.column)
             return "int"
+        if expr.name == "Flush":
+            if len(expr.arguments) > 1:
+                raise ValidationError(f"Function 'Flush' expects 0 or 1 args, got {len(expr.arguments)}", expr.line, expr.column)
+            for arg in expr.arguments:
+                arg_t = _type_of_expression(arg, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+                _ensure_assignable("int", arg_t, arg.line, arg.column)
+            return None
+        if expr.name == "Sqrt":
+            if len(expr.arguments) != 1:
+                raise ValidationError(f"Function 'Sqrt' expects 1 args, got {len(expr.arguments)}", expr.line, expr.column)
+            arg_t = _type_of_expression(expr.arguments[0], globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+            _require_numeric(arg_t, expr.arguments[0].line, expr.arguments[0].column)
+            return arg_t  # integer floor root of an int, the real root of a dec
+        if expr.name in ("Push", "Pop"):
+            expected_args = 2 if expr.name == "Push" else 1
+            if len(expr.arguments) != expected_args:
+                raise ValidationError(f"Function '{expr.name}' expects {expected_args} args, got {len(expr.arguments)}", expr.line, expr.column)
+            vec_t = _type_of_expression(expr.arguments[0], globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+            if vec_t != "array" and not vec_t.endswith("[]"):
+                raise ValidationError(f"Function '{expr.name}' requires an array, got '{vec_t}'", expr.line, expr.column)
+            elem_t = vec_t[:-2] if vec_t.endswith("[]") else "int"
+            if expr.name == "Pop":
+                return elem_t
+            value = expr.arguments[1]
+            value_t = _type_of_expression(value, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+            _ensure_assignable(elem_t, value_t, value.line, value.column)
+            return vec_t
+        if expr.name in ARRAY_KERNELS:
+            expected_args = ARRAY_KERNELS[expr.name]
+            if len(expr.arguments) != expected_args:
+                raise ValidationError(f"Function '{expr.name}' expects {expected_args} args, got {len(expr.arguments)}", expr.line, expr.column)
+            arr_t = _type_of_expression(expr.arguments[0], globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+            elem_t = arr_t[:-2] if arr_t.endswith("[]") else ("int" if arr_t == "array" else None)
+            if elem_t not in NUMERIC:
+                raise ValidationError(f"Function '{expr.name}' requires an int or dec array, got '{arr_t}'", expr.line, expr.column)
+            if expected_args > 1:
+                other = expr.arguments[1]
+                other_t = _type_of_expression(other, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+                _ensure_assignable(arr_t if expr.name == "ArrayCopy" else elem_t, other_t, other.line, other.column)
+            if expr.name in ("ArraySum", "ArrayMin", "ArrayMax"):
+                return elem_t
+            return "int"
+        if expr.name in MAP_BUILTINS:
+            expected_args = MAP_BUILTINS[expr.name]
+            if len(expr.arguments) != expected_args:
+                raise ValidationError(f"Function '{expr.name}' expects {expected_args} args, got {len(expr.arguments)}", expr.line, expr.column)
+            map_t = _type_of_expression(expr.arguments[0], globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+            args = map_type_args(map_t)
+            if args is None and map_t != "Map":
+                raise ValidationError(f"Function '{expr.name}' requires a Map, got '{map_t}'", expr.line, expr.column)
+            key_t, value_t = args or (None, "int")
+            if key_t is not None and key_t not in MAP_KEY_TYPES:
+                raise ValidationError(f"Map keys must be int or string, got '{key_t}'", expr.line, expr.column)
+            if expected_args > 1:
+                key = expr.arguments[1]
+                actual_key_t = _type_of_expression(key, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+                _ensure_assignable(key_t or actual_key_t, actual_key_t, key.line, key.column)
+                key_t = key_t or actual_key_t
+            if expr.name == "MapSet":
+                value = expr.arguments[2]
+                actual_value_t = _type_of_expression(value, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+                _ensure_assignable(value_t, actual_value_t, value.line, value.column)
+                return "int"
+            if expr.name == "MapGet":
+                return value_t
+            if expr.name == "MapHas":
+                return BOOL
+            if expr.name == "MapKeys":
+                return (key_t or "int") + "[]"
+            return "int"
+        if expr.name in CHAN_BUILTINS:
+            expected_args = CHAN_BUILTINS[expr.name]
+            if len(expr.arguments) != expected_args:
+                raise ValidationError(f"Function '{expr.name}' expects {expected_args} args, got {len(expr.arguments)}", expr.line, expr.column)
+            chan_t = _type_of_expression(expr.arguments[0], globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+            elem_t = chan_elem_type(chan_t)
+            if elem_t is None and chan_t != "Chan":
+                raise ValidationError(f"Function '{expr.name}' requires a Chan, got '{chan_t}'", expr.line, expr.column)
+            elem_t = elem_t or "int"
+            if elem_t.startswith("("):
+                raise ValidationError(f"Channels carry one word, not '{elem_t}'", expr.line, expr.column)
+            if expr.name == "ChanSend":
+                value = expr.arguments[1]
+                value_t = _type_of_expression(value, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
+                _ensure_assignable(elem_t, value_t, value.line, value.column)
+                return BOOL
+            if expr.name == "ChanRecv":
+                return elem_t
+            return "int"
         if expr.name in BUILTINS:
             sig_params, sig_ret = BUILTINS[expr.name]
             if len(sig_params) == 1 and sig_params[0] is None:
@@ -445,6 +617,8 @@ def _type_of_expression(expr, globals_table: TypeEnv, locals_table: TypeEnv, fun
             arg_t = _type_of_expression(arg, globals_table, locals_table, functions, structs, enums, in_method, current_struct)
             expected = ptype or "int"
             _ensure_assignable(expected, arg_t, arg.line, arg.column)
+        if fn.is_async:
+            return f"Task<{fn.return_type or 'int'}>"
         return fn.return_type or "int"
     if isinstance(expr, FieldAccess):
         # Check if receiver is an enum (e.g., Status.OK)
@@ -516,9 +690,21 @@ def _ensure_assignable(expected: str, actual: str, line: int, col: int) -> None:
     # simple numeric widening
     if expected == 'dec' and actual == 'int':
         return
+    # untyped arrays from Array()/Vec() can seed a typed array
+    if expected.endswith('[]') and actual == 'array':
+        return
+    # likewise an untyped Map() seeds any Map<K, V>, and a typed map fits a Map parameter
+    if (map_type_args(expected) and actual == 'Map') or (expected == 'Map' and map_type_args(actual)):
+        return
+    # and an untyped Chan() any Chan<T>
+    if chan_elem_type(expected) and actual == 'Chan':
+        return
     # null can be assigned to any pointer type
     if expected.startswith('*') and actual == '*void':
         return
+    # a task handle is an int: it can be stored in int slots and awaited later
+    if expected == 'int' and task_result_type(actual):
+        return
     # enum comparison
     if expected == actual:
         return
@@ -527,6 +713,9 @@ def _ensure_assignable(expected: str, actual: str, line: int, col: int) -> None:
 
 def _ensure_same(t1: str, t2: str, line: int, col: int) -> None:
     if t1 != t2:
+        # ints compare against decs by value
+        if {t1, t2} == NUMERIC:
+            return
         # Allow null comparison with pointers
         if (t1.startswith('*') and t2 == '*void') or (t2.startswith('*') and t1 == '*void'):
             return
@@ -39,6 +39,8 @@ try:
         SelfExpr,
         AddressOf,
         Dereference,
+        AwaitExpr,
+        SpawnExpr,
         NullLiteral,
         TupleLiteral,
         TupleUnpack,
@@ -74,6 +76,8 @@ except ImportError:
         SelfExpr,
         AddressOf,
         Dereference,
+        AwaitExpr,
+        SpawnExpr,
         NullLiteral,
         TupleLiteral,
         TupleUnpack,
@@ -101,6 +105,10 @@ BUILTIN_FUNCTIONS: Set[str] = {
     "Exit",
     "Sleep",
     "Now",
+    "NowNs",
+    "Bench",
+    "BenchNext",
+    "BenchReport",
     "RandInt",
     "Remove",
     "TcpConnect",
@@ -108,15 +116,33 @@ BUILTIN_FUNCTIONS: Set[str] = {
     "TcpRecv",
     "TcpClose",
     "TcpResolve",
+    "TcpListen",
+    "TcpAccept",
+    "Yield",
+    "Chan",
+    "ChanSend",
+    "ChanRecv",
+    "ChanClose",
+    "ChanLen",
+    "AtomicAdd",
+    "AtomicLoad",
+    "AtomicStore",
+    "AtomicCas",
     "TlsConnect",
     "TlsSend",
     "TlsRecv",
     "TlsClose",
     "HttpGet",
     "HttpDownload",
+    "HttpOpen",
+    "HttpStatus",
+    "HttpRead",
+    "HttpClose",
     "Array",
     "Length",
     "Sqrt",
+    "ToDec",
+    "ToInt",
     "MkdirP",
     "RemoveAll",
     "CopyFile",
@@ -126,6 +152,43 @@ BUILTIN_FUNCTIONS: Set[str] = {
     "CloseDir",
     "Alloc",
     "Free",
+    "ArenaNew",
+    "ArenaAlloc",
+    "ArenaReset",
+    "ArenaFree",
+    "MapFile",
+    "UnmapFile",
+    "LineReader",
+    "ReadLine",
+    "ReadChunk",
+    "ReaderEof",
+    "CloseReader",
+    "Flush",
+    "BufferedWriter",
+    "BufWrite",
+    "BufWriteInt",
+    "CloseWriter",
+    "StringBuilder",
+    "Append",
+    "AppendInt",
+    "Reserve",
+    "Build",
+    "Vec",
+    "Push",
+    "Pop",
+    "Map",
+    "MapSet",
+    "MapGet",
+    "MapHas",
+    "MapDelete",
+    "MapLen",
+    "MapKeys",
+    "ArraySum",
+    "ArrayMin",
+    "ArrayMax",
+    "ArrayFind",
+    "ArrayFill",
+    "ArrayCopy",
     "StrConcat",
     "StrLen",
     "StrFind",
@@ -174,7 +237,7 @@ def validate_program(program: Program) -> None:
             _collect_identifiers(node.operand)
         elif isinstance(node, AddressOf):
             _collect_identifiers(node.operand)
-        elif isinstance(node, Dereference):
+        elif isinstance(node, (Dereference, AwaitExpr, SpawnExpr)):
             _collect_identifiers(node.operand)
         elif isinstance(node, (VarDecl, Assignment, ReturnStmt)) and getattr(node, 'value', None):
             _collect_identifiers(node.value)
@@ -195,6 +258,8 @@ def validate_program(program: Program) -> None:
             for inner in (node.body.statements if node.body else []):
                 _collect_identifiers(inner)
         elif isinstance(node, Block):
+            if node.arena is not None:
+                _collect_identifiers(node.arena)
             for inner in node.statements:
                 _collect_identifiers(inner)
 
@@ -299,7 +364,7 @@ def _collect_locals_refs(node, refs: Set[str]) -> None:
     elif isinstance(node, BinaryExpr):
         _collect_locals_refs(node.left, refs)
         _collect_locals_refs(node.right, refs)
-    elif isinstance(node, UnaryExpr):
+    elif isinstance(node, (UnaryExpr, AwaitExpr, SpawnExpr)):
         _collect_locals_refs(node.operand, refs)
     elif hasattr(node, "receiver") and hasattr(node, "index"):
         _collect_locals_refs(node.receiver, refs)
@@ -323,6 +388,8 @@ def _collect_locals_refs(node, refs: Set[str]) -> None:
         for inner in (node.body.statements if node.body else []):
             _collect_locals_refs(inner, refs)
     elif isinstance(node, Block):
+        if node.arena is not None:
+            _collect_locals_refs(node.arena, refs)
         for inner in node.statements:
             _collect_locals_refs(inner, refs)
 
@@ -354,7 +421,7 @@ def _validate_statement(stmt, globals_table: Dict[str, tuple[str, bool]], locals
         _validate_expression(stmt.value, globals_table, locals_table, functions, enums, in_method)
     elif isinstance(stmt, FunctionCall):
         _validate_expression(stmt, globals_table, locals_table, functions, enums, in_method)
-    elif isinstance(stmt, MethodCall):
+    elif isinstance(stmt, (MethodCall, AwaitExpr, SpawnExpr)):
         _validate_expression(stmt, globals_table, locals_table, functions, enums, in_method)
     elif isinstance(stmt, IfStmt):
         _validate_expression(stmt.condition, globals_table, locals_table, functions, enums, in_method)
@@ -374,6 +441,8 @@ def _validate_statement(stmt, globals_table: Dict[str, tuple[str, bool]], locals
         # Validate the deferred body in the current scope
         _validate_statement(stmt.body, globals_table, dict(locals_table), functions, enums, in_function, in_method)
     elif isinstance(stmt, Block):
+        if stmt.arena is not None:
+            _validate_expression(stmt.arena, globals_table, locals_table, functions, enums, in_method)
         scope_locals = dict(locals_table)
         saw_return = False
         for inner in stmt.statements:
@@ -416,7 +485,7 @@ def _validate_expression(expr, globals_table: Dict[str, tuple[str, bool]], local
         return
     elif isinstance(expr, AddressOf):
         _validate_expression(expr.operand, globals_table, locals_table, functions, enums, in_method)
-    elif isinstance(expr, Dereference):
+    elif isinstance(expr, (Dereference, AwaitExpr, SpawnExpr)):
         _validate_expression(expr.operand, globals_table, locals_table, functions, enums, in_method)
     elif isinstance(expr, BinaryExpr):
         _validate_expression(expr.left, globals_table, locals_table, functions, enums, in_method)